@@ -7,6 +7,8 @@
 
 #include "board_init.h"
 #include "cmsis_utils.h"
+#include "dns_cache.h"
+#include "logging.h"
 #include "screen.h"
 #include "sntp_client.h"
 
@@ -31,6 +33,13 @@ void azure_thread_entry(ULONG parameter)
 
     printf("Starting Azure thread\r\n\r\n");
 
+    // Start draining the core logs, until then they are printed by the caller
+    status = logging_start();
+    if (status != NX_SUCCESS)
+    {
+        printf("Failed to start logging (0x%02x)\r\n", status);
+    }
+
     if (platform_init(WIFI_SSID, WIFI_PASSWORD, WIFI_MODE) != NX_SUCCESS)
     {
         printf("Failed to initialize platform.\r\n");
@@ -38,6 +47,13 @@ void azure_thread_entry(ULONG parameter)
     }
     screen_print("WiFi ready", L0);
 
+    // Start the DNS cache, lookups still work without it so carry on regardless
+    status = dns_cache_start(&nx_dns_client);
+    if (status != NX_SUCCESS)
+    {
+        printf("Failed to start the DNS cache (0x%02x)\r\n", status);
+    }
+
     // Start the SNTP client
     status = sntp_start();
     if (status != NX_SUCCESS)
@@ -36,53 +36,42 @@ static TX_EVENT_FLAGS_GROUP azure_iot_flags;
 
 static int32_t telemetry_interval = 10;
 
-static UINT append_device_info_properties(NX_AZURE_IOT_JSON_WRITER* json_writer, VOID* context)
+static VOID stage_device_info_properties(REPORTED_PROPERTIES* properties)
 {
-    if (nx_azure_iot_json_writer_append_property_with_string_value(json_writer,
-            (UCHAR*)DEVICE_INFO_MANUFACTURER_PROPERTY_NAME,
-            sizeof(DEVICE_INFO_MANUFACTURER_PROPERTY_NAME) - 1,
-            (UCHAR*)DEVICE_INFO_MANUFACTURER_PROPERTY_VALUE,
-            sizeof(DEVICE_INFO_MANUFACTURER_PROPERTY_VALUE) - 1) ||
-        nx_azure_iot_json_writer_append_property_with_string_value(json_writer,
-            (UCHAR*)DEVICE_INFO_MODEL_PROPERTY_NAME,
-            sizeof(DEVICE_INFO_MODEL_PROPERTY_NAME) - 1,
-            (UCHAR*)DEVICE_INFO_MODEL_PROPERTY_VALUE,
-            sizeof(DEVICE_INFO_MODEL_PROPERTY_VALUE) - 1) ||
-        nx_azure_iot_json_writer_append_property_with_string_value(json_writer,
-            (UCHAR*)DEVICE_INFO_SW_VERSION_PROPERTY_NAME,
-            sizeof(DEVICE_INFO_SW_VERSION_PROPERTY_NAME) - 1,
-            (UCHAR*)DEVICE_INFO_SW_VERSION_PROPERTY_VALUE,
-            sizeof(DEVICE_INFO_SW_VERSION_PROPERTY_VALUE) - 1) ||
-        nx_azure_iot_json_writer_append_property_with_string_value(json_writer,
-            (UCHAR*)DEVICE_INFO_OS_NAME_PROPERTY_NAME,
-            sizeof(DEVICE_INFO_OS_NAME_PROPERTY_NAME) - 1,
-            (UCHAR*)DEVICE_INFO_OS_NAME_PROPERTY_VALUE,
-            sizeof(DEVICE_INFO_OS_NAME_PROPERTY_VALUE) - 1) ||
-        nx_azure_iot_json_writer_append_property_with_string_value(json_writer,
-            (UCHAR*)DEVICE_INFO_PROCESSOR_ARCHITECTURE_PROPERTY_NAME,
-            sizeof(DEVICE_INFO_PROCESSOR_ARCHITECTURE_PROPERTY_NAME) - 1,
-            (UCHAR*)DEVICE_INFO_PROCESSOR_ARCHITECTURE_PROPERTY_VALUE,
-            sizeof(DEVICE_INFO_PROCESSOR_ARCHITECTURE_PROPERTY_VALUE) - 1) ||
-        nx_azure_iot_json_writer_append_property_with_string_value(json_writer,
-            (UCHAR*)DEVICE_INFO_PROCESSOR_MANUFACTURER_PROPERTY_NAME,
-            sizeof(DEVICE_INFO_PROCESSOR_MANUFACTURER_PROPERTY_NAME) - 1,
-            (UCHAR*)DEVICE_INFO_PROCESSOR_MANUFACTURER_PROPERTY_VALUE,
-            sizeof(DEVICE_INFO_PROCESSOR_MANUFACTURER_PROPERTY_VALUE) - 1) ||
-        nx_azure_iot_json_writer_append_property_with_double_value(json_writer,
-            (UCHAR*)DEVICE_INFO_TOTAL_STORAGE_PROPERTY_NAME,
-            sizeof(DEVICE_INFO_TOTAL_STORAGE_PROPERTY_NAME) - 1,
-            DEVICE_INFO_TOTAL_STORAGE_PROPERTY_VALUE,
-            2) ||
-        nx_azure_iot_json_writer_append_property_with_double_value(json_writer,
-            (UCHAR*)DEVICE_INFO_TOTAL_MEMORY_PROPERTY_NAME,
-            sizeof(DEVICE_INFO_TOTAL_MEMORY_PROPERTY_NAME) - 1,
-            DEVICE_INFO_TOTAL_MEMORY_PROPERTY_VALUE,
-            2))
-    {
-        return NX_NOT_SUCCESSFUL;
-    }
-
-    return NX_AZURE_IOT_SUCCESS;
+    reported_properties_set_string(properties,
+        DEVICE_INFO_COMPONENT_NAME,
+        DEVICE_INFO_MANUFACTURER_PROPERTY_NAME,
+        DEVICE_INFO_MANUFACTURER_PROPERTY_VALUE);
+    reported_properties_set_string(properties,
+        DEVICE_INFO_COMPONENT_NAME,
+        DEVICE_INFO_MODEL_PROPERTY_NAME,
+        DEVICE_INFO_MODEL_PROPERTY_VALUE);
+    reported_properties_set_string(properties,
+        DEVICE_INFO_COMPONENT_NAME,
+        DEVICE_INFO_SW_VERSION_PROPERTY_NAME,
+        DEVICE_INFO_SW_VERSION_PROPERTY_VALUE);
+    reported_properties_set_string(properties,
+        DEVICE_INFO_COMPONENT_NAME,
+        DEVICE_INFO_OS_NAME_PROPERTY_NAME,
+        DEVICE_INFO_OS_NAME_PROPERTY_VALUE);
+    reported_properties_set_string(properties,
+        DEVICE_INFO_COMPONENT_NAME,
+        DEVICE_INFO_PROCESSOR_ARCHITECTURE_PROPERTY_NAME,
+        DEVICE_INFO_PROCESSOR_ARCHITECTURE_PROPERTY_VALUE);
+    reported_properties_set_string(properties,
+        DEVICE_INFO_COMPONENT_NAME,
+        DEVICE_INFO_PROCESSOR_MANUFACTURER_PROPERTY_NAME,
+        DEVICE_INFO_PROCESSOR_MANUFACTURER_PROPERTY_VALUE);
+    reported_properties_set_double(properties,
+        DEVICE_INFO_COMPONENT_NAME,
+        DEVICE_INFO_TOTAL_STORAGE_PROPERTY_NAME,
+        DEVICE_INFO_TOTAL_STORAGE_PROPERTY_VALUE,
+        2);
+    reported_properties_set_double(properties,
+        DEVICE_INFO_COMPONENT_NAME,
+        DEVICE_INFO_TOTAL_MEMORY_PROPERTY_NAME,
+        DEVICE_INFO_TOTAL_MEMORY_PROPERTY_VALUE,
+        2);
 }
 
 static UINT append_device_telemetry(NX_AZURE_IOT_JSON_WRITER* json_writer, VOID* context)
@@ -137,8 +126,7 @@ static void direct_method_cb(AZURE_IOT_NX_CONTEXT* nx_context,
     USHORT method_length,
     UCHAR* payload,
     USHORT payload_length,
-    VOID* context,
-    USHORT context_length)
+    AZURE_IOT_NX_METHOD_HANDLE method_handle)
 {
     UINT status;
     UINT http_status    = 501;
@@ -154,13 +142,11 @@ static void direct_method_cb(AZURE_IOT_NX_CONTEXT* nx_context,
         http_status = 200;
     }
 
-    if ((status = nx_azure_iot_hub_client_direct_method_message_response(&nx_context->iothub_client,
+    if ((status = azure_iot_nx_client_direct_method_respond(nx_context,
              http_status,
-             context,
-             context_length,
+             method_handle,
              (UCHAR*)http_response,
-             strlen(http_response),
-             NX_WAIT_FOREVER)))
+             strlen(http_response))))
     {
         printf("Direct method response failed! (0x%08x)\r\n", status);
         return;
@@ -271,12 +257,12 @@ UINT azure_iot_nx_client_entry(
         return status;
     }
 
-    // Send out property updates
+    // Stage the property updates and send them as one patch
     azure_iot_nx_client_publish_int_writeable_property(
         &azure_iot_nx_client, TELEMETRY_INTERVAL_PROPERTY, telemetry_interval);
     azure_iot_nx_client_publish_bool_property(&azure_iot_nx_client, LED_STATE_PROPERTY, false);
-    azure_iot_nx_client_publish_properties(
-        &azure_iot_nx_client, DEVICE_INFO_COMPONENT_NAME, append_device_info_properties);
+    stage_device_info_properties(&azure_iot_nx_client.reported_properties);
+    azure_iot_nx_client_reported_properties_flush(&azure_iot_nx_client);
 
     printf("\r\nStarting Main loop\r\n");
 
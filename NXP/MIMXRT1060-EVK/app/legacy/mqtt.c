@@ -19,6 +19,7 @@
 #define TELEMETRY_INTERVAL_EVENT 1
 
 static AZURE_IOT_MQTT azure_iot_mqtt;
+static ULONG azure_iot_mqtt_arena[AZURE_IOT_MQTT_ARENA_SIZE_DEFAULT / sizeof(ULONG)];
 static TX_EVENT_FLAGS_GROUP azure_iot_flags;
 
 static INT telemetry_interval = 10;
@@ -39,7 +40,10 @@ static void set_led_state(bool level)
     }
 }
 
-static void mqtt_direct_method(AZURE_IOT_MQTT* iot_mqtt, CHAR* direct_method_name, CHAR* message)
+static void mqtt_direct_method(AZURE_IOT_MQTT* iot_mqtt,
+    CHAR* direct_method_name,
+    AZURE_IOT_MQTT_METHOD_HANDLE handle,
+    AZURE_IOT_MQTT_MESSAGE* message)
 {
     if (strcmp(direct_method_name, "setLedState") == 0)
     {
@@ -47,12 +51,12 @@ static void mqtt_direct_method(AZURE_IOT_MQTT* iot_mqtt, CHAR* direct_method_nam
 
         // 'false' - turn LED off
         // 'true'  - turn LED on
-        bool arg = (strcmp(message, "true") == 0);
+        bool arg = azure_iot_mqtt_message_equals(message, "true", 4);
 
         set_led_state(arg);
 
         // Return success
-        azure_iot_mqtt_respond_direct_method(iot_mqtt, 200);
+        azure_iot_mqtt_respond_direct_method(iot_mqtt, handle, 200);
 
         // Update device twin property
         azure_iot_mqtt_publish_bool_property(iot_mqtt, LED_STATE_PROPERTY, arg);
@@ -60,25 +64,42 @@ static void mqtt_direct_method(AZURE_IOT_MQTT* iot_mqtt, CHAR* direct_method_nam
     else
     {
         printf("Received direct method=%s is unknown\r\n", direct_method_name);
-        azure_iot_mqtt_respond_direct_method(iot_mqtt, 501);
+        azure_iot_mqtt_respond_direct_method(iot_mqtt, handle, 501);
     }
 }
 
-static void mqtt_c2d_message(AZURE_IOT_MQTT* iot_mqtt, CHAR* properties, CHAR* message)
+static void mqtt_c2d_message(
+    AZURE_IOT_MQTT* iot_mqtt, AZURE_IOT_MQTT_SPAN* properties, AZURE_IOT_MQTT_MESSAGE* message)
 {
-    printf("Received C2D message, properties='%s', message='%s'\r\n", properties, message);
+    AZURE_IOT_MQTT_SPAN chunk;
+    ULONG position = 0;
+
+    // Printed a packet at a time, so messages of any size are shown without a copy
+    printf("Received C2D message, properties='%.*s', message='", (INT)properties->length, properties->ptr);
+    while (azure_iot_mqtt_message_chunk_next(message, &position, &chunk))
+    {
+        printf("%.*s", (INT)chunk.length, chunk.ptr);
+    }
+    printf("'\r\n");
 }
 
-static void mqtt_device_twin_desired_prop(AZURE_IOT_MQTT* iot_mqtt, CHAR* message)
+static void mqtt_device_twin_desired_prop(AZURE_IOT_MQTT* iot_mqtt, AZURE_IOT_MQTT_MESSAGE* message)
 {
+    AZURE_IOT_MQTT_SPAN json;
     jsmn_parser parser;
     jsmntok_t tokens[64];
     INT token_count;
 
+    if (azure_iot_mqtt_message_span_get(message, &json) != NX_SUCCESS)
+    {
+        printf("ERROR: Unable to read device twin document\r\n");
+        return;
+    }
+
     jsmn_init(&parser);
-    token_count = jsmn_parse(&parser, message, strlen(message), tokens, 64);
+    token_count = jsmn_parse(&parser, json.ptr, json.length, tokens, 64);
 
-    if (findJsonInt(message, tokens, token_count, TELEMETRY_INTERVAL_PROPERTY, &telemetry_interval))
+    if (findJsonInt(json.ptr, tokens, token_count, TELEMETRY_INTERVAL_PROPERTY, &telemetry_interval))
     {
         // Set a telemetry event so we pick up the change immediately
         tx_event_flags_set(&azure_iot_flags, TELEMETRY_INTERVAL_EVENT, TX_OR);
@@ -88,16 +109,23 @@ static void mqtt_device_twin_desired_prop(AZURE_IOT_MQTT* iot_mqtt, CHAR* messag
     }
 }
 
-static void mqtt_device_twin_prop(AZURE_IOT_MQTT* iot_mqtt, CHAR* message)
+static void mqtt_device_twin_prop(AZURE_IOT_MQTT* iot_mqtt, AZURE_IOT_MQTT_MESSAGE* message)
 {
+    AZURE_IOT_MQTT_SPAN json;
     jsmn_parser parser;
     jsmntok_t tokens[64];
     INT token_count;
 
+    if (azure_iot_mqtt_message_span_get(message, &json) != NX_SUCCESS)
+    {
+        printf("ERROR: Unable to read device twin document\r\n");
+        return;
+    }
+
     jsmn_init(&parser);
-    token_count = jsmn_parse(&parser, message, strlen(message), tokens, 64);
+    token_count = jsmn_parse(&parser, json.ptr, json.length, tokens, 64);
 
-    if (findJsonInt(message, tokens, token_count, TELEMETRY_INTERVAL_PROPERTY, &telemetry_interval))
+    if (findJsonInt(json.ptr, tokens, token_count, TELEMETRY_INTERVAL_PROPERTY, &telemetry_interval))
     {
         // Set a telemetry event so we pick up the change immediately
         tx_event_flags_set(&azure_iot_flags, TELEMETRY_INTERVAL_EVENT, TX_OR);
@@ -129,7 +157,11 @@ UINT azure_iot_mqtt_entry(NX_IP* ip_ptr, NX_PACKET_POOL* pool_ptr, NX_DNS* dns_p
         IOT_DPS_ID_SCOPE,
         IOT_DPS_REGISTRATION_ID,
         IOT_DEVICE_SAS_KEY,
-        IOT_MODEL_ID);
+        IOT_MODEL_ID,
+        NX_NULL,
+        azure_iot_mqtt_arena,
+        sizeof(azure_iot_mqtt_arena),
+        NX_NULL);
 #else
     // Create Azure MQTT for Hub
     status = azure_iot_mqtt_create(&azure_iot_mqtt,
@@ -140,7 +172,10 @@ UINT azure_iot_mqtt_entry(NX_IP* ip_ptr, NX_PACKET_POOL* pool_ptr, NX_DNS* dns_p
         IOT_HUB_HOSTNAME,
         IOT_HUB_DEVICE_ID,
         IOT_DEVICE_SAS_KEY,
-        IOT_MODEL_ID);
+        IOT_MODEL_ID,
+        azure_iot_mqtt_arena,
+        sizeof(azure_iot_mqtt_arena),
+        NX_NULL);
 #endif
 
     if (status != NXD_MQTT_SUCCESS)
@@ -61,6 +61,17 @@
 
 #define NXD_MQTT_CLOUD_ENABLE
 
+/* DNS record cache, core/src/dns_cache.c reads each answer's TTL from it.  */
+#define NX_DNS_CACHE_ENABLE
+
+/* TLS cipher suite profile, see core/src/azure_iot_ciphersuites.h. The ECDHE profile
+   needs ECC and AEAD support compiled into NetX Secure.  */
+/*
+#define AZURE_IOT_TLS_PROFILE AZURE_IOT_TLS_PROFILE_ECDHE_GCM
+#define NX_SECURE_ENABLE_ECC_CIPHERSUITE
+#define NX_SECURE_ENABLE_AEAD_CIPHER
+*/
+
 /* Define various build options for the NetX Duo port.  The application should either make changes
    here by commenting or un-commenting the conditional compilation defined OR supply the defines
    though the compiler's equivalent of the -D option.  */
@@ -12,6 +12,7 @@
 #include <stdint.h>
 
 // TODO: Move to gateway
+#include "dns_cache.h"
 #include "stm_networking.h"
 
 static int32_t slice_next_char(az_span span, int32_t start, uint8_t c, az_span* slice)
@@ -128,8 +129,7 @@ static az_result get_ip_from_uri(az_span uri, NXD_ADDRESS* ip)
     /* Get the IPv4 for the URI using DNS. */
     char uri_str[50];
     az_span_to_str(uri_str, sizeof(uri_str), uri);
-    UINT status = nxd_dns_host_by_name_get(
-        &nx_dns_client, (UCHAR*)uri_str, ip, NX_IP_PERIODIC_RATE, NX_IP_VERSION_V4);
+    UINT status = dns_cache_resolve(&nx_dns_client, uri_str, ip, NX_IP_PERIODIC_RATE);
     AZ_ULIB_THROW_IF_ERROR((status == NX_SUCCESS), AZ_ERROR_ULIB_SYSTEM);
   }
   AZ_ULIB_CATCH(...) {}
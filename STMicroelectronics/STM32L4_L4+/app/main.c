@@ -8,6 +8,8 @@
 
 #include "board_init.h"
 #include "cmsis_utils.h"
+#include "dns_cache.h"
+#include "logging.h"
 #include "sntp_client.h"
 #include "stm_networking.h"
 
@@ -18,6 +20,7 @@
 
 #include "az_ulib_ipc_api.h"
 #include "az_ulib_dm_api.h"
+#include "az_ulib_registry_api.h"
 
 #define AZURE_THREAD_STACK_SIZE 4096
 #define AZURE_THREAD_PRIORITY   4
@@ -38,6 +41,13 @@ void azure_thread_entry(ULONG parameter)
 
     printf("\r\nStarting Azure thread\r\n\r\n");
 
+    // Start draining the core logs, until then they are printed by the caller
+    status = logging_start();
+    if (status != NX_SUCCESS)
+    {
+        printf("Failed to start logging (0x%02x)\r\n", status);
+    }
+
     // Initialize the network
     if (stm32_network_init(WIFI_SSID, WIFI_PASSWORD, WIFI_MODE) != NX_SUCCESS)
     {
@@ -45,6 +55,13 @@ void azure_thread_entry(ULONG parameter)
         return;
     }
 
+    // Start the DNS cache, lookups still work without it so carry on regardless
+    status = dns_cache_start(&nx_dns_client);
+    if (status != NX_SUCCESS)
+    {
+        printf("Failed to start the DNS cache (0x%02x)\r\n", status);
+    }
+
     // Start the SNTP client
     status = sntp_start();
     if (status != NX_SUCCESS)
@@ -75,6 +92,9 @@ void azure_thread_entry(ULONG parameter)
         return;
     }
 
+    //Start Registry, also holds the DPS assignment between boots.
+    az_ulib_registry_init();
+
 #ifdef ENABLE_LEGACY_MQTT
     if ((status = azure_iot_mqtt_entry(&nx_ip, &nx_pool, &nx_dns_client, sntp_time_get)))
 #else
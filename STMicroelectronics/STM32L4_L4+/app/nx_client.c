@@ -22,6 +22,7 @@
 #include "azure_config.h"
 #include "azure_device_x509_cert_config.h"
 #include "azure_pnp_info.h"
+#include "provisioning_registry.h"
 
 #define IOT_MODEL_ID "dtmi:azurertos:devkit:gsg;2"
 
@@ -35,66 +36,59 @@
 
 #define MAX_SESSIONS_IN_METHOD 5
 
+// Package installs download a blob, run them one at a time and give them longer than other methods
+#define PACKAGE_INSTALL_METHOD "dm.*.packages.1:install"
+#define PACKAGE_INSTALL_TIMEOUT (120 * TX_TIMER_TICKS_PER_SECOND)
+
 static AZURE_IOT_NX_CONTEXT azure_iot_nx_client;
 static TX_EVENT_FLAGS_GROUP azure_iot_flags;
 
 static LONG telemetry_interval = 10;
 
-static UINT append_device_info_properties(NX_AZURE_IOT_JSON_WRITER* json_writer, VOID* context)
+static VOID stage_device_info_properties(REPORTED_PROPERTIES* properties)
 {
-  if (nx_azure_iot_json_writer_append_property_with_string_value(
-          json_writer,
-          (UCHAR*)DEVICE_INFO_MANUFACTURER_PROPERTY_NAME,
-          sizeof(DEVICE_INFO_MANUFACTURER_PROPERTY_NAME) - 1,
-          (UCHAR*)DEVICE_INFO_MANUFACTURER_PROPERTY_VALUE,
-          sizeof(DEVICE_INFO_MANUFACTURER_PROPERTY_VALUE) - 1)
-      || nx_azure_iot_json_writer_append_property_with_string_value(
-          json_writer,
-          (UCHAR*)DEVICE_INFO_MODEL_PROPERTY_NAME,
-          sizeof(DEVICE_INFO_MODEL_PROPERTY_NAME) - 1,
-          (UCHAR*)DEVICE_INFO_MODEL_PROPERTY_VALUE,
-          sizeof(DEVICE_INFO_MODEL_PROPERTY_VALUE) - 1)
-      || nx_azure_iot_json_writer_append_property_with_string_value(
-          json_writer,
-          (UCHAR*)DEVICE_INFO_SW_VERSION_PROPERTY_NAME,
-          sizeof(DEVICE_INFO_SW_VERSION_PROPERTY_NAME) - 1,
-          (UCHAR*)DEVICE_INFO_SW_VERSION_PROPERTY_VALUE,
-          sizeof(DEVICE_INFO_SW_VERSION_PROPERTY_VALUE) - 1)
-      || nx_azure_iot_json_writer_append_property_with_string_value(
-          json_writer,
-          (UCHAR*)DEVICE_INFO_OS_NAME_PROPERTY_NAME,
-          sizeof(DEVICE_INFO_OS_NAME_PROPERTY_NAME) - 1,
-          (UCHAR*)DEVICE_INFO_OS_NAME_PROPERTY_VALUE,
-          sizeof(DEVICE_INFO_OS_NAME_PROPERTY_VALUE) - 1)
-      || nx_azure_iot_json_writer_append_property_with_string_value(
-          json_writer,
-          (UCHAR*)DEVICE_INFO_PROCESSOR_ARCHITECTURE_PROPERTY_NAME,
-          sizeof(DEVICE_INFO_PROCESSOR_ARCHITECTURE_PROPERTY_NAME) - 1,
-          (UCHAR*)DEVICE_INFO_PROCESSOR_ARCHITECTURE_PROPERTY_VALUE,
-          sizeof(DEVICE_INFO_PROCESSOR_ARCHITECTURE_PROPERTY_VALUE) - 1)
-      || nx_azure_iot_json_writer_append_property_with_string_value(
-          json_writer,
-          (UCHAR*)DEVICE_INFO_PROCESSOR_MANUFACTURER_PROPERTY_NAME,
-          sizeof(DEVICE_INFO_PROCESSOR_MANUFACTURER_PROPERTY_NAME) - 1,
-          (UCHAR*)DEVICE_INFO_PROCESSOR_MANUFACTURER_PROPERTY_VALUE,
-          sizeof(DEVICE_INFO_PROCESSOR_MANUFACTURER_PROPERTY_VALUE) - 1)
-      || nx_azure_iot_json_writer_append_property_with_double_value(
-          json_writer,
-          (UCHAR*)DEVICE_INFO_TOTAL_STORAGE_PROPERTY_NAME,
-          sizeof(DEVICE_INFO_TOTAL_STORAGE_PROPERTY_NAME) - 1,
-          DEVICE_INFO_TOTAL_STORAGE_PROPERTY_VALUE,
-          2)
-      || nx_azure_iot_json_writer_append_property_with_double_value(
-          json_writer,
-          (UCHAR*)DEVICE_INFO_TOTAL_MEMORY_PROPERTY_NAME,
-          sizeof(DEVICE_INFO_TOTAL_MEMORY_PROPERTY_NAME) - 1,
-          DEVICE_INFO_TOTAL_MEMORY_PROPERTY_VALUE,
-          2))
-  {
-    return NX_NOT_SUCCESSFUL;
-  }
-
-  return NX_AZURE_IOT_SUCCESS;
+  reported_properties_set_string(
+      properties,
+      DEVICE_INFO_COMPONENT_NAME,
+      DEVICE_INFO_MANUFACTURER_PROPERTY_NAME,
+      DEVICE_INFO_MANUFACTURER_PROPERTY_VALUE);
+  reported_properties_set_string(
+      properties,
+      DEVICE_INFO_COMPONENT_NAME,
+      DEVICE_INFO_MODEL_PROPERTY_NAME,
+      DEVICE_INFO_MODEL_PROPERTY_VALUE);
+  reported_properties_set_string(
+      properties,
+      DEVICE_INFO_COMPONENT_NAME,
+      DEVICE_INFO_SW_VERSION_PROPERTY_NAME,
+      DEVICE_INFO_SW_VERSION_PROPERTY_VALUE);
+  reported_properties_set_string(
+      properties,
+      DEVICE_INFO_COMPONENT_NAME,
+      DEVICE_INFO_OS_NAME_PROPERTY_NAME,
+      DEVICE_INFO_OS_NAME_PROPERTY_VALUE);
+  reported_properties_set_string(
+      properties,
+      DEVICE_INFO_COMPONENT_NAME,
+      DEVICE_INFO_PROCESSOR_ARCHITECTURE_PROPERTY_NAME,
+      DEVICE_INFO_PROCESSOR_ARCHITECTURE_PROPERTY_VALUE);
+  reported_properties_set_string(
+      properties,
+      DEVICE_INFO_COMPONENT_NAME,
+      DEVICE_INFO_PROCESSOR_MANUFACTURER_PROPERTY_NAME,
+      DEVICE_INFO_PROCESSOR_MANUFACTURER_PROPERTY_VALUE);
+  reported_properties_set_double(
+      properties,
+      DEVICE_INFO_COMPONENT_NAME,
+      DEVICE_INFO_TOTAL_STORAGE_PROPERTY_NAME,
+      DEVICE_INFO_TOTAL_STORAGE_PROPERTY_VALUE,
+      2);
+  reported_properties_set_double(
+      properties,
+      DEVICE_INFO_COMPONENT_NAME,
+      DEVICE_INFO_TOTAL_MEMORY_PROPERTY_NAME,
+      DEVICE_INFO_TOTAL_MEMORY_PROPERTY_VALUE,
+      2);
 }
 
 static void direct_method_cb(
@@ -103,8 +97,7 @@ static void direct_method_cb(
     USHORT method_length,
     UCHAR* payload,
     USHORT payload_length,
-    VOID* context,
-    USHORT context_length)
+    AZURE_IOT_NX_METHOD_HANDLE method_handle)
 {
   UINT status;
   UINT http_status;
@@ -213,14 +206,12 @@ static void direct_method_cb(
     (void)result;
   }
 
-  if ((status = nx_azure_iot_hub_client_direct_method_message_response(
-           &nx_context->iothub_client,
+  if ((status = azure_iot_nx_client_direct_method_respond(
+           nx_context,
            http_status,
-           context,
-           context_length,
+           method_handle,
            (UCHAR*)az_span_ptr(http_response),
-           (size_t)az_span_size(http_response),
-           NX_WAIT_FOREVER)))
+           (size_t)az_span_size(http_response))))
   {
     printf("Direct method response failed! (0x%08x)\r\n", status);
     return;
@@ -309,6 +300,7 @@ UINT azure_iot_nx_client_entry(
   }
 
 #ifdef ENABLE_DPS
+    azure_iot_nx_client_provisioning_store_set(&azure_iot_nx_client, &provisioning_registry_store);
     status = azure_iot_nx_client_dps_create(&azure_iot_nx_client, IOT_DPS_ID_SCOPE, IOT_DPS_REGISTRATION_ID);
 #else
     status = azure_iot_nx_client_hub_create(&azure_iot_nx_client, IOT_HUB_HOSTNAME, IOT_HUB_DEVICE_ID);
@@ -321,6 +313,8 @@ UINT azure_iot_nx_client_entry(
 
   // Register the callbacks
   azure_iot_nx_client_register_direct_method(&azure_iot_nx_client, direct_method_cb);
+  azure_iot_nx_client_direct_method_limit_set(
+      &azure_iot_nx_client, PACKAGE_INSTALL_METHOD, 1, PACKAGE_INSTALL_TIMEOUT);
   azure_iot_nx_client_register_device_twin_desired_prop(
       &azure_iot_nx_client, device_twin_desired_property_cb);
   azure_iot_nx_client_register_device_twin_prop(&azure_iot_nx_client, device_twin_property_cb);
@@ -338,12 +332,12 @@ UINT azure_iot_nx_client_entry(
     return status;
   }
 
-  // Send out property updates
+  // Stage the property updates and send them as one patch
   azure_iot_nx_client_publish_int_writeable_property(
       &azure_iot_nx_client, TELEMETRY_INTERVAL_PROPERTY, telemetry_interval);
   azure_iot_nx_client_publish_bool_property(&azure_iot_nx_client, LED_STATE_PROPERTY, false);
-  azure_iot_nx_client_publish_properties(
-      &azure_iot_nx_client, DEVICE_INFO_COMPONENT_NAME, append_device_info_properties);
+  stage_device_info_properties(&azure_iot_nx_client.reported_properties);
+  azure_iot_nx_client_reported_properties_flush(&azure_iot_nx_client);
 
   printf("\r\nReady!\r\n");
 
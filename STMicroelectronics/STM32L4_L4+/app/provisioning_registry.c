@@ -0,0 +1,62 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "provisioning_registry.h"
+
+#include <string.h>
+
+#include "az_ulib_registry_api.h"
+
+#define PROVISIONING_REGISTRY_KEY "dps/assignment"
+
+static UINT registry_load(VOID* context, PROVISIONING_RECORD* record)
+{
+    az_span value;
+
+    if (az_ulib_registry_try_get_value(AZ_SPAN_FROM_STR(PROVISIONING_REGISTRY_KEY), &value) != AZ_OK)
+    {
+        return NX_NOT_FOUND;
+    }
+
+    // A record from a different firmware layout is as good as none
+    if (az_span_size(value) != sizeof(*record))
+    {
+        return NX_NOT_FOUND;
+    }
+
+    memcpy(record, az_span_ptr(value), sizeof(*record));
+
+    return NX_SUCCESS;
+}
+
+static UINT registry_save(VOID* context, const PROVISIONING_RECORD* record)
+{
+    az_span value = az_span_create((uint8_t*)record, sizeof(*record));
+
+    // The registry refuses duplicate keys, replace the previous assignment
+    (void)az_ulib_registry_delete(AZ_SPAN_FROM_STR(PROVISIONING_REGISTRY_KEY));
+
+    if (az_ulib_registry_add(AZ_SPAN_FROM_STR(PROVISIONING_REGISTRY_KEY), value) != AZ_OK)
+    {
+        return NX_NOT_SUCCESSFUL;
+    }
+
+    return NX_SUCCESS;
+}
+
+static UINT registry_erase(VOID* context)
+{
+    if (az_ulib_registry_delete(AZ_SPAN_FROM_STR(PROVISIONING_REGISTRY_KEY)) != AZ_OK)
+    {
+        return NX_NOT_SUCCESSFUL;
+    }
+
+    return NX_SUCCESS;
+}
+
+PROVISIONING_STORE provisioning_registry_store = {
+    .load    = registry_load,
+    .save    = registry_save,
+    .erase   = registry_erase,
+    .context = NX_NULL,
+};
@@ -0,0 +1,12 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _PROVISIONING_REGISTRY_H
+#define _PROVISIONING_REGISTRY_H
+
+#include "provisioning_store.h"
+
+// Keeps the DPS assignment in the flash registry, az_ulib_registry_init must have been called
+extern PROVISIONING_STORE provisioning_registry_store;
+
+#endif // _PROVISIONING_REGISTRY_H
@@ -1,6 +1,8 @@
 /* Copyright (c) Microsoft Corporation.
    Licensed under the MIT License. */
 
+#include "dns_cache.h"
+#include "logging.h"
 #include "networking.h"
 #include "sntp_client.h"
 
@@ -25,6 +27,13 @@ void azure_thread_entry(ULONG thread_input)
 
     printf("\r\nStarting Azure thread\r\n\r\n");
 
+    // Start draining the core logs, until then they are printed by the caller
+    status = logging_start();
+    if (status != NX_SUCCESS)
+    {
+        printf("Failed to start logging (0x%02x)\r\n", status);
+    }
+
     // Initialize the network
     if (network_init(nx_sl_wfx_driver_entry) == false)
     {
@@ -32,6 +41,13 @@ void azure_thread_entry(ULONG thread_input)
         return;
     }
 
+    // Start the DNS cache, lookups still work without it so carry on regardless
+    status = dns_cache_start(&nx_dns_client);
+    if (status != NX_SUCCESS)
+    {
+        printf("Failed to start the DNS cache (0x%02x)\r\n", status);
+    }
+
     // Start the SNTP client
     status = sntp_start();
     if (status != NX_SUCCESS)
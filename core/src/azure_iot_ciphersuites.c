@@ -19,6 +19,18 @@
 #error "X509 must be enabled."
 #endif /* NX_SECURE_DISABLE_X509 */
 
+#if (AZURE_IOT_TLS_PROFILE == AZURE_IOT_TLS_PROFILE_ECDHE_GCM)
+#ifndef NX_SECURE_ENABLE_ECC_CIPHERSUITE
+#error "The ECDHE profile requires NX_SECURE_ENABLE_ECC_CIPHERSUITE."
+#endif /* NX_SECURE_ENABLE_ECC_CIPHERSUITE */
+
+#ifndef NX_SECURE_ENABLE_AEAD_CIPHER
+#error "The ECDHE profile requires NX_SECURE_ENABLE_AEAD_CIPHER."
+#endif /* NX_SECURE_ENABLE_AEAD_CIPHER */
+#elif (AZURE_IOT_TLS_PROFILE != AZURE_IOT_TLS_PROFILE_RSA_CBC)
+#error "Unknown AZURE_IOT_TLS_PROFILE."
+#endif /* AZURE_IOT_TLS_PROFILE */
+
 /* Define supported crypto method. */
 extern NX_CRYPTO_METHOD crypto_method_hmac;
 extern NX_CRYPTO_METHOD crypto_method_hmac_sha256;
@@ -26,6 +38,11 @@ extern NX_CRYPTO_METHOD crypto_method_tls_prf_sha256;
 extern NX_CRYPTO_METHOD crypto_method_sha256;
 extern NX_CRYPTO_METHOD crypto_method_aes_cbc_128;
 extern NX_CRYPTO_METHOD crypto_method_rsa;
+#if (AZURE_IOT_TLS_PROFILE == AZURE_IOT_TLS_PROFILE_ECDHE_GCM)
+extern NX_CRYPTO_METHOD crypto_method_ecdhe;
+extern NX_CRYPTO_METHOD crypto_method_ecdsa;
+extern NX_CRYPTO_METHOD crypto_method_aes_128_gcm_16;
+#endif /* (AZURE_IOT_TLS_PROFILE == AZURE_IOT_TLS_PROFILE_ECDHE_GCM) */
 
 const NX_CRYPTO_METHOD *_nx_azure_iot_tls_supported_crypto[] =
 {
@@ -35,6 +52,11 @@ const NX_CRYPTO_METHOD *_nx_azure_iot_tls_supported_crypto[] =
     &crypto_method_sha256,
     &crypto_method_aes_cbc_128,
     &crypto_method_rsa,
+#if (AZURE_IOT_TLS_PROFILE == AZURE_IOT_TLS_PROFILE_ECDHE_GCM)
+    &crypto_method_ecdhe,
+    &crypto_method_ecdsa,
+    &crypto_method_aes_128_gcm_16,
+#endif /* (AZURE_IOT_TLS_PROFILE == AZURE_IOT_TLS_PROFILE_ECDHE_GCM) */
 };
 
 const UINT _nx_azure_iot_tls_supported_crypto_size = sizeof(_nx_azure_iot_tls_supported_crypto) / sizeof(NX_CRYPTO_METHOD*);
@@ -43,17 +65,34 @@ const UINT _nx_azure_iot_tls_supported_crypto_size = sizeof(_nx_azure_iot_tls_su
 /* Define supported TLS ciphersuites. */
 extern const NX_CRYPTO_CIPHERSUITE nx_crypto_tls_rsa_with_aes_128_cbc_sha256;
 extern const NX_CRYPTO_CIPHERSUITE nx_crypto_x509_rsa_sha_256;
+#if (AZURE_IOT_TLS_PROFILE == AZURE_IOT_TLS_PROFILE_ECDHE_GCM)
+extern const NX_CRYPTO_CIPHERSUITE nx_crypto_tls_ecdhe_ecdsa_with_aes_128_gcm_sha256;
+extern const NX_CRYPTO_CIPHERSUITE nx_crypto_tls_ecdhe_rsa_with_aes_128_gcm_sha256;
+extern const NX_CRYPTO_CIPHERSUITE nx_crypto_x509_ecdsa_sha_256;
+#endif /* (AZURE_IOT_TLS_PROFILE == AZURE_IOT_TLS_PROFILE_ECDHE_GCM) */
 
+/* In order of preference, the server picks the first one it also supports. */
 const NX_CRYPTO_CIPHERSUITE *_nx_azure_iot_tls_ciphersuite_map[] =
 {
 
     /* TLS ciphersuites. */
+#if (AZURE_IOT_TLS_PROFILE == AZURE_IOT_TLS_PROFILE_ECDHE_GCM)
+    &nx_crypto_tls_ecdhe_ecdsa_with_aes_128_gcm_sha256,
+    &nx_crypto_tls_ecdhe_rsa_with_aes_128_gcm_sha256,
+#endif /* (AZURE_IOT_TLS_PROFILE == AZURE_IOT_TLS_PROFILE_ECDHE_GCM) */
     &nx_crypto_tls_rsa_with_aes_128_cbc_sha256,
 
     /* X.509 ciphersuites. */
+#if (AZURE_IOT_TLS_PROFILE == AZURE_IOT_TLS_PROFILE_ECDHE_GCM)
+    &nx_crypto_x509_ecdsa_sha_256,
+#endif /* (AZURE_IOT_TLS_PROFILE == AZURE_IOT_TLS_PROFILE_ECDHE_GCM) */
     &nx_crypto_x509_rsa_sha_256,
 };
 
 const UINT _nx_azure_iot_tls_ciphersuite_map_size = sizeof(_nx_azure_iot_tls_ciphersuite_map) / sizeof(NX_CRYPTO_CIPHERSUITE*);
 
-
+#if (AZURE_IOT_TLS_PROFILE == AZURE_IOT_TLS_PROFILE_ECDHE_GCM)
+const CHAR _nx_azure_iot_tls_profile_name[] = "ECDHE AES-128-GCM";
+#else
+const CHAR _nx_azure_iot_tls_profile_name[] = "RSA AES-128-CBC";
+#endif /* (AZURE_IOT_TLS_PROFILE == AZURE_IOT_TLS_PROFILE_ECDHE_GCM) */
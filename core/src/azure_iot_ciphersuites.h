@@ -14,12 +14,31 @@
 
 #include "nx_secure_tls_api.h"
 
+/* Cipher suite profiles, selected per board with AZURE_IOT_TLS_PROFILE in nx_user.h.
+   AZURE_IOT_TLS_PROFILE_RSA_CBC: TLS_RSA_WITH_AES_128_CBC_SHA256 only.
+   AZURE_IOT_TLS_PROFILE_ECDHE_GCM: ECDHE-ECDSA and ECDHE-RSA with AES-128-GCM, falling back to the
+   RSA suite. Needs NX_SECURE_ENABLE_ECC_CIPHERSUITE and NX_SECURE_ENABLE_AEAD_CIPHER.  */
+#define AZURE_IOT_TLS_PROFILE_RSA_CBC                             0
+#define AZURE_IOT_TLS_PROFILE_ECDHE_GCM                           1
+
+#ifndef AZURE_IOT_TLS_PROFILE
+#define AZURE_IOT_TLS_PROFILE                                     AZURE_IOT_TLS_PROFILE_RSA_CBC
+#endif /* AZURE_IOT_TLS_PROFILE  */
+
 /* Users can use these ciphersuites as sample, and also can build their own ciphersuite
    referring to nx_secure/nx_crypto_generic_ciphersuites.c.  */
 extern const NX_CRYPTO_METHOD *_nx_azure_iot_tls_supported_crypto[];
 extern const UINT _nx_azure_iot_tls_supported_crypto_size;
 extern const NX_CRYPTO_CIPHERSUITE *_nx_azure_iot_tls_ciphersuite_map[];
 extern const UINT _nx_azure_iot_tls_ciphersuite_map_size;
+extern const CHAR _nx_azure_iot_tls_profile_name[];
+
+#if (AZURE_IOT_TLS_PROFILE == AZURE_IOT_TLS_PROFILE_ECDHE_GCM)
+/* Curves offered for ECDHE, each TLS session needs them through nx_secure_tls_ecc_initialize.  */
+extern const USHORT nx_crypto_ecc_supported_groups[];
+extern const NX_CRYPTO_METHOD *nx_crypto_ecc_curves[];
+extern const UINT nx_crypto_ecc_supported_groups_size;
+#endif /* (AZURE_IOT_TLS_PROFILE == AZURE_IOT_TLS_PROFILE_ECDHE_GCM)  */
 
 /* Define the metadata size for _nx_azure_iot_tls_ciphers.  */
 #ifndef NX_AZURE_IOT_TLS_METADATA_BUFFER_SIZE
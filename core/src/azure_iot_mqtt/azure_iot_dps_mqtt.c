@@ -10,73 +10,81 @@
 
 #include "azure_iot_mqtt/sas_token.h"
 
+#include "dns_cache.h"
 #include "json_utils.h"
 
 #define AZURE_IOT_DPS_ENDPOINT "global.azure-devices-provisioning.net"
 
 #define USERNAME               "%s/registrations/%s/api-version=2019-03-31"
-#define DPS_REGISTER_BASE      "$dps/registrations/res"
+#define DPS_REGISTER_BASE      "$dps/registrations/res/"
 #define DPS_REGISTER_SUBSCRIBE "$dps/registrations/res/#"
-#define DPS_REGISTER_TOPIC     "$dps/registrations/PUT/iotdps-register/?$rid=1"
-#define DPS_STATUS_TOPIC       "$dps/registrations/GET/iotdps-get-operationstatus/?$rid=1&operationId="
+#define DPS_REGISTER_TOPIC     "$dps/registrations/PUT/iotdps-register/?$rid=%u"
+#define DPS_STATUS_TOPIC       "$dps/registrations/GET/iotdps-get-operationstatus/?$rid=%u&operationId=%s"
 
 #define MQTT_PRIORITY   2
 #define MQTT_TIMEOUT    (10 * TX_TIMER_TICKS_PER_SECOND)
 #define MQTT_KEEP_ALIVE 240
 
+// Bounds on the retry-after the service asks for
+#define DPS_RETRY_AFTER_DEFAULT_SECS 3
+#define DPS_RETRY_AFTER_MAX_SECS     60
+
 #define EVENT_FLAGS_SUCCESS 1
+#define EVENT_FLAGS_FAILURE 2
+#define EVENT_FLAGS_POLL    4
+#define EVENT_FLAGS_ALL     (EVENT_FLAGS_SUCCESS | EVENT_FLAGS_FAILURE | EVENT_FLAGS_POLL)
 
 extern CHAR* azure_iot_x509_hostname;
 
-static VOID process_retry(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHAR* message)
+static VOID dps_poll_timer_expired(ULONG parameter)
 {
-    UINT status;
+    AZURE_IOT_MQTT* azure_iot_mqtt = (AZURE_IOT_MQTT*)parameter;
+
+    tx_event_flags_set(&azure_iot_mqtt->mqtt_event_flags, EVENT_FLAGS_POLL, TX_OR);
+}
 
+static VOID process_retry(
+    AZURE_IOT_MQTT* azure_iot_mqtt, AZURE_IOT_MQTT_TOPIC_FIELDS* fields, AZURE_IOT_MQTT_SPAN* json)
+{
     jsmn_parser parser;
     jsmntok_t tokens[12];
     INT token_count;
 
-    INT retry_interval;
-    CHAR mqtt_publish_topic[256];
+    UINT retry_after = azure_iot_mqtt_span_to_uint(fields->retry_after);
 
-    CHAR* find = strstr(topic, "retry-after=");
-    if (find == 0)
+    if (retry_after == 0)
     {
-        printf("Error: Unknown retry-after\r\n");
-        return;
+        retry_after = DPS_RETRY_AFTER_DEFAULT_SECS;
+    }
+    else if (retry_after > DPS_RETRY_AFTER_MAX_SECS)
+    {
+        retry_after = DPS_RETRY_AFTER_MAX_SECS;
     }
-
-    // extract retry interval
-    retry_interval = atoi(find + 12);
 
     jsmn_init(&parser);
 
-    token_count = jsmn_parse(&parser,
-        azure_iot_mqtt->mqtt_receive_message_buffer,
-        strlen(azure_iot_mqtt->mqtt_receive_message_buffer),
-        tokens,
-        12);
+    token_count = jsmn_parse(&parser, json->ptr, json->length, tokens, 12);
 
-    strncpy(mqtt_publish_topic, DPS_STATUS_TOPIC, sizeof(mqtt_publish_topic));
-    if (!findJsonString(azure_iot_mqtt->mqtt_receive_message_buffer,
+    if (!findJsonStringN(json->ptr,
             tokens,
             token_count,
             "operationId",
-            mqtt_publish_topic + sizeof(DPS_STATUS_TOPIC) - 1))
+            azure_iot_mqtt->dps_operation_id,
+            sizeof(azure_iot_mqtt->dps_operation_id)))
     {
         printf("ERROR: Failed to parse DPS operationId\r\n");
+        tx_event_flags_set(&azure_iot_mqtt->mqtt_event_flags, EVENT_FLAGS_FAILURE, TX_OR);
+        return;
     }
 
-    tx_thread_sleep(retry_interval * TX_TIMER_TICKS_PER_SECOND);
-
-    status = mqtt_publish(azure_iot_mqtt, mqtt_publish_topic, "{}");
-    if (status != NX_SUCCESS)
-    {
-        printf("ERROR: Failed to poll for DPS status (0x%04x)\r\n", status);
-    }
+    // This runs on the MQTT client thread, leave the wait and the poll to the registering thread
+    printf("DPS registration in progress, polling again in %u seconds\r\n", retry_after);
+    tx_timer_deactivate(&azure_iot_mqtt->dps_poll_timer);
+    tx_timer_change(&azure_iot_mqtt->dps_poll_timer, retry_after * TX_TIMER_TICKS_PER_SECOND, 0);
+    tx_timer_activate(&azure_iot_mqtt->dps_poll_timer);
 }
 
-static VOID process_success(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHAR* message)
+static VOID process_success(AZURE_IOT_MQTT* azure_iot_mqtt, AZURE_IOT_MQTT_SPAN* json)
 {
     jsmn_parser parser;
     jsmntok_t tokens[64];
@@ -84,91 +92,60 @@ static VOID process_success(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHAR* m
 
     jsmn_init(&parser);
 
-    token_count = jsmn_parse(&parser,
-        azure_iot_mqtt->mqtt_receive_message_buffer,
-        strlen(azure_iot_mqtt->mqtt_receive_message_buffer),
-        tokens,
-        64);
+    token_count = jsmn_parse(&parser, json->ptr, json->length, tokens, 64);
 
-    if (!findJsonString(azure_iot_mqtt->mqtt_receive_message_buffer,
-            tokens,
-            token_count,
-            "assignedHub",
-            azure_iot_mqtt->mqtt_hub_hostname))
+    if (!findJsonString(json->ptr, tokens, token_count, "assignedHub", azure_iot_mqtt->mqtt_hub_hostname))
     {
         printf("ERROR: DPS failed to parse hub hostname\r\n");
     }
 
-    if (!findJsonString(azure_iot_mqtt->mqtt_receive_message_buffer,
-            tokens,
-            token_count,
-            "deviceId",
-            azure_iot_mqtt->mqtt_device_id))
+    if (!findJsonString(json->ptr, tokens, token_count, "deviceId", azure_iot_mqtt->mqtt_device_id))
     {
         printf("ERROR: DPS failed to parse device id\r\n");
     }
 }
 
-static VOID mqtt_notify_cb(NXD_MQTT_CLIENT* client_ptr, UINT number_of_messages)
+static VOID process_registration_response(
+    VOID* context, AZURE_IOT_MQTT_TOPIC_FIELDS* fields, AZURE_IOT_MQTT_MESSAGE* message)
 {
-    UINT actual_topic_length;
-    UINT actual_message_length;
-    UINT status;
+    AZURE_IOT_MQTT* azure_iot_mqtt = (AZURE_IOT_MQTT*)context;
+    AZURE_IOT_MQTT_SPAN json;
 
-    AZURE_IOT_MQTT* azure_iot_mqtt = (AZURE_IOT_MQTT*)client_ptr->nxd_mqtt_packet_receive_context;
+    // Parse the response status
+    UINT msg_status = azure_iot_mqtt_span_to_uint(fields->name);
 
-    for (UINT count = 0; count < number_of_messages; ++count)
+    // Only the answer to the latest request counts, anything else is a late reply to an earlier poll
+    if (fields->request_id.length != 0 &&
+        azure_iot_mqtt_span_to_uint(fields->request_id) != azure_iot_mqtt->dps_request_id)
     {
-        // Get the mqtt client message
-        status = nxd_mqtt_client_message_get(client_ptr,
-            (UCHAR*)azure_iot_mqtt->mqtt_receive_topic_buffer,
-            AZURE_IOT_MQTT_TOPIC_NAME_LENGTH,
-            &actual_topic_length,
-            (UCHAR*)azure_iot_mqtt->mqtt_receive_message_buffer,
-            AZURE_IOT_MQTT_MESSAGE_LENGTH,
-            &actual_message_length);
-        if (status != NXD_MQTT_SUCCESS)
-        {
-            printf("ERROR: nxd_mqtt_client_message_get failed (0x%02x)\r\n", status);
-            continue;
-        }
-
-        // Append null string terminators
-        azure_iot_mqtt->mqtt_receive_topic_buffer[actual_topic_length]     = 0;
-        azure_iot_mqtt->mqtt_receive_message_buffer[actual_message_length] = 0;
-
-        if (strstr((CHAR*)azure_iot_mqtt->mqtt_receive_topic_buffer, DPS_REGISTER_BASE) == 0)
-        {
-            printf("ERROR: Unknown incoming DPS topic %s\r\n", (CHAR*)azure_iot_mqtt->mqtt_receive_topic_buffer);
-            continue;
-        }
-
-        // Parse the response status
-        CHAR* location = azure_iot_mqtt->mqtt_receive_topic_buffer + sizeof(DPS_REGISTER_BASE);
-        INT msg_status = atoi(location);
+        printf("Ignoring stale DPS response, rid=%u\r\n", azure_iot_mqtt_span_to_uint(fields->request_id));
+        return;
+    }
 
-        switch (msg_status)
-        {
-            case 202:
-                process_retry(azure_iot_mqtt,
-                    azure_iot_mqtt->mqtt_receive_topic_buffer,
-                    azure_iot_mqtt->mqtt_receive_message_buffer);
-                break;
-
-            case 200:
-                process_success(azure_iot_mqtt,
-                    azure_iot_mqtt->mqtt_receive_topic_buffer,
-                    azure_iot_mqtt->mqtt_receive_message_buffer);
-                tx_event_flags_set(&azure_iot_mqtt->mqtt_event_flags, EVENT_FLAGS_SUCCESS, TX_OR);
-                break;
-
-            default:
-                printf("ERROR: Unknown incoming DPS topic status %d\r\n", msg_status);
-                break;
-        }
+    // jsmn needs the document in one piece
+    if (azure_iot_mqtt_message_span_get(message, &json) != NX_SUCCESS)
+    {
+        printf("ERROR: Unable to read DPS response\r\n");
+        tx_event_flags_set(&azure_iot_mqtt->mqtt_event_flags, EVENT_FLAGS_FAILURE, TX_OR);
+        return;
     }
 
-    return;
+    switch (msg_status)
+    {
+        case 202:
+            process_retry(azure_iot_mqtt, fields, &json);
+            break;
+
+        case 200:
+            process_success(azure_iot_mqtt, &json);
+            tx_event_flags_set(&azure_iot_mqtt->mqtt_event_flags, EVENT_FLAGS_SUCCESS, TX_OR);
+            break;
+
+        default:
+            printf("ERROR: Unknown incoming DPS topic status %d\r\n", msg_status);
+            tx_event_flags_set(&azure_iot_mqtt->mqtt_event_flags, EVENT_FLAGS_FAILURE, TX_OR);
+            break;
+    }
 }
 
 UINT azure_iot_dps_create(AZURE_IOT_MQTT* azure_iot_mqtt, NX_IP* nx_ip, NX_PACKET_POOL* nx_pool)
@@ -182,6 +159,20 @@ UINT azure_iot_dps_create(AZURE_IOT_MQTT* azure_iot_mqtt, NX_IP* nx_ip, NX_PACKE
         return false;
     }
 
+    status = tx_timer_create(&azure_iot_mqtt->dps_poll_timer,
+        "DPS poll timer",
+        dps_poll_timer_expired,
+        (ULONG)azure_iot_mqtt,
+        1,
+        0,
+        TX_NO_ACTIVATE);
+    if (status != TX_SUCCESS)
+    {
+        printf("FAIL: Unable to create DPS poll timer (0x%02x)\r\n", status);
+        tx_event_flags_delete(&azure_iot_mqtt->mqtt_event_flags);
+        return status;
+    }
+
     status = nxd_mqtt_client_create(&azure_iot_mqtt->nxd_mqtt_client,
         "MQTT DPS client",
         azure_iot_mqtt->mqtt_dps_registration_id,
@@ -189,29 +180,36 @@ UINT azure_iot_dps_create(AZURE_IOT_MQTT* azure_iot_mqtt, NX_IP* nx_ip, NX_PACKE
         nx_ip,
         nx_pool,
         azure_iot_mqtt->mqtt_client_stack,
-        AZURE_IOT_MQTT_CLIENT_STACK_SIZE,
+        azure_iot_mqtt->mqtt_buffers.client_stack_size,
         MQTT_PRIORITY,
         NX_NULL,
         0);
     if (status)
     {
         printf("Failed to create MQTT Client (0x%02x)\r\n", status);
+        tx_timer_delete(&azure_iot_mqtt->dps_poll_timer);
         tx_event_flags_delete(&azure_iot_mqtt->mqtt_event_flags);
         return status;
     }
 
-    status = nxd_mqtt_client_receive_notify_set(&azure_iot_mqtt->nxd_mqtt_client, mqtt_notify_cb);
-    if (status)
+    // Share the zero copy receive path with the Hub client
+    azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_packet_receive_notify  = azure_iot_mqtt_packet_receive_notify;
+    azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_packet_receive_context = azure_iot_mqtt;
+
+    // Route registration responses through the same topic router as the Hub client
+    if ((status = azure_iot_mqtt_router_init(&azure_iot_mqtt->mqtt_router)) ||
+        (status = azure_iot_mqtt_router_add(&azure_iot_mqtt->mqtt_router,
+             DPS_REGISTER_BASE,
+             sizeof(DPS_REGISTER_BASE) - 1,
+             process_registration_response)))
     {
-        printf("Error in setting receive notify (0x%02x)\r\n", status);
+        printf("Failed to build DPS topic router (0x%02x)\r\n", status);
+        tx_timer_delete(&azure_iot_mqtt->dps_poll_timer);
         tx_event_flags_delete(&azure_iot_mqtt->mqtt_event_flags);
         nxd_mqtt_client_delete(&azure_iot_mqtt->nxd_mqtt_client);
         return status;
     }
 
-    // Set the receive context (highjacking the packet_receive_context) for callbacks
-    azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_packet_receive_context = azure_iot_mqtt;
-
     return NX_SUCCESS;
 }
 
@@ -223,18 +221,88 @@ UINT azure_iot_dps_delete(AZURE_IOT_MQTT* azure_iot_mqtt)
         return NX_PTR_ERROR;
     }
 
-    tx_event_flags_delete(&azure_iot_mqtt->mqtt_event_flags);
     nxd_mqtt_client_disconnect(&azure_iot_mqtt->nxd_mqtt_client);
+    tx_timer_delete(&azure_iot_mqtt->dps_poll_timer);
+    tx_event_flags_delete(&azure_iot_mqtt->mqtt_event_flags);
     nxd_mqtt_client_delete(&azure_iot_mqtt->nxd_mqtt_client);
 
     return NX_SUCCESS;
 }
 
-UINT azure_iot_dps_register(AZURE_IOT_MQTT* azure_iot_mqtt, UINT wait)
+static UINT dps_publish(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic_format, CHAR* operation_id, CHAR* payload)
+{
+    CHAR mqtt_publish_topic[256];
+
+    // A fresh rid for every request, so a late reply to an earlier one can be told apart
+    azure_iot_mqtt->dps_request_id++;
+
+    snprintf(
+        mqtt_publish_topic, sizeof(mqtt_publish_topic), topic_format, azure_iot_mqtt->dps_request_id, operation_id);
+
+    return mqtt_publish(azure_iot_mqtt, mqtt_publish_topic, payload);
+}
+
+static UINT dps_wait(AZURE_IOT_MQTT* azure_iot_mqtt, ULONG timeout, UINT max_polls)
+{
+    UINT status;
+    ULONG events;
+    ULONG wait;
+    ULONG start = tx_time_get();
+
+    while (true)
+    {
+        wait = timeout;
+        if (timeout != NX_WAIT_FOREVER)
+        {
+            if (tx_time_get() - start >= timeout)
+            {
+                printf("ERROR: DPS registration timed out after %u polls\r\n", azure_iot_mqtt->dps_polls);
+                return NX_NOT_SUCCESSFUL;
+            }
+
+            wait = timeout - (tx_time_get() - start);
+        }
+
+        events = 0;
+        tx_event_flags_get(&azure_iot_mqtt->mqtt_event_flags, EVENT_FLAGS_ALL, TX_OR_CLEAR, &events, wait);
+
+        if (events & EVENT_FLAGS_SUCCESS)
+        {
+            return NX_SUCCESS;
+        }
+
+        if (events & EVENT_FLAGS_FAILURE)
+        {
+            printf("ERROR: DPS registration failed\r\n");
+            return NX_NOT_SUCCESSFUL;
+        }
+
+        if (events & EVENT_FLAGS_POLL)
+        {
+            if (azure_iot_mqtt->dps_polls >= max_polls)
+            {
+                printf("ERROR: DPS registration still not assigned after %u polls\r\n", max_polls);
+                return NX_NOT_SUCCESSFUL;
+            }
+
+            azure_iot_mqtt->dps_polls++;
+
+            status = dps_publish(azure_iot_mqtt, DPS_STATUS_TOPIC, azure_iot_mqtt->dps_operation_id, "{}");
+            if (status != NX_SUCCESS)
+            {
+                printf("ERROR: Failed to poll for DPS status (0x%04x)\r\n", status);
+                return status;
+            }
+        }
+    }
+}
+
+UINT azure_iot_dps_register(AZURE_IOT_MQTT* azure_iot_mqtt, ULONG timeout, UINT max_polls)
 {
     UINT status;
     NXD_ADDRESS server_ip;
     CHAR mqtt_publish_payload[100];
+    const CHAR* password;
 
     printf("\tEndpoint: %s\r\n", AZURE_IOT_DPS_ENDPOINT);
     printf("\tId scope: %s\r\n", azure_iot_mqtt->mqtt_dps_id_scope);
@@ -242,18 +310,19 @@ UINT azure_iot_dps_register(AZURE_IOT_MQTT* azure_iot_mqtt, UINT wait)
 
     // Create the nxd_mqtt_client_secure_connect & password
     snprintf(azure_iot_mqtt->mqtt_username,
-        AZURE_IOT_MQTT_USERNAME_SIZE,
+        azure_iot_mqtt->mqtt_buffers.username_size,
         USERNAME,
         azure_iot_mqtt->mqtt_dps_id_scope,
         azure_iot_mqtt->mqtt_dps_registration_id);
 
-    if (!create_dps_sas_token(azure_iot_mqtt->mqtt_sas_key,
-            strlen(azure_iot_mqtt->mqtt_sas_key),
-            azure_iot_mqtt->mqtt_dps_id_scope,
-            azure_iot_mqtt->mqtt_dps_registration_id,
-            azure_iot_mqtt->unix_time_get(),
-            azure_iot_mqtt->mqtt_password,
-            AZURE_IOT_MQTT_PASSWORD_SIZE))
+    // Registration retries reuse the token while it is still good
+    password = sas_token_cache_get_dps(&azure_iot_mqtt->mqtt_sas_token,
+        azure_iot_mqtt->mqtt_sas_key,
+        strlen(azure_iot_mqtt->mqtt_sas_key),
+        azure_iot_mqtt->mqtt_dps_id_scope,
+        azure_iot_mqtt->mqtt_dps_registration_id,
+        azure_iot_mqtt->unix_time_get());
+    if (password == NX_NULL)
     {
         printf("ERROR: Unable to generate DPS SAS token\r\n");
         return NX_PTR_ERROR;
@@ -262,8 +331,8 @@ UINT azure_iot_dps_register(AZURE_IOT_MQTT* azure_iot_mqtt, UINT wait)
     status = nxd_mqtt_client_login_set(&azure_iot_mqtt->nxd_mqtt_client,
         azure_iot_mqtt->mqtt_username,
         strlen(azure_iot_mqtt->mqtt_username),
-        azure_iot_mqtt->mqtt_password,
-        strlen(azure_iot_mqtt->mqtt_password));
+        (CHAR*)password,
+        strlen(password));
     if (status != NXD_MQTT_SUCCESS)
     {
         printf("Could not set client login (0x%04x)\r\n", status);
@@ -272,11 +341,7 @@ UINT azure_iot_dps_register(AZURE_IOT_MQTT* azure_iot_mqtt, UINT wait)
     }
 
     // Resolve the MQTT server IP address
-    status = nxd_dns_host_by_name_get(azure_iot_mqtt->nx_dns,
-        (UCHAR*)AZURE_IOT_DPS_ENDPOINT,
-        &server_ip,
-        5 * NX_IP_PERIODIC_RATE,
-        NX_IP_VERSION_V4);
+    status = dns_cache_resolve(azure_iot_mqtt->nx_dns, AZURE_IOT_DPS_ENDPOINT, &server_ip, 5 * NX_IP_PERIODIC_RATE);
     if (status != NX_SUCCESS)
     {
         printf("Error: Unable to resolve DNS for DPS MQTT Server %s (0x%04x)\r\n",
@@ -300,6 +365,17 @@ UINT azure_iot_dps_register(AZURE_IOT_MQTT* azure_iot_mqtt, UINT wait)
     {
         printf("Error: Could not connect to DPS MQTT server (0x%04x)\r\n", status);
         nx_secure_tls_session_delete(&azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_tls_session);
+
+        // Rejected credentials are never retried as is
+        if (status == NXD_MQTT_ERROR_BAD_USERNAME_PASSWORD || status == NXD_MQTT_ERROR_NOT_AUTHORIZED)
+        {
+            sas_token_cache_invalidate(&azure_iot_mqtt->mqtt_sas_token);
+        }
+        else
+        {
+            dns_cache_invalidate(AZURE_IOT_DPS_ENDPOINT);
+        }
+
         return status;
     }
 
@@ -321,21 +397,24 @@ UINT azure_iot_dps_register(AZURE_IOT_MQTT* azure_iot_mqtt, UINT wait)
         azure_iot_mqtt->mqtt_model_id);
 
     // Register the device
-    status = mqtt_publish(azure_iot_mqtt, DPS_REGISTER_TOPIC, mqtt_publish_payload);
+    azure_iot_mqtt->dps_polls = 0;
+    tx_event_flags_set(&azure_iot_mqtt->mqtt_event_flags, ~EVENT_FLAGS_ALL, TX_AND);
+
+    status = dps_publish(azure_iot_mqtt, DPS_REGISTER_TOPIC, NX_NULL, mqtt_publish_payload);
     if (status != NX_SUCCESS)
     {
         printf("ERROR: Failed to publish DPS registration (0x%04x)\r\n", status);
+        return status;
     }
 
-    // Wait for an event
-    ULONG events = 0;
-    tx_event_flags_get(
-        &azure_iot_mqtt->mqtt_event_flags, EVENT_FLAGS_SUCCESS, TX_OR_CLEAR, &events, 30 * NX_IP_PERIODIC_RATE);
+    status = dps_wait(azure_iot_mqtt, timeout, max_polls);
+
+    tx_timer_deactivate(&azure_iot_mqtt->dps_poll_timer);
 
-    if (events != EVENT_FLAGS_SUCCESS)
+    if (status != NX_SUCCESS)
     {
         printf("ERROR: Failed to resolve device from DPS\r\n");
-        return NX_NOT_SUCCESSFUL;
+        return status;
     }
 
     return NXD_MQTT_SUCCESS;
@@ -9,8 +9,20 @@
 
 #include "azure_iot_mqtt.h"
 
+// Overall time allowed for registration, including every status poll
+#ifndef AZURE_IOT_DPS_REGISTRATION_TIMEOUT
+#define AZURE_IOT_DPS_REGISTRATION_TIMEOUT (120 * TX_TIMER_TICKS_PER_SECOND)
+#endif
+
+// Operation status polls before giving up
+#ifndef AZURE_IOT_DPS_MAX_POLLS
+#define AZURE_IOT_DPS_MAX_POLLS 20
+#endif
+
 UINT azure_iot_dps_create(AZURE_IOT_MQTT* azure_iot_mqtt, NX_IP* nx_ip, NX_PACKET_POOL* nx_pool);
 UINT azure_iot_dps_delete(AZURE_IOT_MQTT* azure_iot_mqtt);
-UINT azure_iot_dps_register(AZURE_IOT_MQTT* azure_iot_mqtt, UINT wait);
+
+// Blocks the caller for up to timeout ticks, the MQTT client thread is never held up
+UINT azure_iot_dps_register(AZURE_IOT_MQTT* azure_iot_mqtt, ULONG timeout, UINT max_polls);
 
 #endif
\ No newline at end of file
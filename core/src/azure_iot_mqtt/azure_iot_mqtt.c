@@ -14,15 +14,11 @@
 #include "azure_iot_cert.h"
 #include "azure_iot_mqtt/azure_iot_dps_mqtt.h"
 #include "azure_iot_mqtt/sas_token.h"
+#include "dns_cache.h"
+#include "json_utils.h"
+#include "logging.h"
+#include "number_format.h"
 
-#define USERNAME                "%s/%s/?api-version=2020-09-30&model-id=%s"
-#define PUBLISH_TELEMETRY_TOPIC "devices/%s/messages/events/"
-
-#define DEVICE_MESSAGE_BASE  "messages/devicebound/"
-#define DEVICE_MESSAGE_TOPIC "devices/%s/messages/devicebound/#"
-
-#define DEVICE_TWIN_PUBLISH_TOPIC          "$iothub/twin/PATCH/properties/reported/?$rid=%d"
-#define DEVICE_TWIN_REQUEST_TOPIC          "$iothub/twin/GET/?$rid=%d"
 #define DEVICE_TWIN_RES_BASE               "$iothub/twin/res/"
 #define DEVICE_TWIN_RES_TOPIC              "$iothub/twin/res/#"
 #define DEVICE_TWIN_DESIRED_PROP_RES_BASE  "$iothub/twin/PATCH/properties/desired/"
@@ -30,14 +26,26 @@
 
 #define DIRECT_METHOD_RECEIVE  "$iothub/methods/POST/"
 #define DIRECT_METHOD_TOPIC    "$iothub/methods/POST/#"
-#define DIRECT_METHOD_RESPONSE "$iothub/methods/res/%d/?$rid=%s"
 
-#define MQTT_CLIENT_PRIORITY 2
+#define MQTT_CLIENT_PRIORITY     2
+#define MQTT_SUPERVISOR_PRIORITY 4
 #define MQTT_TIMEOUT         (10 * TX_TIMER_TICKS_PER_SECOND)
+#define MQTT_FLUSH_WAIT      TX_TIMER_TICKS_PER_SECOND // Reported properties go out from the supervisor thread
 #define MQTT_KEEP_ALIVE      240
 
+// How often the SAS token is checked against its renewal point
+#define SAS_RENEW_CHECK_TICKS (60 * TX_TIMER_TICKS_PER_SECOND)
+
 CHAR* azure_iot_x509_hostname;
 
+const AZURE_IOT_MQTT_BUFFER_PROFILE azure_iot_mqtt_buffer_profile_default = {
+    AZURE_IOT_MQTT_CLIENT_STACK_SIZE,
+    NX_AZURE_IOT_TLS_METADATA_BUFFER_SIZE,
+    TLS_PACKET_BUFFER,
+    AZURE_IOT_MQTT_CERT_BUFFER_SIZE,
+    AZURE_IOT_MQTT_USERNAME_SIZE,
+};
+
 static ULONG azure_iot_certificate_verify(NX_SECURE_TLS_SESSION* session, NX_SECURE_X509_CERT* certificate)
 {
     UINT status;
@@ -47,7 +55,7 @@ static ULONG azure_iot_certificate_verify(NX_SECURE_TLS_SESSION* session, NX_SEC
         certificate, (UCHAR*)azure_iot_x509_hostname, strlen(azure_iot_x509_hostname));
     if (status)
     {
-        printf("Error in certificate verification: DNS name did not match CN\r\n");
+        LOG_ERROR(LOG_MODULE_MQTT, "Error in certificate verification: DNS name did not match CN");
     }
 
     return status;
@@ -101,6 +109,27 @@ UINT azure_iot_mqtt_register_device_twin_prop_callback(
     return NX_SUCCESS;
 }
 
+UINT azure_iot_mqtt_register_connection_state_callback(
+    AZURE_IOT_MQTT* azure_iot_mqtt, func_ptr_connection_state connection_state_callback)
+{
+    if (azure_iot_mqtt == NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    return connection_supervisor_notify_set(&azure_iot_mqtt->mqtt_supervisor, connection_state_callback);
+}
+
+UINT azure_iot_mqtt_connection_metrics_get(AZURE_IOT_MQTT* azure_iot_mqtt, CONNECTION_SUPERVISOR_METRICS* metrics)
+{
+    if (azure_iot_mqtt == NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    return connection_supervisor_metrics_get(&azure_iot_mqtt->mqtt_supervisor, metrics);
+}
+
 UINT tls_setup(NXD_MQTT_CLIENT* client,
     NX_SECURE_TLS_SESSION* tls_session,
     NX_SECURE_X509_CERT* cert,
@@ -117,50 +146,65 @@ UINT tls_setup(NXD_MQTT_CLIENT* client,
         _nx_azure_iot_tls_ciphersuite_map,
         _nx_azure_iot_tls_ciphersuite_map_size,
         azure_iot_mqtt->tls_metadata_buffer,
-        sizeof(azure_iot_mqtt->tls_metadata_buffer));
+        azure_iot_mqtt->mqtt_buffers.tls_metadata_size);
     if (status != NX_SUCCESS)
     {
-        printf("Failed to create TLS session status (0x%04x)\r\n", status);
+        LOG_ERROR(LOG_MODULE_MQTT, "Failed to create TLS session status (0x%04x)", status);
         return status;
     }
 
-    status = nx_secure_tls_remote_certificate_allocate(tls_session,	
-        &azure_iot_mqtt->mqtt_remote_certificate,	
-        azure_iot_mqtt->mqtt_remote_cert_buffer,	
-        sizeof(azure_iot_mqtt->mqtt_remote_cert_buffer));	
-    if (status != NX_SUCCESS)	
-    {	
-        printf("Failed to create remote certificate buffer (0x%04x)\r\n", status);	
-        return status;	
+#if (AZURE_IOT_TLS_PROFILE == AZURE_IOT_TLS_PROFILE_ECDHE_GCM)
+    status = nx_secure_tls_ecc_initialize(
+        tls_session, nx_crypto_ecc_supported_groups, nx_crypto_ecc_supported_groups_size, nx_crypto_ecc_curves);
+    if (status != NX_SUCCESS)
+    {
+        LOG_ERROR(LOG_MODULE_MQTT, "Failed to initialize TLS ECC curves (0x%04x)", status);
+        return status;
     }
+#endif
 
-    // Add a CA Certificate to our trusted store for verifying incoming server certificates
-    status = nx_secure_x509_certificate_initialize(trusted_cert,
-        (UCHAR*)azure_iot_root_ca,
-        azure_iot_root_ca_len,
-        NX_NULL,
-        0,
-        NX_NULL,
-        0,
-        NX_SECURE_X509_KEY_TYPE_NONE);
+    status = nx_secure_tls_remote_certificate_allocate(tls_session,
+        &azure_iot_mqtt->mqtt_remote_certificate,
+        azure_iot_mqtt->mqtt_remote_cert_buffer,
+        azure_iot_mqtt->mqtt_buffers.remote_cert_size);
     if (status != NX_SUCCESS)
     {
-        printf("Unable to initialize CA certificate (0x%04x)\r\n", status);
+        LOG_ERROR(LOG_MODULE_MQTT, "Failed to create remote certificate buffer (0x%04x)", status);
         return status;
     }
 
-    status = nx_secure_tls_trusted_certificate_add(tls_session, trusted_cert);
+    // Parse the CA certificate on the first handshake only, later sessions reuse the parsed copy
+    if (!azure_iot_mqtt->mqtt_trusted_cert_ready)
+    {
+        status = nx_secure_x509_certificate_initialize(&azure_iot_mqtt->mqtt_trusted_cert,
+            (UCHAR*)azure_iot_root_ca,
+            azure_iot_root_ca_len,
+            NX_NULL,
+            0,
+            NX_NULL,
+            0,
+            NX_SECURE_X509_KEY_TYPE_NONE);
+        if (status != NX_SUCCESS)
+        {
+            LOG_ERROR(LOG_MODULE_MQTT, "Unable to initialize CA certificate (0x%04x)", status);
+            return status;
+        }
+
+        azure_iot_mqtt->mqtt_trusted_cert_ready = true;
+    }
+
+    status = nx_secure_tls_trusted_certificate_add(tls_session, &azure_iot_mqtt->mqtt_trusted_cert);
     if (status != NX_SUCCESS)
     {
-        printf("Unable to add CA certificate to trusted store (0x%04x)\r\n", status);
+        LOG_ERROR(LOG_MODULE_MQTT, "Unable to add CA certificate to trusted store (0x%04x)", status);
         return status;
     }
 
     status = nx_secure_tls_session_packet_buffer_set(
-        tls_session, azure_iot_mqtt->tls_packet_buffer, sizeof(azure_iot_mqtt->tls_packet_buffer));
+        tls_session, azure_iot_mqtt->tls_packet_buffer, azure_iot_mqtt->mqtt_buffers.tls_packet_size);
     if (status != NX_SUCCESS)
     {
-        printf("Could not set TLS session packet buffer (0x%02x)\r\n", status);
+        LOG_ERROR(LOG_MODULE_MQTT, "Could not set TLS session packet buffer (0x%02x)", status);
         return status;
     }
 
@@ -169,7 +213,7 @@ UINT tls_setup(NXD_MQTT_CLIENT* client,
     status = nx_secure_tls_session_certificate_callback_set(tls_session, azure_iot_certificate_verify);
     if (status)
     {
-        printf("Failed to set the session certificate callback: status: %d", status);
+        LOG_ERROR(LOG_MODULE_MQTT, "Failed to set the session certificate callback: status: %d", status);
         return status;
     }
 
@@ -179,7 +223,7 @@ UINT tls_setup(NXD_MQTT_CLIENT* client,
     return NX_SUCCESS;
 }
 
-UINT mqtt_publish(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHAR* message)
+static UINT mqtt_publish_wait(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHAR* message, ULONG wait_option)
 {
     UINT status = nxd_mqtt_client_publish(&azure_iot_mqtt->nxd_mqtt_client,
         topic,
@@ -188,472 +232,919 @@ UINT mqtt_publish(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHAR* message)
         strlen(message),
         NX_FALSE,
         MQTT_QOS_1,
-        NX_WAIT_FOREVER);
+        wait_option);
     if (status != NX_SUCCESS)
     {
-        printf("Failed to publish %s (0x%02x)\r\n", message, status);
+        LOG_ERROR(LOG_MODULE_MQTT, "Failed to publish %s (0x%02x)", message, status);
+        return status;
     }
 
+    azure_iot_mqtt_publish_window_sent(&azure_iot_mqtt->mqtt_publish_window, &azure_iot_mqtt->nxd_mqtt_client);
+
     return status;
 }
 
-static UINT mqtt_publish_float(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHAR* label, float value)
+UINT mqtt_publish(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHAR* message)
 {
-    CHAR mqtt_message[100];
+    return mqtt_publish_wait(azure_iot_mqtt, topic, message, NX_WAIT_FOREVER);
+}
+
+static size_t mqtt_format_float(CHAR* mqtt_message, UINT size, CHAR* label, float value)
+{
+    JSON_BUILDER builder;
+    size_t length;
 
-    int decvalue  = value;
-    int fracvalue = abs(100 * (value - (long)value));
+    json_builder_init(&builder, mqtt_message, size);
+    json_builder_append(&builder, "{\"");
+    json_builder_append(&builder, label);
+    json_builder_append(&builder, "\":");
+    json_builder_append_float(&builder, value, AZURE_IOT_MQTT_FLOAT_DECIMALS);
+    json_builder_append(&builder, "}");
 
-    snprintf(mqtt_message, sizeof(mqtt_message), "{\"%s\":%d.%02d}", label, decvalue, fracvalue);
-    printf("Sending message %s\r\n", mqtt_message);
+    if ((length = json_builder_finish(&builder)) == 0)
+    {
+        LOG_ERROR(LOG_MODULE_MQTT, "Property %s does not fit in the message", label);
+    }
 
-    return mqtt_publish(azure_iot_mqtt, topic, mqtt_message);
+    return length;
 }
 
-static UINT mqtt_publish_bool(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHAR* label, bool value)
+static VOID mqtt_store_forward_complete(VOID* context, UINT status)
 {
-    CHAR mqtt_message[200];
-
-    snprintf(mqtt_message, sizeof(mqtt_message), "{\"%s\":%s}", label, (value ? "true" : "false"));
-    printf("Sending message %s\r\n", mqtt_message);
+    AZURE_IOT_MQTT* azure_iot_mqtt = (AZURE_IOT_MQTT*)context;
 
-    return mqtt_publish(azure_iot_mqtt, topic, mqtt_message);
+    // The window completes in send order, which is what the queue expects
+    store_forward_complete(azure_iot_mqtt->mqtt_store_forward, status);
 }
 
-static VOID process_direct_method(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHAR* message)
+static UINT mqtt_store_forward_send(VOID* context, UCHAR* data, UINT length)
 {
-    INT direct_method_receive_size = sizeof(DIRECT_METHOD_RECEIVE) - 1;
-    CHAR direct_method_name[64]    = {0};
+    AZURE_IOT_MQTT* azure_iot_mqtt = (AZURE_IOT_MQTT*)context;
+
+    // Doesn't block, a full window or NetX queue leaves the rest for the next drain. The record stays
+    // stored until the PUBACK arrives and goes out again if the window times it out or aborts it.
+    return azure_iot_mqtt_publish_window_send(&azure_iot_mqtt->mqtt_publish_window,
+        &azure_iot_mqtt->nxd_mqtt_client,
+        azure_iot_mqtt->mqtt_topics.telemetry,
+        azure_iot_mqtt->mqtt_topics.telemetry_length,
+        (CHAR*)data,
+        length,
+        mqtt_store_forward_complete,
+        azure_iot_mqtt);
+}
 
-    CHAR* location = topic + direct_method_receive_size;
-    CHAR* find;
+static UINT mqtt_publish_telemetry(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* message)
+{
+    STORE_FORWARD_QUEUE* queue = azure_iot_mqtt->mqtt_store_forward;
+    UINT status;
 
-    find = strchr(location, '/');
-    if (find == 0)
+    if (queue == NX_NULL)
     {
-        return;
+        return mqtt_publish(azure_iot_mqtt, azure_iot_mqtt->mqtt_topics.telemetry, message);
     }
 
-    strncpy(direct_method_name, location, find - location);
-
-    location = find;
-
-    find = strstr(location, "$rid=");
-    if (find == 0)
+    // Always go through the queue, it keeps the message until the broker has it and replays in the
+    // configured order
+    if ((status = store_forward_enqueue(queue, (UCHAR*)message, strlen(message), STORE_FORWARD_PRIORITY_NORMAL)))
     {
-        printf("Error: failed to parse direct method rid\r\n");
-        return;
+        LOG_ERROR(LOG_MODULE_MQTT, "Telemetry dropped (0x%02x)", status);
+        return status;
     }
 
-    location = find + 5;
-    strncpy(azure_iot_mqtt->direct_command_request_id, location, AZURE_IOT_MQTT_DIRECT_COMMAND_RID_SIZE);
-
-    printf("Received direct method=%s, rid=%s, message=%s\r\n",
-        direct_method_name,
-        azure_iot_mqtt->direct_command_request_id,
-        message);
-
-    if (azure_iot_mqtt->cb_ptr_mqtt_invoke_direct_method == NULL)
+    if (azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_client_state == NXD_MQTT_CLIENT_STATE_CONNECTED)
     {
-        printf("No callback is registered for MQTT direct method invoke\r\n");
-        return;
+        store_forward_drain(queue, mqtt_store_forward_send, azure_iot_mqtt);
     }
 
-    azure_iot_mqtt->cb_ptr_mqtt_invoke_direct_method(azure_iot_mqtt, direct_method_name, message);
+    return NX_SUCCESS;
 }
 
-static VOID process_c2d_message(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHAR* message)
+UINT azure_iot_mqtt_publish_async(AZURE_IOT_MQTT* azure_iot_mqtt,
+    CHAR* topic,
+    CHAR* message,
+    UINT message_length,
+    func_ptr_publish_complete callback,
+    VOID* context)
 {
-    CHAR* properties;
-
-    // Get to parameters list
-    if ((properties = strstr(topic, ".to")) == 0)
+    if (azure_iot_mqtt == NX_NULL || topic == NX_NULL || message == NX_NULL)
     {
-        printf("Received C2D message has no parameter list\r\n");
-        return;
+        return NX_PTR_ERROR;
     }
 
-    // Find the properties
-    if ((properties = strstr(properties, "&")) == 0)
-    {
-        // No properties, point at the null terminator
-        properties = topic + strlen(topic);
-    }
-    else
-    {
-        // Skip over the '&'
-        properties++;
-    }
+    return azure_iot_mqtt_publish_window_send(&azure_iot_mqtt->mqtt_publish_window,
+        &azure_iot_mqtt->nxd_mqtt_client,
+        topic,
+        strlen(topic),
+        message,
+        message_length,
+        callback,
+        context);
+}
 
-    if (azure_iot_mqtt->cb_ptr_mqtt_c2d_message == NULL)
+UINT azure_iot_mqtt_publish_qos0(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHAR* message, UINT message_length)
+{
+    if (azure_iot_mqtt == NX_NULL || topic == NX_NULL || message == NX_NULL)
     {
-        printf("No callback is registered for MQTT cloud to device message processing\r\n");
-        return;
+        return NX_PTR_ERROR;
     }
 
-    azure_iot_mqtt->cb_ptr_mqtt_c2d_message(azure_iot_mqtt, properties, message);
+    // Fire and forget, nothing is retained so there is nothing to track
+    return nxd_mqtt_client_publish(&azure_iot_mqtt->nxd_mqtt_client,
+        topic,
+        strlen(topic),
+        message,
+        message_length,
+        NX_FALSE,
+        MQTT_QOS_0,
+        NX_NO_WAIT);
 }
 
-static VOID process_device_twin_response(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHAR* message)
+UINT azure_iot_mqtt_publish_poll(AZURE_IOT_MQTT* azure_iot_mqtt)
 {
-    INT response_status;
-
-    // Parse the device twin response status
-    CHAR* location = topic + sizeof(DEVICE_TWIN_RES_BASE) - 1;
-    CHAR* find;
-
-    find = strchr(location, '/');
-    if (find == 0)
+    if (azure_iot_mqtt == NX_NULL)
     {
-        return;
+        return NX_PTR_ERROR;
     }
 
-    response_status = atoi(location);
+    azure_iot_mqtt_publish_window_process(&azure_iot_mqtt->mqtt_publish_window, &azure_iot_mqtt->nxd_mqtt_client);
 
-    printf("Processed device twin update response with status=%d\r\n", response_status);
-
-    if (response_status == 200)
+    // Keep replaying stored telemetry even when nothing new is being published
+    if (azure_iot_mqtt->mqtt_store_forward != NX_NULL &&
+        azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_client_state == NXD_MQTT_CLIENT_STATE_CONNECTED)
     {
-        azure_iot_mqtt->cb_ptr_mqtt_device_twin_prop_callback(azure_iot_mqtt, message);
+        store_forward_drain(azure_iot_mqtt->mqtt_store_forward, mqtt_store_forward_send, azure_iot_mqtt);
     }
+
+    return azure_iot_mqtt->mqtt_publish_window.count;
 }
 
-static VOID process_device_twin_desired_prop_update(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHAR* message)
+UINT azure_iot_mqtt_store_forward_set(AZURE_IOT_MQTT* azure_iot_mqtt, STORE_FORWARD_QUEUE* queue)
 {
-    printf("Received device twin desired property\r\n");
+    if (azure_iot_mqtt == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
 
-    // Parse the device twin version
-    CHAR* location = topic + sizeof(DEVICE_TWIN_DESIRED_PROP_RES_BASE) - 1;
+    azure_iot_mqtt->mqtt_store_forward = queue;
 
-    location = strstr(location, "$version=");
-    if (location == 0)
+    return NX_SUCCESS;
+}
+
+UINT azure_iot_mqtt_configure_sas_token(AZURE_IOT_MQTT* azure_iot_mqtt, ULONG lifetime, ULONG renew_margin)
+{
+    if (azure_iot_mqtt == NX_NULL || lifetime == 0)
     {
-        printf("Error: Failed to parse version from desired property update\r\n");
-        return;
+        return NX_PTR_ERROR;
     }
 
-    azure_iot_mqtt->desired_property_version = atoi(location + 9);
+    // Drops the cached token, the next connect signs one with the new lifetime
+    sas_token_cache_init(&azure_iot_mqtt->mqtt_sas_token, lifetime, renew_margin);
 
-    azure_iot_mqtt->cb_ptr_mqtt_device_twin_desired_prop_callback(azure_iot_mqtt, message);
+    return NX_SUCCESS;
 }
 
-static VOID mqtt_disconnect_cb(NXD_MQTT_CLIENT* client_ptr)
+UINT azure_iot_mqtt_configure_publish_window(AZURE_IOT_MQTT* azure_iot_mqtt, UINT window_size, ULONG timeout)
 {
-    printf("ERROR: MQTT disconnected, reconnecting...\r\n");
-
-    AZURE_IOT_MQTT* azure_iot_mqtt = (AZURE_IOT_MQTT*)client_ptr;
+    if (azure_iot_mqtt == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
 
-    // Try and reconnect forever
-    while (azure_iot_mqtt_connect(azure_iot_mqtt) != NX_SUCCESS)
+    if (azure_iot_mqtt->mqtt_publish_window.count != 0)
     {
-        tx_thread_sleep(10 * TX_TIMER_TICKS_PER_SECOND);
+        LOG_ERROR(LOG_MODULE_MQTT, "Cannot resize the publish window with messages in flight");
+        return NX_NOT_SUCCESSFUL;
     }
+
+    return azure_iot_mqtt_publish_window_init(&azure_iot_mqtt->mqtt_publish_window, window_size, timeout);
 }
 
-static VOID mqtt_notify_cb(NXD_MQTT_CLIENT* client_ptr, UINT number_of_messages)
+static UINT direct_method_publish_response(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* request_id, UINT response)
 {
-    UINT actual_topic_length;
-    UINT actual_message_length;
-    UINT status;
+    CHAR mqtt_publish_topic[AZURE_IOT_MQTT_TOPICS_SUFFIXED_SIZE];
 
-    AZURE_IOT_MQTT* azure_iot_mqtt = (AZURE_IOT_MQTT*)client_ptr->nxd_mqtt_packet_receive_context;
-
-    for (UINT count = 0; count < number_of_messages; ++count)
+    if (azure_iot_mqtt_topics_method_response(
+            mqtt_publish_topic, sizeof(mqtt_publish_topic), response, request_id) == 0)
     {
-        // Get the mqtt client message
-        status = nxd_mqtt_client_message_get(client_ptr,
-            (UCHAR*)azure_iot_mqtt->mqtt_receive_topic_buffer,
-            AZURE_IOT_MQTT_TOPIC_NAME_LENGTH,
-            &actual_topic_length,
-            (UCHAR*)azure_iot_mqtt->mqtt_receive_message_buffer,
-            AZURE_IOT_MQTT_MESSAGE_LENGTH,
-            &actual_message_length);
-        if (status != NXD_MQTT_SUCCESS)
-        {
-            printf("ERROR: nxd_mqtt_client_message_get failed (0x%02x)\r\n", status);
-            continue;
-        }
-
-        // Append null string terminators
-        azure_iot_mqtt->mqtt_receive_topic_buffer[actual_topic_length]     = 0;
-        azure_iot_mqtt->mqtt_receive_message_buffer[actual_message_length] = 0;
-
-        if (strstr((CHAR*)azure_iot_mqtt->mqtt_receive_topic_buffer, DIRECT_METHOD_RECEIVE))
-        {
-            process_direct_method(
-                azure_iot_mqtt, azure_iot_mqtt->mqtt_receive_topic_buffer, azure_iot_mqtt->mqtt_receive_message_buffer);
-        }
-        else if (strstr((CHAR*)azure_iot_mqtt->mqtt_receive_topic_buffer, DEVICE_MESSAGE_BASE))
-        {
-            process_c2d_message(
-                azure_iot_mqtt, azure_iot_mqtt->mqtt_receive_topic_buffer, azure_iot_mqtt->mqtt_receive_message_buffer);
-        }
-        else if (strstr((CHAR*)azure_iot_mqtt->mqtt_receive_topic_buffer, DEVICE_TWIN_RES_BASE))
-        {
-            process_device_twin_response(
-                azure_iot_mqtt, azure_iot_mqtt->mqtt_receive_topic_buffer, azure_iot_mqtt->mqtt_receive_message_buffer);
-        }
-        else if (strstr((CHAR*)azure_iot_mqtt->mqtt_receive_topic_buffer, DEVICE_TWIN_DESIRED_PROP_RES_BASE))
-        {
-            process_device_twin_desired_prop_update(
-                azure_iot_mqtt, azure_iot_mqtt->mqtt_receive_topic_buffer, azure_iot_mqtt->mqtt_receive_message_buffer);
-        }
-        else
-        {
-            printf("Unknown topic received, no custom processing specified\r\n");
-        }
+        return NX_SIZE_ERROR;
     }
+
+    return mqtt_publish(azure_iot_mqtt, mqtt_publish_topic, "{}");
 }
 
-static UINT azure_iot_mqtt_create_common(AZURE_IOT_MQTT* azure_iot_mqtt, NX_IP* nx_ip, NX_PACKET_POOL* nx_pool)
+static VOID process_direct_method(
+    VOID* context, AZURE_IOT_MQTT_TOPIC_FIELDS* fields, AZURE_IOT_MQTT_MESSAGE* message)
 {
+    AZURE_IOT_MQTT* azure_iot_mqtt = (AZURE_IOT_MQTT*)context;
+    CHAR direct_method_name[AZURE_IOT_MQTT_METHOD_NAME_SIZE] = {0};
+    CHAR request_id[AZURE_IOT_MQTT_METHOD_RID_SIZE]          = {0};
+    AZURE_IOT_MQTT_METHOD_HANDLE handle;
+    CHAR payload[LOG_METHOD_PAYLOAD_SIZE];
     UINT status;
 
-    printf("Initializing MQTT Hub client\r\n");
+    if (fields->name.length == 0 || fields->name.length >= sizeof(direct_method_name))
+    {
+        LOG_ERROR(LOG_MODULE_MQTT, "failed to parse direct method name");
+        return;
+    }
 
-    status = nxd_mqtt_client_create(&azure_iot_mqtt->nxd_mqtt_client,
-        "MQTT client",
-        azure_iot_mqtt->mqtt_device_id,
-        strlen(azure_iot_mqtt->mqtt_device_id),
-        nx_ip,
-        nx_pool,
-        azure_iot_mqtt->mqtt_client_stack,
-        AZURE_IOT_MQTT_CLIENT_STACK_SIZE,
-        MQTT_CLIENT_PRIORITY,
-        NX_NULL,
-        0);
-    if (status != NXD_MQTT_SUCCESS)
+    if (fields->request_id.length == 0 || fields->request_id.length >= sizeof(request_id))
     {
-        printf("Failed to create MQTT Client (0x%02x)\r\n", status);
-        return status;
+        LOG_ERROR(LOG_MODULE_MQTT, "failed to parse direct method rid");
+        return;
     }
 
-    status = nxd_mqtt_client_receive_notify_set(&azure_iot_mqtt->nxd_mqtt_client, mqtt_notify_cb);
-    if (status != NXD_MQTT_SUCCESS)
+    memcpy(direct_method_name, fields->name.ptr, fields->name.length);
+    memcpy(request_id, fields->request_id.ptr, fields->request_id.length);
+
+    LOG_INFO(LOG_MODULE_MQTT, "Received direct method=%s, rid=%s, message length=%lu",
+        direct_method_name,
+        request_id,
+        message->length);
+
+    status = azure_iot_mqtt_method_begin(&azure_iot_mqtt->mqtt_methods,
+        &azure_iot_mqtt->nxd_mqtt_client,
+        &fields->name,
+        &fields->request_id,
+        &handle);
+    if (status != NX_SUCCESS)
     {
-        printf("Error in setting receive notify (0x%02x)\r\n", status);
-        nxd_mqtt_client_delete(&azure_iot_mqtt->nxd_mqtt_client);
-        return status;
+        // Answer straight away rather than leave the caller waiting for the hub timeout
+        LOG_ERROR(LOG_MODULE_MQTT, "Too many direct methods in flight, rejecting rid=%s", request_id);
+        direct_method_publish_response(azure_iot_mqtt, request_id, 503);
+        return;
     }
 
-    status = nxd_mqtt_client_disconnect_notify_set(&azure_iot_mqtt->nxd_mqtt_client, mqtt_disconnect_cb);
-    if (status != NXD_MQTT_SUCCESS)
+    if (strcmp(direct_method_name, LOG_METHOD_NAME) == 0)
     {
-        printf("Error in seting disconnect notification (0x%02x)\r\n", status);
-        nxd_mqtt_client_delete(&azure_iot_mqtt->nxd_mqtt_client);
-        return status;
+        // Answered here so every application can change its log levels. The payload is a handful of
+        // bytes, copy it out rather than tie up a pool packet to linearize it.
+        if (azure_iot_mqtt_message_copy(message, payload, sizeof(payload)) != NX_SUCCESS)
+        {
+            azure_iot_mqtt_respond_direct_method(azure_iot_mqtt, handle, 400);
+            return;
+        }
+
+        azure_iot_mqtt_respond_direct_method(azure_iot_mqtt, handle, logging_method_invoke(payload, message->length));
+        return;
     }
 
-    // Set the receive context (highjacking the packet_receive_context) for callbacks
-    azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_packet_receive_context = azure_iot_mqtt;
+    if (azure_iot_mqtt->cb_ptr_mqtt_invoke_direct_method == NULL)
+    {
+        LOG_WARN(LOG_MODULE_MQTT, "No callback is registered for MQTT direct method invoke");
+        azure_iot_mqtt_respond_direct_method(azure_iot_mqtt, handle, 501);
+        return;
+    }
 
-    return NXD_MQTT_SUCCESS;
+    azure_iot_mqtt->cb_ptr_mqtt_invoke_direct_method(azure_iot_mqtt, direct_method_name, handle, message);
 }
 
-// Interact with Azure MQTT
-UINT azure_iot_mqtt_publish_float_property(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* label, float value)
+static VOID process_c2d_message(
+    VOID* context, AZURE_IOT_MQTT_TOPIC_FIELDS* fields, AZURE_IOT_MQTT_MESSAGE* message)
 {
-    CHAR mqtt_publish_topic[100];
-    UINT status;
-
-    printf("Sending device twin update with float value\r\n");
+    AZURE_IOT_MQTT* azure_iot_mqtt = (AZURE_IOT_MQTT*)context;
 
-    snprintf(mqtt_publish_topic,
-        sizeof(mqtt_publish_topic),
-        DEVICE_TWIN_PUBLISH_TOPIC,
-        azure_iot_mqtt->reported_property_version++);
+    // The property bag is the tail of the topic, still in the received packet
+    if (fields->name.length == 0)
+    {
+        LOG_WARN(LOG_MODULE_MQTT, "Received C2D message has no parameter list");
+        return;
+    }
 
-    status = mqtt_publish_float(azure_iot_mqtt, mqtt_publish_topic, label, value);
+    if (azure_iot_mqtt->cb_ptr_mqtt_c2d_message == NULL)
+    {
+        LOG_WARN(LOG_MODULE_MQTT, "No callback is registered for MQTT cloud to device message processing");
+        return;
+    }
 
-    return status;
+    azure_iot_mqtt->cb_ptr_mqtt_c2d_message(azure_iot_mqtt, &fields->properties, message);
 }
 
-UINT azure_iot_mqtt_publish_bool_property(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* label, bool value)
+static VOID process_device_twin_response(
+    VOID* context, AZURE_IOT_MQTT_TOPIC_FIELDS* fields, AZURE_IOT_MQTT_MESSAGE* message)
 {
-    CHAR mqtt_publish_topic[100];
+    AZURE_IOT_MQTT* azure_iot_mqtt = (AZURE_IOT_MQTT*)context;
+    UINT response_status;
+
+    // Parse the device twin response status
+    if (fields->name.length == 0)
+    {
+        return;
+    }
 
-    printf("Sending device twin update with bool value\r\n");
+    response_status = azure_iot_mqtt_span_to_uint(fields->name);
 
-    snprintf(mqtt_publish_topic,
-        sizeof(mqtt_publish_topic),
-        DEVICE_TWIN_PUBLISH_TOPIC,
-        azure_iot_mqtt->reported_property_version++);
+    LOG_DEBUG(LOG_MODULE_MQTT, "Processed device twin update response with status=%d", response_status);
 
-    return mqtt_publish_bool(azure_iot_mqtt, mqtt_publish_topic, label, value);
+    if (response_status == 200)
+    {
+        azure_iot_mqtt->cb_ptr_mqtt_device_twin_prop_callback(azure_iot_mqtt, message);
+    }
 }
 
-UINT azure_iot_mqtt_publish_float_telemetry(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* label, float value)
+static VOID process_device_twin_desired_prop_update(
+    VOID* context, AZURE_IOT_MQTT_TOPIC_FIELDS* fields, AZURE_IOT_MQTT_MESSAGE* message)
 {
-    CHAR mqtt_publish_topic[100];
+    AZURE_IOT_MQTT* azure_iot_mqtt = (AZURE_IOT_MQTT*)context;
+
+    LOG_INFO(LOG_MODULE_MQTT, "Received device twin desired property");
 
-    printf("Sending telemetry with float value\r\n");
+    // Parse the device twin version
+    if (fields->version.length == 0)
+    {
+        LOG_ERROR(LOG_MODULE_MQTT, "Failed to parse version from desired property update");
+        return;
+    }
 
-    snprintf(mqtt_publish_topic,
-        sizeof(mqtt_publish_topic),
-        PUBLISH_TELEMETRY_TOPIC,
-        azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_client_id);
+    azure_iot_mqtt->desired_property_version = azure_iot_mqtt_span_to_uint(fields->version);
 
-    return mqtt_publish_float(azure_iot_mqtt, mqtt_publish_topic, label, value);
+    azure_iot_mqtt->cb_ptr_mqtt_device_twin_desired_prop_callback(azure_iot_mqtt, message);
 }
 
-UINT azure_iot_mqtt_publish_int_writeable_property(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* label, int value)
+static VOID mqtt_disconnect_cb(NXD_MQTT_CLIENT* client_ptr)
 {
-    CHAR mqtt_publish_topic[100];
-    CHAR mqtt_publish_message[100];
+    LOG_ERROR(LOG_MODULE_MQTT, "MQTT disconnected");
 
-    printf("Reporting writeable property %s as %d\r\n", label, value);
+    AZURE_IOT_MQTT* azure_iot_mqtt = (AZURE_IOT_MQTT*)client_ptr;
 
-    snprintf(mqtt_publish_topic,
-        sizeof(mqtt_publish_topic),
-        DEVICE_TWIN_PUBLISH_TOPIC,
-        azure_iot_mqtt->reported_property_version++);
+    // Anything still waiting for a PUBACK is gone with the session
+    azure_iot_mqtt_publish_window_abort(&azure_iot_mqtt->mqtt_publish_window, client_ptr, NX_NOT_CONNECTED);
 
-    snprintf(mqtt_publish_message,
-        sizeof(mqtt_publish_message),
-        "{\"%s\":{\"value\":%d,\"ac\":200,\"av\":1}}",
-        label,
-        value);
+    // The hub fails pending method calls when the device drops, answering them later is pointless
+    azure_iot_mqtt_method_abort(&azure_iot_mqtt->mqtt_methods, client_ptr);
 
-    return mqtt_publish(azure_iot_mqtt, mqtt_publish_topic, mqtt_publish_message);
+    // This runs on the MQTT client thread, leave the reconnect to the supervisor
+    connection_supervisor_disconnected(&azure_iot_mqtt->mqtt_supervisor);
 }
 
-UINT azure_iot_mqtt_respond_int_writeable_property(
-    AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* label, int value, int http_status)
+UINT azure_iot_mqtt_packet_receive_notify(NXD_MQTT_CLIENT* client_ptr, NX_PACKET* packet_ptr, VOID* context)
 {
-    CHAR mqtt_publish_topic[100];
-    CHAR mqtt_publish_message[100];
+    AZURE_IOT_MQTT* azure_iot_mqtt = (AZURE_IOT_MQTT*)context;
+    AZURE_IOT_MQTT_MESSAGE topic;
+    AZURE_IOT_MQTT_MESSAGE message;
+    AZURE_IOT_MQTT_SPAN topic_span;
+    ULONG topic_offset;
+    USHORT topic_length;
+    ULONG message_offset;
+    ULONG message_length;
+    UINT status;
 
-    printf("Responding to writeable property %s = %d\r\n", label, value);
+    // Only called for PUBLISH packets. All our subscriptions are QoS 0 so there is nothing to
+    // acknowledge and the packet can be handed straight to the router without copying it out.
+    status = _nxd_mqtt_process_publish_packet(
+        packet_ptr, &topic_offset, &topic_length, &message_offset, &message_length);
+    if (status != NXD_MQTT_SUCCESS)
+    {
+        LOG_ERROR(LOG_MODULE_MQTT, "Failed to parse MQTT publish packet (0x%02x)", status);
+        nx_packet_release(packet_ptr);
+        return NX_TRUE;
+    }
 
-    snprintf(mqtt_publish_topic,
-        sizeof(mqtt_publish_topic),
-        DEVICE_TWIN_PUBLISH_TOPIC,
-        azure_iot_mqtt->reported_property_version++);
+    azure_iot_mqtt_message_init(&topic, packet_ptr, topic_offset, topic_length);
+    azure_iot_mqtt_message_init(&message, packet_ptr, message_offset, message_length);
 
-    snprintf(mqtt_publish_message,
-        sizeof(mqtt_publish_message),
-        "{\"%s\":{\"value\":%d,\"ac\":%d,\"av\":%d}}",
-        label,
-        value,
-        http_status,
-        azure_iot_mqtt->desired_property_version);
+    // The router walks the topic in one pass, this only copies if it straddles packets
+    status = azure_iot_mqtt_message_span_get(&topic, &topic_span);
+    if (status != NX_SUCCESS)
+    {
+        LOG_ERROR(LOG_MODULE_MQTT, "Unable to read MQTT topic (0x%02x)", status);
+    }
+    else if (azure_iot_mqtt_router_dispatch(
+                 &azure_iot_mqtt->mqtt_router, topic_span.ptr, topic_span.length, azure_iot_mqtt, &message) !=
+             NX_SUCCESS)
+    {
+        LOG_WARN(LOG_MODULE_MQTT, "Unknown topic received, no custom processing specified");
+    }
 
-    return mqtt_publish(azure_iot_mqtt, mqtt_publish_topic, mqtt_publish_message);
+    // Callbacks are done with the views, release the packet on behalf of the MQTT client
+    azure_iot_mqtt_message_release(&message);
+    azure_iot_mqtt_message_release(&topic);
+    nx_packet_release(packet_ptr);
+
+    return NX_TRUE;
 }
 
-UINT azure_iot_mqtt_respond_direct_method(AZURE_IOT_MQTT* azure_iot_mqtt, UINT response)
+// Everything derived from the hub and device id, rebuilt whenever DPS may have changed them
+static UINT mqtt_topics_create(AZURE_IOT_MQTT* azure_iot_mqtt)
 {
-    CHAR mqtt_publish_topic[100];
-
-    printf("Responding to direct command property with status:%d, rid:%s\r\n",
-        response,
-        azure_iot_mqtt->direct_command_request_id);
-
-    snprintf(mqtt_publish_topic,
-        sizeof(mqtt_publish_topic),
-        DIRECT_METHOD_RESPONSE,
-        response,
-        azure_iot_mqtt->direct_command_request_id);
+    if (azure_iot_mqtt_topics_init(&azure_iot_mqtt->mqtt_topics, azure_iot_mqtt->mqtt_device_id) ||
+        azure_iot_mqtt_topics_username(azure_iot_mqtt->mqtt_username,
+            azure_iot_mqtt->mqtt_buffers.username_size,
+            azure_iot_mqtt->mqtt_hub_hostname,
+            azure_iot_mqtt->mqtt_device_id,
+            azure_iot_mqtt->mqtt_model_id) == 0)
+    {
+        LOG_ERROR(LOG_MODULE_MQTT, "Device id or hostname too long for the MQTT topics");
+        return NX_SIZE_ERROR;
+    }
 
-    return mqtt_publish(azure_iot_mqtt, mqtt_publish_topic, "{}");
+    return NX_SUCCESS;
 }
 
-UINT azure_iot_mqtt_device_twin_request(AZURE_IOT_MQTT* azure_iot_mqtt)
+static UINT mqtt_router_create(AZURE_IOT_MQTT* azure_iot_mqtt)
 {
-    CHAR mqtt_publish_topic[100];
+    // Build the trie from the same prefixes we subscribe to
+    if (azure_iot_mqtt_router_init(&azure_iot_mqtt->mqtt_router) ||
+        azure_iot_mqtt_router_add(&azure_iot_mqtt->mqtt_router,
+            azure_iot_mqtt->mqtt_topics.c2d_filter,
+            azure_iot_mqtt->mqtt_topics.c2d_filter_length - 1,
+            process_c2d_message) ||
+        azure_iot_mqtt_router_add(&azure_iot_mqtt->mqtt_router,
+            DIRECT_METHOD_RECEIVE,
+            sizeof(DIRECT_METHOD_RECEIVE) - 1,
+            process_direct_method) ||
+        azure_iot_mqtt_router_add(&azure_iot_mqtt->mqtt_router,
+            DEVICE_TWIN_RES_BASE,
+            sizeof(DEVICE_TWIN_RES_BASE) - 1,
+            process_device_twin_response) ||
+        azure_iot_mqtt_router_add(&azure_iot_mqtt->mqtt_router,
+            DEVICE_TWIN_DESIRED_PROP_RES_BASE,
+            sizeof(DEVICE_TWIN_DESIRED_PROP_RES_BASE) - 1,
+            process_device_twin_desired_prop_update))
+    {
+        LOG_ERROR(LOG_MODULE_MQTT, "Failed to build MQTT topic router");
+        return NX_NOT_SUCCESSFUL;
+    }
 
-    printf("Requesting device twin model\r\n");
+    return NX_SUCCESS;
+}
 
-    snprintf(mqtt_publish_topic, sizeof(mqtt_publish_topic), DEVICE_TWIN_REQUEST_TOPIC, 0);
+// Timer context, reading the clock may block so the token check runs on the supervisor thread
+static VOID mqtt_sas_timer_expired(ULONG parameter)
+{
+    AZURE_IOT_MQTT* azure_iot_mqtt = (AZURE_IOT_MQTT*)parameter;
 
-    // Publish an empty message to request the device twin
-    return mqtt_publish(azure_iot_mqtt, mqtt_publish_topic, "{}");
+    connection_supervisor_work_notify(&azure_iot_mqtt->mqtt_supervisor);
 }
 
-UINT azure_iot_mqtt_create(AZURE_IOT_MQTT* azure_iot_mqtt,
-    NX_IP* nx_ip,
-    NX_PACKET_POOL* nx_pool,
-    NX_DNS* nx_dns,
-    func_ptr_unix_time_get unix_time_get,
-    CHAR* iot_hub_hostname,
-    CHAR* iot_device_id,
-    CHAR* iot_sas_key,
-    CHAR* iot_model_id)
+static UINT mqtt_connect(VOID* context)
 {
-    if (azure_iot_mqtt == NULL)
+    AZURE_IOT_MQTT* azure_iot_mqtt = (AZURE_IOT_MQTT*)context;
+    UINT status;
+    NXD_ADDRESS server_ip;
+    const CHAR* password;
+    ULONG bytes_sent;
+    ULONG bytes_received;
+
+    // Re-authenticating, close the old session cleanly before presenting the new token
+    if (azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_client_state == NXD_MQTT_CLIENT_STATE_CONNECTED)
     {
-        printf("ERROR: azure_iot_mqtt is NULL\r\n");
-        return NX_PTR_ERROR;
+        nxd_mqtt_client_disconnect(&azure_iot_mqtt->nxd_mqtt_client);
     }
 
-    if (iot_hub_hostname[0] == 0 || iot_device_id[0] == 0 || iot_sas_key[0] == 0)
+    // The username was built with the topics, a reconnect reuses the token until it is due for renewal
+    password = sas_token_cache_get(&azure_iot_mqtt->mqtt_sas_token,
+        azure_iot_mqtt->mqtt_sas_key,
+        strlen(azure_iot_mqtt->mqtt_sas_key),
+        azure_iot_mqtt->mqtt_hub_hostname,
+        azure_iot_mqtt->mqtt_device_id,
+        azure_iot_mqtt->unix_time_get());
+    if (password == NX_NULL)
     {
-        printf("ERROR: IoT Hub connection configuration is empty\r\n");
+        LOG_ERROR(LOG_MODULE_MQTT, "Unable to generate SAS token");
         return NX_PTR_ERROR;
     }
 
-    memset(azure_iot_mqtt, 0, sizeof(*azure_iot_mqtt));
+    status = nxd_mqtt_client_login_set(&azure_iot_mqtt->nxd_mqtt_client,
+        azure_iot_mqtt->mqtt_username,
+        strlen(azure_iot_mqtt->mqtt_username),
+        (CHAR*)password,
+        strlen(password));
+    if (status != NXD_MQTT_SUCCESS)
+    {
+        LOG_ERROR(LOG_MODULE_MQTT, "Could not create Login Set (0x%02x)", status);
+        nx_secure_tls_session_delete(&azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_tls_session);
+        return status;
+    }
 
-    // Stash the connection information
-    azure_iot_mqtt->nx_dns        = nx_dns;
-    azure_iot_mqtt->unix_time_get = unix_time_get;
-    strncpy(azure_iot_mqtt->mqtt_hub_hostname, iot_hub_hostname, AZURE_IOT_MQTT_HOSTNAME_SIZE);
-    strncpy(azure_iot_mqtt->mqtt_device_id, iot_device_id, AZURE_IOT_MQTT_DEVICE_ID_SIZE);
-    azure_iot_mqtt->mqtt_sas_key  = iot_sas_key;
-    azure_iot_mqtt->mqtt_model_id = iot_model_id;
+    connection_supervisor_state_set(&azure_iot_mqtt->mqtt_supervisor, CONNECTION_STATE_RESOLVING);
 
-    // call into common code
-    return azure_iot_mqtt_create_common(azure_iot_mqtt, nx_ip, nx_pool);
+    // Resolve the MQTT server IP address
+    status = dns_cache_resolve(
+        azure_iot_mqtt->nx_dns, azure_iot_mqtt->mqtt_hub_hostname, &server_ip, NX_IP_PERIODIC_RATE);
+    if (status != NX_SUCCESS)
+    {
+        LOG_ERROR(LOG_MODULE_MQTT,
+            "Unable to resolve DNS for MQTT Server %s (0x%02x)",
+            azure_iot_mqtt->mqtt_hub_hostname,
+            status);
+        nx_secure_tls_session_delete(&azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_tls_session);
+        return status;
+    }
+
+    // Stash the hostname in a global variable so we can verify the cert at connect
+    azure_iot_x509_hostname = azure_iot_mqtt->mqtt_hub_hostname;
+
+    // TLS handshake and MQTT CONNECT both happen inside the one NetX call
+    connection_supervisor_state_set(&azure_iot_mqtt->mqtt_supervisor, CONNECTION_STATE_CONNECTING);
+
+    status = nxd_mqtt_client_secure_connect(&azure_iot_mqtt->nxd_mqtt_client,
+        &server_ip,
+        NXD_MQTT_TLS_PORT,
+        tls_setup,
+        MQTT_KEEP_ALIVE,
+        NX_TRUE,
+        MQTT_TIMEOUT);
+    if (status != NXD_MQTT_SUCCESS)
+    {
+        LOG_ERROR(LOG_MODULE_MQTT, "Could not connect to MQTT server (0x%02x)", status);
+        nx_secure_tls_session_delete(&azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_tls_session);
+
+        // The hub refused the token, e.g. it was signed before the clock was set, sign a new one next time
+        if (status == NXD_MQTT_ERROR_BAD_USERNAME_PASSWORD || status == NXD_MQTT_ERROR_NOT_AUTHORIZED)
+        {
+            sas_token_cache_invalidate(&azure_iot_mqtt->mqtt_sas_token);
+        }
+        else
+        {
+            // The server may have moved, don't keep connecting to the cached address
+            dns_cache_invalidate(azure_iot_mqtt->mqtt_hub_hostname);
+        }
+
+        return status;
+    }
+
+    // Everything on the socket so far was the TLS handshake and MQTT CONNECT
+    if (nx_tcp_socket_info_get(&azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_client_socket,
+            NX_NULL,
+            &bytes_sent,
+            NX_NULL,
+            &bytes_received,
+            NX_NULL,
+            NX_NULL,
+            NX_NULL,
+            NX_NULL,
+            NX_NULL,
+            NX_NULL,
+            NX_NULL) == NX_SUCCESS)
+    {
+        connection_supervisor_handshake_bytes_set(&azure_iot_mqtt->mqtt_supervisor, bytes_sent + bytes_received);
+    }
+
+    connection_supervisor_state_set(&azure_iot_mqtt->mqtt_supervisor, CONNECTION_STATE_SUBSCRIBING);
+
+    // Drop the session on failure so the next attempt starts from a clean client
+    status = nxd_mqtt_client_subscribe(&azure_iot_mqtt->nxd_mqtt_client,
+        azure_iot_mqtt->mqtt_topics.c2d_filter,
+        azure_iot_mqtt->mqtt_topics.c2d_filter_length,
+        MQTT_QOS_0);
+    if (status != NXD_MQTT_SUCCESS)
+    {
+        LOG_ERROR(LOG_MODULE_MQTT, "Error in subscribing to server (0x%02x)", status);
+        nxd_mqtt_client_disconnect(&azure_iot_mqtt->nxd_mqtt_client);
+        return status;
+    }
+
+    status = nxd_mqtt_client_subscribe(
+        &azure_iot_mqtt->nxd_mqtt_client, DIRECT_METHOD_TOPIC, strlen(DIRECT_METHOD_TOPIC), MQTT_QOS_0);
+    if (status != NXD_MQTT_SUCCESS)
+    {
+        LOG_ERROR(LOG_MODULE_MQTT, "Error in direct method subscribing to server (0x%02x)", status);
+        nxd_mqtt_client_disconnect(&azure_iot_mqtt->nxd_mqtt_client);
+        return status;
+    }
+
+    status = nxd_mqtt_client_subscribe(
+        &azure_iot_mqtt->nxd_mqtt_client, DEVICE_TWIN_RES_TOPIC, strlen(DEVICE_TWIN_RES_TOPIC), MQTT_QOS_0);
+    if (status != NXD_MQTT_SUCCESS)
+    {
+        LOG_ERROR(LOG_MODULE_MQTT, "Error in device twin response subscribing to server (0x%02x)", status);
+        nxd_mqtt_client_disconnect(&azure_iot_mqtt->nxd_mqtt_client);
+        return status;
+    }
+
+    status = nxd_mqtt_client_subscribe(&azure_iot_mqtt->nxd_mqtt_client,
+        DEVICE_TWIN_DESIRED_PROP_RES_TOPIC,
+        strlen(DEVICE_TWIN_DESIRED_PROP_RES_TOPIC),
+        MQTT_QOS_0);
+    if (status != NXD_MQTT_SUCCESS)
+    {
+        LOG_ERROR(LOG_MODULE_MQTT,
+            "Error in device twin desired properties response subscribing to server (0x%02x)",
+            status);
+        nxd_mqtt_client_disconnect(&azure_iot_mqtt->nxd_mqtt_client);
+        return status;
+    }
+
+    return NXD_MQTT_SUCCESS;
 }
 
-UINT azure_iot_mqtt_create_with_dps(AZURE_IOT_MQTT* azure_iot_mqtt,
-    NX_IP* nx_ip,
-    NX_PACKET_POOL* nx_pool,
-    NX_DNS* nx_dns,
-    func_ptr_unix_time_get unix_time_get,
-    CHAR* iot_dps_id_scope,
-    CHAR* iot_registration_id,
-    CHAR* iot_sas_key,
-    CHAR* iot_model_id)
+static UINT mqtt_reported_properties_send(VOID* context, CHAR* patch, UINT length)
+{
+    AZURE_IOT_MQTT* azure_iot_mqtt = (AZURE_IOT_MQTT*)context;
+    CHAR mqtt_publish_topic[AZURE_IOT_MQTT_TOPICS_SUFFIXED_SIZE];
+
+    azure_iot_mqtt_topics_twin_patch(
+        mqtt_publish_topic, sizeof(mqtt_publish_topic), azure_iot_mqtt->reported_property_version++);
+
+    LOG_DEBUG(LOG_MODULE_MQTT, "Sending device twin update %s", patch);
+
+    // Bounded so a starved packet pool cannot stall reconnects, a failed patch stays pending for the next flush
+    return mqtt_publish_wait(azure_iot_mqtt, mqtt_publish_topic, patch, MQTT_FLUSH_WAIT);
+}
+
+static VOID mqtt_reported_properties_due(VOID* context)
+{
+    AZURE_IOT_MQTT* azure_iot_mqtt = (AZURE_IOT_MQTT*)context;
+
+    connection_supervisor_work_notify(&azure_iot_mqtt->mqtt_supervisor);
+}
+
+// Runs on the supervisor thread, only while connected
+static VOID mqtt_supervisor_work(VOID* context)
+{
+    AZURE_IOT_MQTT* azure_iot_mqtt = (AZURE_IOT_MQTT*)context;
+
+    // The hub drops the connection once the token expires, reconnect with a fresh one before that happens
+    if (sas_token_cache_renew_due(&azure_iot_mqtt->mqtt_sas_token, azure_iot_mqtt->unix_time_get()))
+    {
+        connection_supervisor_reconnect(&azure_iot_mqtt->mqtt_supervisor);
+    }
+
+    // A patch that does not go out stays pending, the SAS check comes round again within a minute
+    azure_iot_mqtt_reported_properties_flush(azure_iot_mqtt);
+}
+
+static UINT azure_iot_mqtt_create_common(AZURE_IOT_MQTT* azure_iot_mqtt, NX_IP* nx_ip, NX_PACKET_POOL* nx_pool)
 {
     UINT status;
 
-    printf("Initializing MQTT DPS client\r\n");
+    LOG_INFO(LOG_MODULE_MQTT, "Initializing MQTT Hub client");
+    LOG_INFO(LOG_MODULE_MQTT, "\tTLS profile: %s", _nx_azure_iot_tls_profile_name);
 
-    if (azure_iot_mqtt == NULL)
+    azure_iot_mqtt->nx_ip   = nx_ip;
+    azure_iot_mqtt->nx_pool = nx_pool;
+
+    // Resolve the hub while the rest of the client is set up
+    dns_cache_prefetch(azure_iot_mqtt->mqtt_hub_hostname);
+
+    azure_iot_mqtt_publish_window_init(&azure_iot_mqtt->mqtt_publish_window,
+        AZURE_IOT_MQTT_PUBLISH_WINDOW_DEFAULT,
+        AZURE_IOT_MQTT_PUBLISH_TIMEOUT_DEFAULT);
+
+    azure_iot_mqtt_method_table_init(&azure_iot_mqtt->mqtt_methods);
+
+    status = nxd_mqtt_client_create(&azure_iot_mqtt->nxd_mqtt_client,
+        "MQTT client",
+        azure_iot_mqtt->mqtt_device_id,
+        strlen(azure_iot_mqtt->mqtt_device_id),
+        nx_ip,
+        nx_pool,
+        azure_iot_mqtt->mqtt_client_stack,
+        azure_iot_mqtt->mqtt_buffers.client_stack_size,
+        MQTT_CLIENT_PRIORITY,
+        NX_NULL,
+        0);
+    if (status != NXD_MQTT_SUCCESS)
+    {
+        LOG_ERROR(LOG_MODULE_MQTT, "Failed to create MQTT Client (0x%02x)", status);
+        return status;
+    }
+
+    status = nxd_mqtt_client_disconnect_notify_set(&azure_iot_mqtt->nxd_mqtt_client, mqtt_disconnect_cb);
+    if (status != NXD_MQTT_SUCCESS)
+    {
+        LOG_ERROR(LOG_MODULE_MQTT, "Error in seting disconnect notification (0x%02x)", status);
+        nxd_mqtt_client_delete(&azure_iot_mqtt->nxd_mqtt_client);
+        return status;
+    }
+
+    status = connection_supervisor_create(
+        &azure_iot_mqtt->mqtt_supervisor, "MQTT supervisor", MQTT_SUPERVISOR_PRIORITY, mqtt_connect, azure_iot_mqtt);
+    if (status != NX_SUCCESS)
+    {
+        LOG_ERROR(LOG_MODULE_MQTT, "Failed to create MQTT connection supervisor (0x%02x)", status);
+        nxd_mqtt_client_delete(&azure_iot_mqtt->nxd_mqtt_client);
+        return status;
+    }
+
+    connection_supervisor_work_set(&azure_iot_mqtt->mqtt_supervisor, mqtt_supervisor_work);
+
+    status = reported_properties_create(&azure_iot_mqtt->mqtt_reported_properties,
+        "MQTT reported properties",
+        REPORTED_PROPERTIES_WINDOW_DEFAULT,
+        mqtt_reported_properties_due,
+        azure_iot_mqtt);
+    if (status != NX_SUCCESS)
+    {
+        connection_supervisor_delete(&azure_iot_mqtt->mqtt_supervisor);
+        nxd_mqtt_client_delete(&azure_iot_mqtt->nxd_mqtt_client);
+        return status;
+    }
+
+    status = tx_timer_create(&azure_iot_mqtt->mqtt_sas_timer,
+        "MQTT SAS renewal",
+        mqtt_sas_timer_expired,
+        (ULONG)azure_iot_mqtt,
+        SAS_RENEW_CHECK_TICKS,
+        SAS_RENEW_CHECK_TICKS,
+        TX_AUTO_ACTIVATE);
+    if (status != TX_SUCCESS)
+    {
+        LOG_ERROR(LOG_MODULE_MQTT, "Failed to create SAS renewal timer (0x%02x)", status);
+        reported_properties_delete(&azure_iot_mqtt->mqtt_reported_properties);
+        connection_supervisor_delete(&azure_iot_mqtt->mqtt_supervisor);
+        nxd_mqtt_client_delete(&azure_iot_mqtt->nxd_mqtt_client);
+        return status;
+    }
+
+    // Take ownership of received packets so callbacks can read them in place
+    azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_packet_receive_notify  = azure_iot_mqtt_packet_receive_notify;
+    azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_packet_receive_context = azure_iot_mqtt;
+
+    return NXD_MQTT_SUCCESS;
+}
+
+// Interact with Azure MQTT
+UINT azure_iot_mqtt_publish_float_property(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* label, float value)
+{
+    return reported_properties_set_double(
+        &azure_iot_mqtt->mqtt_reported_properties, NX_NULL, label, value, AZURE_IOT_MQTT_FLOAT_DECIMALS);
+}
+
+UINT azure_iot_mqtt_publish_bool_property(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* label, bool value)
+{
+    return reported_properties_set_bool(&azure_iot_mqtt->mqtt_reported_properties, NX_NULL, label, value);
+}
+
+UINT azure_iot_mqtt_publish_float_telemetry(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* label, float value)
+{
+    CHAR mqtt_message[100];
+
+    LOG_DEBUG(LOG_MODULE_MQTT, "Sending telemetry with float value");
+
+    if (mqtt_format_float(mqtt_message, sizeof(mqtt_message), label, value) == 0)
+    {
+        return NX_SIZE_ERROR;
+    }
+
+    LOG_DEBUG(LOG_MODULE_MQTT, "Sending message %s", mqtt_message);
+
+    return mqtt_publish_telemetry(azure_iot_mqtt, mqtt_message);
+}
+
+UINT azure_iot_mqtt_publish_int_writeable_property(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* label, int value)
+{
+    LOG_INFO(LOG_MODULE_MQTT, "Reporting writeable property %s as %d", label, value);
+
+    return reported_properties_set_writeable(&azure_iot_mqtt->mqtt_reported_properties, NX_NULL, label, value, 200, 1);
+}
+
+UINT azure_iot_mqtt_respond_int_writeable_property(
+    AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* label, int value, int http_status)
+{
+    LOG_INFO(LOG_MODULE_MQTT, "Responding to writeable property %s = %d", label, value);
+
+    return reported_properties_set_writeable(&azure_iot_mqtt->mqtt_reported_properties,
+        NX_NULL,
+        label,
+        value,
+        http_status,
+        azure_iot_mqtt->desired_property_version);
+}
+
+UINT azure_iot_mqtt_reported_properties_flush(AZURE_IOT_MQTT* azure_iot_mqtt)
+{
+    CHAR patch[AZURE_IOT_MQTT_PATCH_SIZE];
+    UINT status;
+
+    if (azure_iot_mqtt == NX_NULL)
     {
-        printf("ERROR: azure_iot_mqtt is NULL\r\n");
         return NX_PTR_ERROR;
     }
 
-    if (iot_dps_id_scope[0] == 0 || iot_registration_id[0] == 0 || iot_sas_key[0] == 0)
+    status = reported_properties_flush(
+        &azure_iot_mqtt->mqtt_reported_properties, patch, sizeof(patch), mqtt_reported_properties_send, azure_iot_mqtt);
+
+    // Nothing pending is not a failure
+    return status == NX_NOT_FOUND ? NX_SUCCESS : status;
+}
+
+UINT azure_iot_mqtt_respond_direct_method(
+    AZURE_IOT_MQTT* azure_iot_mqtt, AZURE_IOT_MQTT_METHOD_HANDLE handle, UINT response)
+{
+    AZURE_IOT_MQTT_METHOD_REQUEST request;
+    UINT status;
+
+    if (azure_iot_mqtt == NX_NULL)
     {
-        printf("ERROR: IoT DPS connection configuration is empty\r\n");
         return NX_PTR_ERROR;
     }
 
-    memset(azure_iot_mqtt, 0, sizeof(*azure_iot_mqtt));
+    status = azure_iot_mqtt_method_end(
+        &azure_iot_mqtt->mqtt_methods, &azure_iot_mqtt->nxd_mqtt_client, handle, &request);
+    if (status != NX_SUCCESS)
+    {
+        LOG_ERROR(
+            LOG_MODULE_MQTT, "Direct method %lu is not in flight, it was already answered or has expired", handle);
+        return status;
+    }
 
-    // Stash the connection information
-    azure_iot_mqtt->nx_dns                   = nx_dns;
-    azure_iot_mqtt->unix_time_get            = unix_time_get;
-    azure_iot_mqtt->mqtt_dps_id_scope        = iot_dps_id_scope;
-    azure_iot_mqtt->mqtt_dps_registration_id = iot_registration_id;
-    azure_iot_mqtt->mqtt_sas_key             = iot_sas_key;
-    azure_iot_mqtt->mqtt_model_id            = iot_model_id;
+    LOG_INFO(LOG_MODULE_MQTT, "Responding to direct method=%s with status:%d, rid:%s after %lu ms",
+        request.name,
+        response,
+        request.request_id,
+        (tx_time_get() - request.arrival_time) * 1000 / TX_TIMER_TICKS_PER_SECOND);
+
+    return direct_method_publish_response(azure_iot_mqtt, request.request_id, response);
+}
+
+UINT azure_iot_mqtt_direct_method_metrics_get(AZURE_IOT_MQTT* azure_iot_mqtt, AZURE_IOT_MQTT_METHOD_METRICS* metrics)
+{
+    if (azure_iot_mqtt == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    return azure_iot_mqtt_method_metrics_get(
+        &azure_iot_mqtt->mqtt_methods, &azure_iot_mqtt->nxd_mqtt_client, metrics);
+}
+
+UINT azure_iot_mqtt_device_twin_request(AZURE_IOT_MQTT* azure_iot_mqtt)
+{
+    CHAR mqtt_publish_topic[AZURE_IOT_MQTT_TOPICS_SUFFIXED_SIZE];
+
+    LOG_INFO(LOG_MODULE_MQTT, "Requesting device twin model");
+
+    azure_iot_mqtt_topics_twin_get(mqtt_publish_topic, sizeof(mqtt_publish_topic), 0);
+
+    // Publish an empty message to request the device twin
+    return mqtt_publish(azure_iot_mqtt, mqtt_publish_topic, "{}");
+}
+
+ULONG azure_iot_mqtt_arena_size(const AZURE_IOT_MQTT_BUFFER_PROFILE* profile)
+{
+    if (profile == NX_NULL)
+    {
+        profile = &azure_iot_mqtt_buffer_profile_default;
+    }
+
+    return AZURE_IOT_MQTT_ARENA_SIZE(profile->client_stack_size,
+        profile->tls_metadata_size,
+        profile->tls_packet_size,
+        profile->remote_cert_size,
+        profile->username_size);
+}
+
+static UCHAR* arena_carve(UCHAR** arena, ULONG size)
+{
+    UCHAR* buffer = *arena;
+
+    *arena += AZURE_IOT_MQTT_ARENA_ALIGN(size);
+
+    return buffer;
+}
+
+static UINT mqtt_arena_set(
+    AZURE_IOT_MQTT* azure_iot_mqtt, VOID* arena, ULONG arena_size, const AZURE_IOT_MQTT_BUFFER_PROFILE* profile)
+{
+    UCHAR* next = (UCHAR*)arena;
+    ULONG required;
+
+    if (profile == NX_NULL)
+    {
+        profile = &azure_iot_mqtt_buffer_profile_default;
+    }
+
+    if (arena == NX_NULL || ((ULONG)arena & (sizeof(ULONG) - 1)) != 0)
+    {
+        LOG_ERROR(LOG_MODULE_MQTT, "MQTT arena must be ULONG aligned");
+        return NX_PTR_ERROR;
+    }
+
+    required = azure_iot_mqtt_arena_size(profile);
+    if (arena_size < required)
+    {
+        LOG_ERROR(LOG_MODULE_MQTT, "MQTT arena is %lu bytes, the buffer profile needs %lu", arena_size, required);
+        return NX_SIZE_ERROR;
+    }
+
+    azure_iot_mqtt->mqtt_buffers            = *profile;
+    azure_iot_mqtt->mqtt_client_stack       = (ULONG*)arena_carve(&next, profile->client_stack_size);
+    azure_iot_mqtt->tls_metadata_buffer     = (ULONG*)arena_carve(&next, profile->tls_metadata_size);
+    azure_iot_mqtt->tls_packet_buffer       = arena_carve(&next, profile->tls_packet_size);
+    azure_iot_mqtt->mqtt_remote_cert_buffer = arena_carve(&next, profile->remote_cert_size);
+    azure_iot_mqtt->mqtt_username           = (CHAR*)arena_carve(&next, profile->username_size);
+
+    return NX_SUCCESS;
+}
+
+// Registers with DPS on a temporary client, leaving the assigned hub and device id behind
+static UINT mqtt_dps_provision(AZURE_IOT_MQTT* azure_iot_mqtt, NX_IP* nx_ip, NX_PACKET_POOL* nx_pool)
+{
+    UINT status;
 
-    // Setup DPS
     status = azure_iot_dps_create(azure_iot_mqtt, nx_ip, nx_pool);
     if (status != NX_SUCCESS)
     {
-        printf("ERROR: Failed to create DPS client (0x%04x)\r\n", status);
+        LOG_ERROR(LOG_MODULE_MQTT, "Failed to create DPS client (0x%04x)", status);
         return status;
     }
 
-    status = azure_iot_dps_register(azure_iot_mqtt, NX_WAIT_FOREVER);
+    status = azure_iot_dps_register(azure_iot_mqtt, AZURE_IOT_DPS_REGISTRATION_TIMEOUT, AZURE_IOT_DPS_MAX_POLLS);
     if (status != NX_SUCCESS)
     {
-        printf("ERROR: Failed to register DPS device (0x%04x)\r\n", status);
+        LOG_ERROR(LOG_MODULE_MQTT, "Failed to register DPS device (0x%04x)", status);
         azure_iot_dps_delete(azure_iot_mqtt);
         return status;
     }
@@ -661,141 +1152,225 @@ UINT azure_iot_mqtt_create_with_dps(AZURE_IOT_MQTT* azure_iot_mqtt,
     status = azure_iot_dps_delete(azure_iot_mqtt);
     if (status != NX_SUCCESS)
     {
-        printf("ERROR: Failed to delete DPS client (0x%04x)\r\n", status);
+        LOG_ERROR(LOG_MODULE_MQTT, "Failed to delete DPS client (0x%04x)", status);
         return status;
     }
 
-    printf("SUCCESS: MQTT DPS client initialized\r\n\r\n");
+    // Later boots can go straight to the hub
+    if (azure_iot_mqtt->mqtt_provisioning_store != NX_NULL)
+    {
+        provisioning_store_save(azure_iot_mqtt->mqtt_provisioning_store,
+            azure_iot_mqtt->mqtt_dps_id_scope,
+            azure_iot_mqtt->mqtt_dps_registration_id,
+            azure_iot_mqtt->mqtt_hub_hostname,
+            azure_iot_mqtt->mqtt_device_id);
+    }
 
-    // call into common code
-    return azure_iot_mqtt_create_common(azure_iot_mqtt, nx_ip, nx_pool);
+    LOG_INFO(LOG_MODULE_MQTT, "SUCCESS: MQTT DPS client initialized\r\n");
+
+    return NX_SUCCESS;
 }
 
-UINT azure_iot_mqtt_delete(AZURE_IOT_MQTT* azure_iot_mqtt)
+// The hub refused the stored identity, e.g. the device was moved to another hub or deleted
+static UINT mqtt_dps_reprovision(AZURE_IOT_MQTT* azure_iot_mqtt)
 {
-    nxd_mqtt_client_disconnect(&azure_iot_mqtt->nxd_mqtt_client);
+    func_ptr_connection_state state_changed = azure_iot_mqtt->mqtt_supervisor.state_changed;
+    UINT status;
+
+    LOG_WARN(LOG_MODULE_MQTT, "Stored DPS assignment was rejected by the hub, provisioning again");
+
+    provisioning_store_erase(azure_iot_mqtt->mqtt_provisioning_store);
+    azure_iot_mqtt->mqtt_dps_cached = false;
+
+    // DPS runs on the same NetX client, tear the hub side down and build it again afterwards
+    tx_timer_delete(&azure_iot_mqtt->mqtt_sas_timer);
+    connection_supervisor_delete(&azure_iot_mqtt->mqtt_supervisor);
+    reported_properties_delete(&azure_iot_mqtt->mqtt_reported_properties);
     nxd_mqtt_client_delete(&azure_iot_mqtt->nxd_mqtt_client);
 
-    return NXD_MQTT_SUCCESS;
+    if ((status = mqtt_dps_provision(azure_iot_mqtt, azure_iot_mqtt->nx_ip, azure_iot_mqtt->nx_pool)) ||
+        (status = azure_iot_mqtt_create_common(azure_iot_mqtt, azure_iot_mqtt->nx_ip, azure_iot_mqtt->nx_pool)) ||
+        (status = mqtt_topics_create(azure_iot_mqtt)) || (status = mqtt_router_create(azure_iot_mqtt)))
+    {
+        return status;
+    }
+
+    connection_supervisor_notify_set(&azure_iot_mqtt->mqtt_supervisor, state_changed);
+
+    return NX_SUCCESS;
 }
 
-UINT azure_iot_mqtt_connect(AZURE_IOT_MQTT* azure_iot_mqtt)
+UINT azure_iot_mqtt_create(AZURE_IOT_MQTT* azure_iot_mqtt,
+    NX_IP* nx_ip,
+    NX_PACKET_POOL* nx_pool,
+    NX_DNS* nx_dns,
+    func_ptr_unix_time_get unix_time_get,
+    CHAR* iot_hub_hostname,
+    CHAR* iot_device_id,
+    CHAR* iot_sas_key,
+    CHAR* iot_model_id,
+    VOID* arena,
+    ULONG arena_size,
+    const AZURE_IOT_MQTT_BUFFER_PROFILE* profile)
 {
     UINT status;
-    CHAR mqtt_subscribe_topic[100];
-    NXD_ADDRESS server_ip;
 
-    printf("\tHub hostname: %s\r\n", azure_iot_mqtt->mqtt_hub_hostname);
-    printf("\tDevice id: %s\r\n", azure_iot_mqtt->mqtt_device_id);
-    printf("\tModel id: %s\r\n", azure_iot_mqtt->mqtt_model_id);
-
-    // Create the username & password
-    snprintf(azure_iot_mqtt->mqtt_username,
-        AZURE_IOT_MQTT_USERNAME_SIZE,
-        USERNAME,
-        azure_iot_mqtt->mqtt_hub_hostname,
-        azure_iot_mqtt->mqtt_device_id,
-        azure_iot_mqtt->mqtt_model_id);
+    if (azure_iot_mqtt == NULL)
+    {
+        LOG_ERROR(LOG_MODULE_MQTT, "azure_iot_mqtt is NULL");
+        return NX_PTR_ERROR;
+    }
 
-    if (!create_sas_token(azure_iot_mqtt->mqtt_sas_key,
-            strlen(azure_iot_mqtt->mqtt_sas_key),
-            azure_iot_mqtt->mqtt_hub_hostname,
-            azure_iot_mqtt->mqtt_device_id,
-            azure_iot_mqtt->unix_time_get(),
-            azure_iot_mqtt->mqtt_password,
-            AZURE_IOT_MQTT_PASSWORD_SIZE))
+    if (iot_hub_hostname[0] == 0 || iot_device_id[0] == 0 || iot_sas_key[0] == 0)
     {
-        printf("ERROR: Unable to generate SAS token\r\n");
+        LOG_ERROR(LOG_MODULE_MQTT, "IoT Hub connection configuration is empty");
         return NX_PTR_ERROR;
     }
 
-    status = nxd_mqtt_client_login_set(&azure_iot_mqtt->nxd_mqtt_client,
-        azure_iot_mqtt->mqtt_username,
-        strlen(azure_iot_mqtt->mqtt_username),
-        azure_iot_mqtt->mqtt_password,
-        strlen(azure_iot_mqtt->mqtt_password));
-    if (status != NXD_MQTT_SUCCESS)
+    memset(azure_iot_mqtt, 0, sizeof(*azure_iot_mqtt));
+
+    if ((status = mqtt_arena_set(azure_iot_mqtt, arena, arena_size, profile)))
     {
-        printf("Could not create Login Set (0x%02x)\r\n", status);
-        nx_secure_tls_session_delete(&azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_tls_session);
         return status;
     }
 
-    // Resolve the MQTT server IP address
-    status = nxd_dns_host_by_name_get(azure_iot_mqtt->nx_dns,
-        (UCHAR*)azure_iot_mqtt->mqtt_hub_hostname,
-        &server_ip,
-        NX_IP_PERIODIC_RATE,
-        NX_IP_VERSION_V4);
-    if (status != NX_SUCCESS)
+    sas_token_cache_init(&azure_iot_mqtt->mqtt_sas_token, SAS_TOKEN_LIFETIME_SECS, SAS_TOKEN_RENEW_MARGIN_SECS);
+
+    // Stash the connection information
+    azure_iot_mqtt->nx_dns        = nx_dns;
+    azure_iot_mqtt->unix_time_get = unix_time_get;
+    strncpy(azure_iot_mqtt->mqtt_hub_hostname, iot_hub_hostname, AZURE_IOT_MQTT_HOSTNAME_SIZE);
+    strncpy(azure_iot_mqtt->mqtt_device_id, iot_device_id, AZURE_IOT_MQTT_DEVICE_ID_SIZE);
+    azure_iot_mqtt->mqtt_sas_key  = iot_sas_key;
+    azure_iot_mqtt->mqtt_model_id = iot_model_id;
+
+    // call into common code
+    return azure_iot_mqtt_create_common(azure_iot_mqtt, nx_ip, nx_pool);
+}
+
+UINT azure_iot_mqtt_create_with_dps(AZURE_IOT_MQTT* azure_iot_mqtt,
+    NX_IP* nx_ip,
+    NX_PACKET_POOL* nx_pool,
+    NX_DNS* nx_dns,
+    func_ptr_unix_time_get unix_time_get,
+    CHAR* iot_dps_id_scope,
+    CHAR* iot_registration_id,
+    CHAR* iot_sas_key,
+    CHAR* iot_model_id,
+    PROVISIONING_STORE* provisioning_store,
+    VOID* arena,
+    ULONG arena_size,
+    const AZURE_IOT_MQTT_BUFFER_PROFILE* profile)
+{
+    UINT status;
+
+    LOG_INFO(LOG_MODULE_MQTT, "Initializing MQTT DPS client");
+
+    if (azure_iot_mqtt == NULL)
     {
-        printf("Unable to resolve DNS for MQTT Server %s (0x%02x)\r\n", azure_iot_mqtt->mqtt_hub_hostname, status);
-        nx_secure_tls_session_delete(&azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_tls_session);
-        return status;
+        LOG_ERROR(LOG_MODULE_MQTT, "azure_iot_mqtt is NULL");
+        return NX_PTR_ERROR;
     }
 
-    // Stash the hostname in a global variable so we can verify the cert at connect
-    azure_iot_x509_hostname = azure_iot_mqtt->mqtt_hub_hostname;
+    if (iot_dps_id_scope[0] == 0 || iot_registration_id[0] == 0 || iot_sas_key[0] == 0)
+    {
+        LOG_ERROR(LOG_MODULE_MQTT, "IoT DPS connection configuration is empty");
+        return NX_PTR_ERROR;
+    }
 
-    status = nxd_mqtt_client_secure_connect(&azure_iot_mqtt->nxd_mqtt_client,
-        &server_ip,
-        NXD_MQTT_TLS_PORT,
-        tls_setup,
-        MQTT_KEEP_ALIVE,
-        NX_TRUE,
-        MQTT_TIMEOUT);
-    if (status != NXD_MQTT_SUCCESS)
+    memset(azure_iot_mqtt, 0, sizeof(*azure_iot_mqtt));
+
+    if ((status = mqtt_arena_set(azure_iot_mqtt, arena, arena_size, profile)))
     {
-        printf("Could not connect to MQTT server (0x%02x)\r\n", status);
-        nx_secure_tls_session_delete(&azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_tls_session);
         return status;
     }
 
-    snprintf(mqtt_subscribe_topic, sizeof(mqtt_subscribe_topic), DEVICE_MESSAGE_TOPIC, azure_iot_mqtt->mqtt_device_id);
-    status = nxd_mqtt_client_subscribe(
-        &azure_iot_mqtt->nxd_mqtt_client, mqtt_subscribe_topic, strlen(mqtt_subscribe_topic), MQTT_QOS_0);
-    if (status != NXD_MQTT_SUCCESS)
+    sas_token_cache_init(&azure_iot_mqtt->mqtt_sas_token, SAS_TOKEN_LIFETIME_SECS, SAS_TOKEN_RENEW_MARGIN_SECS);
+
+    // Stash the connection information
+    azure_iot_mqtt->nx_dns                   = nx_dns;
+    azure_iot_mqtt->unix_time_get            = unix_time_get;
+    azure_iot_mqtt->mqtt_dps_id_scope        = iot_dps_id_scope;
+    azure_iot_mqtt->mqtt_dps_registration_id = iot_registration_id;
+    azure_iot_mqtt->mqtt_sas_key             = iot_sas_key;
+    azure_iot_mqtt->mqtt_model_id            = iot_model_id;
+    azure_iot_mqtt->mqtt_provisioning_store  = provisioning_store;
+
+    if (provisioning_store != NX_NULL &&
+        provisioning_store_load(provisioning_store,
+            iot_dps_id_scope,
+            iot_registration_id,
+            azure_iot_mqtt->mqtt_hub_hostname,
+            sizeof(azure_iot_mqtt->mqtt_hub_hostname),
+            azure_iot_mqtt->mqtt_device_id,
+            sizeof(azure_iot_mqtt->mqtt_device_id)) == NX_SUCCESS)
+    {
+        LOG_INFO(LOG_MODULE_MQTT, "SUCCESS: Using stored DPS assignment\r\n");
+        azure_iot_mqtt->mqtt_dps_cached = true;
+    }
+    else if ((status = mqtt_dps_provision(azure_iot_mqtt, nx_ip, nx_pool)))
     {
-        printf("Error in subscribing to server (0x%02x)\r\n", status);
-        nx_secure_tls_session_delete(&azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_tls_session);
         return status;
     }
 
-    status = nxd_mqtt_client_subscribe(
-        &azure_iot_mqtt->nxd_mqtt_client, DIRECT_METHOD_TOPIC, strlen(DIRECT_METHOD_TOPIC), MQTT_QOS_0);
-    if (status != NXD_MQTT_SUCCESS)
+    // call into common code
+    return azure_iot_mqtt_create_common(azure_iot_mqtt, nx_ip, nx_pool);
+}
+
+UINT azure_iot_mqtt_delete(AZURE_IOT_MQTT* azure_iot_mqtt)
+{
+    azure_iot_mqtt_publish_window_abort(
+        &azure_iot_mqtt->mqtt_publish_window, &azure_iot_mqtt->nxd_mqtt_client, NX_NOT_CONNECTED);
+
+    tx_timer_delete(&azure_iot_mqtt->mqtt_sas_timer);
+    connection_supervisor_delete(&azure_iot_mqtt->mqtt_supervisor);
+    reported_properties_delete(&azure_iot_mqtt->mqtt_reported_properties);
+
+    nxd_mqtt_client_disconnect(&azure_iot_mqtt->nxd_mqtt_client);
+    nxd_mqtt_client_delete(&azure_iot_mqtt->nxd_mqtt_client);
+
+    return NXD_MQTT_SUCCESS;
+}
+
+UINT azure_iot_mqtt_connect(AZURE_IOT_MQTT* azure_iot_mqtt)
+{
+    UINT status;
+
+    LOG_INFO(LOG_MODULE_MQTT, "\tHub hostname: %s", azure_iot_mqtt->mqtt_hub_hostname);
+    LOG_INFO(LOG_MODULE_MQTT, "\tDevice id: %s", azure_iot_mqtt->mqtt_device_id);
+    LOG_INFO(LOG_MODULE_MQTT, "\tModel id: %s", azure_iot_mqtt->mqtt_model_id);
+
+    if ((status = mqtt_topics_create(azure_iot_mqtt)) || (status = mqtt_router_create(azure_iot_mqtt)))
     {
-        printf("Error in direct method subscribing to server (0x%02x)\r\n", status);
-        nx_secure_tls_session_delete(&azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_tls_session);
         return status;
     }
 
-    status = nxd_mqtt_client_subscribe(
-        &azure_iot_mqtt->nxd_mqtt_client, DEVICE_TWIN_RES_TOPIC, strlen(DEVICE_TWIN_RES_TOPIC), MQTT_QOS_0);
-    if (status != NXD_MQTT_SUCCESS)
+    // First attempt runs here so the caller sees the result, reconnects are left to the supervisor
+    status = connection_supervisor_connect(&azure_iot_mqtt->mqtt_supervisor);
+    if (status != NX_SUCCESS && azure_iot_mqtt->mqtt_dps_cached &&
+        (status == NXD_MQTT_ERROR_BAD_USERNAME_PASSWORD || status == NXD_MQTT_ERROR_NOT_AUTHORIZED))
     {
-        printf("Error in device twin response subscribing to server (0x%02x)\r\n", status);
-        nx_secure_tls_session_delete(&azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_tls_session);
-        return status;
+        if ((status = mqtt_dps_reprovision(azure_iot_mqtt)) == NX_SUCCESS)
+        {
+            status = connection_supervisor_connect(&azure_iot_mqtt->mqtt_supervisor);
+        }
     }
 
-    status = nxd_mqtt_client_subscribe(&azure_iot_mqtt->nxd_mqtt_client,
-        DEVICE_TWIN_DESIRED_PROP_RES_TOPIC,
-        strlen(DEVICE_TWIN_DESIRED_PROP_RES_TOPIC),
-        MQTT_QOS_0);
-    if (status != NXD_MQTT_SUCCESS)
+    if (status != NX_SUCCESS)
     {
-        printf("Error in device twin desired properties response subscribing to server (0x%02x)\r\n", status);
         return status;
     }
 
-    printf("SUCCESS: MQTT Hub client initialized\r\n\r\n");
+    LOG_INFO(LOG_MODULE_MQTT, "SUCCESS: MQTT Hub client initialized\r\n");
 
     return NXD_MQTT_SUCCESS;
 }
 
 UINT azure_iot_mqtt_disconnect(AZURE_IOT_MQTT* azure_iot_mqtt)
 {
+    // Intentional, don't let the supervisor bring it back
+    connection_supervisor_stop(&azure_iot_mqtt->mqtt_supervisor);
+
     UINT status = nxd_mqtt_client_disconnect(&azure_iot_mqtt->nxd_mqtt_client);
 
     return status;
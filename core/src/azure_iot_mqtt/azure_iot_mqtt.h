@@ -13,19 +13,53 @@
 #include "nxd_mqtt_client.h"
 
 #include "azure_iot_ciphersuites.h"
-
-#define AZURE_IOT_MQTT_HOSTNAME_SIZE           100
-#define AZURE_IOT_MQTT_DEVICE_ID_SIZE          64
-#define AZURE_IOT_MQTT_USERNAME_SIZE           256
-#define AZURE_IOT_MQTT_PASSWORD_SIZE           256
-#define AZURE_IOT_MQTT_TOPIC_NAME_LENGTH       256
-#define AZURE_IOT_MQTT_MESSAGE_LENGTH          1024
-#define AZURE_IOT_MQTT_DIRECT_COMMAND_RID_SIZE 6
-
+#include "connection_supervisor.h"
+#include "provisioning_store.h"
+#include "reported_properties.h"
+#include "store_forward.h"
+#include "azure_iot_mqtt_method.h"
+#include "azure_iot_mqtt_publish.h"
+#include "azure_iot_mqtt_router.h"
+#include "azure_iot_mqtt_topics.h"
+#include "azure_iot_mqtt/sas_token.h"
+
+#define AZURE_IOT_MQTT_HOSTNAME_SIZE     100
+#define AZURE_IOT_MQTT_DEVICE_ID_SIZE    64
+#define AZURE_IOT_MQTT_TOPIC_NAME_LENGTH 256
+
+#define AZURE_IOT_MQTT_DPS_OPERATION_ID_SIZE 96
+
+// Default buffer profile
+#define AZURE_IOT_MQTT_USERNAME_SIZE     256
 #define AZURE_IOT_MQTT_CLIENT_STACK_SIZE 4096
-#define AZURE_IOT_MQTT_CERT_BUFFER_SIZE 4096
-
-#define TLS_PACKET_BUFFER 4096
+#define AZURE_IOT_MQTT_CERT_BUFFER_SIZE  4096
+#define TLS_PACKET_BUFFER                4096
+
+// Each buffer in the arena starts on a ULONG boundary
+#define AZURE_IOT_MQTT_ARENA_ALIGN(size) (((size) + sizeof(ULONG) - 1) & ~(sizeof(ULONG) - 1))
+
+// Compile time equivalent of azure_iot_mqtt_arena_size, for sizing static arenas
+#define AZURE_IOT_MQTT_ARENA_SIZE(stack, tls_metadata, tls_packet, remote_cert, username) \
+    (AZURE_IOT_MQTT_ARENA_ALIGN(stack) + AZURE_IOT_MQTT_ARENA_ALIGN(tls_metadata) \
+        + AZURE_IOT_MQTT_ARENA_ALIGN(tls_packet) + AZURE_IOT_MQTT_ARENA_ALIGN(remote_cert) \
+        + AZURE_IOT_MQTT_ARENA_ALIGN(username))
+
+#define AZURE_IOT_MQTT_ARENA_SIZE_DEFAULT \
+    AZURE_IOT_MQTT_ARENA_SIZE(AZURE_IOT_MQTT_CLIENT_STACK_SIZE, \
+        NX_AZURE_IOT_TLS_METADATA_BUFFER_SIZE, \
+        TLS_PACKET_BUFFER, \
+        AZURE_IOT_MQTT_CERT_BUFFER_SIZE, \
+        AZURE_IOT_MQTT_USERNAME_SIZE)
+
+// Decimals used for float properties and telemetry, NUMBER_FORMAT_SHORTEST sends every significant digit
+#ifndef AZURE_IOT_MQTT_FLOAT_DECIMALS
+#define AZURE_IOT_MQTT_FLOAT_DECIMALS 2
+#endif
+
+// Largest merged reported property patch
+#ifndef AZURE_IOT_MQTT_PATCH_SIZE
+#define AZURE_IOT_MQTT_PATCH_SIZE 512
+#endif
 
 #define MQTT_QOS_0 0 // QoS 0 - Deliver at most once
 #define MQTT_QOS_1 1 // QoS 1 - Deliver at least once
@@ -33,20 +67,38 @@
 
 typedef struct AZURE_IOT_MQTT_STRUCT AZURE_IOT_MQTT;
 
-typedef void (*func_ptr_direct_method)(AZURE_IOT_MQTT*, CHAR*, CHAR*);
-typedef void (*func_ptr_c2d_message)(AZURE_IOT_MQTT*, CHAR*, CHAR*);
-typedef void (*func_ptr_device_twin_desired_prop)(AZURE_IOT_MQTT*, CHAR*);
-typedef void (*func_ptr_device_twin_prop)(AZURE_IOT_MQTT*, CHAR*);
+// Sizes of the buffers carved out of the caller's arena. DPS registration and the Hub connection
+// run one after the other on the same client, so they share one set.
+typedef struct AZURE_IOT_MQTT_BUFFER_PROFILE_STRUCT
+{
+    ULONG client_stack_size;
+    ULONG tls_metadata_size; // Crypto state for the negotiated cipher suite
+    ULONG tls_packet_size; // Largest TLS record that can be received
+    ULONG remote_cert_size; // Largest certificate the server may present
+    ULONG username_size;
+} AZURE_IOT_MQTT_BUFFER_PROFILE;
+
+extern const AZURE_IOT_MQTT_BUFFER_PROFILE azure_iot_mqtt_buffer_profile_default;
+
+// Messages are read-only views over the received packet and are only valid during the callback.
+// A direct method may be answered later from any thread by passing its handle to
+// azure_iot_mqtt_respond_direct_method, copy out whatever is needed from the payload first.
+typedef void (*func_ptr_direct_method)(
+    AZURE_IOT_MQTT*, CHAR*, AZURE_IOT_MQTT_METHOD_HANDLE, AZURE_IOT_MQTT_MESSAGE*);
+typedef void (*func_ptr_c2d_message)(AZURE_IOT_MQTT*, AZURE_IOT_MQTT_SPAN*, AZURE_IOT_MQTT_MESSAGE*);
+typedef void (*func_ptr_device_twin_desired_prop)(AZURE_IOT_MQTT*, AZURE_IOT_MQTT_MESSAGE*);
+typedef void (*func_ptr_device_twin_prop)(AZURE_IOT_MQTT*, AZURE_IOT_MQTT_MESSAGE*);
 typedef ULONG (*func_ptr_unix_time_get)(VOID);
 
 struct AZURE_IOT_MQTT_STRUCT
 {
     NXD_MQTT_CLIENT nxd_mqtt_client;
+    NX_IP* nx_ip;
+    NX_PACKET_POOL* nx_pool;
     NX_DNS* nx_dns;
 
     // TX_MUTEX mqtt_mutex;
     TX_EVENT_FLAGS_GROUP mqtt_event_flags;
-    UINT mqtt_dps_status;
 
     // Hub config
     CHAR mqtt_hub_hostname[AZURE_IOT_MQTT_HOSTNAME_SIZE];
@@ -55,30 +107,46 @@ struct AZURE_IOT_MQTT_STRUCT
     CHAR* mqtt_dps_id_scope;
     CHAR* mqtt_dps_registration_id;
 
+    // DPS registration progress, the operation status is polled from a timer
+    TX_TIMER dps_poll_timer;
+    UINT dps_request_id; // rid of the request we are waiting on
+    UINT dps_polls;
+    CHAR dps_operation_id[AZURE_IOT_MQTT_DPS_OPERATION_ID_SIZE];
+
+    PROVISIONING_STORE* mqtt_provisioning_store;
+    bool mqtt_dps_cached; // Hub assignment came from the store rather than DPS
+
     // Device config
     CHAR mqtt_device_id[AZURE_IOT_MQTT_DEVICE_ID_SIZE];
     CHAR* mqtt_sas_key;
     CHAR* mqtt_model_id;
 
-    UINT dps_retry_interval;
-
     UINT reported_property_version;
     UINT desired_property_version;
-    CHAR direct_command_request_id[AZURE_IOT_MQTT_DIRECT_COMMAND_RID_SIZE];
-
-    CHAR mqtt_username[AZURE_IOT_MQTT_USERNAME_SIZE];
-    CHAR mqtt_password[AZURE_IOT_MQTT_PASSWORD_SIZE];
 
-    CHAR mqtt_receive_topic_buffer[AZURE_IOT_MQTT_TOPIC_NAME_LENGTH];
-    CHAR mqtt_receive_message_buffer[AZURE_IOT_MQTT_MESSAGE_LENGTH];
-
-    ULONG mqtt_client_stack[AZURE_IOT_MQTT_CLIENT_STACK_SIZE / sizeof(ULONG)];
-
-    ULONG tls_metadata_buffer[NX_AZURE_IOT_TLS_METADATA_BUFFER_SIZE / sizeof(ULONG)];
-    UCHAR tls_packet_buffer[TLS_PACKET_BUFFER];
-
-    NX_SECURE_X509_CERT mqtt_remote_certificate;	
-    UCHAR mqtt_remote_cert_buffer[AZURE_IOT_MQTT_CERT_BUFFER_SIZE];
+    // Carved out of the arena passed to create
+    AZURE_IOT_MQTT_BUFFER_PROFILE mqtt_buffers;
+    CHAR* mqtt_username;
+    ULONG* mqtt_client_stack;
+    ULONG* tls_metadata_buffer;
+    UCHAR* tls_packet_buffer;
+    UCHAR* mqtt_remote_cert_buffer;
+
+    // Also the MQTT password, NetX keeps a pointer to it while connected
+    SAS_TOKEN_CACHE mqtt_sas_token;
+    TX_TIMER mqtt_sas_timer;
+
+    AZURE_IOT_MQTT_TOPICS mqtt_topics;
+    AZURE_IOT_MQTT_ROUTER mqtt_router;
+    AZURE_IOT_MQTT_PUBLISH_WINDOW mqtt_publish_window;
+    AZURE_IOT_MQTT_METHOD_TABLE mqtt_methods;
+    REPORTED_PROPERTIES mqtt_reported_properties;
+    STORE_FORWARD_QUEUE* mqtt_store_forward;
+    CONNECTION_SUPERVISOR mqtt_supervisor;
+
+    NX_SECURE_X509_CERT mqtt_remote_certificate;
+    NX_SECURE_X509_CERT mqtt_trusted_cert;
+    bool mqtt_trusted_cert_ready;
 
     func_ptr_direct_method cb_ptr_mqtt_invoke_direct_method;
     func_ptr_c2d_message cb_ptr_mqtt_c2d_message;
@@ -97,22 +165,59 @@ UINT azure_iot_mqtt_register_device_twin_desired_prop_callback(
 UINT azure_iot_mqtt_register_device_twin_prop_callback(
     AZURE_IOT_MQTT* azure_iot_mqtt, func_ptr_device_twin_prop mqtt_device_twin_prop_callback);
 
+// Called with the AZURE_IOT_MQTT as context on every connection state change
+UINT azure_iot_mqtt_register_connection_state_callback(
+    AZURE_IOT_MQTT* azure_iot_mqtt, func_ptr_connection_state connection_state_callback);
+UINT azure_iot_mqtt_connection_metrics_get(AZURE_IOT_MQTT* azure_iot_mqtt, CONNECTION_SUPERVISOR_METRICS* metrics);
+
+// Lifetime of generated SAS tokens and how long before expiry the connection re-authenticates
+UINT azure_iot_mqtt_configure_sas_token(AZURE_IOT_MQTT* azure_iot_mqtt, ULONG lifetime, ULONG renew_margin);
+
 UINT tls_setup(NXD_MQTT_CLIENT* client,
     NX_SECURE_TLS_SESSION* tls_session,
     NX_SECURE_X509_CERT* cert,
     NX_SECURE_X509_CERT* trusted_cert);
 
+UINT azure_iot_mqtt_packet_receive_notify(NXD_MQTT_CLIENT* client_ptr, NX_PACKET* packet_ptr, VOID* context);
+
 UINT mqtt_publish(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHAR* message);
 
+// Non-blocking publish. QoS 1 messages take a slot in the in-flight window until they are
+// acknowledged or time out, NX_NO_MORE_ENTRIES is returned while the window is full.
+UINT azure_iot_mqtt_publish_async(AZURE_IOT_MQTT* azure_iot_mqtt,
+    CHAR* topic,
+    CHAR* message,
+    UINT message_length,
+    func_ptr_publish_complete callback,
+    VOID* context);
+UINT azure_iot_mqtt_publish_qos0(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHAR* message, UINT message_length);
+UINT azure_iot_mqtt_publish_poll(AZURE_IOT_MQTT* azure_iot_mqtt);
+UINT azure_iot_mqtt_configure_publish_window(AZURE_IOT_MQTT* azure_iot_mqtt, UINT window_size, ULONG timeout);
+
+// Telemetry that cannot be sent is kept in the queue and replayed once connected
+UINT azure_iot_mqtt_store_forward_set(AZURE_IOT_MQTT* azure_iot_mqtt, STORE_FORWARD_QUEUE* queue);
+
+// Property updates are staged and merged into one twin patch, sent REPORTED_PROPERTIES_WINDOW_DEFAULT
+// after the first of them or by an explicit flush. The staging area is also open for direct use, e.g.
+// for component properties.
 UINT azure_iot_mqtt_publish_float_property(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* label, float value);
 UINT azure_iot_mqtt_publish_bool_property(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* label, bool value);
 UINT azure_iot_mqtt_publish_float_telemetry(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* label, float value);
 UINT azure_iot_mqtt_publish_int_writeable_property(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* label, int value);
 UINT azure_iot_mqtt_respond_int_writeable_property(
     AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* label, int value, int http_status);
-UINT azure_iot_mqtt_respond_direct_method(AZURE_IOT_MQTT* azure_iot_mqtt, UINT response);
+UINT azure_iot_mqtt_reported_properties_flush(AZURE_IOT_MQTT* azure_iot_mqtt);
+UINT azure_iot_mqtt_respond_direct_method(
+    AZURE_IOT_MQTT* azure_iot_mqtt, AZURE_IOT_MQTT_METHOD_HANDLE handle, UINT response);
+UINT azure_iot_mqtt_direct_method_metrics_get(AZURE_IOT_MQTT* azure_iot_mqtt, AZURE_IOT_MQTT_METHOD_METRICS* metrics);
 UINT azure_iot_mqtt_device_twin_request(AZURE_IOT_MQTT* azure_iot_mqtt);
 
+// Bytes of arena needed for a profile, NULL for the default profile
+ULONG azure_iot_mqtt_arena_size(const AZURE_IOT_MQTT_BUFFER_PROFILE* profile);
+
+// The arena must outlive the client and be at least azure_iot_mqtt_arena_size(profile) bytes,
+// pass NULL as the profile for the default sizes. With a provisioning store the DPS assignment is
+// remembered and later boots go straight to the hub, pass NULL to register on every boot.
 UINT azure_iot_mqtt_create(AZURE_IOT_MQTT* azure_iot_mqtt,
     NX_IP* nx_ip,
     NX_PACKET_POOL* nx_pool,
@@ -121,7 +226,10 @@ UINT azure_iot_mqtt_create(AZURE_IOT_MQTT* azure_iot_mqtt,
     CHAR* iot_hub_hostname,
     CHAR* iot_device_id,
     CHAR* iot_sas_key,
-    CHAR* iot_model_id);
+    CHAR* iot_model_id,
+    VOID* arena,
+    ULONG arena_size,
+    const AZURE_IOT_MQTT_BUFFER_PROFILE* profile);
 UINT azure_iot_mqtt_create_with_dps(AZURE_IOT_MQTT* azure_iot_mqtt,
     NX_IP* nx_ip,
     NX_PACKET_POOL* nx_pool,
@@ -130,7 +238,11 @@ UINT azure_iot_mqtt_create_with_dps(AZURE_IOT_MQTT* azure_iot_mqtt,
     CHAR* iot_dps_id_scope,
     CHAR* iot_device_id,
     CHAR* iot_sas_key,
-    CHAR* iot_model_id);
+    CHAR* iot_model_id,
+    PROVISIONING_STORE* provisioning_store,
+    VOID* arena,
+    ULONG arena_size,
+    const AZURE_IOT_MQTT_BUFFER_PROFILE* profile);
 UINT azure_iot_mqtt_delete(AZURE_IOT_MQTT* azure_iot_mqtt);
 
 UINT azure_iot_mqtt_connect(AZURE_IOT_MQTT* azure_iot_mqtt);
@@ -0,0 +1,181 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "azure_iot_mqtt_message.h"
+
+#include <string.h>
+
+#include "logging.h"
+
+VOID azure_iot_mqtt_message_init(AZURE_IOT_MQTT_MESSAGE* message, NX_PACKET* packet, ULONG offset, ULONG length)
+{
+    message->packet        = packet;
+    message->offset        = offset;
+    message->length        = length;
+    message->linear_packet = NX_NULL;
+}
+
+VOID azure_iot_mqtt_message_release(AZURE_IOT_MQTT_MESSAGE* message)
+{
+    // The packet chain itself belongs to whoever received it, only drop our copy
+    if (message->linear_packet != NX_NULL)
+    {
+        nx_packet_release(message->linear_packet);
+        message->linear_packet = NX_NULL;
+    }
+}
+
+bool azure_iot_mqtt_message_chunk_next(
+    const AZURE_IOT_MQTT_MESSAGE* message, ULONG* position, AZURE_IOT_MQTT_SPAN* chunk)
+{
+    NX_PACKET* packet = message->packet;
+    ULONG skip;
+    ULONG available = 0;
+
+    if (*position >= message->length)
+    {
+        return false;
+    }
+
+    // Find the packet in the chain holding the next byte
+    skip = message->offset + *position;
+    while (packet != NX_NULL)
+    {
+        available = packet->nx_packet_append_ptr - packet->nx_packet_prepend_ptr;
+        if (skip < available)
+        {
+            break;
+        }
+
+        skip -= available;
+        packet = packet->nx_packet_next;
+    }
+
+    if (packet == NX_NULL)
+    {
+        return false;
+    }
+
+    chunk->ptr    = (const CHAR*)packet->nx_packet_prepend_ptr + skip;
+    chunk->length = available - skip;
+    if (chunk->length > message->length - *position)
+    {
+        chunk->length = message->length - *position;
+    }
+
+    *position += chunk->length;
+
+    return true;
+}
+
+UINT azure_iot_mqtt_message_span_get(AZURE_IOT_MQTT_MESSAGE* message, AZURE_IOT_MQTT_SPAN* span)
+{
+    NX_PACKET* linear_packet;
+    ULONG position = 0;
+    ULONG bytes_copied;
+    UINT status;
+
+    if (message->length == 0)
+    {
+        span->ptr    = "";
+        span->length = 0;
+        return NX_SUCCESS;
+    }
+
+    // Most messages arrive in a single packet and can be used in place
+    if (azure_iot_mqtt_message_chunk_next(message, &position, span) && span->length == message->length)
+    {
+        return NX_SUCCESS;
+    }
+
+    if (message->linear_packet == NX_NULL)
+    {
+        // Gather the chain into one packet from the same pool rather than a dedicated buffer
+        status = nx_packet_allocate(
+            message->packet->nx_packet_pool_owner, &linear_packet, NX_RECEIVE_PACKET, NX_NO_WAIT);
+        if (status != NX_SUCCESS)
+        {
+            LOG_ERROR(LOG_MODULE_MQTT, "Unable to allocate packet to linearize message (0x%02x)", status);
+            return status;
+        }
+
+        if (message->length > (ULONG)(linear_packet->nx_packet_data_end - linear_packet->nx_packet_prepend_ptr))
+        {
+            LOG_ERROR(LOG_MODULE_MQTT, "Message of %lu bytes does not fit in a single packet", message->length);
+            nx_packet_release(linear_packet);
+            return NX_SIZE_ERROR;
+        }
+
+        status = nx_packet_data_extract_offset(message->packet,
+            message->offset,
+            linear_packet->nx_packet_prepend_ptr,
+            message->length,
+            &bytes_copied);
+        if (status != NX_SUCCESS || bytes_copied != message->length)
+        {
+            LOG_ERROR(LOG_MODULE_MQTT, "Unable to linearize message (0x%02x)", status);
+            nx_packet_release(linear_packet);
+            return NX_NOT_SUCCESSFUL;
+        }
+
+        linear_packet->nx_packet_append_ptr = linear_packet->nx_packet_prepend_ptr + message->length;
+        linear_packet->nx_packet_length     = message->length;
+
+        message->linear_packet = linear_packet;
+    }
+
+    span->ptr    = (const CHAR*)message->linear_packet->nx_packet_prepend_ptr;
+    span->length = message->length;
+
+    return NX_SUCCESS;
+}
+
+UINT azure_iot_mqtt_message_copy(const AZURE_IOT_MQTT_MESSAGE* message, CHAR* buffer, UINT buffer_size)
+{
+    ULONG bytes_copied = 0;
+    ULONG length;
+    UINT status;
+
+    if (buffer == NX_NULL || buffer_size == 0)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    // Leave room for the null terminator
+    length = message->length < buffer_size ? message->length : buffer_size - 1;
+
+    if (length > 0)
+    {
+        status = nx_packet_data_extract_offset(message->packet, message->offset, buffer, length, &bytes_copied);
+        if (status != NX_SUCCESS)
+        {
+            buffer[0] = 0;
+            return status;
+        }
+    }
+
+    buffer[bytes_copied] = 0;
+
+    return bytes_copied == message->length ? NX_SUCCESS : NX_SIZE_ERROR;
+}
+
+bool azure_iot_mqtt_message_equals(const AZURE_IOT_MQTT_MESSAGE* message, const CHAR* str, UINT str_length)
+{
+    AZURE_IOT_MQTT_SPAN chunk;
+    ULONG position = 0;
+
+    if (message->length != str_length)
+    {
+        return false;
+    }
+
+    while (azure_iot_mqtt_message_chunk_next(message, &position, &chunk))
+    {
+        if (memcmp(chunk.ptr, str + position - chunk.length, chunk.length) != 0)
+        {
+            return false;
+        }
+    }
+
+    return position == str_length;
+}
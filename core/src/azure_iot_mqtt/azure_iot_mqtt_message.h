@@ -0,0 +1,49 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _AZURE_IOT_MQTT_MESSAGE_H
+#define _AZURE_IOT_MQTT_MESSAGE_H
+
+#include <stdbool.h>
+
+#include "tx_api.h"
+
+#include "nx_api.h"
+
+// Length delimited view into received data, not null terminated
+typedef struct AZURE_IOT_MQTT_SPAN_STRUCT
+{
+    const CHAR* ptr;
+    UINT length;
+} AZURE_IOT_MQTT_SPAN;
+
+// Read-only view over part of a received NX_PACKET chain. The view is only valid for the
+// duration of the callback it is passed to, the packet is released once the callback returns.
+typedef struct AZURE_IOT_MQTT_MESSAGE_STRUCT
+{
+    NX_PACKET* packet; // Head of the packet chain
+    ULONG offset;      // Offset of the first byte from the head prepend pointer
+    ULONG length;      // Total length, which may span several packets
+
+    NX_PACKET* linear_packet; // Single packet copy made by azure_iot_mqtt_message_span_get, if any
+} AZURE_IOT_MQTT_MESSAGE;
+
+VOID azure_iot_mqtt_message_init(AZURE_IOT_MQTT_MESSAGE* message, NX_PACKET* packet, ULONG offset, ULONG length);
+VOID azure_iot_mqtt_message_release(AZURE_IOT_MQTT_MESSAGE* message);
+
+// Walks the message a packet at a time from *position, returns false once all of it has been seen.
+// Prefer this for payloads of unbounded size, it never copies.
+bool azure_iot_mqtt_message_chunk_next(
+    const AZURE_IOT_MQTT_MESSAGE* message, ULONG* position, AZURE_IOT_MQTT_SPAN* chunk);
+
+// Contiguous view of the whole message, for consumers that need one piece such as jsmn. A message that
+// straddles packets is gathered into one packet of the same pool, so it fails with NX_SIZE_ERROR if the
+// message is larger than the pool payload size (1536 bytes with networking.c, above the 1024 byte
+// receive buffer this replaced). Topics, DPS responses and the sample twin documents fit well inside that.
+UINT azure_iot_mqtt_message_span_get(AZURE_IOT_MQTT_MESSAGE* message, AZURE_IOT_MQTT_SPAN* span);
+
+// Copies into a null terminated buffer, NX_SIZE_ERROR if it had to be cut short
+UINT azure_iot_mqtt_message_copy(const AZURE_IOT_MQTT_MESSAGE* message, CHAR* buffer, UINT buffer_size);
+bool azure_iot_mqtt_message_equals(const AZURE_IOT_MQTT_MESSAGE* message, const CHAR* str, UINT str_length);
+
+#endif // _AZURE_IOT_MQTT_MESSAGE_H
@@ -0,0 +1,192 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "azure_iot_mqtt_method.h"
+
+#include <string.h>
+
+#include "logging.h"
+
+// Must be called with the client mutex held
+static VOID method_table_expire(AZURE_IOT_MQTT_METHOD_TABLE* table, ULONG now)
+{
+    AZURE_IOT_MQTT_METHOD_REQUEST* request;
+
+    for (UINT i = 0; i < AZURE_IOT_MQTT_METHOD_MAX; i++)
+    {
+        request = &table->requests[i];
+
+        if (request->handle != 0 && now - request->arrival_time >= AZURE_IOT_MQTT_METHOD_TIMEOUT)
+        {
+            LOG_WARN(
+                LOG_MODULE_MQTT, "Direct method=%s, rid=%s was never answered", request->name, request->request_id);
+            request->handle = 0;
+            table->in_flight--;
+            table->metrics.expired++;
+        }
+    }
+}
+
+UINT azure_iot_mqtt_method_table_init(AZURE_IOT_MQTT_METHOD_TABLE* table)
+{
+    if (table == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    memset(table, 0, sizeof(*table));
+
+    return NX_SUCCESS;
+}
+
+UINT azure_iot_mqtt_method_begin(AZURE_IOT_MQTT_METHOD_TABLE* table,
+    NXD_MQTT_CLIENT* client,
+    AZURE_IOT_MQTT_SPAN* name,
+    AZURE_IOT_MQTT_SPAN* request_id,
+    AZURE_IOT_MQTT_METHOD_HANDLE* handle)
+{
+    AZURE_IOT_MQTT_METHOD_REQUEST* request = NX_NULL;
+    ULONG now                              = tx_time_get();
+
+    if (table == NX_NULL || name == NX_NULL || request_id == NX_NULL || handle == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    tx_mutex_get(client->nxd_mqtt_client_mutex_ptr, TX_WAIT_FOREVER);
+
+    table->metrics.received++;
+
+    if (name->length >= AZURE_IOT_MQTT_METHOD_NAME_SIZE || request_id->length >= AZURE_IOT_MQTT_METHOD_RID_SIZE)
+    {
+        table->metrics.rejected++;
+        tx_mutex_put(client->nxd_mqtt_client_mutex_ptr);
+        return NX_SIZE_ERROR;
+    }
+
+    method_table_expire(table, now);
+
+    for (UINT i = 0; i < AZURE_IOT_MQTT_METHOD_MAX; i++)
+    {
+        if (table->requests[i].handle == 0)
+        {
+            request = &table->requests[i];
+            break;
+        }
+    }
+
+    if (request == NX_NULL)
+    {
+        table->metrics.rejected++;
+        tx_mutex_put(client->nxd_mqtt_client_mutex_ptr);
+        return NX_NO_MORE_ENTRIES;
+    }
+
+    // Never hand out 0, it marks a free slot
+    if (++table->sequence == 0)
+    {
+        table->sequence = 1;
+    }
+
+    request->handle       = table->sequence;
+    request->arrival_time = now;
+
+    memcpy(request->name, name->ptr, name->length);
+    request->name[name->length] = 0;
+
+    memcpy(request->request_id, request_id->ptr, request_id->length);
+    request->request_id[request_id->length] = 0;
+
+    table->in_flight++;
+    if (table->in_flight > table->metrics.max_in_flight)
+    {
+        table->metrics.max_in_flight = table->in_flight;
+    }
+
+    *handle = request->handle;
+
+    tx_mutex_put(client->nxd_mqtt_client_mutex_ptr);
+
+    return NX_SUCCESS;
+}
+
+UINT azure_iot_mqtt_method_end(AZURE_IOT_MQTT_METHOD_TABLE* table,
+    NXD_MQTT_CLIENT* client,
+    AZURE_IOT_MQTT_METHOD_HANDLE handle,
+    AZURE_IOT_MQTT_METHOD_REQUEST* request)
+{
+    ULONG latency;
+    UINT status = NX_NOT_FOUND;
+
+    if (table == NX_NULL || request == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    if (handle == 0)
+    {
+        return NX_NOT_FOUND;
+    }
+
+    tx_mutex_get(client->nxd_mqtt_client_mutex_ptr, TX_WAIT_FOREVER);
+
+    for (UINT i = 0; i < AZURE_IOT_MQTT_METHOD_MAX; i++)
+    {
+        if (table->requests[i].handle == handle)
+        {
+            *request                  = table->requests[i];
+            table->requests[i].handle = 0;
+            table->in_flight--;
+
+            latency = tx_time_get() - request->arrival_time;
+
+            table->metrics.completed++;
+            table->metrics.last_latency_ticks = latency;
+            table->metrics.total_latency_ticks += latency;
+            if (latency > table->metrics.max_latency_ticks)
+            {
+                table->metrics.max_latency_ticks = latency;
+            }
+
+            status = NX_SUCCESS;
+            break;
+        }
+    }
+
+    tx_mutex_put(client->nxd_mqtt_client_mutex_ptr);
+
+    return status;
+}
+
+VOID azure_iot_mqtt_method_abort(AZURE_IOT_MQTT_METHOD_TABLE* table, NXD_MQTT_CLIENT* client)
+{
+    tx_mutex_get(client->nxd_mqtt_client_mutex_ptr, TX_WAIT_FOREVER);
+
+    for (UINT i = 0; i < AZURE_IOT_MQTT_METHOD_MAX; i++)
+    {
+        if (table->requests[i].handle != 0)
+        {
+            table->requests[i].handle = 0;
+            table->metrics.expired++;
+        }
+    }
+
+    table->in_flight = 0;
+
+    tx_mutex_put(client->nxd_mqtt_client_mutex_ptr);
+}
+
+UINT azure_iot_mqtt_method_metrics_get(
+    AZURE_IOT_MQTT_METHOD_TABLE* table, NXD_MQTT_CLIENT* client, AZURE_IOT_MQTT_METHOD_METRICS* metrics)
+{
+    if (table == NX_NULL || metrics == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    tx_mutex_get(client->nxd_mqtt_client_mutex_ptr, TX_WAIT_FOREVER);
+    *metrics = table->metrics;
+    tx_mutex_put(client->nxd_mqtt_client_mutex_ptr);
+
+    return NX_SUCCESS;
+}
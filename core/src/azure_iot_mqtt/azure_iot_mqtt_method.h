@@ -0,0 +1,81 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _AZURE_IOT_MQTT_METHOD_H
+#define _AZURE_IOT_MQTT_METHOD_H
+
+#include <stdbool.h>
+
+#include "tx_api.h"
+
+#include "nx_api.h"
+#include "nxd_mqtt_client.h"
+
+#include "azure_iot_mqtt_message.h"
+
+// Upper bound on direct method requests waiting for a response
+#ifndef AZURE_IOT_MQTT_METHOD_MAX
+#define AZURE_IOT_MQTT_METHOD_MAX 4
+#endif
+
+#define AZURE_IOT_MQTT_METHOD_NAME_SIZE 64
+#define AZURE_IOT_MQTT_METHOD_RID_SIZE  32
+
+// IoT Hub gives up on a method after at most 300 seconds, slots older than that are reclaimed
+#define AZURE_IOT_MQTT_METHOD_TIMEOUT (300 * TX_TIMER_TICKS_PER_SECOND)
+
+// Identifies one method invocation until it is answered, stale handles are rejected
+typedef ULONG AZURE_IOT_MQTT_METHOD_HANDLE;
+
+typedef struct AZURE_IOT_MQTT_METHOD_REQUEST_STRUCT
+{
+    AZURE_IOT_MQTT_METHOD_HANDLE handle; // 0 when the slot is free
+    ULONG arrival_time;
+    CHAR name[AZURE_IOT_MQTT_METHOD_NAME_SIZE];
+    CHAR request_id[AZURE_IOT_MQTT_METHOD_RID_SIZE];
+} AZURE_IOT_MQTT_METHOD_REQUEST;
+
+typedef struct AZURE_IOT_MQTT_METHOD_METRICS_STRUCT
+{
+    ULONG received;
+    ULONG completed;
+    ULONG rejected;             // Refused because the table was full or the rid too long
+    ULONG expired;              // Dropped unanswered on timeout or disconnect
+    ULONG max_in_flight;
+    ULONG last_latency_ticks;   // From arrival to the response being published
+    ULONG max_latency_ticks;
+    ULONG total_latency_ticks;
+} AZURE_IOT_MQTT_METHOD_METRICS;
+
+typedef struct AZURE_IOT_MQTT_METHOD_TABLE_STRUCT
+{
+    AZURE_IOT_MQTT_METHOD_REQUEST requests[AZURE_IOT_MQTT_METHOD_MAX];
+    UINT in_flight;
+    ULONG sequence;
+
+    AZURE_IOT_MQTT_METHOD_METRICS metrics;
+} AZURE_IOT_MQTT_METHOD_TABLE;
+
+UINT azure_iot_mqtt_method_table_init(AZURE_IOT_MQTT_METHOD_TABLE* table);
+
+// Claims a slot for an incoming request. The name and rid are copied, so the spans only need to
+// be valid for the duration of the call.
+UINT azure_iot_mqtt_method_begin(AZURE_IOT_MQTT_METHOD_TABLE* table,
+    NXD_MQTT_CLIENT* client,
+    AZURE_IOT_MQTT_SPAN* name,
+    AZURE_IOT_MQTT_SPAN* request_id,
+    AZURE_IOT_MQTT_METHOD_HANDLE* handle);
+
+// Releases the slot and copies out the request, returns NX_NOT_FOUND for an unknown or stale handle
+UINT azure_iot_mqtt_method_end(AZURE_IOT_MQTT_METHOD_TABLE* table,
+    NXD_MQTT_CLIENT* client,
+    AZURE_IOT_MQTT_METHOD_HANDLE handle,
+    AZURE_IOT_MQTT_METHOD_REQUEST* request);
+
+// Forgets every outstanding request, responses to them would be for a session that no longer exists
+VOID azure_iot_mqtt_method_abort(AZURE_IOT_MQTT_METHOD_TABLE* table, NXD_MQTT_CLIENT* client);
+
+UINT azure_iot_mqtt_method_metrics_get(
+    AZURE_IOT_MQTT_METHOD_TABLE* table, NXD_MQTT_CLIENT* client, AZURE_IOT_MQTT_METHOD_METRICS* metrics);
+
+#endif // _AZURE_IOT_MQTT_METHOD_H
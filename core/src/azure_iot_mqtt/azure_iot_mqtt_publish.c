@@ -0,0 +1,193 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "azure_iot_mqtt_publish.h"
+
+#include <string.h>
+
+#include "logging.h"
+
+#define PUBLISH_QOS_1 1
+
+static UINT transmit_queue_depth(NXD_MQTT_CLIENT* client)
+{
+    NX_PACKET* packet = client->message_transmit_queue_head;
+    UINT depth        = 0;
+
+    // NetX holds on to every QoS 1 PUBLISH in this queue until the matching PUBACK arrives
+    while (packet != NX_NULL)
+    {
+        depth++;
+        packet = packet->nx_packet_queue_next;
+    }
+
+    return depth;
+}
+
+// Must be called with the client mutex held. Moves finished slots into completed and
+// returns how many there are, the callbacks are run by the caller once the mutex is released.
+static UINT window_reap(AZURE_IOT_MQTT_PUBLISH_WINDOW* window,
+    NXD_MQTT_CLIENT* client,
+    AZURE_IOT_MQTT_PUBLISH_SLOT* completed,
+    UINT* completed_status)
+{
+    AZURE_IOT_MQTT_PUBLISH_SLOT* slot;
+    ULONG now = tx_time_get();
+    UINT depth;
+    ULONG acked;
+    UINT count = 0;
+
+    if (window->count == 0)
+    {
+        return 0;
+    }
+
+    // The broker acknowledges QoS 1 messages in the order they were sent, so whatever has
+    // left the NetX queue is the oldest part of what we published
+    depth = transmit_queue_depth(client);
+    acked = window->published > depth ? window->published - depth : 0;
+
+    while (window->count > 0)
+    {
+        slot = &window->slots[window->head];
+
+        if (slot->sequence < acked)
+        {
+            completed_status[count] = NX_SUCCESS;
+        }
+        else if (now - slot->sent_time >= window->timeout)
+        {
+            completed_status[count] = NX_NOT_SUCCESSFUL;
+        }
+        else
+        {
+            break;
+        }
+
+        completed[count++] = *slot;
+        window->head       = (window->head + 1) % AZURE_IOT_MQTT_PUBLISH_WINDOW_MAX;
+        window->count--;
+    }
+
+    return count;
+}
+
+static VOID window_complete(AZURE_IOT_MQTT_PUBLISH_SLOT* completed, UINT* completed_status, UINT count)
+{
+    for (UINT i = 0; i < count; i++)
+    {
+        if (completed[i].callback != NX_NULL)
+        {
+            completed[i].callback(completed[i].context, completed_status[i]);
+        }
+    }
+}
+
+UINT azure_iot_mqtt_publish_window_init(AZURE_IOT_MQTT_PUBLISH_WINDOW* window, UINT size, ULONG timeout)
+{
+    if (window == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    if (size == 0 || size > AZURE_IOT_MQTT_PUBLISH_WINDOW_MAX || timeout == 0)
+    {
+        LOG_ERROR(LOG_MODULE_MQTT, "Publish window must be 1 to %d messages", AZURE_IOT_MQTT_PUBLISH_WINDOW_MAX);
+        return NX_SIZE_ERROR;
+    }
+
+    memset(window, 0, sizeof(*window));
+    window->size    = size;
+    window->timeout = timeout;
+
+    return NX_SUCCESS;
+}
+
+UINT azure_iot_mqtt_publish_window_send(AZURE_IOT_MQTT_PUBLISH_WINDOW* window,
+    NXD_MQTT_CLIENT* client,
+    CHAR* topic,
+    UINT topic_length,
+    CHAR* message,
+    UINT message_length,
+    func_ptr_publish_complete callback,
+    VOID* context)
+{
+    AZURE_IOT_MQTT_PUBLISH_SLOT* slot;
+    UINT status;
+
+    // Free up whatever has been acknowledged since the last call
+    azure_iot_mqtt_publish_window_process(window, client);
+
+    tx_mutex_get(client->nxd_mqtt_client_mutex_ptr, TX_WAIT_FOREVER);
+
+    if (window->count >= window->size)
+    {
+        tx_mutex_put(client->nxd_mqtt_client_mutex_ptr);
+        return NX_NO_MORE_ENTRIES;
+    }
+
+    // Publish under the client mutex so the NetX queue order matches our sequence numbers
+    status = nxd_mqtt_client_publish(
+        client, topic, topic_length, message, message_length, NX_FALSE, PUBLISH_QOS_1, NX_NO_WAIT);
+    if (status == NXD_MQTT_SUCCESS)
+    {
+        slot = &window->slots[(window->head + window->count) % AZURE_IOT_MQTT_PUBLISH_WINDOW_MAX];
+        slot->sequence  = window->published++;
+        slot->sent_time = tx_time_get();
+        slot->callback  = callback;
+        slot->context   = context;
+        window->count++;
+    }
+
+    tx_mutex_put(client->nxd_mqtt_client_mutex_ptr);
+
+    return status;
+}
+
+VOID azure_iot_mqtt_publish_window_sent(AZURE_IOT_MQTT_PUBLISH_WINDOW* window, NXD_MQTT_CLIENT* client)
+{
+    // Account for a QoS 1 message published outside the window. Counting it after NetX has
+    // queued it can only delay completions, never report one early.
+    tx_mutex_get(client->nxd_mqtt_client_mutex_ptr, TX_WAIT_FOREVER);
+    window->published++;
+    tx_mutex_put(client->nxd_mqtt_client_mutex_ptr);
+}
+
+VOID azure_iot_mqtt_publish_window_process(AZURE_IOT_MQTT_PUBLISH_WINDOW* window, NXD_MQTT_CLIENT* client)
+{
+    AZURE_IOT_MQTT_PUBLISH_SLOT completed[AZURE_IOT_MQTT_PUBLISH_WINDOW_MAX];
+    UINT completed_status[AZURE_IOT_MQTT_PUBLISH_WINDOW_MAX];
+    UINT count;
+
+    tx_mutex_get(client->nxd_mqtt_client_mutex_ptr, TX_WAIT_FOREVER);
+    count = window_reap(window, client, completed, completed_status);
+    tx_mutex_put(client->nxd_mqtt_client_mutex_ptr);
+
+    window_complete(completed, completed_status, count);
+}
+
+VOID azure_iot_mqtt_publish_window_abort(
+    AZURE_IOT_MQTT_PUBLISH_WINDOW* window, NXD_MQTT_CLIENT* client, UINT status)
+{
+    AZURE_IOT_MQTT_PUBLISH_SLOT completed[AZURE_IOT_MQTT_PUBLISH_WINDOW_MAX];
+    UINT completed_status[AZURE_IOT_MQTT_PUBLISH_WINDOW_MAX];
+    UINT count = 0;
+
+    tx_mutex_get(client->nxd_mqtt_client_mutex_ptr, TX_WAIT_FOREVER);
+
+    while (window->count > 0)
+    {
+        completed_status[count] = status;
+        completed[count++]      = window->slots[window->head];
+        window->head            = (window->head + 1) % AZURE_IOT_MQTT_PUBLISH_WINDOW_MAX;
+        window->count--;
+    }
+
+    // We connect with a clean session, so NetX starts the next one with an empty queue
+    window->head      = 0;
+    window->published = 0;
+
+    tx_mutex_put(client->nxd_mqtt_client_mutex_ptr);
+
+    window_complete(completed, completed_status, count);
+}
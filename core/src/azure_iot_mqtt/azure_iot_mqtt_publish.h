@@ -0,0 +1,60 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _AZURE_IOT_MQTT_PUBLISH_H
+#define _AZURE_IOT_MQTT_PUBLISH_H
+
+#include "tx_api.h"
+
+#include "nx_api.h"
+#include "nxd_mqtt_client.h"
+
+// Upper bound on QoS 1 messages tracked while waiting for a PUBACK
+#ifndef AZURE_IOT_MQTT_PUBLISH_WINDOW_MAX
+#define AZURE_IOT_MQTT_PUBLISH_WINDOW_MAX 16
+#endif
+
+#define AZURE_IOT_MQTT_PUBLISH_WINDOW_DEFAULT  4
+#define AZURE_IOT_MQTT_PUBLISH_TIMEOUT_DEFAULT (30 * TX_TIMER_TICKS_PER_SECOND)
+
+// Called with NX_SUCCESS once the broker acknowledged the message, or an error on timeout
+// or disconnect. May run on the MQTT client thread, must not block.
+typedef VOID (*func_ptr_publish_complete)(VOID* context, UINT status);
+
+typedef struct AZURE_IOT_MQTT_PUBLISH_SLOT_STRUCT
+{
+    ULONG sequence;
+    ULONG sent_time;
+    func_ptr_publish_complete callback;
+    VOID* context;
+} AZURE_IOT_MQTT_PUBLISH_SLOT;
+
+typedef struct AZURE_IOT_MQTT_PUBLISH_WINDOW_STRUCT
+{
+    AZURE_IOT_MQTT_PUBLISH_SLOT slots[AZURE_IOT_MQTT_PUBLISH_WINDOW_MAX];
+    UINT head;  // Oldest outstanding slot
+    UINT count; // Outstanding slots
+
+    UINT size;     // Configured window, at most AZURE_IOT_MQTT_PUBLISH_WINDOW_MAX
+    ULONG timeout; // Ticks to wait for a PUBACK
+
+    ULONG published; // QoS 1 messages handed to NetX since connect
+} AZURE_IOT_MQTT_PUBLISH_WINDOW;
+
+UINT azure_iot_mqtt_publish_window_init(AZURE_IOT_MQTT_PUBLISH_WINDOW* window, UINT size, ULONG timeout);
+
+UINT azure_iot_mqtt_publish_window_send(AZURE_IOT_MQTT_PUBLISH_WINDOW* window,
+    NXD_MQTT_CLIENT* client,
+    CHAR* topic,
+    UINT topic_length,
+    CHAR* message,
+    UINT message_length,
+    func_ptr_publish_complete callback,
+    VOID* context);
+VOID azure_iot_mqtt_publish_window_sent(AZURE_IOT_MQTT_PUBLISH_WINDOW* window, NXD_MQTT_CLIENT* client);
+
+VOID azure_iot_mqtt_publish_window_process(AZURE_IOT_MQTT_PUBLISH_WINDOW* window, NXD_MQTT_CLIENT* client);
+VOID azure_iot_mqtt_publish_window_abort(
+    AZURE_IOT_MQTT_PUBLISH_WINDOW* window, NXD_MQTT_CLIENT* client, UINT status);
+
+#endif // _AZURE_IOT_MQTT_PUBLISH_H
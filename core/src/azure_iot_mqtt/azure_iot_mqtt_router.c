@@ -0,0 +1,212 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "azure_iot_mqtt_router.h"
+
+#include <string.h>
+
+#include "nx_api.h"
+
+#include "logging.h"
+
+#define TOPIC_KEY_REQUEST_ID  "$rid"
+#define TOPIC_KEY_VERSION     "$version"
+#define TOPIC_KEY_RETRY_AFTER "retry-after"
+
+static VOID topic_fields_parse(const CHAR* location, const CHAR* end, AZURE_IOT_MQTT_TOPIC_FIELDS* fields)
+{
+    AZURE_IOT_MQTT_SPAN key;
+    AZURE_IOT_MQTT_SPAN value;
+
+    memset(fields, 0, sizeof(*fields));
+
+    // First segment, e.g. the method name or the response status
+    fields->name.ptr = location;
+    while (location < end && *location != '/' && *location != '?' && *location != '&')
+    {
+        location++;
+    }
+    fields->name.length = location - fields->name.ptr;
+
+    if (location < end && *location == '/')
+    {
+        location++;
+    }
+
+    if (location < end && (*location == '?' || *location == '&'))
+    {
+        location++;
+    }
+
+    fields->properties.ptr    = location;
+    fields->properties.length = end - location;
+
+    // Walk the key=value pairs, picking out the ones the clients care about
+    while (location < end)
+    {
+        key.ptr = location;
+        while (location < end && *location != '=' && *location != '&')
+        {
+            location++;
+        }
+        key.length = location - key.ptr;
+
+        value.ptr    = location;
+        value.length = 0;
+        if (location < end && *location == '=')
+        {
+            value.ptr = ++location;
+            while (location < end && *location != '&')
+            {
+                location++;
+            }
+            value.length = location - value.ptr;
+        }
+
+        if (azure_iot_mqtt_span_equals(key, TOPIC_KEY_REQUEST_ID, sizeof(TOPIC_KEY_REQUEST_ID) - 1))
+        {
+            fields->request_id = value;
+        }
+        else if (azure_iot_mqtt_span_equals(key, TOPIC_KEY_VERSION, sizeof(TOPIC_KEY_VERSION) - 1))
+        {
+            fields->version = value;
+        }
+        else if (azure_iot_mqtt_span_equals(key, TOPIC_KEY_RETRY_AFTER, sizeof(TOPIC_KEY_RETRY_AFTER) - 1))
+        {
+            fields->retry_after = value;
+        }
+
+        // Skip over the '&'
+        if (location < end)
+        {
+            location++;
+        }
+    }
+}
+
+UINT azure_iot_mqtt_router_init(AZURE_IOT_MQTT_ROUTER* router)
+{
+    if (router == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    memset(router, 0, sizeof(*router));
+
+    // Node 0 is the root
+    router->node_count = 1;
+
+    return NX_SUCCESS;
+}
+
+UINT azure_iot_mqtt_router_add(
+    AZURE_IOT_MQTT_ROUTER* router, const CHAR* prefix, UINT prefix_length, func_ptr_topic_handler handler)
+{
+    UINT node = 0;
+    UINT child;
+
+    if (router == NX_NULL || prefix == NX_NULL || prefix_length == 0 || handler == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    if (router->route_count >= AZURE_IOT_MQTT_ROUTER_MAX_ROUTES)
+    {
+        LOG_ERROR(LOG_MODULE_MQTT, "MQTT router has no free routes");
+        return NX_SIZE_ERROR;
+    }
+
+    for (UINT i = 0; i < prefix_length; i++)
+    {
+        child = router->nodes[node].child;
+        while (child != 0 && router->nodes[child].ch != prefix[i])
+        {
+            child = router->nodes[child].sibling;
+        }
+
+        if (child == 0)
+        {
+            if (router->node_count >= AZURE_IOT_MQTT_ROUTER_MAX_NODES)
+            {
+                LOG_ERROR(LOG_MODULE_MQTT, "MQTT router has no free nodes");
+                return NX_SIZE_ERROR;
+            }
+
+            child                        = router->node_count++;
+            router->nodes[child].ch      = prefix[i];
+            router->nodes[child].sibling = router->nodes[node].child;
+            router->nodes[node].child    = child;
+        }
+
+        node = child;
+    }
+
+    router->handlers[router->route_count++] = handler;
+    router->nodes[node].route               = router->route_count;
+
+    return NX_SUCCESS;
+}
+
+UINT azure_iot_mqtt_router_dispatch(AZURE_IOT_MQTT_ROUTER* router,
+    const CHAR* topic,
+    UINT topic_length,
+    VOID* context,
+    AZURE_IOT_MQTT_MESSAGE* message)
+{
+    AZURE_IOT_MQTT_TOPIC_FIELDS fields;
+    UINT node           = 0;
+    UINT route          = 0;
+    UINT matched_length = 0;
+    UINT child;
+
+    // Single pass down the trie, remembering the longest prefix that ends a route
+    for (UINT i = 0; i < topic_length; i++)
+    {
+        child = router->nodes[node].child;
+        while (child != 0 && router->nodes[child].ch != topic[i])
+        {
+            child = router->nodes[child].sibling;
+        }
+
+        if (child == 0)
+        {
+            break;
+        }
+
+        node = child;
+        if (router->nodes[node].route != 0)
+        {
+            route          = router->nodes[node].route;
+            matched_length = i + 1;
+        }
+    }
+
+    if (route == 0)
+    {
+        return NX_NOT_FOUND;
+    }
+
+    // Continue from where the match finished to pick up the variable fields
+    topic_fields_parse(topic + matched_length, topic + topic_length, &fields);
+
+    router->handlers[route - 1](context, &fields, message);
+
+    return NX_SUCCESS;
+}
+
+bool azure_iot_mqtt_span_equals(AZURE_IOT_MQTT_SPAN span, const CHAR* str, UINT str_length)
+{
+    return span.length == str_length && memcmp(span.ptr, str, str_length) == 0;
+}
+
+UINT azure_iot_mqtt_span_to_uint(AZURE_IOT_MQTT_SPAN span)
+{
+    UINT value = 0;
+
+    for (UINT i = 0; i < span.length && span.ptr[i] >= '0' && span.ptr[i] <= '9'; i++)
+    {
+        value = value * 10 + (span.ptr[i] - '0');
+    }
+
+    return value;
+}
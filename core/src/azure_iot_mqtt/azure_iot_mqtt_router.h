@@ -0,0 +1,64 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _AZURE_IOT_MQTT_ROUTER_H
+#define _AZURE_IOT_MQTT_ROUTER_H
+
+#include <stdbool.h>
+
+#include "tx_api.h"
+
+#include "azure_iot_mqtt_message.h"
+
+// Enough for the four Hub filters with a 64 character device id
+#ifndef AZURE_IOT_MQTT_ROUTER_MAX_NODES
+#define AZURE_IOT_MQTT_ROUTER_MAX_NODES 160
+#endif
+
+#if AZURE_IOT_MQTT_ROUTER_MAX_NODES > 256
+#error "AZURE_IOT_MQTT_ROUTER_MAX_NODES must fit in the UCHAR node links"
+#endif
+
+#define AZURE_IOT_MQTT_ROUTER_MAX_ROUTES 8
+
+typedef struct AZURE_IOT_MQTT_TOPIC_FIELDS_STRUCT
+{
+    AZURE_IOT_MQTT_SPAN name;        // First segment after the route prefix, method name or status
+    AZURE_IOT_MQTT_SPAN request_id;  // $rid
+    AZURE_IOT_MQTT_SPAN version;     // $version
+    AZURE_IOT_MQTT_SPAN retry_after; // retry-after
+    AZURE_IOT_MQTT_SPAN properties;  // Everything after the first '?' or '&'
+} AZURE_IOT_MQTT_TOPIC_FIELDS;
+
+typedef VOID (*func_ptr_topic_handler)(VOID*, AZURE_IOT_MQTT_TOPIC_FIELDS*, AZURE_IOT_MQTT_MESSAGE*);
+
+typedef struct AZURE_IOT_MQTT_ROUTER_NODE_STRUCT
+{
+    CHAR ch;
+    UCHAR child;   // 0 if none, the root is never a child
+    UCHAR sibling; // 0 if none
+    UCHAR route;   // 1 based handler index, 0 if no route ends here
+} AZURE_IOT_MQTT_ROUTER_NODE;
+
+typedef struct AZURE_IOT_MQTT_ROUTER_STRUCT
+{
+    AZURE_IOT_MQTT_ROUTER_NODE nodes[AZURE_IOT_MQTT_ROUTER_MAX_NODES];
+    UINT node_count;
+
+    func_ptr_topic_handler handlers[AZURE_IOT_MQTT_ROUTER_MAX_ROUTES];
+    UINT route_count;
+} AZURE_IOT_MQTT_ROUTER;
+
+UINT azure_iot_mqtt_router_init(AZURE_IOT_MQTT_ROUTER* router);
+UINT azure_iot_mqtt_router_add(
+    AZURE_IOT_MQTT_ROUTER* router, const CHAR* prefix, UINT prefix_length, func_ptr_topic_handler handler);
+UINT azure_iot_mqtt_router_dispatch(AZURE_IOT_MQTT_ROUTER* router,
+    const CHAR* topic,
+    UINT topic_length,
+    VOID* context,
+    AZURE_IOT_MQTT_MESSAGE* message);
+
+bool azure_iot_mqtt_span_equals(AZURE_IOT_MQTT_SPAN span, const CHAR* str, UINT str_length);
+UINT azure_iot_mqtt_span_to_uint(AZURE_IOT_MQTT_SPAN span);
+
+#endif // _AZURE_IOT_MQTT_ROUTER_H
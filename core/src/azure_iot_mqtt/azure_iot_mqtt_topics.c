@@ -0,0 +1,157 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// https://docs.microsoft.com/azure/iot-hub/iot-hub-mqtt-support
+
+#include "azure_iot_mqtt_topics.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "number_format.h"
+
+#define USERNAME_API_VERSION "/?api-version=2020-09-30&model-id="
+
+#define DEVICE_PREFIX     "devices/"
+#define TELEMETRY_SUFFIX  "/messages/events/"
+#define C2D_FILTER_SUFFIX "/messages/devicebound/#"
+
+#define TWIN_PATCH_PREFIX      "$iothub/twin/PATCH/properties/reported/?$rid="
+#define TWIN_GET_PREFIX        "$iothub/twin/GET/?$rid="
+#define METHOD_RESPONSE_PREFIX "$iothub/methods/res/"
+#define METHOD_RESPONSE_RID    "/?$rid="
+
+// Bounded concatenation, the first piece that does not fit poisons the rest
+typedef struct TOPIC_WRITER_STRUCT
+{
+    CHAR* buffer;
+    UINT size;
+    UINT length;
+    bool overflow;
+} TOPIC_WRITER;
+
+static VOID topic_writer_init(TOPIC_WRITER* writer, CHAR* buffer, UINT size)
+{
+    writer->buffer   = buffer;
+    writer->size     = size;
+    writer->length   = 0;
+    writer->overflow = size == 0;
+}
+
+static VOID topic_append(TOPIC_WRITER* writer, const CHAR* text, UINT length)
+{
+    if (writer->overflow || writer->length + length + 1 > writer->size)
+    {
+        writer->overflow = true;
+        return;
+    }
+
+    memcpy(writer->buffer + writer->length, text, length);
+    writer->length += length;
+}
+
+static VOID topic_append_uint(TOPIC_WRITER* writer, UINT value)
+{
+    CHAR digits[NUMBER_FORMAT_BUFFER_SIZE];
+
+    topic_append(writer, digits, number_format_int64(value, digits, sizeof(digits)));
+}
+
+static UINT topic_finish(TOPIC_WRITER* writer)
+{
+    if (writer->overflow)
+    {
+        if (writer->size > 0)
+        {
+            writer->buffer[0] = 0;
+        }
+
+        return 0;
+    }
+
+    writer->buffer[writer->length] = 0;
+
+    return writer->length;
+}
+
+UINT azure_iot_mqtt_topics_init(AZURE_IOT_MQTT_TOPICS* topics, const CHAR* device_id)
+{
+    TOPIC_WRITER writer;
+    UINT device_id_length;
+
+    if (topics == NX_NULL || device_id == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    device_id_length = strlen(device_id);
+
+    topic_writer_init(&writer, topics->telemetry, sizeof(topics->telemetry));
+    topic_append(&writer, DEVICE_PREFIX, sizeof(DEVICE_PREFIX) - 1);
+    topic_append(&writer, device_id, device_id_length);
+    topic_append(&writer, TELEMETRY_SUFFIX, sizeof(TELEMETRY_SUFFIX) - 1);
+    topics->telemetry_length = topic_finish(&writer);
+
+    topic_writer_init(&writer, topics->c2d_filter, sizeof(topics->c2d_filter));
+    topic_append(&writer, DEVICE_PREFIX, sizeof(DEVICE_PREFIX) - 1);
+    topic_append(&writer, device_id, device_id_length);
+    topic_append(&writer, C2D_FILTER_SUFFIX, sizeof(C2D_FILTER_SUFFIX) - 1);
+    topics->c2d_filter_length = topic_finish(&writer);
+
+    if (topics->telemetry_length == 0 || topics->c2d_filter_length == 0)
+    {
+        return NX_SIZE_ERROR;
+    }
+
+    return NX_SUCCESS;
+}
+
+UINT azure_iot_mqtt_topics_username(
+    CHAR* buffer, UINT size, const CHAR* hub_hostname, const CHAR* device_id, const CHAR* model_id)
+{
+    TOPIC_WRITER writer;
+
+    topic_writer_init(&writer, buffer, size);
+    topic_append(&writer, hub_hostname, strlen(hub_hostname));
+    topic_append(&writer, "/", 1);
+    topic_append(&writer, device_id, strlen(device_id));
+    topic_append(&writer, USERNAME_API_VERSION, sizeof(USERNAME_API_VERSION) - 1);
+    topic_append(&writer, model_id, strlen(model_id));
+
+    return topic_finish(&writer);
+}
+
+UINT azure_iot_mqtt_topics_twin_patch(CHAR* buffer, UINT size, UINT request_id)
+{
+    TOPIC_WRITER writer;
+
+    topic_writer_init(&writer, buffer, size);
+    topic_append(&writer, TWIN_PATCH_PREFIX, sizeof(TWIN_PATCH_PREFIX) - 1);
+    topic_append_uint(&writer, request_id);
+
+    return topic_finish(&writer);
+}
+
+UINT azure_iot_mqtt_topics_twin_get(CHAR* buffer, UINT size, UINT request_id)
+{
+    TOPIC_WRITER writer;
+
+    topic_writer_init(&writer, buffer, size);
+    topic_append(&writer, TWIN_GET_PREFIX, sizeof(TWIN_GET_PREFIX) - 1);
+    topic_append_uint(&writer, request_id);
+
+    return topic_finish(&writer);
+}
+
+UINT azure_iot_mqtt_topics_method_response(CHAR* buffer, UINT size, UINT status, const CHAR* request_id)
+{
+    TOPIC_WRITER writer;
+
+    topic_writer_init(&writer, buffer, size);
+    topic_append(&writer, METHOD_RESPONSE_PREFIX, sizeof(METHOD_RESPONSE_PREFIX) - 1);
+    topic_append_uint(&writer, status);
+    topic_append(&writer, METHOD_RESPONSE_RID, sizeof(METHOD_RESPONSE_RID) - 1);
+    topic_append(&writer, request_id, strlen(request_id));
+
+    return topic_finish(&writer);
+}
@@ -0,0 +1,35 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _AZURE_IOT_MQTT_TOPICS_H
+#define _AZURE_IOT_MQTT_TOPICS_H
+
+#include "tx_api.h"
+
+#include "nx_api.h"
+
+// Enough for "devices/<64 character device id>/messages/devicebound/#"
+#define AZURE_IOT_MQTT_TOPICS_PREFIX_SIZE 100
+
+// Largest topic with a per-message suffix, "$iothub/methods/res/<status>/?$rid=<rid>" with a 32 character rid
+#define AZURE_IOT_MQTT_TOPICS_SUFFIXED_SIZE 100
+
+// Topics that only depend on the device identity, built once per connection
+typedef struct AZURE_IOT_MQTT_TOPICS_STRUCT
+{
+    CHAR telemetry[AZURE_IOT_MQTT_TOPICS_PREFIX_SIZE]; // devices/<id>/messages/events/
+    UINT telemetry_length;
+    CHAR c2d_filter[AZURE_IOT_MQTT_TOPICS_PREFIX_SIZE]; // devices/<id>/messages/devicebound/#
+    UINT c2d_filter_length;                             // Route prefix is one shorter, without the '#'
+} AZURE_IOT_MQTT_TOPICS;
+
+UINT azure_iot_mqtt_topics_init(AZURE_IOT_MQTT_TOPICS* topics, const CHAR* device_id);
+
+// The writers below null terminate and return the length, or 0 if the topic does not fit
+UINT azure_iot_mqtt_topics_username(
+    CHAR* buffer, UINT size, const CHAR* hub_hostname, const CHAR* device_id, const CHAR* model_id);
+UINT azure_iot_mqtt_topics_twin_patch(CHAR* buffer, UINT size, UINT request_id);
+UINT azure_iot_mqtt_topics_twin_get(CHAR* buffer, UINT size, UINT request_id);
+UINT azure_iot_mqtt_topics_method_response(CHAR* buffer, UINT size, UINT status, const CHAR* request_id);
+
+#endif // _AZURE_IOT_MQTT_TOPICS_H
@@ -3,7 +3,7 @@
    
 #include "hmac_sha256.h"
 
-#include "sha256.h"
+#include <string.h>
 
 #define B 64
 #define L (SHA256_DIGEST_SIZE)
@@ -12,37 +12,75 @@
 #define I_PAD 0x36
 #define O_PAD 0x5C
 
-void hmac_sha256(
-    uint8_t out[HMAC_SHA256_DIGEST_SIZE],
-    const uint8_t* data, size_t data_len,
-    const uint8_t* key, size_t key_len)
+static void hmac_sha256_restart(hmac_sha256_t* p)
+{
+    // Same as having just hashed the inner padded key block
+    sha256_init(&p->ss);
+    memcpy(p->ss.state, p->inner, sizeof(p->inner));
+    p->ss.count = B;
+}
+
+void hmac_sha256_init(hmac_sha256_t* p, const uint8_t* key, size_t key_len)
 {
-    sha256_t ss;
     uint8_t kh[SHA256_DIGEST_SIZE];
+    uint8_t kx[B];
 
     if (key_len > B) 
     {
-        sha256_init(&ss);
-        sha256_update(&ss, key, key_len);
-        sha256_final(&ss, kh);
+        sha256_init(&p->ss);
+        sha256_update(&p->ss, key, key_len);
+        sha256_final(&p->ss, kh);
         key_len = SHA256_DIGEST_SIZE;
         key = kh;
     }
 
-    uint8_t kx[B];
     for (size_t i = 0; i < key_len; i++) kx[i] = I_PAD ^ key[i];
     for (size_t i = key_len; i < B; i++) kx[i] = I_PAD ^ 0;
 
-    sha256_init(&ss);
-    sha256_update(&ss, kx, B);
-    sha256_update(&ss, data, data_len);
-    sha256_final(&ss, out);
+    sha256_init(&p->ss);
+    sha256_update(&p->ss, kx, B);
+    memcpy(p->inner, p->ss.state, sizeof(p->inner));
 
     for (size_t i = 0; i < key_len; i++) kx[i] = O_PAD ^ key[i];
     for (size_t i = key_len; i < B; i++) kx[i] = O_PAD ^ 0;
 
-    sha256_init(&ss);
-    sha256_update(&ss, kx, B);
-    sha256_update(&ss, out, SHA256_DIGEST_SIZE);
-    sha256_final(&ss, out);
+    sha256_init(&p->ss);
+    sha256_update(&p->ss, kx, B);
+    memcpy(p->outer, p->ss.state, sizeof(p->outer));
+
+    // Don't leave key material on the stack
+    memset(kx, 0, sizeof(kx));
+    memset(kh, 0, sizeof(kh));
+
+    hmac_sha256_restart(p);
+}
+
+void hmac_sha256_update(hmac_sha256_t* p, const uint8_t* data, size_t data_len)
+{
+    sha256_update(&p->ss, data, data_len);
+}
+
+void hmac_sha256_final(hmac_sha256_t* p, uint8_t out[HMAC_SHA256_DIGEST_SIZE])
+{
+    sha256_final(&p->ss, out);
+
+    sha256_init(&p->ss);
+    memcpy(p->ss.state, p->outer, sizeof(p->outer));
+    p->ss.count = B;
+    sha256_update(&p->ss, out, SHA256_DIGEST_SIZE);
+    sha256_final(&p->ss, out);
+
+    hmac_sha256_restart(p);
+}
+
+void hmac_sha256(
+    uint8_t out[HMAC_SHA256_DIGEST_SIZE],
+    const uint8_t* data, size_t data_len,
+    const uint8_t* key, size_t key_len)
+{
+    hmac_sha256_t hmac;
+
+    hmac_sha256_init(&hmac, key, key_len);
+    hmac_sha256_update(&hmac, data, data_len);
+    hmac_sha256_final(&hmac, out);
 }
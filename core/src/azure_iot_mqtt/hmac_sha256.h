@@ -7,8 +7,25 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include "sha256.h"
+
 #define HMAC_SHA256_DIGEST_SIZE 32
 
+// Keyed once, then signs any number of messages. The padded key blocks are absorbed up front
+// and only their midstates are kept, so each signature starts two compressions further on.
+typedef struct
+{
+    uint32_t inner[8];
+    uint32_t outer[8];
+    sha256_t ss;
+} hmac_sha256_t;
+
+void hmac_sha256_init(hmac_sha256_t* p, const uint8_t* key, size_t key_len);
+void hmac_sha256_update(hmac_sha256_t* p, const uint8_t* data, size_t data_len);
+
+// Writes the MAC and resets for the next message under the same key
+void hmac_sha256_final(hmac_sha256_t* p, uint8_t out[HMAC_SHA256_DIGEST_SIZE]);
+
 void hmac_sha256(
     uint8_t out[HMAC_SHA256_DIGEST_SIZE],
     const uint8_t* data, size_t data_len,
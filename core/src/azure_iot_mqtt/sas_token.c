@@ -8,368 +8,142 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "base64.h"
 #include "hmac_sha256.h"
 
-// Expire in one year minus one day
-#define SAS_EXPIRATION_SECS     (364 * 24 * 60 * 60)
 #define SAS_DPS_EXPIRATION_SECS (60 * 60)
 
-static bool base64_encode(char* src, size_t src_len, char* out)
-{
-    char* o = out;
-    char* p = src;
+#define SAS_RESOURCE_SIZE 128
 
-    const char* b = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static bool sas_key_schedule(hmac_sha256_t* hmac, char* key, unsigned int key_size)
+{
+    unsigned char key_binary[96];
+    size_t key_binary_size;
 
-    for (; p < (src + src_len - 2); p += 3)
+    if (!base64_decode(key, key_size, key_binary, sizeof(key_binary), &key_binary_size))
     {
-        *o++ = b[(p[0] >> 2) & 0x3f];
-        *o++ = b[((p[0] & 0x03) << 4) | ((p[1] & 0xf0) >> 4)];
-        *o++ = b[((p[1] & 0x0f) << 2) | ((p[2] & 0xc0) >> 6)];
-        *o++ = b[p[2] & 0x3f];
+        printf("ERROR: SAS key is not valid base64\r\n");
+        return false;
     }
 
-    if (p < src + src_len)
-    {
-        *o++ = b[(p[0] >> 2) & 0x3f];
+    hmac_sha256_init(hmac, key_binary, key_binary_size);
 
-        if (p == src + src_len - 1)
-        {
-            *o++ = b[((p[0] & 0x03) << 4)];
-            *o++ = '=';
-        }
+    memset(key_binary, 0, sizeof(key_binary));
 
-        else
-        {
-            *o++ = b[((p[0] & 0x03) << 4) | ((p[1] & 0xf0) >> 4)];
-            *o++ = b[(p[1] & 0x0f) << 2];
-        }
+    return true;
+}
+
+static bool sas_token_sign(hmac_sha256_t* hmac,
+    char* resource,
+    unsigned long expiry,
+    char* key_name,
+    char* output,
+    unsigned int output_size)
+{
+    char expiry_string[16];
+    unsigned char hash[HMAC_SHA256_DIGEST_SIZE];
+    size_t length;
+
+    char* output_end = output + output_size;
+
+    // The string to sign is "<resource>\n<expiry>", fed straight into the keyed hash
+    snprintf(expiry_string, sizeof(expiry_string), "\n%lu", expiry);
+
+    hmac_sha256_update(hmac, (unsigned char*)resource, strlen(resource));
+    hmac_sha256_update(hmac, (unsigned char*)expiry_string, strlen(expiry_string));
+    hmac_sha256_final(hmac, hash);
 
-        *o++ = '=';
+    // Create the output SAS token, the signature is encoded straight into place
+    output += snprintf(output, output_end - output, "SharedAccessSignature sr=%s&sig=", resource);
+    if (output >= output_end)
+    {
+        return false;
+    }
+
+    if ((length = base64_url_encode(hash, sizeof(hash), output, output_end - output)) == 0)
+    {
+        return false;
     }
 
-    *o = 0;
+    output += length;
+    output += snprintf(output, output_end - output, "&se=%lu%s", expiry, key_name);
+
+    if ((output_end - output) < 2)
+    {
+        return false;
+    }
 
     return true;
 }
 
-static size_t base64_decode(char* src, size_t len, char* out)
+static bool hub_sas_token(hmac_sha256_t* hmac,
+    char* hostname,
+    char* device_id,
+    unsigned long expiry,
+    char* output,
+    unsigned int output_size)
 {
-    unsigned char* o = (unsigned char*)out;
-    unsigned char* p = (unsigned char*)src;
-
-    const unsigned char b[256] = {64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        62,
-        64,
-        64,
-        64,
-        63,
-        52,
-        53,
-        54,
-        55,
-        56,
-        57,
-        58,
-        59,
-        60,
-        61,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        0,
-        1,
-        2,
-        3,
-        4,
-        5,
-        6,
-        7,
-        8,
-        9,
-        10,
-        11,
-        12,
-        13,
-        14,
-        15,
-        16,
-        17,
-        18,
-        19,
-        20,
-        21,
-        22,
-        23,
-        24,
-        25,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        26,
-        27,
-        28,
-        29,
-        30,
-        31,
-        32,
-        33,
-        34,
-        35,
-        36,
-        37,
-        38,
-        39,
-        40,
-        41,
-        42,
-        43,
-        44,
-        45,
-        46,
-        47,
-        48,
-        49,
-        50,
-        51,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64,
-        64};
-
-    while (len > 4)
-    {
-        *o++ = b[p[0]] << 2 | b[p[1]] >> 4;
-        *o++ = b[p[1]] << 4 | b[p[2]] >> 2;
-        *o++ = b[p[2]] << 6 | b[p[3]];
+    char resource[SAS_RESOURCE_SIZE];
 
-        p += 4;
-        len -= 4;
-    }
+    snprintf(resource, sizeof(resource), "%s%%2Fdevices%%2F%s", hostname, device_id);
+
+    return sas_token_sign(hmac, resource, expiry, "", output, output_size);
+}
 
-    if (len > 1)
-        *o++ = b[p[0]] << 2 | b[p[1]] >> 4;
-    if (len > 2)
-        *o++ = b[p[1]] << 4 | b[p[2]] >> 2;
-    if (len > 3)
-        *o++ = b[p[2]] << 6 | b[p[3]];
+static bool dps_sas_token(hmac_sha256_t* hmac,
+    char* id_scope,
+    char* registration_id,
+    unsigned long expiry,
+    char* output,
+    unsigned int output_size)
+{
+    char resource[SAS_RESOURCE_SIZE];
 
-    *o++ = 0;
+    snprintf(resource, sizeof(resource), "%s%%2Fregistrations%%2F%s", id_scope, registration_id);
 
-    return (o - (unsigned char*)out);
+    return sas_token_sign(hmac, resource, expiry, "&skn=registration", output, output_size);
 }
 
-static size_t base64_decode_length(char* str, size_t len)
+// FNV-1a, only used to notice that the cached token was signed for something else
+static unsigned long fingerprint_add(unsigned long hash, const char* data, unsigned int length)
 {
-    size_t outlen = (len * 6) / 8;
-
-    for (char* p = str + len - 1; *p == '='; p--)
+    for (unsigned int i = 0; i < length; i++)
     {
-        outlen--;
+        hash = (hash ^ (unsigned char)data[i]) * 16777619UL;
     }
 
-    return outlen;
+    return hash & 0xFFFFFFFFUL;
 }
 
-static int url_encode(char* dest, char* msg)
+// Decoding the key and absorbing it into the HMAC only has to happen when the key changes
+static bool sas_token_cache_key_set(SAS_TOKEN_CACHE* cache, char* key, unsigned int key_size)
 {
-    const char* hex = "0123456789abcdef";
-    char* startPtr  = dest;
+    unsigned long hash = fingerprint_add(2166136261UL, key, key_size);
 
-    while (*msg != 0)
+    if (hash != cache->key_fingerprint)
     {
-        if (('a' <= *msg && *msg <= 'z') || ('A' <= *msg && *msg <= 'Z') || ('0' <= *msg && *msg <= '9'))
-        {
-            *dest++ = *msg;
-        }
-        else
+        if (!sas_key_schedule(&cache->key_schedule, key, key_size))
         {
-            *dest++ = '%';
-            *dest++ = hex[*msg >> 4];
-            *dest++ = hex[*msg & 15];
+            cache->key_fingerprint = 0;
+            return false;
         }
-        msg++;
+
+        cache->key_fingerprint = hash;
     }
-    *dest = 0;
-    return dest - startPtr;
+
+    return true;
+}
+
+static unsigned long fingerprint(char kind, char* key, unsigned int key_size, char* first, char* second)
+{
+    unsigned long hash = 2166136261UL;
+
+    hash = fingerprint_add(hash, &kind, 1);
+    hash = fingerprint_add(hash, first, strlen(first) + 1);
+    hash = fingerprint_add(hash, second, strlen(second) + 1);
+    hash = fingerprint_add(hash, key, key_size);
+
+    return hash;
 }
 
 bool create_sas_token(char* key,
@@ -380,37 +154,14 @@ bool create_sas_token(char* key,
     char* output,
     unsigned int output_size)
 {
-    char buffer[128];
-    char key_binary[96];
-    int key_binary_size;
-    char hash[32];
-    char encoded_hash[44 + 1];
-
-    char* output_end = output + output_size;
-
-    valid_until += SAS_EXPIRATION_SECS;
-    snprintf(buffer, sizeof(buffer), "%s%%2Fdevices%%2F%s\n%lu", hostname, device_id, valid_until);
-
-    base64_decode(key, key_size, key_binary);
-    key_binary_size = base64_decode_length(key, key_size);
-
-    hmac_sha256(
-        (unsigned char*)hash, (unsigned char*)buffer, strlen(buffer), (unsigned char*)key_binary, key_binary_size);
-
-    base64_encode(hash, sizeof(hash), encoded_hash);
-
-    // Create the output SAS token
-    output +=
-        snprintf(output, output_end - output, "SharedAccessSignature sr=%s%%2Fdevices%%2F%s&sig=", hostname, device_id);
-    output += url_encode(output, encoded_hash);
-    output += snprintf(output, output_end - output, "&se=%lu", valid_until);
+    hmac_sha256_t hmac;
 
-    if ((output_end - output) < 2)
+    if (!sas_key_schedule(&hmac, key, key_size))
     {
         return false;
     }
 
-    return true;
+    return hub_sas_token(&hmac, hostname, device_id, valid_until + SAS_TOKEN_LIFETIME_SECS, output, output_size);
 }
 
 bool create_dps_sas_token(char* key,
@@ -421,38 +172,86 @@ bool create_dps_sas_token(char* key,
     char* output,
     unsigned int output_size)
 {
-    char buffer[128];
-    char key_binary[96];
-    int key_binary_size;
-    char hash[32];
-    char encoded_hash[44 + 1];
+    hmac_sha256_t hmac;
 
-    char* output_end = output + output_size;
+    if (!sas_key_schedule(&hmac, key, key_size))
+    {
+        return false;
+    }
+
+    return dps_sas_token(
+        &hmac, id_scope, registration_id, valid_until + SAS_DPS_EXPIRATION_SECS, output, output_size);
+}
+
+void sas_token_cache_init(SAS_TOKEN_CACHE* cache, unsigned long lifetime, unsigned long renew_margin)
+{
+    memset(cache, 0, sizeof(*cache));
+
+    cache->lifetime     = lifetime;
+    cache->renew_margin = renew_margin < lifetime ? renew_margin : lifetime / 2;
+}
 
-    valid_until += SAS_DPS_EXPIRATION_SECS;
-    snprintf(buffer, sizeof(buffer), "%s%%2Fregistrations%%2F%s\n%lu", id_scope, registration_id, valid_until);
+void sas_token_cache_invalidate(SAS_TOKEN_CACHE* cache)
+{
+    cache->expiry   = 0;
+    cache->token[0] = 0;
+}
 
-    base64_decode(key, key_size, key_binary);
-    key_binary_size = base64_decode_length(key, key_size);
+bool sas_token_cache_renew_due(SAS_TOKEN_CACHE* cache, unsigned long now)
+{
+    return cache->expiry != 0 && now + cache->renew_margin >= cache->expiry;
+}
 
-    hmac_sha256(
-        (unsigned char*)hash, (unsigned char*)buffer, strlen(buffer), (unsigned char*)key_binary, key_binary_size);
+const char* sas_token_cache_get(
+    SAS_TOKEN_CACHE* cache, char* key, unsigned int key_size, char* hostname, char* device_id, unsigned long now)
+{
+    unsigned long hash = fingerprint('h', key, key_size, hostname, device_id);
 
-    base64_encode(hash, sizeof(hash), encoded_hash);
+    if (hash == cache->fingerprint && cache->expiry != 0 && !sas_token_cache_renew_due(cache, now))
+    {
+        return cache->token;
+    }
 
-    // Create the output SAS token
-    output += snprintf(output,
-        output_end - output,
-        "SharedAccessSignature sr=%s%%2Fregistrations%%2F%s&sig=",
-        id_scope,
-        registration_id);
-    output += url_encode(output, encoded_hash);
-    output += snprintf(output, output_end - output, "&se=%lu&skn=registration", valid_until);
+    sas_token_cache_invalidate(cache);
 
-    if ((output_end - output) < 2)
+    if (!sas_token_cache_key_set(cache, key, key_size) ||
+        !hub_sas_token(
+            &cache->key_schedule, hostname, device_id, now + cache->lifetime, cache->token, sizeof(cache->token)))
     {
-        return false;
+        return NULL;
     }
 
-    return true;
+    cache->fingerprint = hash;
+    cache->expiry      = now + cache->lifetime;
+
+    return cache->token;
+}
+
+const char* sas_token_cache_get_dps(
+    SAS_TOKEN_CACHE* cache, char* key, unsigned int key_size, char* id_scope, char* registration_id, unsigned long now)
+{
+    unsigned long hash = fingerprint('d', key, key_size, id_scope, registration_id);
+    unsigned long lifetime;
+
+    if (hash == cache->fingerprint && cache->expiry != 0 && !sas_token_cache_renew_due(cache, now))
+    {
+        return cache->token;
+    }
+
+    sas_token_cache_invalidate(cache);
+
+    // Registration only takes a few round trips, don't hand out long lived DPS credentials
+    lifetime = cache->lifetime < SAS_DPS_EXPIRATION_SECS ? cache->lifetime : SAS_DPS_EXPIRATION_SECS;
+
+    if (!sas_token_cache_key_set(cache, key, key_size) ||
+        !dps_sas_token(
+            &cache->key_schedule, id_scope, registration_id, now + lifetime, cache->token, sizeof(cache->token)))
+    {
+        return NULL;
+    }
+
+    cache->fingerprint = hash;
+    cache->expiry      = now + lifetime;
+
+    return cache->token;
 }
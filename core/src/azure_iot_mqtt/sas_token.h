@@ -6,6 +6,28 @@
 
 #include <stdbool.h>
 
+#include "hmac_sha256.h"
+
+#define SAS_TOKEN_SIZE 256
+
+// Default hub token lifetime of one year minus one day, renewed shortly before it runs out
+#define SAS_TOKEN_LIFETIME_SECS     (364 * 24 * 60 * 60)
+#define SAS_TOKEN_RENEW_MARGIN_SECS (5 * 60)
+
+// Signing is the expensive part of connecting, keep the last token while it is still good
+typedef struct SAS_TOKEN_CACHE_STRUCT
+{
+    unsigned long lifetime;
+    unsigned long renew_margin;
+    unsigned long expiry;      // 0 if nothing is cached
+    unsigned long fingerprint; // Resource and key the token was signed for
+    char token[SAS_TOKEN_SIZE];
+
+    unsigned long key_fingerprint;
+    hmac_sha256_t key_schedule; // Device key, ready to sign
+
+} SAS_TOKEN_CACHE;
+
 bool create_sas_token(char* key,
     unsigned int key_size,
     char* hostname,
@@ -19,4 +41,14 @@ bool create_dps_sas_token(char *key, unsigned int key_size, char *id_scope,
     char* output,
     unsigned int output_size);
 
+void sas_token_cache_init(SAS_TOKEN_CACHE* cache, unsigned long lifetime, unsigned long renew_margin);
+void sas_token_cache_invalidate(SAS_TOKEN_CACHE* cache);
+bool sas_token_cache_renew_due(SAS_TOKEN_CACHE* cache, unsigned long now);
+
+// Return the cached token, signing a new one if it is missing, for another resource or close to expiry
+const char* sas_token_cache_get(
+    SAS_TOKEN_CACHE* cache, char* key, unsigned int key_size, char* hostname, char* device_id, unsigned long now);
+const char* sas_token_cache_get_dps(
+    SAS_TOKEN_CACHE* cache, char* key, unsigned int key_size, char* id_scope, char* registration_id, unsigned long now);
+
 #endif // _SAS_TOKEN_H
@@ -3,6 +3,11 @@
    
 #include "sha256.h"
 
+#include <string.h>
+
+#define LOAD32_BE(p) \
+    (((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) | ((uint32_t)(p)[2] << 8) | ((uint32_t)(p)[3]))
+
 #define ROTL32(a, b) (((a) << (b)) | ((a) >> (32 - (b))))
 #define ROTR32(a, b) (((a) >> (b)) | ((a) << (32 - (b))))
 
@@ -20,7 +25,7 @@
 #define g(i) T[(6 - (i)) & 7]
 #define h(i) T[(7 - (i)) & 7]
 
-#define blk0(i) (W[i] = data[i])
+#define blk0(i) (W[i] = LOAD32_BE(data + (i) * 4))
 #define blk2(i) (W[i & 15] += s1(W[(i - 2) & 15]) + W[(i - 7) & 15] + s0(W[(i - 15) & 15]))
 #define Ch(x, y, z) (z ^ (x & (y ^ z)))
 #define Maj(x, y, z) ((x & y) | (z & (x | y)))
@@ -51,50 +56,50 @@ static const uint32_t K[64] =
         0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
         0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
 
-static void sha256_transform(uint32_t *state, const uint32_t *data)
+// Portable compression, reads the message words straight out of the caller's bytes so blocks
+// never have to be copied or aligned first
+static void sha256_transform(uint32_t *state, const unsigned char *blocks, size_t block_count)
 {
     uint32_t W[16];
     uint32_t j;
-
     uint32_t a, b, c, d, e, f, g, h;
-    a = state[0];
-    b = state[1];
-    c = state[2];
-    d = state[3];
-    e = state[4];
-    f = state[5];
-    g = state[6];
-    h = state[7];
-
-    for (j = 0; j < 64; j += 16)
+    const unsigned char *data;
+
+    for (; block_count > 0; block_count--, blocks += SHA256_BLOCK_SIZE)
     {
-        RX_8(0);
-        RX_8(8);
-    }
+        data = blocks;
+
+        a = state[0];
+        b = state[1];
+        c = state[2];
+        d = state[3];
+        e = state[4];
+        f = state[5];
+        g = state[6];
+        h = state[7];
+
+        for (j = 0; j < 64; j += 16)
+        {
+            RX_8(0);
+            RX_8(8);
+        }
 
-    state[0] += a;
-    state[1] += b;
-    state[2] += c;
-    state[3] += d;
-    state[4] += e;
-    state[5] += f;
-    state[6] += g;
-    state[7] += h;
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
 }
 
-static void sha256_write_byte_block(sha256_t *p)
-{
-    uint32_t data32[16];
-    for (unsigned i = 0; i < 16; i++)
-    {
-        data32[i] =
-            ((uint32_t)(p->buffer[i * 4]) << 24) +
-            ((uint32_t)(p->buffer[i * 4 + 1]) << 16) +
-            ((uint32_t)(p->buffer[i * 4 + 2]) << 8) +
-            ((uint32_t)(p->buffer[i * 4 + 3]));
-    }
+static sha256_compress_t sha256_compress = sha256_transform;
 
-    sha256_transform(p->state, data32);
+void sha256_set_compress(sha256_compress_t compress)
+{
+    sha256_compress = compress != NULL ? compress : sha256_transform;
 }
 
 void sha256_init(sha256_t *p)
@@ -112,43 +117,65 @@ void sha256_init(sha256_t *p)
 
 void sha256_update(sha256_t *p, const unsigned char *data, size_t size)
 {
-    uint32_t curBufferPos = (uint32_t)p->count & 0x3F;
-    while (size > 0)
+    size_t curBufferPos = (size_t)p->count & 0x3F;
+    size_t blocks;
+
+    p->count += size;
+
+    // Top up a partial block left over from the last call
+    if (curBufferPos != 0)
     {
-        p->buffer[curBufferPos++] = *data++;
-        p->count++;
-        size--;
-        if (curBufferPos == 64)
+        size_t fill = SHA256_BLOCK_SIZE - curBufferPos;
+
+        if (size < fill)
         {
-            curBufferPos = 0;
-            sha256_write_byte_block(p);
+            memcpy(p->buffer + curBufferPos, data, size);
+            return;
         }
+
+        memcpy(p->buffer + curBufferPos, data, fill);
+        sha256_compress(p->state, p->buffer, 1);
+        data += fill;
+        size -= fill;
+    }
+
+    // Whole blocks are hashed in place
+    blocks = size / SHA256_BLOCK_SIZE;
+    if (blocks > 0)
+    {
+        sha256_compress(p->state, data, blocks);
+        data += blocks * SHA256_BLOCK_SIZE;
+        size -= blocks * SHA256_BLOCK_SIZE;
     }
+
+    // Only the tail is buffered
+    memcpy(p->buffer, data, size);
 }
 
 void sha256_final(sha256_t *p, unsigned char *digest)
 {
     uint64_t lenInBits = (p->count << 3);
-    uint32_t curBufferPos = (uint32_t)p->count & 0x3F;
+    size_t curBufferPos = (size_t)p->count & 0x3F;
     unsigned i;
+
     p->buffer[curBufferPos++] = 0x80;
 
-    while (curBufferPos != (64 - 8))
+    // No room for the length, pad out this block and start another
+    if (curBufferPos > SHA256_BLOCK_SIZE - 8)
     {
-        curBufferPos &= 0x3F;
-        if (curBufferPos == 0)
-        {
-            sha256_write_byte_block(p);
-        }
-        p->buffer[curBufferPos++] = 0;
+        memset(p->buffer + curBufferPos, 0, SHA256_BLOCK_SIZE - curBufferPos);
+        sha256_compress(p->state, p->buffer, 1);
+        curBufferPos = 0;
     }
 
+    memset(p->buffer + curBufferPos, 0, SHA256_BLOCK_SIZE - 8 - curBufferPos);
+
     for (i = 0; i < 8; i++)
     {
-        p->buffer[curBufferPos++] = (unsigned char)(lenInBits >> 56);
+        p->buffer[SHA256_BLOCK_SIZE - 8 + i] = (unsigned char)(lenInBits >> 56);
         lenInBits <<= 8;
     }
-    sha256_write_byte_block(p);
+    sha256_compress(p->state, p->buffer, 1);
 
     for (i = 0; i < 8; i++)
     {
@@ -8,6 +8,7 @@
 #include <stddef.h>
 
 #define SHA256_DIGEST_SIZE 32
+#define SHA256_BLOCK_SIZE  64
 
 typedef struct
 {
@@ -16,6 +17,13 @@ typedef struct
     unsigned char buffer[64];
 } sha256_t;
 
+// Compresses block_count consecutive 64 byte blocks into state. Blocks are raw message bytes
+// with no alignment guarantee. Lets a crypto peripheral or CPU extension replace the C rounds.
+typedef void (*sha256_compress_t)(uint32_t state[8], const unsigned char* blocks, size_t block_count);
+
+// NULL restores the portable implementation
+void sha256_set_compress(sha256_compress_t compress);
+
 void sha256_init(sha256_t* p);
 void sha256_update(sha256_t* p, const unsigned char* data, size_t size);
 void sha256_final(sha256_t* p, unsigned char* digest);
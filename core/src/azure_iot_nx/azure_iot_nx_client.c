@@ -3,21 +3,29 @@
 
 #include "azure_iot_nx_client.h"
 
+#include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "azure_iot_cert.h"
 #include "azure_iot_ciphersuites.h"
+#include "logging.h"
+#include "number_format.h"
 #include "nx_azure_iot_pnp_helpers.h"
+#include "work_queue.h"
 
 #define NX_AZURE_IOT_THREAD_PRIORITY 4
+#define SUPERVISOR_PRIORITY          5
 #define THREAD_PRIORITY              16
+#define METHOD_WORKER_PRIORITY       17
 
-// Incoming events from the middleware
-#define ALL_EVENTS                         0xFF
-#define DIRECT_METHOD_EVENT                0x01
-#define DEVICE_TWIN_GET_EVENT              0x02
-#define DEVICE_TWIN_DESIRED_PROPERTY_EVENT 0x04
-#define DEVICE_TWIN_COMPLETE_EVENT         0x08
+// Set once the event thread has processed the twin GET
+#define DEVICE_TWIN_COMPLETE_EVENT 0x08
+
+// How long work may wait on the event thread before it jumps the priority order, in ticks
+#define URGENT_DEADLINE_TICKS (TX_TIMER_TICKS_PER_SECOND / 10)
+#define NORMAL_DEADLINE_TICKS TX_TIMER_TICKS_PER_SECOND
+#define BULK_DEADLINE_TICKS   (5 * TX_TIMER_TICKS_PER_SECOND)
 
 #define AZURE_IOT_DPS_ENDPOINT "global.azure-devices-provisioning.net"
 
@@ -25,147 +33,208 @@
 #define DPS_PAYLOAD "{\"modelId\":\"%s\"}"
 
 #define DPS_PAYLOAD_SIZE    200
-#define PUBLISH_BUFFER_SIZE 512
-
-#define MAX_EXPONENTIAL_BACKOFF_JITTER_PERCENT 60
-#define MAX_EXPONENTIAL_BACKOFF_IN_SEC         (10 * 60)
-#define INITIAL_EXPONENTIAL_BACKOFF_IN_SEC     3
 
 // Connection timeouts in threadx ticks
 #define HUB_CONNECT_TIMEOUT_TICKS  (10 * TX_TIMER_TICKS_PER_SECOND)
 #define DPS_REGISTER_TIMEOUT_TICKS (3 * TX_TIMER_TICKS_PER_SECOND)
 
-static UINT exponential_backoff_with_jitter(UINT* exponential_retry_count)
+static VOID reported_properties_submit(VOID* context);
+static VOID store_forward_replay(VOID* context);
+
+static VOID reported_properties_post(AZURE_IOT_NX_CONTEXT* context)
 {
-    float jitter_percent = (MAX_EXPONENTIAL_BACKOFF_JITTER_PERCENT / 100.0f) * (rand() / ((float)RAND_MAX));
-    UINT base_delay      = MAX_EXPONENTIAL_BACKOFF_IN_SEC;
+    work_queue_post(&context->work, reported_properties_submit, context, WORK_PRIORITY_NORMAL, NORMAL_DEADLINE_TICKS);
+}
 
-    base_delay = (1 << *exponential_retry_count) * INITIAL_EXPONENTIAL_BACKOFF_IN_SEC;
+static VOID store_forward_post(AZURE_IOT_NX_CONTEXT* context)
+{
+    work_queue_post(&context->work, store_forward_replay, context, WORK_PRIORITY_BULK, BULK_DEADLINE_TICKS);
+}
 
-    if (base_delay > MAX_EXPONENTIAL_BACKOFF_IN_SEC)
-    {
-        base_delay = MAX_EXPONENTIAL_BACKOFF_IN_SEC;
-    }
-    else
+static UINT hub_connect(VOID* context)
+{
+    AZURE_IOT_NX_CONTEXT* nx_context = (AZURE_IOT_NX_CONTEXT*)context;
+    UINT status;
+
+    // DNS, TLS, MQTT CONNECT and the subscribes all happen inside the middleware
+    connection_supervisor_state_set(&nx_context->supervisor, CONNECTION_STATE_CONNECTING);
+
+    if ((status = nx_azure_iot_hub_client_connect(&nx_context->iothub_client, NX_TRUE, HUB_CONNECT_TIMEOUT_TICKS)))
     {
-        (*exponential_retry_count)++;
+        LOG_ERROR(LOG_MODULE_NX, "Failed on nx_azure_iot_hub_client_connect (0x%08x)", status);
     }
 
-    return (base_delay * (1 + jitter_percent)) * TX_TIMER_TICKS_PER_SECOND;
+    return status;
 }
 
 static VOID connection_status_callback(NX_AZURE_IOT_HUB_CLIENT* hub_client_ptr, UINT status)
 {
+    AZURE_IOT_NX_CONTEXT* nx_context =
+        (AZURE_IOT_NX_CONTEXT*)((UCHAR*)hub_client_ptr - offsetof(AZURE_IOT_NX_CONTEXT, iothub_client));
+
     if (status == NX_SUCCESS)
     {
-        printf("Connected to IoT Hub\r\n");
-    }
-    else
-    {
-        printf("Connection failure from IoT Hub (0x%08x)\r\n", status);
+        LOG_INFO(LOG_MODULE_NX, "Connected to IoT Hub");
 
-        UINT connect_status = NX_AZURE_IOT_FAILURE;
-        UINT retry_count    = 0;
-        while (connect_status)
+        // Send whatever was staged or stored while the connection was down
+        if (!reported_properties_is_empty(&nx_context->reported_properties))
         {
-            printf("Reconnecting to IoT Hub...\r\n");
+            reported_properties_post(nx_context);
+        }
 
-            if ((connect_status = nx_azure_iot_hub_client_connect(hub_client_ptr, NX_TRUE, HUB_CONNECT_TIMEOUT_TICKS)))
-            {
-                printf("Failed reconnect on nx_azure_iot_hub_client_connect (0x%08x)\r\n", connect_status);
-                tx_thread_sleep(exponential_backoff_with_jitter(&retry_count));
-            }
+        if (nx_context->store_forward != NX_NULL && !store_forward_is_empty(nx_context->store_forward))
+        {
+            store_forward_post(nx_context);
         }
     }
-}
+    else
+    {
+        LOG_ERROR(LOG_MODULE_NX, "Connection failure from IoT Hub (0x%08x)", status);
 
-static VOID message_receive_direct_method(NX_AZURE_IOT_HUB_CLIENT* hub_client_ptr, VOID* context)
-{
-    AZURE_IOT_NX_CONTEXT* nx_context = (AZURE_IOT_NX_CONTEXT*)context;
-    tx_event_flags_set(&nx_context->events, DIRECT_METHOD_EVENT, TX_OR);
+        // This runs on the middleware thread, leave the reconnect to the supervisor
+        connection_supervisor_disconnected(&nx_context->supervisor);
+    }
 }
 
-static VOID message_receive_callback_twin(NX_AZURE_IOT_HUB_CLIENT* hub_client_ptr, VOID* context)
+static VOID method_expire(VOID* context)
 {
     AZURE_IOT_NX_CONTEXT* nx_context = (AZURE_IOT_NX_CONTEXT*)context;
-    tx_event_flags_set(&nx_context->events, DEVICE_TWIN_GET_EVENT, TX_OR);
+    ULONG next;
+
+    if ((next = azure_iot_nx_method_expire(&nx_context->methods)) != TX_WAIT_FOREVER)
+    {
+        work_queue_schedule(
+            &nx_context->work, method_expire, nx_context, WORK_PRIORITY_URGENT, next, URGENT_DEADLINE_TICKS);
+    }
 }
 
-static VOID message_receive_callback_desire_property(NX_AZURE_IOT_HUB_CLIENT* hub_client_ptr, VOID* context)
+// Called on a method worker
+static VOID method_invoke(VOID* context,
+    const UCHAR* method,
+    USHORT method_length,
+    UCHAR* payload,
+    USHORT payload_length,
+    AZURE_IOT_NX_METHOD_HANDLE method_handle)
 {
     AZURE_IOT_NX_CONTEXT* nx_context = (AZURE_IOT_NX_CONTEXT*)context;
-    tx_event_flags_set(&nx_context->events, DEVICE_TWIN_DESIRED_PROPERTY_EVENT, TX_OR);
+
+    nx_context->direct_method_cb(nx_context, method, method_length, payload, payload_length, method_handle);
 }
 
-static VOID process_direct_method(AZURE_IOT_NX_CONTEXT* nx_context)
+// Hands one method per run to the workers so more urgent work can get in between
+static VOID process_direct_method(VOID* context)
 {
+    AZURE_IOT_NX_CONTEXT* nx_context = (AZURE_IOT_NX_CONTEXT*)context;
+    ULONG timeout;
     UINT status;
     NX_PACKET* packet;
     const UCHAR* method_name;
     USHORT method_name_length;
-    VOID* context;
-    USHORT context_length;
+    VOID* method_context;
+    USHORT method_context_length;
     UCHAR* payload;
     USHORT payload_length;
+    UINT http_status;
+
+    if ((status = nx_azure_iot_hub_client_direct_method_message_receive(&nx_context->iothub_client,
+             &method_name,
+             &method_name_length,
+             &method_context,
+             &method_context_length,
+             &packet,
+             NX_NO_WAIT)))
+    {
+        // If we failed for anything other than no packet, then report error
+        if (status != NX_AZURE_IOT_NO_PACKET)
+        {
+            LOG_ERROR(LOG_MODULE_NX, "direct method receive failed (0x%08x)", status);
+        }
 
-    while ((status = nx_azure_iot_hub_client_direct_method_message_receive(&nx_context->iothub_client,
-                &method_name,
-                &method_name_length,
-                &context,
-                &context_length,
-                &packet,
-                NX_NO_WAIT)) == NX_AZURE_IOT_SUCCESS)
-    {
-        printf("Receive direct method: %.*s\r\n", (INT)method_name_length, (CHAR*)method_name);
-        printf_packet(packet, "\tPayload: ");
+        return;
+    }
+
+    LOG_INFO(LOG_MODULE_NX, "Receive direct method: %.*s", (INT)method_name_length, (CHAR*)method_name);
+    printf_packet(packet, "\tPayload: ");
+
+    payload        = packet->nx_packet_prepend_ptr;
+    payload_length = packet->nx_packet_append_ptr - packet->nx_packet_prepend_ptr;
 
-        payload        = packet->nx_packet_prepend_ptr;
-        payload_length = packet->nx_packet_append_ptr - packet->nx_packet_prepend_ptr;
+    if (method_name_length == sizeof(LOG_METHOD_NAME) - 1 &&
+        memcmp(method_name, LOG_METHOD_NAME, method_name_length) == 0)
+    {
+        // Answered here so every application can change its log levels. The send is bounded like the pool's
+        // responses, a stalled connection must not hold up the event thread.
+        http_status = logging_method_invoke((CHAR*)payload, payload_length);
 
-        if (nx_context->direct_method_cb)
+        if ((status = nx_azure_iot_hub_client_direct_method_message_response(&nx_context->iothub_client,
+                 http_status,
+                 method_context,
+                 method_context_length,
+                 (UCHAR*)"{}",
+                 sizeof("{}") - 1,
+                 AZURE_IOT_NX_METHOD_RESPONSE_WAIT)))
         {
-            nx_context->direct_method_cb(
-                nx_context, method_name, method_name_length, payload, payload_length, context, context_length);
+            LOG_ERROR(LOG_MODULE_NX, "Direct method response failed (0x%08x)", status);
+        }
+    }
+    else if (nx_context->direct_method_cb)
+    {
+        // The pool owns the packet from here, even if it has to turn the method away
+        if (azure_iot_nx_method_dispatch(&nx_context->methods,
+                method_name,
+                method_name_length,
+                packet,
+                method_context,
+                method_context_length,
+                &timeout) == NX_SUCCESS)
+        {
+            work_queue_schedule(&nx_context->work,
+                method_expire,
+                nx_context,
+                WORK_PRIORITY_URGENT,
+                timeout,
+                URGENT_DEADLINE_TICKS);
         }
 
-        // Release the received packet, as ownership was passed to the application from the middleware
-        nx_packet_release(packet);
+        packet = NX_NULL;
     }
 
-    // If we failed for anything other than no packet, then report error
-    if (status != NX_AZURE_IOT_NO_PACKET)
+    // Release the received packet, as ownership was passed to the application from the middleware
+    if (packet != NX_NULL)
     {
-        printf("ERROR: direct method receive failed (0x%08x)\r\n", status);
-        return;
+        nx_packet_release(packet);
     }
+
+    // There may be more waiting
+    work_queue_post(
+        &nx_context->work, process_direct_method, nx_context, WORK_PRIORITY_URGENT, URGENT_DEADLINE_TICKS);
 }
 
-static VOID process_device_twin_get(AZURE_IOT_NX_CONTEXT* nx_context)
+static VOID process_device_twin_get(VOID* context)
 {
+    AZURE_IOT_NX_CONTEXT* nx_context = (AZURE_IOT_NX_CONTEXT*)context;
     UINT status;
     NX_PACKET* packet_ptr;
     NX_AZURE_IOT_JSON_READER json_reader;
-    UCHAR buffer[PUBLISH_BUFFER_SIZE];
 
+    // Only posted once the middleware has the document, so there is no need to wait for it
     if ((status = nx_azure_iot_hub_client_device_twin_properties_receive(
-             &nx_context->iothub_client, &packet_ptr, NX_WAIT_FOREVER)))
+             &nx_context->iothub_client, &packet_ptr, NX_NO_WAIT)))
     {
-        printf("Error: receive device twin property failed (0x%08x)\r\n", status);
+        if (status != NX_AZURE_IOT_NO_PACKET)
+        {
+            LOG_ERROR(LOG_MODULE_NX, "receive device twin property failed (0x%08x)", status);
+        }
+
         return;
     }
 
     printf_packet(packet_ptr, "Receive twin properties: ");
 
-    if (packet_ptr->nx_packet_length > (ULONG)(packet_ptr->nx_packet_append_ptr - packet_ptr->nx_packet_prepend_ptr))
-    {
-        printf("ERROR: json is large than nx_packet\r\n");
-        nx_packet_release(packet_ptr);
-        return;
-    }
-
+    // The reader walks the whole packet chain, so a document of any size is parsed in place
     if ((status = nx_azure_iot_json_reader_init(&json_reader, packet_ptr)))
     {
-        printf("ERROR: failed to initialize json reader (0x%08x)\r\n", status);
+        LOG_ERROR(LOG_MODULE_NX, "failed to initialize json reader (0x%08x)", status);
         nx_packet_release(packet_ptr);
         return;
     }
@@ -176,12 +245,10 @@ static VOID process_device_twin_get(AZURE_IOT_NX_CONTEXT* nx_context)
                  NX_FALSE,
                  NX_NULL,
                  0,
-                 buffer,
-                 PUBLISH_BUFFER_SIZE,
                  nx_context->device_twin_get_cb,
                  nx_context)))
         {
-            printf("ERROR: failed to parse twin data (0x%08x)\r\n", status);
+            LOG_ERROR(LOG_MODULE_NX, "failed to parse twin data (0x%08x)", status);
         }
     }
 
@@ -190,47 +257,51 @@ static VOID process_device_twin_get(AZURE_IOT_NX_CONTEXT* nx_context)
 
     // Send event to notify device twin received
     tx_event_flags_set(&nx_context->events, DEVICE_TWIN_COMPLETE_EVENT, TX_OR);
+
+    // Posts for two documents may have been merged
+    work_queue_post(
+        &nx_context->work, process_device_twin_get, nx_context, WORK_PRIORITY_NORMAL, NORMAL_DEADLINE_TICKS);
 }
 
-static VOID process_device_twin_desired_property(AZURE_IOT_NX_CONTEXT* nx_context)
+// Handles one patch per run so method responses can get in between
+static VOID process_device_twin_desired_property(VOID* context)
 {
+    AZURE_IOT_NX_CONTEXT* nx_context = (AZURE_IOT_NX_CONTEXT*)context;
     UINT status;
     NX_PACKET* packet_ptr;
     NX_AZURE_IOT_JSON_READER json_reader;
-    UCHAR buffer[128];
 
-    while ((status = nx_azure_iot_hub_client_device_twin_desired_properties_receive(
-                &nx_context->iothub_client, &packet_ptr, NX_NO_WAIT)) == NX_AZURE_IOT_SUCCESS)
+    if ((status = nx_azure_iot_hub_client_device_twin_desired_properties_receive(
+             &nx_context->iothub_client, &packet_ptr, NX_NO_WAIT)))
     {
-        printf_packet(packet_ptr, "Receive twin writeable property: ");
-
-        if (packet_ptr->nx_packet_length >
-            (ULONG)(packet_ptr->nx_packet_append_ptr - packet_ptr->nx_packet_prepend_ptr))
+        // If we failed for anything other than no packet, then report error
+        if (status != NX_AZURE_IOT_NO_PACKET)
         {
-            printf("ERROR: json is large than nx_packet\r\n");
-            nx_packet_release(packet_ptr);
-            continue;
+            LOG_ERROR(LOG_MODULE_NX, "device twin writeable property receive failed (0x%08x)", status);
         }
 
-        if ((status = nx_azure_iot_json_reader_init(&json_reader, packet_ptr)))
-        {
-            printf("ERROR: failed to initialize json reader (0x%08x)\r\n", status);
-            nx_packet_release(packet_ptr);
-            continue;
-        }
+        return;
+    }
 
+    printf_packet(packet_ptr, "Receive twin writeable property: ");
+
+    if ((status = nx_azure_iot_json_reader_init(&json_reader, packet_ptr)))
+    {
+        LOG_ERROR(LOG_MODULE_NX, "failed to initialize json reader (0x%08x)", status);
+        nx_packet_release(packet_ptr);
+    }
+    else
+    {
         if (nx_context->device_twin_desired_prop_cb)
         {
             if ((status = nx_azure_iot_pnp_helper_twin_data_parse(&json_reader,
                      NX_TRUE,
                      NX_NULL,
                      0,
-                     buffer,
-                     sizeof(buffer),
                      nx_context->device_twin_desired_prop_cb,
                      nx_context)))
             {
-                printf("ERROR: failed to parse twin data (0x%08x)\r\n", status);
+                LOG_ERROR(LOG_MODULE_NX, "failed to parse twin data (0x%08x)", status);
             }
         }
 
@@ -238,51 +309,305 @@ static VOID process_device_twin_desired_property(AZURE_IOT_NX_CONTEXT* nx_contex
         nx_azure_iot_json_reader_deinit(&json_reader);
     }
 
-    // If we failed for anything other than no packet, then report error
-    if (status != NX_AZURE_IOT_NO_PACKET)
+    // There may be more waiting
+    work_queue_post(&nx_context->work,
+        process_device_twin_desired_property,
+        nx_context,
+        WORK_PRIORITY_NORMAL,
+        NORMAL_DEADLINE_TICKS);
+}
+
+static VOID message_receive_direct_method(NX_AZURE_IOT_HUB_CLIENT* hub_client_ptr, VOID* context)
+{
+    AZURE_IOT_NX_CONTEXT* nx_context = (AZURE_IOT_NX_CONTEXT*)context;
+    work_queue_post(
+        &nx_context->work, process_direct_method, nx_context, WORK_PRIORITY_URGENT, URGENT_DEADLINE_TICKS);
+}
+
+static VOID message_receive_callback_twin(NX_AZURE_IOT_HUB_CLIENT* hub_client_ptr, VOID* context)
+{
+    AZURE_IOT_NX_CONTEXT* nx_context = (AZURE_IOT_NX_CONTEXT*)context;
+    work_queue_post(
+        &nx_context->work, process_device_twin_get, nx_context, WORK_PRIORITY_NORMAL, NORMAL_DEADLINE_TICKS);
+}
+
+static VOID message_receive_callback_desire_property(NX_AZURE_IOT_HUB_CLIENT* hub_client_ptr, VOID* context)
+{
+    AZURE_IOT_NX_CONTEXT* nx_context = (AZURE_IOT_NX_CONTEXT*)context;
+    work_queue_post(&nx_context->work,
+        process_device_twin_desired_property,
+        nx_context,
+        WORK_PRIORITY_NORMAL,
+        NORMAL_DEADLINE_TICKS);
+}
+
+static UINT telemetry_send(AZURE_IOT_NX_CONTEXT* context, UCHAR* data, UINT length, UINT wait_option)
+{
+    UINT status;
+    NX_PACKET* packet_ptr;
+
+    if ((status = nx_azure_iot_pnp_helper_telemetry_message_create(
+             &context->iothub_client, NX_NULL, 0, &packet_ptr, wait_option)))
     {
-        printf("ERROR: device twin writeable property receive failed (0x%08x)\r\n", status);
-        return;
+        LOG_ERROR(LOG_MODULE_NX, "Telemetry message create failed!: error code = 0x%08x", status);
+        return status;
+    }
+
+    if ((status = nx_azure_iot_hub_client_telemetry_send(
+             &context->iothub_client, packet_ptr, data, length, wait_option)))
+    {
+        LOG_ERROR(LOG_MODULE_NX, "Telemetry message send failed (0x%08x)", status);
+        nx_azure_iot_hub_client_telemetry_message_delete(packet_ptr);
+        return status;
     }
+
+    return NX_SUCCESS;
 }
 
-static VOID event_thread(ULONG parameter)
+static UINT store_forward_send(VOID* context, UCHAR* data, UINT length)
 {
-    ULONG app_events;
+    AZURE_IOT_NX_CONTEXT* nx_context = (AZURE_IOT_NX_CONTEXT*)context;
+    UINT status;
 
-    AZURE_IOT_NX_CONTEXT* context = (AZURE_IOT_NX_CONTEXT*)parameter;
+    // Don't hold up the event thread, anything that cannot go now is retried on the next drain
+    if ((status = telemetry_send(nx_context, data, length, NX_NO_WAIT)))
+    {
+        return status;
+    }
+
+    // The middleware reports no PUBACK for telemetry, so the record is settled once it is handed over
+    return store_forward_complete(nx_context->store_forward, NX_SUCCESS);
+}
+
+// Writes the document straight into a telemetry packet, chaining more packets from the pool as it grows.
+// On success the caller owns the packet and the document is its last telemetry_length bytes.
+static UINT telemetry_build(AZURE_IOT_NX_CONTEXT* context,
+    UINT (*append_properties)(NX_AZURE_IOT_JSON_WRITER* json_builder_ptr, VOID* context),
+    NX_PACKET** packet_pptr,
+    ULONG* telemetry_length,
+    UINT wait_option)
+{
+    NX_AZURE_IOT_JSON_WRITER json_builder;
+    NX_PACKET* packet_ptr;
+    ULONG header_length;
+    UINT status;
+
+    *packet_pptr = NX_NULL;
+
+    if ((status = nx_azure_iot_pnp_helper_telemetry_message_create(
+             &context->iothub_client, NX_NULL, 0, &packet_ptr, wait_option)))
+    {
+        LOG_ERROR(LOG_MODULE_NX, "Telemetry message create failed!: error code = 0x%08x", status);
+        return status;
+    }
+
+    header_length = packet_ptr->nx_packet_length;
 
-    while (true)
+    if ((status = nx_azure_iot_json_writer_init(&json_builder, packet_ptr, wait_option)))
     {
-        tx_event_flags_get(&context->events, ALL_EVENTS, TX_OR_CLEAR, &app_events, NX_IP_PERIODIC_RATE);
+        LOG_ERROR(LOG_MODULE_NX, "Failed to initialize json writer (0x%08x)", status);
+        nx_azure_iot_hub_client_telemetry_message_delete(packet_ptr);
+        return status;
+    }
 
-        if (app_events & DIRECT_METHOD_EVENT)
-        {
-            process_direct_method(context);
-        }
+    if ((status = nx_azure_iot_pnp_helper_build_reported_property(NULL, 0, append_properties, NX_NULL, &json_builder)))
+    {
+        LOG_ERROR(LOG_MODULE_NX, "Failed to build telemetry!: error code = 0x%08x", status);
+        nx_azure_iot_json_writer_deinit(&json_builder);
+        nx_azure_iot_hub_client_telemetry_message_delete(packet_ptr);
+        return status;
+    }
+
+    nx_azure_iot_json_writer_deinit(&json_builder);
+
+    *packet_pptr      = packet_ptr;
+    *telemetry_length = packet_ptr->nx_packet_length - header_length;
+
+    return NX_SUCCESS;
+}
+
+// Queues telemetry that could not be sent, taking ownership of the packet it was built into if there is one
+static UINT telemetry_store(AZURE_IOT_NX_CONTEXT* context,
+    UINT (*append_properties)(NX_AZURE_IOT_JSON_WRITER* json_builder_ptr, VOID* context),
+    NX_PACKET* packet_ptr,
+    ULONG telemetry_length)
+{
+    NX_AZURE_IOT_JSON_WRITER json_builder;
+    UCHAR buffer[STORE_FORWARD_PAYLOAD_SIZE];
+    UINT status;
 
-        if (app_events & DEVICE_TWIN_GET_EVENT)
+    if (packet_ptr != NX_NULL)
+    {
+        // The document is at the end of the packet, take it back out rather than build it again
+        if (telemetry_length > sizeof(buffer))
         {
-            process_device_twin_get(context);
+            status = NX_SIZE_ERROR;
         }
-
-        if (app_events & DEVICE_TWIN_DESIRED_PROPERTY_EVENT)
+        else
         {
-            process_device_twin_desired_property(context);
+            status = nx_packet_data_extract_offset(packet_ptr,
+                packet_ptr->nx_packet_length - telemetry_length,
+                buffer,
+                telemetry_length,
+                &telemetry_length);
         }
 
-        app_events = 0;
+        nx_azure_iot_hub_client_telemetry_message_delete(packet_ptr);
+    }
+
+    // No packet to be had, e.g. while disconnected or with the pool drained
+    else if ((status = nx_azure_iot_json_writer_with_buffer_init(&json_builder, buffer, sizeof(buffer))) ==
+             NX_AZURE_IOT_SUCCESS)
+    {
+        status = nx_azure_iot_pnp_helper_build_reported_property(NULL, 0, append_properties, NX_NULL, &json_builder);
+
+        telemetry_length = nx_azure_iot_json_writer_get_bytes_used(&json_builder);
+        nx_azure_iot_json_writer_deinit(&json_builder);
+    }
+
+    if (status != NX_SUCCESS ||
+        (status = store_forward_enqueue(
+             context->store_forward, buffer, telemetry_length, STORE_FORWARD_PRIORITY_NORMAL)))
+    {
+        LOG_ERROR(LOG_MODULE_NX, "Telemetry dropped (0x%08x)", status);
+        return status;
+    }
+
+    LOG_DEBUG(LOG_MODULE_NX, "Telemetry message stored: %.*s.", (INT)telemetry_length, buffer);
+
+    store_forward_post(context);
+
+    return NX_SUCCESS;
+}
+
+static VOID patch_deliver(VOID* context)
+{
+    AZURE_IOT_NX_CONTEXT* nx_context = (AZURE_IOT_NX_CONTEXT*)context;
+
+    azure_iot_nx_patch_deliver(&nx_context->patches);
+
+    if (nx_context->reported_properties_waiting)
+    {
+        nx_context->reported_properties_waiting = false;
+        reported_properties_post(nx_context);
+    }
+}
+
+// Called on a sender thread, completions are run on the event thread
+static VOID patch_done(VOID* context)
+{
+    AZURE_IOT_NX_CONTEXT* nx_context = (AZURE_IOT_NX_CONTEXT*)context;
+
+    work_queue_post(&nx_context->work, patch_deliver, nx_context, WORK_PRIORITY_URGENT, URGENT_DEADLINE_TICKS);
+}
+
+static VOID reported_properties_complete(ULONG request, AZURE_IOT_NX_PATCH_RESULT* result, VOID* context)
+{
+    AZURE_IOT_NX_CONTEXT* nx_context = (AZURE_IOT_NX_CONTEXT*)context;
+
+    if (result->status == NX_SUCCESS)
+    {
+        reported_properties_sent(&nx_context->reported_properties, nx_context->reported_properties_sequence);
+    }
+
+    tx_semaphore_put(&nx_context->reported_properties_gate);
+
+    // Values set while the patch was out go next, a failed patch waits for the next change or reconnect
+    if (result->status == NX_SUCCESS && !reported_properties_is_empty(&nx_context->reported_properties))
+    {
+        reported_properties_post(nx_context);
+    }
+}
+
+// Runs on the event thread and returns once the staged patch is queued. Only one staged patch is out at a
+// time, so two patches carrying the same property cannot be applied out of order.
+static VOID reported_properties_submit(VOID* parameter)
+{
+    AZURE_IOT_NX_CONTEXT* context = (AZURE_IOT_NX_CONTEXT*)parameter;
+    AZURE_IOT_NX_PATCH* patch;
+    UINT length;
+    UINT status;
+
+    if (tx_semaphore_get(&context->reported_properties_gate, TX_NO_WAIT))
+    {
+        // The patch in flight posts this again when it completes
+        return;
+    }
+
+    if (azure_iot_nx_patch_claim(&context->patches, &patch))
+    {
+        // Every slot is taken, retry once one of them completes
+        context->reported_properties_waiting = true;
+        tx_semaphore_put(&context->reported_properties_gate);
+        return;
+    }
+
+    if ((status = reported_properties_build(&context->reported_properties,
+             patch->document,
+             sizeof(patch->document),
+             &length,
+             &context->reported_properties_sequence)))
+    {
+        azure_iot_nx_patch_abandon(&context->patches, patch);
+        tx_semaphore_put(&context->reported_properties_gate);
+        return;
+    }
+
+    if (azure_iot_nx_patch_submit(
+            &context->patches, patch, length, reported_properties_complete, context, false, NX_NULL))
+    {
+        tx_semaphore_put(&context->reported_properties_gate);
     }
 }
 
+// Called from the staging timer, the patch goes out on the event thread
+static VOID reported_properties_due(VOID* context)
+{
+    reported_properties_post((AZURE_IOT_NX_CONTEXT*)context);
+}
+
+// Replays a batch of stored telemetry, the queue paces itself
+static VOID store_forward_replay(VOID* parameter)
+{
+    AZURE_IOT_NX_CONTEXT* context = (AZURE_IOT_NX_CONTEXT*)parameter;
+    ULONG interval;
+
+    if (context->store_forward == NX_NULL)
+    {
+        return;
+    }
+
+    // A failed send leaves the rest for the next telemetry or the reconnect
+    if (store_forward_drain(context->store_forward, store_forward_send, context) == NX_SUCCESS &&
+        !store_forward_is_empty(context->store_forward))
+    {
+        interval = context->store_forward->config.drain_interval;
+        work_queue_schedule(&context->work,
+            store_forward_replay,
+            context,
+            WORK_PRIORITY_BULK,
+            interval == 0 ? 1 : interval,
+            BULK_DEADLINE_TICKS);
+    }
+}
+
+static VOID event_thread(ULONG parameter)
+{
+    AZURE_IOT_NX_CONTEXT* context = (AZURE_IOT_NX_CONTEXT*)parameter;
+
+    // Sleeps until something is posted, then runs it most urgent first
+    work_queue_run(&context->work);
+}
+
 static UINT azure_iot_nx_client_hub_create_internal(AZURE_IOT_NX_CONTEXT* context)
 {
     UINT status;
 
-    printf("Initializing Azure IoT Hub client\r\n");
-    printf("\tHub hostname: %s\r\n", context->azure_iot_hub_hostname);
-    printf("\tDevice id: %s\r\n", context->azure_iot_device_id);
-    printf("\tModel id: %s\r\n", context->azure_iot_model_id);
+    LOG_INFO(LOG_MODULE_NX, "Initializing Azure IoT Hub client");
+    LOG_INFO(LOG_MODULE_NX, "\tHub hostname: %s", context->azure_iot_hub_hostname);
+    LOG_INFO(LOG_MODULE_NX, "\tDevice id: %s", context->azure_iot_device_id);
+    LOG_INFO(LOG_MODULE_NX, "\tModel id: %s", context->azure_iot_model_id);
+    LOG_INFO(LOG_MODULE_NX, "\tTLS profile: %s", _nx_azure_iot_tls_profile_name);
 
     // Initialize IoT Hub client.
     if ((status = nx_azure_iot_hub_client_initialize(&context->iothub_client,
@@ -301,7 +626,7 @@ static UINT azure_iot_nx_client_hub_create_internal(AZURE_IOT_NX_CONTEXT* contex
              sizeof(context->nx_azure_iot_tls_metadata_buffer),
              &context->root_ca_cert)))
     {
-        printf("ERROR: on nx_azure_iot_hub_client_initialize (0x%08x)\r\n", status);
+        LOG_ERROR(LOG_MODULE_NX, "on nx_azure_iot_hub_client_initialize (0x%08x)", status);
         return status;
     }
 
@@ -313,7 +638,7 @@ static UINT azure_iot_nx_client_hub_create_internal(AZURE_IOT_NX_CONTEXT* contex
                  (UCHAR*)context->azure_iot_device_sas_key,
                  context->azure_iot_device_sas_key_len)))
         {
-            printf("ERROR: failed on nx_azure_iot_hub_client_symmetric_key_set (0x%08x)\r\n", status);
+            LOG_ERROR(LOG_MODULE_NX, "failed on nx_azure_iot_hub_client_symmetric_key_set (0x%08x)", status);
         }
     }
     else if (context->azure_iot_auth_mode == AZURE_IOT_AUTH_MODE_CERT)
@@ -321,7 +646,7 @@ static UINT azure_iot_nx_client_hub_create_internal(AZURE_IOT_NX_CONTEXT* contex
         // X509 Certificate
         if ((status = nx_azure_iot_hub_client_device_cert_set(&context->iothub_client, &context->device_certificate)))
         {
-            printf("ERROR: failed on nx_azure_iot_hub_client_device_cert_set!: error code = 0x%08x\r\n", status);
+            LOG_ERROR(LOG_MODULE_NX, "failed on nx_azure_iot_hub_client_device_cert_set!: error code = 0x%08x", status);
         }
     }
 
@@ -329,26 +654,26 @@ static UINT azure_iot_nx_client_hub_create_internal(AZURE_IOT_NX_CONTEXT* contex
     if ((status = nx_azure_iot_hub_client_model_id_set(
              &context->iothub_client, (UCHAR*)context->azure_iot_model_id, strlen(context->azure_iot_model_id))))
     {
-        printf("ERROR: nx_azure_iot_hub_client_model_id_set (0x%08x)\r\n", status);
+        LOG_ERROR(LOG_MODULE_NX, "nx_azure_iot_hub_client_model_id_set (0x%08x)", status);
     }
 
     // Set connection status callback
     else if ((status = nx_azure_iot_hub_client_connection_status_callback_set(
                   &context->iothub_client, connection_status_callback)))
     {
-        printf("ERROR: failed on connection_status_callback (0x%08x)\r\n", status);
+        LOG_ERROR(LOG_MODULE_NX, "failed on connection_status_callback (0x%08x)", status);
     }
 
     // Enable direct methods
     else if ((status = nx_azure_iot_hub_client_direct_method_enable(&context->iothub_client)))
     {
-        printf("ERROR: direct method receive enable failed (0x%08x)\r\n", status);
+        LOG_ERROR(LOG_MODULE_NX, "direct method receive enable failed (0x%08x)", status);
     }
 
     // Enable device twin
     else if ((status = nx_azure_iot_hub_client_device_twin_enable(&context->iothub_client)))
     {
-        printf("ERROR: device twin enabled failed (0x%08x)\r\n", status);
+        LOG_ERROR(LOG_MODULE_NX, "device twin enabled failed (0x%08x)", status);
     }
 
     // Set device twin callback
@@ -357,7 +682,7 @@ static UINT azure_iot_nx_client_hub_create_internal(AZURE_IOT_NX_CONTEXT* contex
                   message_receive_callback_twin,
                   (VOID*)context)))
     {
-        printf("ERROR: device twin callback set (0x%08x)\r\n", status);
+        LOG_ERROR(LOG_MODULE_NX, "device twin callback set (0x%08x)", status);
     }
 
     // Set direct method callback
@@ -366,7 +691,7 @@ static UINT azure_iot_nx_client_hub_create_internal(AZURE_IOT_NX_CONTEXT* contex
                   message_receive_direct_method,
                   (VOID*)context)))
     {
-        printf("ERROR: device method callback set (0x%08x)\r\n", status);
+        LOG_ERROR(LOG_MODULE_NX, "device method callback set (0x%08x)", status);
     }
 
     // Set the writeable property callback
@@ -375,7 +700,7 @@ static UINT azure_iot_nx_client_hub_create_internal(AZURE_IOT_NX_CONTEXT* contex
                   message_receive_callback_desire_property,
                   (VOID*)context)))
     {
-        printf("ERROR: device twin desired property callback set (0x%08x)\r\n", status);
+        LOG_ERROR(LOG_MODULE_NX, "device twin desired property callback set (0x%08x)", status);
     }
 
     if (status != NX_AZURE_IOT_SUCCESS)
@@ -397,6 +722,43 @@ UINT azure_iot_nx_client_register_direct_method(AZURE_IOT_NX_CONTEXT* context, f
     return NX_SUCCESS;
 }
 
+UINT azure_iot_nx_client_direct_method_limit_set(
+    AZURE_IOT_NX_CONTEXT* context, const CHAR* pattern, UINT max_concurrent, ULONG timeout)
+{
+    if (context == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    return azure_iot_nx_method_limit_set(&context->methods, pattern, max_concurrent, timeout);
+}
+
+UINT azure_iot_nx_client_direct_method_respond(AZURE_IOT_NX_CONTEXT* context,
+    UINT http_status,
+    AZURE_IOT_NX_METHOD_HANDLE method_handle,
+    UCHAR* payload,
+    UINT payload_length)
+{
+    if (context == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    return azure_iot_nx_method_respond(&context->methods, http_status, method_handle, payload, payload_length);
+}
+
+UINT azure_iot_nx_client_direct_method_metrics_get(AZURE_IOT_NX_CONTEXT* context, AZURE_IOT_NX_METHOD_METRICS* metrics)
+{
+    if (context == NX_NULL || metrics == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    azure_iot_nx_method_metrics_get(&context->methods, metrics);
+
+    return NX_SUCCESS;
+}
+
 UINT azure_iot_nx_client_register_device_twin_desired_prop(
     AZURE_IOT_NX_CONTEXT* context, func_ptr_device_twin_desired_prop callback)
 {
@@ -420,11 +782,56 @@ UINT azure_iot_nx_client_register_device_twin_prop(AZURE_IOT_NX_CONTEXT* context
     return NX_SUCCESS;
 }
 
+UINT azure_iot_nx_client_register_connection_state(AZURE_IOT_NX_CONTEXT* context, func_ptr_connection_state callback)
+{
+    if (context == NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    return connection_supervisor_notify_set(&context->supervisor, callback);
+}
+
+UINT azure_iot_nx_client_connection_metrics_get(AZURE_IOT_NX_CONTEXT* context, CONNECTION_SUPERVISOR_METRICS* metrics)
+{
+    if (context == NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    return connection_supervisor_metrics_get(&context->supervisor, metrics);
+}
+
+UINT azure_iot_nx_client_work_metrics_get(AZURE_IOT_NX_CONTEXT* context, WORK_QUEUE_METRICS* metrics)
+{
+    if (context == NX_NULL || metrics == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    work_queue_metrics_get(&context->work, metrics);
+
+    return NX_SUCCESS;
+}
+
+UINT azure_iot_nx_client_provisioning_store_set(AZURE_IOT_NX_CONTEXT* context, PROVISIONING_STORE* store)
+{
+    if (context == NX_NULL)
+    {
+        LOG_ERROR(LOG_MODULE_NX, "context is NULL");
+        return NX_PTR_ERROR;
+    }
+
+    context->provisioning_store = store;
+
+    return NX_SUCCESS;
+}
+
 UINT azure_iot_nx_client_sas_set(AZURE_IOT_NX_CONTEXT* context, CHAR* device_sas_key)
 {
     if (device_sas_key[0] == 0)
     {
-        printf("ERROR: azure_iot_nx_client_sas_set device_sas_key is null\r\n");
+        LOG_ERROR(LOG_MODULE_NX, "azure_iot_nx_client_sas_set device_sas_key is null");
         return NX_PTR_ERROR;
     }
 
@@ -445,7 +852,7 @@ UINT azure_iot_nx_client_cert_set(AZURE_IOT_NX_CONTEXT* context,
 
     if (device_x509_cert[0] == 0 || device_x509_cert_len == 0 || device_x509_key[0] == 0 || device_x509_key_len == 0)
     {
-        printf("ERROR: azure_iot_nx_client_cert_set cert/key is null\r\n");
+        LOG_ERROR(LOG_MODULE_NX, "azure_iot_nx_client_cert_set cert/key is null");
         return NX_PTR_ERROR;
     }
 
@@ -461,7 +868,8 @@ UINT azure_iot_nx_client_cert_set(AZURE_IOT_NX_CONTEXT* context,
              (USHORT)device_x509_key_len,
              NX_SECURE_X509_KEY_TYPE_RSA_PKCS1_DER)))
     {
-        printf("Error: Failed on device nx_secure_x509_certificate_initialize!: error code = 0x%08x\r\n", status);
+        LOG_ERROR(
+            LOG_MODULE_NX, "Failed on device nx_secure_x509_certificate_initialize!: error code = 0x%08x", status);
     }
 
     return NX_SUCCESS;
@@ -478,7 +886,7 @@ UINT azure_iot_nx_client_create(AZURE_IOT_NX_CONTEXT* context,
 
     if (iot_model_id[0] == 0)
     {
-        printf("ERROR: UINT azure_iot_nx_client_create_new empty device_id or model_id\r\n");
+        LOG_ERROR(LOG_MODULE_NX, "UINT azure_iot_nx_client_create_new empty device_id or model_id");
         return NX_PTR_ERROR;
     }
 
@@ -490,7 +898,69 @@ UINT azure_iot_nx_client_create(AZURE_IOT_NX_CONTEXT* context,
 
     if ((status = tx_event_flags_create(&context->events, "nx_client")))
     {
-        printf("ERROR: failed on create nx_client event flags (0x%08x)\r\n", status);
+        LOG_ERROR(LOG_MODULE_NX, "failed on create nx_client event flags (0x%08x)", status);
+        return status;
+    }
+
+    if ((status = work_queue_create(&context->work, "nx_client work")))
+    {
+        LOG_ERROR(LOG_MODULE_NX, "failed on create nx_client work queue (0x%08x)", status);
+        tx_event_flags_delete(&context->events);
+        return status;
+    }
+
+    if ((status = connection_supervisor_create(
+             &context->supervisor, "nx_client supervisor", SUPERVISOR_PRIORITY, hub_connect, context)))
+    {
+        LOG_ERROR(LOG_MODULE_NX, "failed on create nx_client connection supervisor (0x%08x)", status);
+        work_queue_delete(&context->work);
+        tx_event_flags_delete(&context->events);
+        return status;
+    }
+
+    if ((status = reported_properties_create(&context->reported_properties,
+             "nx_client reported properties",
+             REPORTED_PROPERTIES_WINDOW_DEFAULT,
+             reported_properties_due,
+             context)))
+    {
+        connection_supervisor_delete(&context->supervisor);
+        work_queue_delete(&context->work);
+        tx_event_flags_delete(&context->events);
+        return status;
+    }
+
+    if ((status = tx_semaphore_create(&context->reported_properties_gate, "nx_client reported properties", 1)))
+    {
+        LOG_ERROR(LOG_MODULE_NX, "failed on create nx_client reported properties gate (0x%08x)", status);
+        reported_properties_delete(&context->reported_properties);
+        connection_supervisor_delete(&context->supervisor);
+        work_queue_delete(&context->work);
+        tx_event_flags_delete(&context->events);
+        return status;
+    }
+
+    if ((status = azure_iot_nx_patch_pipeline_create(
+             &context->patches, &context->iothub_client, THREAD_PRIORITY, patch_done, context)))
+    {
+        tx_semaphore_delete(&context->reported_properties_gate);
+        reported_properties_delete(&context->reported_properties);
+        connection_supervisor_delete(&context->supervisor);
+        work_queue_delete(&context->work);
+        tx_event_flags_delete(&context->events);
+        return status;
+    }
+
+    // Workers sit below the event thread so a busy method cannot hold up the rest of the client
+    if ((status = azure_iot_nx_method_pool_create(
+             &context->methods, &context->iothub_client, METHOD_WORKER_PRIORITY, method_invoke, context)))
+    {
+        azure_iot_nx_patch_pipeline_delete(&context->patches);
+        tx_semaphore_delete(&context->reported_properties_gate);
+        reported_properties_delete(&context->reported_properties);
+        connection_supervisor_delete(&context->supervisor);
+        work_queue_delete(&context->work);
+        tx_event_flags_delete(&context->events);
         return status;
     }
 
@@ -505,7 +975,14 @@ UINT azure_iot_nx_client_create(AZURE_IOT_NX_CONTEXT* context,
              NX_AZURE_IOT_THREAD_PRIORITY,
              unix_time_callback)))
     {
-        printf("ERROR: failed on nx_azure_iot_create (0x%08x)\r\n", status);
+        LOG_ERROR(LOG_MODULE_NX, "failed on nx_azure_iot_create (0x%08x)", status);
+        azure_iot_nx_method_pool_delete(&context->methods);
+        azure_iot_nx_patch_pipeline_delete(&context->patches);
+        tx_semaphore_delete(&context->reported_properties_gate);
+        reported_properties_delete(&context->reported_properties);
+        connection_supervisor_delete(&context->supervisor);
+        work_queue_delete(&context->work);
+        tx_event_flags_delete(&context->events);
         return status;
     }
 
@@ -519,8 +996,14 @@ UINT azure_iot_nx_client_create(AZURE_IOT_NX_CONTEXT* context,
              0,
              NX_SECURE_X509_KEY_TYPE_NONE)))
     {
-        printf("Failed to initialize ROOT CA certificate!: error code = 0x%08x\r\n", status);
+        LOG_ERROR(LOG_MODULE_NX, "Failed to initialize ROOT CA certificate!: error code = 0x%08x", status);
         nx_azure_iot_delete(&context->nx_azure_iot);
+        azure_iot_nx_method_pool_delete(&context->methods);
+        azure_iot_nx_patch_pipeline_delete(&context->patches);
+        tx_semaphore_delete(&context->reported_properties_gate);
+        reported_properties_delete(&context->reported_properties);
+        connection_supervisor_delete(&context->supervisor);
+        work_queue_delete(&context->work);
         return status;
     }
 
@@ -531,14 +1014,14 @@ UINT azure_iot_nx_client_hub_create(AZURE_IOT_NX_CONTEXT* context, CHAR* iot_hub
 {
     if (context == NULL)
     {
-        printf("ERROR: context is NULL\r\n");
+        LOG_ERROR(LOG_MODULE_NX, "context is NULL");
         return NX_PTR_ERROR;
     }
 
     // Return error if empty hostname or device id
     if (iot_hub_hostname[0] == 0 || iot_device_id[0] == 0)
     {
-        printf("ERROR: azure_iot_nx_client_hub_create iot_hub_hostname is null\r\n");
+        LOG_ERROR(LOG_MODULE_NX, "azure_iot_nx_client_hub_create iot_hub_hostname is null");
         return NX_PTR_ERROR;
     }
 
@@ -549,34 +1032,16 @@ UINT azure_iot_nx_client_hub_create(AZURE_IOT_NX_CONTEXT* context, CHAR* iot_hub
     return azure_iot_nx_client_hub_create_internal(context);
 }
 
-UINT azure_iot_nx_client_dps_create(AZURE_IOT_NX_CONTEXT* context, CHAR* dps_id_scope, CHAR* dps_registration_id)
+static UINT dps_register(AZURE_IOT_NX_CONTEXT* context, CHAR* dps_id_scope, CHAR* dps_registration_id)
 {
     UINT status;
     CHAR payload[DPS_PAYLOAD_SIZE];
     UINT iot_hub_hostname_len = AZURE_IOT_HOST_NAME_SIZE;
     UINT iot_device_id_len    = AZURE_IOT_DEVICE_ID_SIZE;
 
-    printf("Initializing Azure IoT DPS client\r\n");
-    printf("\tDPS endpoint: %s\r\n", AZURE_IOT_DPS_ENDPOINT);
-    printf("\tDPS ID scope: %s\r\n", dps_id_scope);
-    printf("\tRegistration ID: %s\r\n", dps_registration_id);
-
-    if (context == NULL)
-    {
-        printf("ERROR: context is NULL\r\n");
-        return NX_PTR_ERROR;
-    }
-
-    // Return error if empty credentials
-    if (dps_id_scope[0] == 0 || dps_registration_id[0] == 0)
-    {
-        printf("ERROR: azure_iot_nx_client_dps_create incorrect parameters\r\n");
-        return NX_PTR_ERROR;
-    }
-
     if (snprintf(payload, sizeof(payload), DPS_PAYLOAD, context->azure_iot_model_id) > DPS_PAYLOAD_SIZE - 1)
     {
-        printf("ERROR: insufficient buffer size to create DPS payload\r\n");
+        LOG_ERROR(LOG_MODULE_NX, "insufficient buffer size to create DPS payload");
         return NX_SIZE_ERROR;
     }
 
@@ -597,7 +1062,7 @@ UINT azure_iot_nx_client_dps_create(AZURE_IOT_NX_CONTEXT* context, CHAR* dps_id_
              sizeof(context->nx_azure_iot_tls_metadata_buffer),
              &context->root_ca_cert)))
     {
-        printf("Failed on nx_azure_iot_provisioning_client_initialize (0x%08x)\r\n", status);
+        LOG_ERROR(LOG_MODULE_NX, "Failed on nx_azure_iot_provisioning_client_initialize (0x%08x)", status);
         return status;
     }
 
@@ -609,7 +1074,7 @@ UINT azure_iot_nx_client_dps_create(AZURE_IOT_NX_CONTEXT* context, CHAR* dps_id_
                  (UCHAR*)context->azure_iot_device_sas_key,
                  context->azure_iot_device_sas_key_len)))
         {
-            printf("Failed on nx_azure_iot_hub_client_symmetric_key_set (0x%08x)\r\n", status);
+            LOG_ERROR(LOG_MODULE_NX, "Failed on nx_azure_iot_hub_client_symmetric_key_set (0x%08x)", status);
         }
     }
     else if (context->azure_iot_auth_mode == AZURE_IOT_AUTH_MODE_CERT)
@@ -618,7 +1083,7 @@ UINT azure_iot_nx_client_dps_create(AZURE_IOT_NX_CONTEXT* context, CHAR* dps_id_
         if ((status = nx_azure_iot_provisioning_client_device_cert_set(
                  &context->dps_client, &context->device_certificate)))
         {
-            printf("Failed on nx_azure_iot_hub_client_device_cert_set! (0x%08x)\r\n", status);
+            LOG_ERROR(LOG_MODULE_NX, "Failed on nx_azure_iot_hub_client_device_cert_set! (0x%08x)", status);
         }
     }
 
@@ -626,7 +1091,7 @@ UINT azure_iot_nx_client_dps_create(AZURE_IOT_NX_CONTEXT* context, CHAR* dps_id_
     if ((status = nx_azure_iot_provisioning_client_registration_payload_set(
              &context->dps_client, (UCHAR*)payload, strlen(payload))))
     {
-        printf("ERROR: nx_azure_iot_provisioning_client_registration_payload_set (0x%08x\r\n", status);
+        LOG_ERROR(LOG_MODULE_NX, "nx_azure_iot_provisioning_client_registration_payload_set (0x%08x", status);
     }
 
     // Register device
@@ -637,7 +1102,7 @@ UINT azure_iot_nx_client_dps_create(AZURE_IOT_NX_CONTEXT* context, CHAR* dps_id_
             status = nx_azure_iot_provisioning_client_register(&context->dps_client, DPS_REGISTER_TIMEOUT_TICKS);
             if (status == NX_AZURE_IOT_PENDING)
             {
-                printf("\tPending DPS connection, retrying\r\n");
+                LOG_INFO(LOG_MODULE_NX, "\tPending DPS connection, retrying");
                 continue;
             }
 
@@ -648,7 +1113,7 @@ UINT azure_iot_nx_client_dps_create(AZURE_IOT_NX_CONTEXT* context, CHAR* dps_id_
 
     if (status != NX_AZURE_IOT_SUCCESS)
     {
-        printf("\tERROR: nx_azure_iot_provisioning_client_register (0x%08x)\r\n", status);
+        LOG_ERROR(LOG_MODULE_NX, "nx_azure_iot_provisioning_client_register (0x%08x)", status);
     }
 
     // Get Device info
@@ -658,7 +1123,7 @@ UINT azure_iot_nx_client_dps_create(AZURE_IOT_NX_CONTEXT* context, CHAR* dps_id_
                   (UCHAR*)context->azure_iot_device_id,
                   &iot_device_id_len)))
     {
-        printf("ERROR: nx_azure_iot_provisioning_client_iothub_device_info_get (0x%08x)\r\n", status);
+        LOG_ERROR(LOG_MODULE_NX, "nx_azure_iot_provisioning_client_iothub_device_info_get (0x%08x)", status);
     }
 
     // Destroy Provisioning Client
@@ -673,13 +1138,112 @@ UINT azure_iot_nx_client_dps_create(AZURE_IOT_NX_CONTEXT* context, CHAR* dps_id_
     context->azure_iot_hub_hostname[iot_hub_hostname_len] = 0;
     context->azure_iot_device_id[iot_device_id_len]       = 0;
 
-    printf("SUCCESS: Azure IoT DPS client initialized\r\n\r\n");
+    // Later boots can go straight to the hub
+    if (context->provisioning_store != NX_NULL)
+    {
+        provisioning_store_save(context->provisioning_store,
+            dps_id_scope,
+            dps_registration_id,
+            context->azure_iot_hub_hostname,
+            context->azure_iot_device_id);
+    }
+
+    return NX_SUCCESS;
+}
+
+// The hub refused the stored identity, e.g. the device was moved to another hub or deleted
+static bool hub_rejected_identity(UINT status)
+{
+    return status == NXD_MQTT_ERROR_BAD_USERNAME_PASSWORD || status == NXD_MQTT_ERROR_NOT_AUTHORIZED;
+}
+
+static UINT dps_reprovision(AZURE_IOT_NX_CONTEXT* context)
+{
+    UINT status;
+
+    LOG_WARN(LOG_MODULE_NX, "Stored DPS assignment was rejected by the hub, provisioning again");
+
+    provisioning_store_erase(context->provisioning_store);
+    context->azure_iot_dps_cached = false;
+
+    // The hub and DPS clients share storage, the hub client has to go first
+    nx_azure_iot_hub_client_deinitialize(&context->iothub_client);
+
+    if ((status = dps_register(context, context->azure_iot_dps_id_scope, context->azure_iot_dps_registration_id)))
+    {
+        return status;
+    }
+
+    return azure_iot_nx_client_hub_create_internal(context);
+}
+
+UINT azure_iot_nx_client_dps_create(AZURE_IOT_NX_CONTEXT* context, CHAR* dps_id_scope, CHAR* dps_registration_id)
+{
+    UINT status;
+
+    LOG_INFO(LOG_MODULE_NX, "Initializing Azure IoT DPS client");
+    LOG_INFO(LOG_MODULE_NX, "\tDPS endpoint: %s", AZURE_IOT_DPS_ENDPOINT);
+    LOG_INFO(LOG_MODULE_NX, "\tDPS ID scope: %s", dps_id_scope);
+    LOG_INFO(LOG_MODULE_NX, "\tRegistration ID: %s", dps_registration_id);
+
+    if (context == NULL)
+    {
+        LOG_ERROR(LOG_MODULE_NX, "context is NULL");
+        return NX_PTR_ERROR;
+    }
+
+    // Return error if empty credentials
+    if (dps_id_scope[0] == 0 || dps_registration_id[0] == 0)
+    {
+        LOG_ERROR(LOG_MODULE_NX, "azure_iot_nx_client_dps_create incorrect parameters");
+        return NX_PTR_ERROR;
+    }
+
+    // Kept for re-provisioning if the hub turns the stored assignment down
+    context->azure_iot_dps_id_scope        = dps_id_scope;
+    context->azure_iot_dps_registration_id = dps_registration_id;
+
+    if (context->provisioning_store != NX_NULL &&
+        provisioning_store_load(context->provisioning_store,
+            dps_id_scope,
+            dps_registration_id,
+            context->azure_iot_hub_hostname,
+            sizeof(context->azure_iot_hub_hostname),
+            context->azure_iot_device_id,
+            sizeof(context->azure_iot_device_id)) == NX_SUCCESS)
+    {
+        LOG_INFO(LOG_MODULE_NX, "SUCCESS: Using stored DPS assignment\r\n");
+        context->azure_iot_dps_cached = true;
+    }
+    else
+    {
+        if ((status = dps_register(context, dps_id_scope, dps_registration_id)))
+        {
+            return status;
+        }
+
+        LOG_INFO(LOG_MODULE_NX, "SUCCESS: Azure IoT DPS client initialized\r\n");
+    }
 
     return azure_iot_nx_client_hub_create_internal(context);
 }
 
 UINT azure_iot_nx_client_delete(AZURE_IOT_NX_CONTEXT* context)
 {
+    connection_supervisor_delete(&context->supervisor);
+
+    // The event thread runs inside work_queue_run, it has to go before the queue does. It only exists
+    // once connected, for a client that never was both calls fail harmlessly on the zeroed control block.
+    tx_thread_terminate(&context->azure_iot_thread);
+    tx_thread_delete(&context->azure_iot_thread);
+
+    azure_iot_nx_method_pool_delete(&context->methods);
+    azure_iot_nx_patch_pipeline_delete(&context->patches);
+    tx_semaphore_delete(&context->reported_properties_gate);
+    reported_properties_delete(&context->reported_properties);
+    tx_event_flags_delete(&context->events);
+    work_queue_delete(&context->work);
+
     // Destroy IoTHub Client
     nx_azure_iot_hub_client_disconnect(&context->iothub_client);
     nx_azure_iot_hub_client_deinitialize(&context->iothub_client);
@@ -694,10 +1258,18 @@ UINT azure_iot_nx_client_connect(AZURE_IOT_NX_CONTEXT* context)
 {
     UINT status;
 
-    // Connect to IoTHub client
-    if ((status = nx_azure_iot_hub_client_connect(&context->iothub_client, NX_TRUE, HUB_CONNECT_TIMEOUT_TICKS)))
+    // Connect to IoTHub client, reconnects are left to the supervisor
+    status = connection_supervisor_connect(&context->supervisor);
+    if (status != NX_SUCCESS && context->azure_iot_dps_cached && hub_rejected_identity(status))
+    {
+        if ((status = dps_reprovision(context)) == NX_SUCCESS)
+        {
+            status = connection_supervisor_connect(&context->supervisor);
+        }
+    }
+
+    if (status != NX_SUCCESS)
     {
-        printf("Failed on nx_azure_iot_hub_client_connect (0x%08x)\r\n", status);
         return status;
     }
 
@@ -712,17 +1284,20 @@ UINT azure_iot_nx_client_connect(AZURE_IOT_NX_CONTEXT* context)
              1,
              TX_AUTO_START)))
     {
-        printf("Failed to create telemetry thread (0x%08x)\r\n", status);
+        LOG_ERROR(LOG_MODULE_NX, "Failed to create telemetry thread (0x%08x)", status);
         return status;
     }
 
-    printf("SUCCESS: Azure IoT Hub client initialized\r\n\r\n");
+    LOG_INFO(LOG_MODULE_NX, "SUCCESS: Azure IoT Hub client initialized\r\n");
 
     return NX_SUCCESS;
 }
 
 UINT azure_iot_nx_client_disconnect(AZURE_IOT_NX_CONTEXT* context)
 {
+    // Intentional, don't let the supervisor bring it back
+    connection_supervisor_stop(&context->supervisor);
+
     nx_azure_iot_hub_client_disconnect(&context->iothub_client);
 
     return NX_SUCCESS;
@@ -736,7 +1311,7 @@ UINT azure_iot_nx_client_device_twin_request_and_wait(AZURE_IOT_NX_CONTEXT* cont
     // Request the device twin for writeable property update
     if ((status = nx_azure_iot_hub_client_device_twin_properties_request(&context->iothub_client, NX_WAIT_FOREVER)))
     {
-        printf("ERROR: failed to request device twin (0x%08x)\r\n", status);
+        LOG_ERROR(LOG_MODULE_NX, "failed to request device twin (0x%08x)", status);
         return status;
     }
 
@@ -744,281 +1319,256 @@ UINT azure_iot_nx_client_device_twin_request_and_wait(AZURE_IOT_NX_CONTEXT* cont
     if ((status = tx_event_flags_get(
              &context->events, DEVICE_TWIN_COMPLETE_EVENT, TX_OR_CLEAR, &app_events, 10 * NX_IP_PERIODIC_RATE)))
     {
-        printf("ERROR: failed to execute tx_event_flags_get (0x%08x)\r\n", status);
+        LOG_ERROR(LOG_MODULE_NX, "failed to execute tx_event_flags_get (0x%08x)", status);
         return status;
     }
 
     return NX_SUCCESS;
 }
 
+UINT azure_iot_nx_client_store_forward_set(AZURE_IOT_NX_CONTEXT* context, STORE_FORWARD_QUEUE* queue)
+{
+    if (context == NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    context->store_forward = queue;
+
+    return NX_SUCCESS;
+}
+
 UINT azure_iot_nx_client_publish_telemetry(
     AZURE_IOT_NX_CONTEXT* context, UINT (*append_properties)(NX_AZURE_IOT_JSON_WRITER* json_builder_ptr, VOID* context))
 {
     UINT status;
-    NX_PACKET* packet_ptr;
-    NX_AZURE_IOT_JSON_WRITER json_builder;
-    UINT telemetry_length;
-    UCHAR buffer[PUBLISH_BUFFER_SIZE];
-
-    if ((status = nx_azure_iot_pnp_helper_telemetry_message_create(
-             &context->iothub_client, NX_NULL, 0, &packet_ptr, NX_WAIT_FOREVER)))
-    {
-        printf("Telemetry message create failed!: error code = 0x%08x\r\n", status);
-        return (status);
-    }
+    NX_PACKET* packet_ptr  = NX_NULL;
+    ULONG telemetry_length = 0;
+    UINT wait_option;
 
-    if ((status = nx_azure_iot_json_writer_with_buffer_init(&json_builder, buffer, PUBLISH_BUFFER_SIZE)))
+    if (context->store_forward == NX_NULL || store_forward_is_empty(context->store_forward))
     {
-        printf("Failed to initialize json writer\r\n");
-        nx_azure_iot_hub_client_telemetry_message_delete(packet_ptr);
-        return NX_NOT_SUCCESSFUL;
-    }
+        // With a queue to fall back on, don't wait for a packet or for the send
+        wait_option = context->store_forward == NX_NULL ? NX_WAIT_FOREVER : NX_NO_WAIT;
 
-    if ((status = nx_azure_iot_pnp_helper_build_reported_property(NULL, 0, append_properties, NX_NULL, &json_builder)))
-    {
-        printf("Failed to build telemetry!: error code = 0x%08x\r\n", status);
-        nx_azure_iot_json_writer_deinit(&json_builder);
-        nx_azure_iot_hub_client_telemetry_message_delete(packet_ptr);
-        return status;
-    }
+        if ((status = telemetry_build(context, append_properties, &packet_ptr, &telemetry_length, wait_option)) ==
+            NX_SUCCESS)
+        {
+            if ((status = nx_azure_iot_hub_client_telemetry_send(
+                     &context->iothub_client, packet_ptr, NX_NULL, 0, wait_option)) == NX_SUCCESS)
+            {
+                LOG_DEBUG(LOG_MODULE_NX, "Telemetry message sent (%lu bytes)", telemetry_length);
+                return NX_SUCCESS;
+            }
 
-    telemetry_length = nx_azure_iot_json_writer_get_bytes_used(&json_builder);
-    if ((status = nx_azure_iot_hub_client_telemetry_send(
-             &context->iothub_client, packet_ptr, buffer, telemetry_length, NX_WAIT_FOREVER)))
-    {
-        printf("Telemetry message send failed (0x%08x)\r\n", status);
-        nx_azure_iot_json_writer_deinit(&json_builder);
-        nx_azure_iot_hub_client_telemetry_message_delete(packet_ptr);
-        return status;
-    }
+            LOG_ERROR(LOG_MODULE_NX, "Telemetry message send failed (0x%08x)", status);
+        }
 
-    printf("Telemetry message sent: %.*s.\r\n", telemetry_length, buffer);
+        if (context->store_forward == NX_NULL)
+        {
+            if (packet_ptr != NX_NULL)
+            {
+                nx_azure_iot_hub_client_telemetry_message_delete(packet_ptr);
+            }
 
-    nx_azure_iot_json_writer_deinit(&json_builder);
+            return status;
+        }
+    }
 
-    return status;
+    // Queue behind any backlog, the event thread replays it in the configured order
+    return telemetry_store(context, append_properties, packet_ptr, telemetry_length);
 }
 
-UINT azure_iot_nx_client_publish_properties(AZURE_IOT_NX_CONTEXT* context,
+// Claims a slot and builds the component patch straight into it
+static UINT properties_claim(AZURE_IOT_NX_CONTEXT* context,
     CHAR* component,
-    UINT (*append_properties)(NX_AZURE_IOT_JSON_WRITER* json_builder_ptr, VOID* context))
+    UINT (*append_properties)(NX_AZURE_IOT_JSON_WRITER* json_builder_ptr, VOID* context),
+    AZURE_IOT_NX_PATCH** patch,
+    UINT* length)
 {
-    UINT reported_properties_length;
-    UINT status;
-    UINT response_status;
-    UINT request_id;
     NX_AZURE_IOT_JSON_WRITER json_builder;
-    ULONG reported_property_version;
-    UCHAR buffer[PUBLISH_BUFFER_SIZE];
+    UINT status;
+
+    if ((status = azure_iot_nx_patch_claim(&context->patches, patch)))
+    {
+        LOG_ERROR(LOG_MODULE_NX, "No free slot for a reported property patch");
+        return status;
+    }
 
-    if ((status = nx_azure_iot_json_writer_with_buffer_init(&json_builder, buffer, PUBLISH_BUFFER_SIZE)))
+    if ((status = nx_azure_iot_json_writer_with_buffer_init(
+             &json_builder, (UCHAR*)(*patch)->document, sizeof((*patch)->document))))
     {
-        printf("Failed to initialize json writer\r\n");
+        LOG_ERROR(LOG_MODULE_NX, "Failed to initialize json writer");
+        azure_iot_nx_patch_abandon(&context->patches, *patch);
         return NX_NOT_SUCCESSFUL;
     }
 
     if ((status = nx_azure_iot_pnp_helper_build_reported_property(
              (UCHAR*)component, strlen(component), append_properties, NX_NULL, &json_builder)))
     {
-        printf("Failed to build reported property!: error code = 0x%08x\r\n", status);
+        LOG_ERROR(LOG_MODULE_NX, "Failed to build reported property!: error code = 0x%08x", status);
         nx_azure_iot_json_writer_deinit(&json_builder);
+        azure_iot_nx_patch_abandon(&context->patches, *patch);
         return status;
     }
 
-    reported_properties_length = nx_azure_iot_json_writer_get_bytes_used(&json_builder);
-    if ((status = nx_azure_iot_hub_client_device_twin_reported_properties_send(&context->iothub_client,
-             buffer,
-             reported_properties_length,
-             &request_id,
-             &response_status,
-             &reported_property_version,
-             (5 * NX_IP_PERIODIC_RATE))))
-    {
-        printf("Device twin reported properties failed!: error code = 0x%08x\r\n", status);
-        nx_azure_iot_json_writer_deinit(&json_builder);
-        return status;
-    }
+    *length = nx_azure_iot_json_writer_get_bytes_used(&json_builder);
 
     nx_azure_iot_json_writer_deinit(&json_builder);
 
-    if ((response_status < 200) || (response_status >= 300))
-    {
-        printf("device twin report properties failed with code : %d\r\n", response_status);
-        return NX_NOT_SUCCESSFUL;
-    }
-
-    printf("Device twin property sent: %.*s.\r\n", reported_properties_length, buffer);
-
-    return status;
+    return NX_SUCCESS;
 }
 
-UINT azure_iot_nx_client_publish_float_property(AZURE_IOT_NX_CONTEXT* context, CHAR* key, float value)
+UINT azure_iot_nx_client_publish_properties(AZURE_IOT_NX_CONTEXT* context,
+    CHAR* component,
+    UINT (*append_properties)(NX_AZURE_IOT_JSON_WRITER* json_builder_ptr, VOID* context))
 {
+    AZURE_IOT_NX_PATCH_RESULT result;
+    ULONG request;
     UINT status;
-    UINT response_status;
-    UINT request_id;
-    ULONG version;
-    CHAR buffer[PUBLISH_BUFFER_SIZE];
-
-    int intvalue  = value;
-    int fracvalue = abs(100 * (value - (long)value));
 
-    if (snprintf(buffer, PUBLISH_BUFFER_SIZE, "{\"%s\":%d.%2d}", key, intvalue, fracvalue) > PUBLISH_BUFFER_SIZE - 1)
+    if ((status = azure_iot_nx_client_publish_properties_async(
+             context, component, append_properties, NX_NULL, NX_NULL, &request)))
     {
-        printf("ERROR: insufficient buffer size to publish float property\r\n");
-        return NX_SIZE_ERROR;
-    }
-
-    if ((status = nx_azure_iot_hub_client_device_twin_reported_properties_send(&context->iothub_client,
-             (UCHAR*)buffer,
-             strlen(buffer),
-             &request_id,
-             &response_status,
-             &version,
-             NX_WAIT_FOREVER)))
-    {
-        printf("Device twin reported properties failed (0x%08x)\r\n", status);
         return status;
     }
 
-    if ((response_status < 200) || (response_status >= 300))
+    if ((status = azure_iot_nx_client_properties_wait(context, request, &result, TX_WAIT_FOREVER)))
     {
-        printf("device twin report properties failed (%d)\r\n", response_status);
         return status;
     }
 
-    printf("Device twin property sent: %s\r\n", buffer);
-
-    return NX_SUCCESS;
+    return result.status;
 }
 
-UINT azure_iot_nx_client_publish_bool_property(AZURE_IOT_NX_CONTEXT* context, CHAR* key, bool value)
+UINT azure_iot_nx_client_publish_properties_async(AZURE_IOT_NX_CONTEXT* context,
+    CHAR* component,
+    UINT (*append_properties)(NX_AZURE_IOT_JSON_WRITER* json_builder_ptr, VOID* context),
+    func_ptr_patch_complete complete,
+    VOID* complete_context,
+    ULONG* request)
 {
+    AZURE_IOT_NX_PATCH* patch;
+    UINT length;
     UINT status;
-    UINT response_status;
-    UINT request_id;
-    ULONG version;
-    CHAR buffer[PUBLISH_BUFFER_SIZE];
 
-    if (snprintf(buffer, PUBLISH_BUFFER_SIZE, "{\"%s\":%s}", key, (value ? "true" : "false")) > PUBLISH_BUFFER_SIZE - 1)
+    if (context == NX_NULL || component == NX_NULL || append_properties == NX_NULL)
     {
-        printf("ERROR: Unsufficient buffer size to publish bool property\r\n");
-        return NX_SIZE_ERROR;
+        return NX_PTR_ERROR;
     }
 
-    if ((status = nx_azure_iot_hub_client_device_twin_reported_properties_send(&context->iothub_client,
-             (UCHAR*)buffer,
-             strlen(buffer),
-             &request_id,
-             &response_status,
-             &version,
-             NX_WAIT_FOREVER)))
+    if ((status = properties_claim(context, component, append_properties, &patch, &length)))
     {
-        printf("Error: device twin reported properties failed (0x%08x)\r\n", status);
         return status;
     }
 
-    if ((response_status < 200) || (response_status >= 300))
+    // Without a callback the result is held for azure_iot_nx_client_properties_wait
+    return azure_iot_nx_patch_submit(
+        &context->patches, patch, length, complete, complete_context, complete == NX_NULL, request);
+}
+
+UINT azure_iot_nx_client_properties_wait(
+    AZURE_IOT_NX_CONTEXT* context, ULONG request, AZURE_IOT_NX_PATCH_RESULT* result, ULONG wait_option)
+{
+    if (context == NX_NULL)
     {
-        printf("Error: device twin report properties failed (%d)\r\n", response_status);
-        return status;
+        return NX_PTR_ERROR;
     }
 
-    printf("Device twin property sent: %s\r\n", buffer);
+    return azure_iot_nx_patch_wait(&context->patches, request, result, wait_option);
+}
 
-    return NX_SUCCESS;
+UINT azure_iot_nx_client_publish_float_property(AZURE_IOT_NX_CONTEXT* context, CHAR* key, float value)
+{
+    return reported_properties_set_double(
+        &context->reported_properties, NX_NULL, key, value, AZURE_IOT_NX_FLOAT_DECIMALS);
+}
+
+UINT azure_iot_nx_client_publish_bool_property(AZURE_IOT_NX_CONTEXT* context, CHAR* key, bool value)
+{
+    return reported_properties_set_bool(&context->reported_properties, NX_NULL, key, value);
 }
 
 UINT azure_iot_nx_client_publish_int_writeable_property(AZURE_IOT_NX_CONTEXT* context, CHAR* key, UINT value)
 {
+    return reported_properties_set_writeable(&context->reported_properties, NX_NULL, key, value, 200, 1);
+}
+
+UINT azure_nx_client_respond_int_writeable_property(
+    AZURE_IOT_NX_CONTEXT* context, CHAR* property, int value, int http_status, int version)
+{
+    return reported_properties_set_writeable(
+        &context->reported_properties, NX_NULL, property, value, http_status, version);
+}
+
+UINT azure_iot_nx_client_reported_properties_flush(AZURE_IOT_NX_CONTEXT* context)
+{
+    AZURE_IOT_NX_PATCH_RESULT result;
+    AZURE_IOT_NX_PATCH* patch;
+    ULONG sequence;
+    ULONG request;
+    UINT length;
     UINT status;
-    UINT response_status;
-    UINT request_id;
-    ULONG version;
-    CHAR buffer[PUBLISH_BUFFER_SIZE];
 
-    if (snprintf(buffer, PUBLISH_BUFFER_SIZE, "{\"%s\":{\"value\":%d,\"ac\":200,\"av\":1}}", key, value) >
-        PUBLISH_BUFFER_SIZE - 1)
+    if (context == NX_NULL)
     {
-        printf("ERROR: Unsufficient buffer size to publish int property\r\n");
-        return NX_SIZE_ERROR;
+        return NX_PTR_ERROR;
     }
 
-    if ((status = nx_azure_iot_hub_client_device_twin_reported_properties_send(&context->iothub_client,
-             (UCHAR*)buffer,
-             strlen(buffer),
-             &request_id,
-             &response_status,
-             &version,
-             NX_WAIT_FOREVER)))
+    // Waiting here would hold up the completion the gate waits for
+    if (tx_thread_identify() == &context->azure_iot_thread)
     {
-        printf("Error: device twin reported properties failed (0x%08x)\r\n", status);
-        return status;
+        reported_properties_post(context);
+        return NX_SUCCESS;
     }
 
-    if ((response_status < 200) || (response_status >= 300))
+    tx_semaphore_get(&context->reported_properties_gate, TX_WAIT_FOREVER);
+
+    if ((status = azure_iot_nx_patch_claim(&context->patches, &patch)))
     {
-        printf("Error: device twin report properties failed (%d)\r\n", response_status);
+        tx_semaphore_put(&context->reported_properties_gate);
         return status;
     }
 
-    printf("Device twin writeable property sent: %s\r\n", buffer);
-
-    return NX_SUCCESS;
-}
+    if ((status = reported_properties_build(
+             &context->reported_properties, patch->document, sizeof(patch->document), &length, &sequence)))
+    {
+        azure_iot_nx_patch_abandon(&context->patches, patch);
+        tx_semaphore_put(&context->reported_properties_gate);
 
-UINT azure_nx_client_respond_int_writeable_property(
-    AZURE_IOT_NX_CONTEXT* context, CHAR* property, int value, int http_status, int version)
-{
-    UINT status;
-    UINT response_status;
-    UINT request_id;
-    ULONG version_dt;
-    CHAR buffer[PUBLISH_BUFFER_SIZE];
-
-    if (snprintf(buffer,
-            PUBLISH_BUFFER_SIZE,
-            "{\"%s\":{\"value\":%d,\"ac\":%d,\"av\":%d}}",
-            property,
-            value,
-            http_status,
-            version) > PUBLISH_BUFFER_SIZE - 1)
-    {
-        printf("ERROR: insufficient buffer size to respond to writeable property\r\n");
-        return NX_SIZE_ERROR;
+        // Nothing pending is not a failure
+        return status == NX_NOT_FOUND ? NX_SUCCESS : status;
     }
 
-    if ((status = nx_azure_iot_hub_client_device_twin_reported_properties_send(&context->iothub_client,
-             (UCHAR*)buffer,
-             strlen(buffer),
-             &request_id,
-             &response_status,
-             &version_dt,
-             NX_WAIT_FOREVER)))
+    if ((status = azure_iot_nx_patch_submit(&context->patches, patch, length, NX_NULL, NX_NULL, true, &request)) ||
+        (status = azure_iot_nx_patch_wait(&context->patches, request, &result, TX_WAIT_FOREVER)))
     {
-        printf("ERROR: device twin reported properties failed (0x%08x)\r\n", status);
+        tx_semaphore_put(&context->reported_properties_gate);
+        return status;
     }
 
-    if ((response_status < 200) || (response_status >= 300))
+    if (result.status == NX_SUCCESS)
     {
-        printf("ERROR: device twin report properties failed (%d)\r\n", response_status);
-        return status;
+        reported_properties_sent(&context->reported_properties, sequence);
     }
 
-    printf("Device twin writeable property response: %s\r\n", buffer);
+    tx_semaphore_put(&context->reported_properties_gate);
 
-    return status;
+    // Values set during the round trip go out from the event thread
+    if (result.status == NX_SUCCESS && !reported_properties_is_empty(&context->reported_properties))
+    {
+        reported_properties_post(context);
+    }
+
+    return result.status;
 }
 
 VOID printf_packet(NX_PACKET* packet_ptr, CHAR* prepend)
 {
-    printf("%s", prepend);
-
-    while (packet_ptr != NX_NULL)
-    {
-        printf("%.*s", (INT)(packet_ptr->nx_packet_length), (CHAR*)packet_ptr->nx_packet_prepend_ptr);
-        packet_ptr = packet_ptr->nx_packet_next;
-    }
-
-    printf("\r\n");
+    // A record only holds the start of the first packet, which is enough to tell what arrived
+    LOG_DEBUG(LOG_MODULE_NX,
+        "%s%.*s",
+        prepend,
+        (INT)(packet_ptr->nx_packet_append_ptr - packet_ptr->nx_packet_prepend_ptr),
+        (CHAR*)packet_ptr->nx_packet_prepend_ptr);
 }
@@ -12,19 +12,32 @@
 #include "nx_azure_iot_provisioning_client.h"
 
 #include "azure_iot_ciphersuites.h"
+#include "azure_iot_nx_method.h"
+#include "azure_iot_nx_patch.h"
+#include "connection_supervisor.h"
+#include "provisioning_store.h"
+#include "reported_properties.h"
+#include "store_forward.h"
+#include "work_queue.h"
 
 #define NX_AZURE_IOT_STACK_SIZE  (2 * 1024)
 #define AZURE_IOT_STACK_SIZE     (3 * 1024)
 #define AZURE_IOT_HOST_NAME_SIZE 128
 #define AZURE_IOT_DEVICE_ID_SIZE 64
 
+// Decimals used for float properties, NUMBER_FORMAT_SHORTEST sends every significant digit
+#ifndef AZURE_IOT_NX_FLOAT_DECIMALS
+#define AZURE_IOT_NX_FLOAT_DECIMALS 2
+#endif
+
 #define AZURE_IOT_AUTH_MODE_UNKNOWN 0
 #define AZURE_IOT_AUTH_MODE_SAS     1
 #define AZURE_IOT_AUTH_MODE_CERT    2
 
 typedef struct AZURE_IOT_NX_CONTEXT_STRUCT AZURE_IOT_NX_CONTEXT;
 
-typedef void (*func_ptr_direct_method)(AZURE_IOT_NX_CONTEXT*, const UCHAR*, USHORT, UCHAR*, USHORT, VOID*, USHORT);
+typedef void (*func_ptr_direct_method)(
+    AZURE_IOT_NX_CONTEXT*, const UCHAR*, USHORT, UCHAR*, USHORT, AZURE_IOT_NX_METHOD_HANDLE);
 typedef void (*func_ptr_device_twin_desired_prop)(UCHAR*, UINT, UCHAR*, UINT, NX_AZURE_IOT_JSON_READER, UINT, VOID*);
 typedef void (*func_ptr_device_twin_prop)(UCHAR*, UINT, UCHAR*, UINT, NX_AZURE_IOT_JSON_READER, UINT, VOID*);
 typedef void (*func_ptr_device_twin_received)(AZURE_IOT_NX_CONTEXT*);
@@ -48,6 +61,7 @@ struct AZURE_IOT_NX_CONTEXT_STRUCT
 
     TX_THREAD azure_iot_thread;
     TX_EVENT_FLAGS_GROUP events;
+    WORK_QUEUE work; // Run by azure_iot_thread
 
     NX_AZURE_IOT nx_azure_iot;
 
@@ -60,16 +74,52 @@ struct AZURE_IOT_NX_CONTEXT_STRUCT
 #define iothub_client client.iothub
 #define dps_client    client.dps
 
+    STORE_FORWARD_QUEUE* store_forward;
+    CONNECTION_SUPERVISOR supervisor;
+    REPORTED_PROPERTIES reported_properties;
+    TX_SEMAPHORE reported_properties_gate; // Held while a staged patch is out
+    ULONG reported_properties_sequence;   // Sequence of the staged patch the event thread sent
+    bool reported_properties_waiting;     // Staged patch is waiting for a free slot
+    AZURE_IOT_NX_PATCH_PIPELINE patches;
+    AZURE_IOT_NX_METHOD_POOL methods;
+
+    PROVISIONING_STORE* provisioning_store;
+    CHAR* azure_iot_dps_id_scope;
+    CHAR* azure_iot_dps_registration_id;
+    bool azure_iot_dps_cached; // Hub assignment came from the store rather than DPS
+
     func_ptr_direct_method direct_method_cb;
     func_ptr_device_twin_desired_prop device_twin_desired_prop_cb;
     func_ptr_device_twin_prop device_twin_get_cb;
 };
 
+// The callback runs on one of AZURE_IOT_NX_METHOD_WORKERS workers, so methods can run side by side and
+// answer in any order. Every call must be answered with azure_iot_nx_client_direct_method_respond, from the
+// callback or later from any thread, using the handle it was given.
 UINT azure_iot_nx_client_register_direct_method(AZURE_IOT_NX_CONTEXT* context, func_ptr_direct_method callback);
+UINT azure_iot_nx_client_direct_method_respond(AZURE_IOT_NX_CONTEXT* context,
+    UINT http_status,
+    AZURE_IOT_NX_METHOD_HANDLE method_handle,
+    UCHAR* payload,
+    UINT payload_length);
+
+// Limits how many calls of the methods matching pattern, e.g. "dm.*.packages.1:install", run at once and
+// how long each may take before the hub is answered with 504. Methods without a limit get
+// AZURE_IOT_NX_METHOD_TIMEOUT.
+UINT azure_iot_nx_client_direct_method_limit_set(
+    AZURE_IOT_NX_CONTEXT* context, const CHAR* pattern, UINT max_concurrent, ULONG timeout);
+UINT azure_iot_nx_client_direct_method_metrics_get(AZURE_IOT_NX_CONTEXT* context, AZURE_IOT_NX_METHOD_METRICS* metrics);
 UINT azure_iot_nx_client_register_device_twin_desired_prop(
     AZURE_IOT_NX_CONTEXT* context, func_ptr_device_twin_desired_prop callback);
 UINT azure_iot_nx_client_register_device_twin_prop(AZURE_IOT_NX_CONTEXT* context, func_ptr_device_twin_prop callback);
 
+// Called with the AZURE_IOT_NX_CONTEXT as context on every connection state change
+UINT azure_iot_nx_client_register_connection_state(AZURE_IOT_NX_CONTEXT* context, func_ptr_connection_state callback);
+UINT azure_iot_nx_client_connection_metrics_get(AZURE_IOT_NX_CONTEXT* context, CONNECTION_SUPERVISOR_METRICS* metrics);
+
+// Depth and latency of the work run on the client's event thread
+UINT azure_iot_nx_client_work_metrics_get(AZURE_IOT_NX_CONTEXT* context, WORK_QUEUE_METRICS* metrics);
+
 UINT azure_iot_nx_client_sas_set(AZURE_IOT_NX_CONTEXT* context, CHAR* device_sas_key);
 UINT azure_iot_nx_client_cert_set(AZURE_IOT_NX_CONTEXT* context,
     UCHAR* device_x509_cert,
@@ -84,6 +134,9 @@ UINT azure_iot_nx_client_create(AZURE_IOT_NX_CONTEXT* context,
     UINT (*unix_time_callback)(ULONG* unix_time),
     CHAR* iot_model_id);
 
+// Remembers the DPS assignment so later boots can skip registration, set before dps_create
+UINT azure_iot_nx_client_provisioning_store_set(AZURE_IOT_NX_CONTEXT* context, PROVISIONING_STORE* store);
+
 UINT azure_iot_nx_client_hub_create(AZURE_IOT_NX_CONTEXT* context, CHAR* iot_hub_hostname, CHAR* iot_device_id);
 UINT azure_iot_nx_client_dps_create(AZURE_IOT_NX_CONTEXT* context, CHAR* dps_id_scope, CHAR* dps_registration_id);
 
@@ -92,12 +145,34 @@ UINT azure_iot_nx_client_connect(AZURE_IOT_NX_CONTEXT* context);
 
 UINT azure_iot_nx_client_device_twin_request_and_wait(AZURE_IOT_NX_CONTEXT* context);
 
+// Telemetry that cannot be sent is kept in the queue and replayed once connected
+UINT azure_iot_nx_client_store_forward_set(AZURE_IOT_NX_CONTEXT* context, STORE_FORWARD_QUEUE* queue);
+
+// The document is written straight into the outgoing packet, so its size is only bounded by the packet pool.
+// Telemetry that has to be queued is still limited to STORE_FORWARD_PAYLOAD_SIZE.
 UINT azure_iot_nx_client_publish_telemetry(AZURE_IOT_NX_CONTEXT* context,
     UINT (*append_properties)(NX_AZURE_IOT_JSON_WRITER* json_builder_ptr, VOID* context));
 
+// Sends one component straight away in its own patch and waits for the hub's answer
 UINT azure_iot_nx_client_publish_properties(AZURE_IOT_NX_CONTEXT* context,
     CHAR* component,
     UINT (*append_properties)(NX_AZURE_IOT_JSON_WRITER* json_builder_ptr, VOID* context));
+
+// Queues the patch and returns its request id without waiting, up to AZURE_IOT_NX_PATCH_MAX can be
+// outstanding. complete runs on the event thread with the hub's answer. Pass no callback to collect
+// the result with azure_iot_nx_client_properties_wait instead, which then has to be called.
+UINT azure_iot_nx_client_publish_properties_async(AZURE_IOT_NX_CONTEXT* context,
+    CHAR* component,
+    UINT (*append_properties)(NX_AZURE_IOT_JSON_WRITER* json_builder_ptr, VOID* context),
+    func_ptr_patch_complete complete,
+    VOID* complete_context,
+    ULONG* request);
+UINT azure_iot_nx_client_properties_wait(
+    AZURE_IOT_NX_CONTEXT* context, ULONG request, AZURE_IOT_NX_PATCH_RESULT* result, ULONG wait_option);
+
+// These stage the value in context->reported_properties. Everything staged goes out as one patch from
+// the event thread REPORTED_PROPERTIES_WINDOW_DEFAULT after the first change, or on an explicit flush.
+// Component properties can be staged directly with reported_properties_set_*.
 UINT azure_iot_nx_client_publish_float_property(AZURE_IOT_NX_CONTEXT* context, CHAR* key, float value);
 UINT azure_iot_nx_client_publish_bool_property(AZURE_IOT_NX_CONTEXT* context, CHAR* key, bool value);
 
@@ -105,6 +180,10 @@ UINT azure_iot_nx_client_publish_int_writeable_property(AZURE_IOT_NX_CONTEXT* co
 UINT azure_nx_client_respond_int_writeable_property(
     AZURE_IOT_NX_CONTEXT* context, CHAR* property, int value, int http_status, int version);
 
+// Sends everything staged now and waits for the hub to accept it. From the event thread, i.e. inside
+// a client callback, it only schedules the patch.
+UINT azure_iot_nx_client_reported_properties_flush(AZURE_IOT_NX_CONTEXT* context);
+
 VOID printf_packet(NX_PACKET* packet_ptr, CHAR* prepend);
 
 #endif
\ No newline at end of file
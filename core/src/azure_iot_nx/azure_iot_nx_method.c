@@ -0,0 +1,529 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "azure_iot_nx_method.h"
+
+#include <string.h>
+
+#include "logging.h"
+
+#define INVOCATION_FREE     0
+#define INVOCATION_PENDING  1 // Waiting for a worker
+#define INVOCATION_RUNNING  2 // On a worker
+#define INVOCATION_RETURNED 3 // Invoke returned without answering yet
+
+#define BAD_REQUEST_STATUS 400
+#define BUSY_STATUS        503
+#define TIMEOUT_STATUS     504
+
+// Tick comparisons that survive the counter wrapping
+#define TICKS_BEFORE(a, b) ((LONG)((a) - (b)) < 0)
+
+// Glob match where * stands for any run of characters, including none
+static bool pattern_match(const CHAR* pattern, const CHAR* name, UINT name_length)
+{
+    const CHAR* star = NX_NULL;
+    UINT star_index  = 0;
+    UINT i           = 0;
+
+    while (i < name_length)
+    {
+        if (*pattern == '*')
+        {
+            star       = pattern++;
+            star_index = i;
+        }
+        else if (*pattern != 0 && *pattern == name[i])
+        {
+            pattern++;
+            i++;
+        }
+        else if (star != NX_NULL)
+        {
+            // Let the last star swallow one more character and try again
+            pattern = star + 1;
+            i       = ++star_index;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    while (*pattern == '*')
+    {
+        pattern++;
+    }
+
+    return *pattern == 0;
+}
+
+// Must be called with the pool mutex held
+static bool invocation_runnable(AZURE_IOT_NX_METHOD_POOL* pool, AZURE_IOT_NX_METHOD_INVOCATION* invocation)
+{
+    UINT active = 0;
+
+    if (invocation->limit == NX_NULL)
+    {
+        return true;
+    }
+
+    for (UINT i = 0; i < AZURE_IOT_NX_METHOD_MAX; i++)
+    {
+        if (pool->invocations[i].limit == invocation->limit && !pool->invocations[i].responded &&
+            (pool->invocations[i].state == INVOCATION_RUNNING || pool->invocations[i].state == INVOCATION_RETURNED))
+        {
+            active++;
+        }
+    }
+
+    return active < invocation->limit->max_concurrent;
+}
+
+static UINT response_send(AZURE_IOT_NX_METHOD_POOL* pool,
+    UINT http_status,
+    UCHAR* context,
+    USHORT context_length,
+    UCHAR* payload,
+    UINT payload_length)
+{
+    UINT status;
+
+    if ((status = nx_azure_iot_hub_client_direct_method_message_response(pool->hub_client,
+             http_status,
+             context,
+             context_length,
+             payload,
+             payload_length,
+             AZURE_IOT_NX_METHOD_RESPONSE_WAIT)))
+    {
+        LOG_ERROR(LOG_MODULE_NX, "Direct method response failed (0x%08x)", status);
+    }
+
+    return status;
+}
+
+static VOID worker_thread(ULONG parameter)
+{
+    AZURE_IOT_NX_METHOD_POOL* pool = (AZURE_IOT_NX_METHOD_POOL*)parameter;
+    AZURE_IOT_NX_METHOD_INVOCATION* invocation;
+    AZURE_IOT_NX_METHOD_HANDLE handle;
+    NX_PACKET* packet;
+
+    while (true)
+    {
+        tx_semaphore_get(&pool->ready, TX_WAIT_FOREVER);
+
+        tx_mutex_get(&pool->mutex, TX_WAIT_FOREVER);
+
+        // Oldest first among those under their limit
+        invocation = NX_NULL;
+        for (UINT i = 0; i < AZURE_IOT_NX_METHOD_MAX; i++)
+        {
+            if (pool->invocations[i].state == INVOCATION_PENDING &&
+                (invocation == NX_NULL || TICKS_BEFORE(pool->invocations[i].sequence, invocation->sequence)) &&
+                invocation_runnable(pool, &pool->invocations[i]))
+            {
+                invocation = &pool->invocations[i];
+            }
+        }
+
+        if (invocation == NX_NULL)
+        {
+            // Whatever is pending waits for a running method to answer
+            tx_mutex_put(&pool->mutex);
+            continue;
+        }
+
+        invocation->state = INVOCATION_RUNNING;
+        handle.index      = invocation - pool->invocations;
+        handle.sequence   = invocation->sequence;
+
+        tx_mutex_put(&pool->mutex);
+
+        packet = invocation->packet;
+
+        pool->invoke(pool->invoke_context,
+            (UCHAR*)invocation->method,
+            invocation->method_length,
+            packet->nx_packet_prepend_ptr,
+            packet->nx_packet_append_ptr - packet->nx_packet_prepend_ptr,
+            handle);
+
+        tx_mutex_get(&pool->mutex, TX_WAIT_FOREVER);
+
+        invocation->packet = NX_NULL;
+        invocation->state  = invocation->responded ? INVOCATION_FREE : INVOCATION_RETURNED;
+
+        tx_mutex_put(&pool->mutex);
+
+        nx_packet_release(packet);
+    }
+}
+
+UINT azure_iot_nx_method_pool_create(AZURE_IOT_NX_METHOD_POOL* pool,
+    NX_AZURE_IOT_HUB_CLIENT* hub_client,
+    UINT priority,
+    func_ptr_method_invoke invoke,
+    VOID* invoke_context)
+{
+    UINT status;
+    UINT i;
+
+    if (pool == NX_NULL || hub_client == NX_NULL || invoke == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    memset(pool, 0, sizeof(*pool));
+
+    pool->hub_client     = hub_client;
+    pool->invoke         = invoke;
+    pool->invoke_context = invoke_context;
+
+    if ((status = tx_mutex_create(&pool->mutex, "Method pool mutex", TX_NO_INHERIT)))
+    {
+        LOG_ERROR(LOG_MODULE_NX, "failed to create method pool mutex (0x%08x)", status);
+        return status;
+    }
+
+    if ((status = tx_semaphore_create(&pool->ready, "Method pool ready", 0)))
+    {
+        LOG_ERROR(LOG_MODULE_NX, "failed to create method pool semaphore (0x%08x)", status);
+        tx_mutex_delete(&pool->mutex);
+        return status;
+    }
+
+    for (i = 0; i < AZURE_IOT_NX_METHOD_WORKERS; i++)
+    {
+        if ((status = tx_thread_create(&pool->workers[i],
+                 "Method worker",
+                 worker_thread,
+                 (ULONG)pool,
+                 pool->stacks[i],
+                 AZURE_IOT_NX_METHOD_STACK_SIZE,
+                 priority,
+                 priority,
+                 1,
+                 TX_AUTO_START)))
+        {
+            LOG_ERROR(LOG_MODULE_NX, "failed to create method worker (0x%08x)", status);
+
+            while (i-- > 0)
+            {
+                tx_thread_terminate(&pool->workers[i]);
+                tx_thread_delete(&pool->workers[i]);
+            }
+
+            tx_semaphore_delete(&pool->ready);
+            tx_mutex_delete(&pool->mutex);
+            return status;
+        }
+    }
+
+    return NX_SUCCESS;
+}
+
+UINT azure_iot_nx_method_pool_delete(AZURE_IOT_NX_METHOD_POOL* pool)
+{
+    if (pool == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    for (UINT i = 0; i < AZURE_IOT_NX_METHOD_WORKERS; i++)
+    {
+        tx_thread_terminate(&pool->workers[i]);
+        tx_thread_delete(&pool->workers[i]);
+    }
+
+    for (UINT i = 0; i < AZURE_IOT_NX_METHOD_MAX; i++)
+    {
+        if (pool->invocations[i].packet != NX_NULL)
+        {
+            nx_packet_release(pool->invocations[i].packet);
+        }
+    }
+
+    tx_semaphore_delete(&pool->ready);
+    tx_mutex_delete(&pool->mutex);
+
+    return NX_SUCCESS;
+}
+
+UINT azure_iot_nx_method_limit_set(
+    AZURE_IOT_NX_METHOD_POOL* pool, const CHAR* pattern, UINT max_concurrent, ULONG timeout)
+{
+    AZURE_IOT_NX_METHOD_LIMIT* limit = NX_NULL;
+
+    if (pool == NX_NULL || pattern == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    if (pattern[0] == 0 || strlen(pattern) >= AZURE_IOT_NX_METHOD_NAME_SIZE || max_concurrent == 0)
+    {
+        return NX_SIZE_ERROR;
+    }
+
+    tx_mutex_get(&pool->mutex, TX_WAIT_FOREVER);
+
+    for (UINT i = 0; i < AZURE_IOT_NX_METHOD_LIMITS; i++)
+    {
+        if (strcmp(pool->limits[i].pattern, pattern) == 0)
+        {
+            limit = &pool->limits[i];
+            break;
+        }
+
+        if (limit == NX_NULL && pool->limits[i].pattern[0] == 0)
+        {
+            limit = &pool->limits[i];
+        }
+    }
+
+    if (limit == NX_NULL)
+    {
+        tx_mutex_put(&pool->mutex);
+        return NX_NO_MORE_ENTRIES;
+    }
+
+    strcpy(limit->pattern, pattern);
+    limit->max_concurrent = max_concurrent;
+    limit->timeout        = timeout;
+
+    tx_mutex_put(&pool->mutex);
+
+    // A higher limit may let a waiting method run
+    tx_semaphore_put(&pool->ready);
+
+    return NX_SUCCESS;
+}
+
+UINT azure_iot_nx_method_dispatch(AZURE_IOT_NX_METHOD_POOL* pool,
+    const UCHAR* method,
+    USHORT method_length,
+    NX_PACKET* packet,
+    VOID* context,
+    USHORT context_length,
+    ULONG* timeout)
+{
+    AZURE_IOT_NX_METHOD_INVOCATION* invocation = NX_NULL;
+    UINT active                                = 0;
+
+    if (pool == NX_NULL || method == NX_NULL || packet == NX_NULL || context == NX_NULL || timeout == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    if (method_length >= AZURE_IOT_NX_METHOD_NAME_SIZE || context_length > AZURE_IOT_NX_METHOD_CONTEXT_SIZE)
+    {
+        LOG_ERROR(LOG_MODULE_NX, "Direct method name or context too long");
+        response_send(pool, BAD_REQUEST_STATUS, context, context_length, (UCHAR*)"{}", sizeof("{}") - 1);
+        nx_packet_release(packet);
+        return NX_SIZE_ERROR;
+    }
+
+    tx_mutex_get(&pool->mutex, TX_WAIT_FOREVER);
+
+    for (UINT i = 0; i < AZURE_IOT_NX_METHOD_MAX; i++)
+    {
+        if (pool->invocations[i].state != INVOCATION_FREE)
+        {
+            active++;
+        }
+        else if (invocation == NX_NULL)
+        {
+            invocation = &pool->invocations[i];
+        }
+    }
+
+    if (invocation == NX_NULL)
+    {
+        pool->metrics.rejected++;
+        tx_mutex_put(&pool->mutex);
+
+        LOG_ERROR(LOG_MODULE_NX, "No room for direct method %.*s", (INT)method_length, (CHAR*)method);
+        response_send(pool, BUSY_STATUS, context, context_length, (UCHAR*)"{}", sizeof("{}") - 1);
+        nx_packet_release(packet);
+        return NX_NO_MORE_ENTRIES;
+    }
+
+    memcpy(invocation->method, method, method_length);
+    invocation->method[method_length] = 0;
+    invocation->method_length         = method_length;
+    memcpy(invocation->context, context, context_length);
+    invocation->context_length = context_length;
+    invocation->packet         = packet;
+    invocation->responded      = false;
+
+    if (++pool->sequence == 0)
+    {
+        pool->sequence = 1;
+    }
+    invocation->sequence = pool->sequence;
+
+    invocation->limit = NX_NULL;
+    for (UINT i = 0; i < AZURE_IOT_NX_METHOD_LIMITS; i++)
+    {
+        if (pool->limits[i].pattern[0] != 0 &&
+            pattern_match(pool->limits[i].pattern, invocation->method, method_length))
+        {
+            invocation->limit = &pool->limits[i];
+            break;
+        }
+    }
+
+    *timeout = invocation->limit != NX_NULL ? invocation->limit->timeout : AZURE_IOT_NX_METHOD_TIMEOUT;
+
+    invocation->deadline = tx_time_get() + *timeout;
+    invocation->state    = INVOCATION_PENDING;
+
+    pool->metrics.dispatched++;
+    if (active + 1 > pool->metrics.max_active)
+    {
+        pool->metrics.max_active = active + 1;
+    }
+
+    tx_mutex_put(&pool->mutex);
+
+    tx_semaphore_put(&pool->ready);
+
+    return NX_SUCCESS;
+}
+
+UINT azure_iot_nx_method_respond(AZURE_IOT_NX_METHOD_POOL* pool,
+    UINT http_status,
+    AZURE_IOT_NX_METHOD_HANDLE method_handle,
+    UCHAR* payload,
+    UINT payload_length)
+{
+    AZURE_IOT_NX_METHOD_INVOCATION* invocation;
+    UCHAR context[AZURE_IOT_NX_METHOD_CONTEXT_SIZE];
+    USHORT context_length;
+    ULONG sequence;
+    UINT status;
+
+    if (pool == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    if (method_handle.index >= AZURE_IOT_NX_METHOD_MAX)
+    {
+        return NX_INVALID_PARAMETERS;
+    }
+
+    invocation = &pool->invocations[method_handle.index];
+
+    tx_mutex_get(&pool->mutex, TX_WAIT_FOREVER);
+
+    // A different sequence means the slot was freed by a timeout and now holds a later call
+    if (invocation->state == INVOCATION_FREE || invocation->responded || invocation->sequence != method_handle.sequence)
+    {
+        pool->metrics.late++;
+        tx_mutex_put(&pool->mutex);
+        LOG_ERROR(LOG_MODULE_NX, "Direct method response after the timeout dropped");
+        return NX_NOT_FOUND;
+    }
+
+    // The worker may free the slot as soon as this is set, so send from a copy
+    invocation->responded = true;
+    sequence              = invocation->sequence;
+    context_length        = invocation->context_length;
+    memcpy(context, invocation->context, context_length);
+
+    tx_mutex_put(&pool->mutex);
+
+    status = response_send(pool, http_status, context, context_length, payload, payload_length);
+
+    tx_mutex_get(&pool->mutex, TX_WAIT_FOREVER);
+
+    if (invocation->sequence == sequence && invocation->state == INVOCATION_RETURNED)
+    {
+        invocation->state = INVOCATION_FREE;
+    }
+
+    tx_mutex_put(&pool->mutex);
+
+    // The method no longer counts against its limit
+    tx_semaphore_put(&pool->ready);
+
+    return status;
+}
+
+ULONG azure_iot_nx_method_expire(AZURE_IOT_NX_METHOD_POOL* pool)
+{
+    AZURE_IOT_NX_METHOD_INVOCATION* invocation;
+    UCHAR contexts[AZURE_IOT_NX_METHOD_MAX][AZURE_IOT_NX_METHOD_CONTEXT_SIZE];
+    USHORT context_lengths[AZURE_IOT_NX_METHOD_MAX];
+    NX_PACKET* packets[AZURE_IOT_NX_METHOD_MAX];
+    ULONG next   = TX_WAIT_FOREVER;
+    ULONG now    = tx_time_get();
+    UINT expired = 0;
+
+    tx_mutex_get(&pool->mutex, TX_WAIT_FOREVER);
+
+    for (UINT i = 0; i < AZURE_IOT_NX_METHOD_MAX; i++)
+    {
+        invocation = &pool->invocations[i];
+        if (invocation->state == INVOCATION_FREE || invocation->responded)
+        {
+            continue;
+        }
+
+        if (TICKS_BEFORE(now, invocation->deadline))
+        {
+            if (invocation->deadline - now < next)
+            {
+                next = invocation->deadline - now;
+            }
+            continue;
+        }
+
+        LOG_ERROR(LOG_MODULE_NX, "Direct method %s timed out", invocation->method);
+
+        invocation->responded    = true;
+        context_lengths[expired] = invocation->context_length;
+        memcpy(contexts[expired], invocation->context, invocation->context_length);
+        packets[expired] = NX_NULL;
+
+        // A running method keeps its slot until the invoke returns
+        if (invocation->state == INVOCATION_PENDING)
+        {
+            packets[expired]   = invocation->packet;
+            invocation->packet = NX_NULL;
+            invocation->state  = INVOCATION_FREE;
+        }
+        else if (invocation->state == INVOCATION_RETURNED)
+        {
+            invocation->state = INVOCATION_FREE;
+        }
+
+        pool->metrics.timed_out++;
+        expired++;
+    }
+
+    tx_mutex_put(&pool->mutex);
+
+    for (UINT i = 0; i < expired; i++)
+    {
+        response_send(pool, TIMEOUT_STATUS, contexts[i], context_lengths[i], (UCHAR*)"{}", sizeof("{}") - 1);
+
+        if (packets[i] != NX_NULL)
+        {
+            nx_packet_release(packets[i]);
+        }
+
+        tx_semaphore_put(&pool->ready);
+    }
+
+    return next;
+}
+
+VOID azure_iot_nx_method_metrics_get(AZURE_IOT_NX_METHOD_POOL* pool, AZURE_IOT_NX_METHOD_METRICS* metrics)
+{
+    tx_mutex_get(&pool->mutex, TX_WAIT_FOREVER);
+    *metrics = pool->metrics;
+    tx_mutex_put(&pool->mutex);
+}
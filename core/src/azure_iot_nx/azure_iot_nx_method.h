@@ -0,0 +1,143 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _AZURE_IOT_NX_METHOD_H
+#define _AZURE_IOT_NX_METHOD_H
+
+#include <stdbool.h>
+
+#include "tx_api.h"
+
+#include "nx_api.h"
+
+#include "nx_azure_iot_hub_client.h"
+
+// Methods that run at once, a slow method only holds up its own worker
+#ifndef AZURE_IOT_NX_METHOD_WORKERS
+#define AZURE_IOT_NX_METHOD_WORKERS 2
+#endif
+
+// Invocations queued, running or waiting for their response. The hub gets a 503 beyond this.
+#ifndef AZURE_IOT_NX_METHOD_MAX
+#define AZURE_IOT_NX_METHOD_MAX 4
+#endif
+
+#ifndef AZURE_IOT_NX_METHOD_LIMITS
+#define AZURE_IOT_NX_METHOD_LIMITS 4
+#endif
+
+// Matches the hub's default response timeout
+#ifndef AZURE_IOT_NX_METHOD_TIMEOUT
+#define AZURE_IOT_NX_METHOD_TIMEOUT (30 * TX_TIMER_TICKS_PER_SECOND)
+#endif
+
+#define AZURE_IOT_NX_METHOD_STACK_SIZE   (3 * 1024)
+#define AZURE_IOT_NX_METHOD_NAME_SIZE    64
+#define AZURE_IOT_NX_METHOD_CONTEXT_SIZE 32
+
+// How long a response may wait for the connection
+#define AZURE_IOT_NX_METHOD_RESPONSE_WAIT (5 * NX_IP_PERIODIC_RATE)
+
+// Names one invocation. A slot reused by a later call gets a new sequence, so a handle kept past its
+// timeout can never answer that call.
+typedef struct AZURE_IOT_NX_METHOD_HANDLE_STRUCT
+{
+    UINT index;
+    ULONG sequence;
+} AZURE_IOT_NX_METHOD_HANDLE;
+
+// Runs on a worker. The payload is valid until it returns, the handle is kept by value for the response.
+typedef VOID (*func_ptr_method_invoke)(VOID* context,
+    const UCHAR* method,
+    USHORT method_length,
+    UCHAR* payload,
+    USHORT payload_length,
+    AZURE_IOT_NX_METHOD_HANDLE method_handle);
+
+typedef struct AZURE_IOT_NX_METHOD_LIMIT_STRUCT
+{
+    CHAR pattern[AZURE_IOT_NX_METHOD_NAME_SIZE]; // Empty when the slot is free, * matches any run of characters
+    UINT max_concurrent;
+    ULONG timeout;
+} AZURE_IOT_NX_METHOD_LIMIT;
+
+typedef struct AZURE_IOT_NX_METHOD_INVOCATION_STRUCT
+{
+    UCHAR state;
+    bool responded;
+    ULONG sequence; // Order of arrival, never 0 so that a zeroed handle matches nothing
+    ULONG deadline;
+    AZURE_IOT_NX_METHOD_LIMIT* limit; // NX_NULL for the defaults
+
+    NX_PACKET* packet; // Holds the payload until the invoke returns
+    CHAR method[AZURE_IOT_NX_METHOD_NAME_SIZE];
+    USHORT method_length;
+    UCHAR context[AZURE_IOT_NX_METHOD_CONTEXT_SIZE];
+    USHORT context_length;
+} AZURE_IOT_NX_METHOD_INVOCATION;
+
+typedef struct AZURE_IOT_NX_METHOD_METRICS_STRUCT
+{
+    ULONG dispatched;
+    ULONG rejected;  // No free slot, answered with 503
+    ULONG timed_out; // Answered with 504 on the method's behalf
+    ULONG late;      // Responses that came after the timeout and were dropped
+    UINT max_active;
+} AZURE_IOT_NX_METHOD_METRICS;
+
+typedef struct AZURE_IOT_NX_METHOD_POOL_STRUCT
+{
+    NX_AZURE_IOT_HUB_CLIENT* hub_client;
+
+    TX_MUTEX mutex;
+    TX_SEMAPHORE ready; // Put whenever an invocation may have become runnable
+    TX_THREAD workers[AZURE_IOT_NX_METHOD_WORKERS];
+    ULONG stacks[AZURE_IOT_NX_METHOD_WORKERS][AZURE_IOT_NX_METHOD_STACK_SIZE / sizeof(ULONG)];
+
+    AZURE_IOT_NX_METHOD_INVOCATION invocations[AZURE_IOT_NX_METHOD_MAX];
+    AZURE_IOT_NX_METHOD_LIMIT limits[AZURE_IOT_NX_METHOD_LIMITS];
+    ULONG sequence;
+
+    func_ptr_method_invoke invoke;
+    VOID* invoke_context;
+
+    AZURE_IOT_NX_METHOD_METRICS metrics;
+} AZURE_IOT_NX_METHOD_POOL;
+
+UINT azure_iot_nx_method_pool_create(AZURE_IOT_NX_METHOD_POOL* pool,
+    NX_AZURE_IOT_HUB_CLIENT* hub_client,
+    UINT priority,
+    func_ptr_method_invoke invoke,
+    VOID* invoke_context);
+UINT azure_iot_nx_method_pool_delete(AZURE_IOT_NX_METHOD_POOL* pool);
+
+// Methods matching pattern run at most max_concurrent at once, further calls wait their turn. The hub is
+// answered with 504 if there is no response within timeout of the call arriving. Setting a pattern again
+// replaces its limit.
+UINT azure_iot_nx_method_limit_set(
+    AZURE_IOT_NX_METHOD_POOL* pool, const CHAR* pattern, UINT max_concurrent, ULONG timeout);
+
+// Queues a received method and returns the ticks until it times out. Takes ownership of the packet, also
+// on failure, when the hub is answered with 503 if every slot is taken or 400 if the method does not fit.
+UINT azure_iot_nx_method_dispatch(AZURE_IOT_NX_METHOD_POOL* pool,
+    const UCHAR* method,
+    USHORT method_length,
+    NX_PACKET* packet,
+    VOID* context,
+    USHORT context_length,
+    ULONG* timeout);
+
+// Answers an invocation, from any thread and in any order. method_handle is the one handed to invoke,
+// NX_NOT_FOUND once the invocation has timed out.
+UINT azure_iot_nx_method_respond(AZURE_IOT_NX_METHOD_POOL* pool,
+    UINT http_status,
+    AZURE_IOT_NX_METHOD_HANDLE method_handle,
+    UCHAR* payload,
+    UINT payload_length);
+
+// Answers overdue invocations with 504, returns the ticks until the next one is due or TX_WAIT_FOREVER
+ULONG azure_iot_nx_method_expire(AZURE_IOT_NX_METHOD_POOL* pool);
+
+VOID azure_iot_nx_method_metrics_get(AZURE_IOT_NX_METHOD_POOL* pool, AZURE_IOT_NX_METHOD_METRICS* metrics);
+
+#endif // _AZURE_IOT_NX_METHOD_H
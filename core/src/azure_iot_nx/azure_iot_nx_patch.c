@@ -0,0 +1,382 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "azure_iot_nx_patch.h"
+
+#include <string.h>
+
+#include "logging.h"
+
+#define PATCH_FREE    0
+#define PATCH_CLAIMED 1 // Document being built by the caller
+#define PATCH_QUEUED  2 // Waiting for or held by a sender
+#define PATCH_DONE    3
+
+// Must be called with the pipeline mutex held
+static VOID patch_release_if_finished(AZURE_IOT_NX_PATCH_PIPELINE* pipeline, UINT index)
+{
+    AZURE_IOT_NX_PATCH* patch = &pipeline->patches[index];
+
+    if (patch->state == PATCH_DONE && patch->delivered && !patch->keep)
+    {
+        patch->state   = PATCH_FREE;
+        patch->request = 0;
+        tx_event_flags_set(&pipeline->done_flags, ~(1UL << index), TX_AND);
+    }
+}
+
+static VOID sender_thread(ULONG parameter)
+{
+    AZURE_IOT_NX_PATCH_PIPELINE* pipeline = (AZURE_IOT_NX_PATCH_PIPELINE*)parameter;
+    AZURE_IOT_NX_PATCH_RESULT result;
+    AZURE_IOT_NX_PATCH* patch;
+    UINT request_id;
+    ULONG index;
+
+    while (true)
+    {
+        if (tx_queue_receive(&pipeline->queue, &index, TX_WAIT_FOREVER) != TX_SUCCESS)
+        {
+            continue;
+        }
+
+        patch = &pipeline->patches[index];
+        memset(&result, 0, sizeof(result));
+
+        // Other senders keep going meanwhile, the middleware matches each answer to its request
+        result.status = nx_azure_iot_hub_client_device_twin_reported_properties_send(pipeline->hub_client,
+            (UCHAR*)patch->document,
+            patch->length,
+            &request_id,
+            &result.response_status,
+            &result.version,
+            AZURE_IOT_NX_PATCH_TIMEOUT);
+
+        if (result.status != NX_SUCCESS)
+        {
+            LOG_ERROR(LOG_MODULE_NX, "device twin reported properties failed (0x%08x)", result.status);
+        }
+        else if (result.response_status < 200 || result.response_status >= 300)
+        {
+            LOG_ERROR(LOG_MODULE_NX, "device twin report properties failed (%d)", result.response_status);
+            result.status = NX_NOT_SUCCESSFUL;
+        }
+        else
+        {
+            LOG_DEBUG(LOG_MODULE_NX, "Device twin properties sent: %.*s", patch->length, patch->document);
+        }
+
+        tx_mutex_get(&pipeline->mutex, TX_WAIT_FOREVER);
+
+        patch->result = result;
+        patch->state  = PATCH_DONE;
+        pipeline->in_flight--;
+
+        if (result.status != NX_SUCCESS)
+        {
+            pipeline->metrics.failed++;
+        }
+
+        tx_mutex_put(&pipeline->mutex);
+
+        tx_event_flags_set(&pipeline->done_flags, 1UL << index, TX_OR);
+
+        if (pipeline->done != NX_NULL)
+        {
+            pipeline->done(pipeline->done_context);
+        }
+    }
+}
+
+UINT azure_iot_nx_patch_pipeline_create(AZURE_IOT_NX_PATCH_PIPELINE* pipeline,
+    NX_AZURE_IOT_HUB_CLIENT* hub_client,
+    UINT priority,
+    func_ptr_patch_done done,
+    VOID* done_context)
+{
+    UINT status;
+    UINT i;
+
+    if (pipeline == NX_NULL || hub_client == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    memset(pipeline, 0, sizeof(*pipeline));
+
+    pipeline->hub_client   = hub_client;
+    pipeline->done         = done;
+    pipeline->done_context = done_context;
+
+    if ((status = tx_mutex_create(&pipeline->mutex, "Twin patch mutex", TX_NO_INHERIT)))
+    {
+        LOG_ERROR(LOG_MODULE_NX, "failed to create twin patch mutex (0x%08x)", status);
+        return status;
+    }
+
+    if ((status = tx_event_flags_create(&pipeline->done_flags, "Twin patch flags")))
+    {
+        LOG_ERROR(LOG_MODULE_NX, "failed to create twin patch event flags (0x%08x)", status);
+        tx_mutex_delete(&pipeline->mutex);
+        return status;
+    }
+
+    if ((status = tx_queue_create(&pipeline->queue,
+             "Twin patch queue",
+             TX_1_ULONG,
+             pipeline->queue_storage,
+             sizeof(pipeline->queue_storage))))
+    {
+        LOG_ERROR(LOG_MODULE_NX, "failed to create twin patch queue (0x%08x)", status);
+        tx_event_flags_delete(&pipeline->done_flags);
+        tx_mutex_delete(&pipeline->mutex);
+        return status;
+    }
+
+    for (i = 0; i < AZURE_IOT_NX_PATCH_SENDERS; i++)
+    {
+        if ((status = tx_thread_create(&pipeline->senders[i],
+                 "Twin patch sender",
+                 sender_thread,
+                 (ULONG)pipeline,
+                 pipeline->stacks[i],
+                 AZURE_IOT_NX_PATCH_STACK_SIZE,
+                 priority,
+                 priority,
+                 TX_NO_TIME_SLICE,
+                 TX_AUTO_START)))
+        {
+            LOG_ERROR(LOG_MODULE_NX, "failed to create twin patch sender (0x%08x)", status);
+
+            while (i-- > 0)
+            {
+                tx_thread_terminate(&pipeline->senders[i]);
+                tx_thread_delete(&pipeline->senders[i]);
+            }
+
+            tx_queue_delete(&pipeline->queue);
+            tx_event_flags_delete(&pipeline->done_flags);
+            tx_mutex_delete(&pipeline->mutex);
+            return status;
+        }
+    }
+
+    return NX_SUCCESS;
+}
+
+UINT azure_iot_nx_patch_pipeline_delete(AZURE_IOT_NX_PATCH_PIPELINE* pipeline)
+{
+    if (pipeline == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    for (UINT i = 0; i < AZURE_IOT_NX_PATCH_SENDERS; i++)
+    {
+        tx_thread_terminate(&pipeline->senders[i]);
+        tx_thread_delete(&pipeline->senders[i]);
+    }
+
+    tx_queue_delete(&pipeline->queue);
+    tx_event_flags_delete(&pipeline->done_flags);
+    tx_mutex_delete(&pipeline->mutex);
+
+    return NX_SUCCESS;
+}
+
+UINT azure_iot_nx_patch_claim(AZURE_IOT_NX_PATCH_PIPELINE* pipeline, AZURE_IOT_NX_PATCH** patch)
+{
+    if (pipeline == NX_NULL || patch == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    tx_mutex_get(&pipeline->mutex, TX_WAIT_FOREVER);
+
+    for (UINT i = 0; i < AZURE_IOT_NX_PATCH_MAX; i++)
+    {
+        if (pipeline->patches[i].state == PATCH_FREE)
+        {
+            pipeline->patches[i].state = PATCH_CLAIMED;
+            *patch                     = &pipeline->patches[i];
+
+            tx_mutex_put(&pipeline->mutex);
+            return NX_SUCCESS;
+        }
+    }
+
+    pipeline->metrics.rejected++;
+
+    tx_mutex_put(&pipeline->mutex);
+
+    return NX_NO_MORE_ENTRIES;
+}
+
+VOID azure_iot_nx_patch_abandon(AZURE_IOT_NX_PATCH_PIPELINE* pipeline, AZURE_IOT_NX_PATCH* patch)
+{
+    tx_mutex_get(&pipeline->mutex, TX_WAIT_FOREVER);
+    patch->state = PATCH_FREE;
+    tx_mutex_put(&pipeline->mutex);
+}
+
+UINT azure_iot_nx_patch_submit(AZURE_IOT_NX_PATCH_PIPELINE* pipeline,
+    AZURE_IOT_NX_PATCH* patch,
+    UINT length,
+    func_ptr_patch_complete complete,
+    VOID* complete_context,
+    bool keep,
+    ULONG* request)
+{
+    ULONG index;
+    UINT status;
+
+    if (pipeline == NX_NULL || patch == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    if (length == 0 || length > sizeof(patch->document))
+    {
+        azure_iot_nx_patch_abandon(pipeline, patch);
+        return NX_SIZE_ERROR;
+    }
+
+    index = patch - pipeline->patches;
+
+    tx_mutex_get(&pipeline->mutex, TX_WAIT_FOREVER);
+
+    // Never hand out 0, it marks a slot without a request
+    if (++pipeline->sequence == 0)
+    {
+        pipeline->sequence = 1;
+    }
+
+    patch->request          = pipeline->sequence;
+    patch->length           = length;
+    patch->complete         = complete;
+    patch->complete_context = complete_context;
+    patch->keep             = keep;
+    patch->delivered        = false;
+    patch->state            = PATCH_QUEUED;
+
+    pipeline->in_flight++;
+    pipeline->metrics.submitted++;
+    if (pipeline->in_flight > pipeline->metrics.max_in_flight)
+    {
+        pipeline->metrics.max_in_flight = pipeline->in_flight;
+    }
+
+    if (request != NX_NULL)
+    {
+        *request = patch->request;
+    }
+
+    tx_mutex_put(&pipeline->mutex);
+
+    // The queue has room for every slot, so this cannot block
+    if ((status = tx_queue_send(&pipeline->queue, &index, TX_NO_WAIT)))
+    {
+        tx_mutex_get(&pipeline->mutex, TX_WAIT_FOREVER);
+        pipeline->in_flight--;
+        patch->state   = PATCH_FREE;
+        patch->request = 0;
+        tx_mutex_put(&pipeline->mutex);
+    }
+
+    return status;
+}
+
+UINT azure_iot_nx_patch_wait(
+    AZURE_IOT_NX_PATCH_PIPELINE* pipeline, ULONG request, AZURE_IOT_NX_PATCH_RESULT* result, ULONG wait_option)
+{
+    AZURE_IOT_NX_PATCH* patch = NX_NULL;
+    ULONG flags;
+    UINT index;
+    UINT status;
+
+    if (pipeline == NX_NULL || result == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    tx_mutex_get(&pipeline->mutex, TX_WAIT_FOREVER);
+
+    for (index = 0; index < AZURE_IOT_NX_PATCH_MAX; index++)
+    {
+        if (request != 0 && pipeline->patches[index].request == request && pipeline->patches[index].keep)
+        {
+            patch = &pipeline->patches[index];
+            break;
+        }
+    }
+
+    tx_mutex_put(&pipeline->mutex);
+
+    if (patch == NX_NULL)
+    {
+        return NX_NOT_FOUND;
+    }
+
+    // The slot cannot be reused while keep is set
+    status = tx_event_flags_get(&pipeline->done_flags, 1UL << index, TX_OR, &flags, wait_option);
+
+    tx_mutex_get(&pipeline->mutex, TX_WAIT_FOREVER);
+
+    if (status == TX_SUCCESS)
+    {
+        *result = patch->result;
+    }
+
+    // A wait that timed out gives the result up
+    patch->keep = false;
+    patch_release_if_finished(pipeline, index);
+
+    tx_mutex_put(&pipeline->mutex);
+
+    return status;
+}
+
+VOID azure_iot_nx_patch_deliver(AZURE_IOT_NX_PATCH_PIPELINE* pipeline)
+{
+    AZURE_IOT_NX_PATCH* patch;
+    AZURE_IOT_NX_PATCH_RESULT result;
+    func_ptr_patch_complete complete;
+    VOID* complete_context;
+    ULONG request;
+
+    for (UINT i = 0; i < AZURE_IOT_NX_PATCH_MAX; i++)
+    {
+        patch = &pipeline->patches[i];
+
+        tx_mutex_get(&pipeline->mutex, TX_WAIT_FOREVER);
+
+        if (patch->state != PATCH_DONE || patch->delivered)
+        {
+            tx_mutex_put(&pipeline->mutex);
+            continue;
+        }
+
+        complete         = patch->complete;
+        complete_context = patch->complete_context;
+        request          = patch->request;
+        result           = patch->result;
+
+        patch->delivered = true;
+        patch_release_if_finished(pipeline, i);
+
+        tx_mutex_put(&pipeline->mutex);
+
+        // Outside the mutex, the callback may well submit the next patch
+        if (complete != NX_NULL)
+        {
+            complete(request, &result, complete_context);
+        }
+    }
+}
+
+VOID azure_iot_nx_patch_metrics_get(AZURE_IOT_NX_PATCH_PIPELINE* pipeline, AZURE_IOT_NX_PATCH_METRICS* metrics)
+{
+    tx_mutex_get(&pipeline->mutex, TX_WAIT_FOREVER);
+    *metrics = pipeline->metrics;
+    tx_mutex_put(&pipeline->mutex);
+}
@@ -0,0 +1,121 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _AZURE_IOT_NX_PATCH_H
+#define _AZURE_IOT_NX_PATCH_H
+
+#include <stdbool.h>
+
+#include "tx_api.h"
+
+#include "nx_api.h"
+
+#include "nx_azure_iot_hub_client.h"
+
+// Reported property patches queued or waiting for the hub's answer
+#ifndef AZURE_IOT_NX_PATCH_MAX
+#define AZURE_IOT_NX_PATCH_MAX 4
+#endif
+
+// Patches on the wire at once, each one holds a sender thread for its round trip
+#ifndef AZURE_IOT_NX_PATCH_SENDERS
+#define AZURE_IOT_NX_PATCH_SENDERS 2
+#endif
+
+#define AZURE_IOT_NX_PATCH_SIZE       512
+#define AZURE_IOT_NX_PATCH_STACK_SIZE (3 * 1024)
+
+// How long a sender waits for the hub to answer
+#define AZURE_IOT_NX_PATCH_TIMEOUT (5 * NX_IP_PERIODIC_RATE)
+
+typedef struct AZURE_IOT_NX_PATCH_RESULT_STRUCT
+{
+    UINT status;          // NX_SUCCESS only if the hub accepted the patch
+    UINT response_status; // HTTP style status from the hub, 0 if it never answered
+    ULONG version;        // Reported properties version after the patch
+} AZURE_IOT_NX_PATCH_RESULT;
+
+typedef VOID (*func_ptr_patch_complete)(ULONG request, AZURE_IOT_NX_PATCH_RESULT* result, VOID* context);
+
+// Called on a sender thread whenever a patch has its result, must not block.
+// Completion callbacks are run later by azure_iot_nx_patch_deliver.
+typedef VOID (*func_ptr_patch_done)(VOID* context);
+
+typedef struct AZURE_IOT_NX_PATCH_STRUCT
+{
+    ULONG request; // 0 until submitted
+    UCHAR state;
+    bool keep;      // Result is held for azure_iot_nx_patch_wait
+    bool delivered; // Completion callback has run
+
+    func_ptr_patch_complete complete;
+    VOID* complete_context;
+    AZURE_IOT_NX_PATCH_RESULT result;
+
+    UINT length;
+    CHAR document[AZURE_IOT_NX_PATCH_SIZE];
+} AZURE_IOT_NX_PATCH;
+
+typedef struct AZURE_IOT_NX_PATCH_METRICS_STRUCT
+{
+    ULONG submitted;
+    ULONG failed;   // Not sent, or refused by the hub
+    ULONG rejected; // No free slot
+    ULONG max_in_flight;
+} AZURE_IOT_NX_PATCH_METRICS;
+
+typedef struct AZURE_IOT_NX_PATCH_PIPELINE_STRUCT
+{
+    NX_AZURE_IOT_HUB_CLIENT* hub_client;
+
+    TX_MUTEX mutex;
+    TX_QUEUE queue;
+    TX_EVENT_FLAGS_GROUP done_flags; // One flag per slot
+    TX_THREAD senders[AZURE_IOT_NX_PATCH_SENDERS];
+
+    ULONG queue_storage[AZURE_IOT_NX_PATCH_MAX];
+    ULONG stacks[AZURE_IOT_NX_PATCH_SENDERS][AZURE_IOT_NX_PATCH_STACK_SIZE / sizeof(ULONG)];
+
+    AZURE_IOT_NX_PATCH patches[AZURE_IOT_NX_PATCH_MAX];
+    UINT in_flight;
+    ULONG sequence;
+
+    func_ptr_patch_done done;
+    VOID* done_context;
+
+    AZURE_IOT_NX_PATCH_METRICS metrics;
+} AZURE_IOT_NX_PATCH_PIPELINE;
+
+// The hub client only has to be connected once patches are submitted
+UINT azure_iot_nx_patch_pipeline_create(AZURE_IOT_NX_PATCH_PIPELINE* pipeline,
+    NX_AZURE_IOT_HUB_CLIENT* hub_client,
+    UINT priority,
+    func_ptr_patch_done done,
+    VOID* done_context);
+UINT azure_iot_nx_patch_pipeline_delete(AZURE_IOT_NX_PATCH_PIPELINE* pipeline);
+
+// Claims a free slot so the caller can build the document straight into patch->document.
+// Hand it back with azure_iot_nx_patch_submit or azure_iot_nx_patch_abandon.
+UINT azure_iot_nx_patch_claim(AZURE_IOT_NX_PATCH_PIPELINE* pipeline, AZURE_IOT_NX_PATCH** patch);
+VOID azure_iot_nx_patch_abandon(AZURE_IOT_NX_PATCH_PIPELINE* pipeline, AZURE_IOT_NX_PATCH* patch);
+
+// Queues the document and returns without waiting for the hub. Patches in flight together may be
+// applied in either order. With keep set the result is held until azure_iot_nx_patch_wait collects it.
+UINT azure_iot_nx_patch_submit(AZURE_IOT_NX_PATCH_PIPELINE* pipeline,
+    AZURE_IOT_NX_PATCH* patch,
+    UINT length,
+    func_ptr_patch_complete complete,
+    VOID* complete_context,
+    bool keep,
+    ULONG* request);
+
+// Blocks until the hub has answered a request submitted with keep set
+UINT azure_iot_nx_patch_wait(
+    AZURE_IOT_NX_PATCH_PIPELINE* pipeline, ULONG request, AZURE_IOT_NX_PATCH_RESULT* result, ULONG wait_option);
+
+// Runs the completion callbacks of finished patches on the calling thread
+VOID azure_iot_nx_patch_deliver(AZURE_IOT_NX_PATCH_PIPELINE* pipeline);
+
+VOID azure_iot_nx_patch_metrics_get(AZURE_IOT_NX_PATCH_PIPELINE* pipeline, AZURE_IOT_NX_PATCH_METRICS* metrics);
+
+#endif // _AZURE_IOT_NX_PATCH_H
@@ -68,13 +68,42 @@ static UINT sample_json_child_token_move(
     return (NX_AZURE_IOT_NOT_FOUND);
 }
 
+/* Point at the current property name where it lies in the packet. Only a name that straddles two packets of
+   the chain is copied, into name_buf.  */
+static UINT sample_json_property_name_get(NX_AZURE_IOT_JSON_READER* json_reader_ptr,
+    UCHAR* name_buf,
+    UINT name_buf_len,
+    UCHAR** property_name_pptr,
+    UINT* property_name_len_ptr)
+{
+    az_json_token* token_ptr = &(json_reader_ptr->json_reader.token);
+    az_span remainder;
+
+    if (az_span_size(token_ptr->slice) == token_ptr->size)
+    {
+        *property_name_pptr    = az_span_ptr(token_ptr->slice);
+        *property_name_len_ptr = (UINT)token_ptr->size;
+        return (NX_AZURE_IOT_SUCCESS);
+    }
+
+    if ((UINT)token_ptr->size > name_buf_len)
+    {
+        printf("Property name split across packets is too long: %d\r\n", (INT)token_ptr->size);
+        return (NX_AZURE_IOT_INSUFFICIENT_BUFFER_SPACE);
+    }
+
+    remainder              = az_json_token_copy_into_span(token_ptr, az_span_create(name_buf, (INT)name_buf_len));
+    *property_name_pptr    = name_buf;
+    *property_name_len_ptr = name_buf_len - (UINT)az_span_size(remainder);
+
+    return (NX_AZURE_IOT_SUCCESS);
+}
+
 /* Visit component property Object and call callback on each property of that component.  */
 static UINT visit_component_properties(UCHAR* component_name_ptr,
     UINT component_name_len,
     NX_AZURE_IOT_JSON_READER* json_reader_ptr,
     UINT version,
-    UCHAR* scratch_buf,
-    UINT scratch_buf_len,
     VOID (*sample_desired_property_callback)(UCHAR* component_name_ptr,
         UINT component_name_len,
         UCHAR* property_name_ptr,
@@ -84,13 +113,15 @@ static UINT visit_component_properties(UCHAR* component_name_ptr,
         VOID* userContextCallback),
     VOID* context_ptr)
 {
+    UCHAR name_buf[NX_AZURE_IOT_PNP_PROPERTY_NAME_SIZE];
+    UCHAR* name_ptr;
     UINT len;
 
     while (nx_azure_iot_json_reader_next_token(json_reader_ptr) == NX_AZURE_IOT_SUCCESS)
     {
         if (nx_azure_iot_json_reader_token_type(json_reader_ptr) == NX_AZURE_IOT_READER_TOKEN_PROPERTY_NAME)
         {
-            if (nx_azure_iot_json_reader_token_string_get(json_reader_ptr, scratch_buf, scratch_buf_len, &len))
+            if (sample_json_property_name_get(json_reader_ptr, name_buf, sizeof(name_buf), &name_ptr, &len))
             {
                 printf("Failed to get string property value\r\n");
                 return (NX_NOT_SUCCESSFUL);
@@ -103,19 +134,19 @@ static UINT visit_component_properties(UCHAR* component_name_ptr,
             }
 
             if ((len == sizeof(sample_pnp_component_type_property_name) - 1) &&
-                (memcmp((VOID*)scratch_buf, (VOID*)sample_pnp_component_type_property_name, len) == 0))
+                (memcmp((VOID*)name_ptr, (VOID*)sample_pnp_component_type_property_name, len) == 0))
             {
                 continue;
             }
 
             if ((len == sizeof(sample_iot_hub_twin_desired_version) - 1) &&
-                (memcmp((VOID*)scratch_buf, (VOID*)sample_iot_hub_twin_desired_version, len) == 0))
+                (memcmp((VOID*)name_ptr, (VOID*)sample_iot_hub_twin_desired_version, len) == 0))
             {
                 continue;
             }
 
             sample_desired_property_callback(
-                component_name_ptr, component_name_len, scratch_buf, len, *json_reader_ptr, version, context_ptr);
+                component_name_ptr, component_name_len, name_ptr, len, *json_reader_ptr, version, context_ptr);
         }
 
         if (nx_azure_iot_json_reader_token_type(json_reader_ptr) == NX_AZURE_IOT_READER_TOKEN_BEGIN_OBJECT)
@@ -202,8 +233,6 @@ UINT nx_azure_iot_pnp_helper_twin_data_parse(NX_AZURE_IOT_JSON_READER* json_read
     UINT is_partial,
     CHAR** sample_components_ptr,
     UINT sample_components_num,
-    UCHAR* scratch_buf,
-    UINT scratch_buf_len,
     VOID (*sample_desired_property_callback)(UCHAR* component_name_ptr,
         UINT component_name_len,
         UCHAR* property_name_ptr,
@@ -214,6 +243,8 @@ UINT nx_azure_iot_pnp_helper_twin_data_parse(NX_AZURE_IOT_JSON_READER* json_read
     VOID* context_ptr)
 {
     NX_AZURE_IOT_JSON_READER copy_json_reader;
+    UCHAR name_buf[NX_AZURE_IOT_PNP_PROPERTY_NAME_SIZE];
+    UCHAR* name_ptr;
     UINT version;
     UINT len;
     UINT index;
@@ -247,7 +278,7 @@ UINT nx_azure_iot_pnp_helper_twin_data_parse(NX_AZURE_IOT_JSON_READER* json_read
     {
         if (nx_azure_iot_json_reader_token_type(json_reader_ptr) == NX_AZURE_IOT_READER_TOKEN_PROPERTY_NAME)
         {
-            if (nx_azure_iot_json_reader_token_string_get(json_reader_ptr, scratch_buf, scratch_buf_len, &len))
+            if (sample_json_property_name_get(json_reader_ptr, name_buf, sizeof(name_buf), &name_ptr, &len))
             {
                 printf("Failed to string value for property name\r\n");
                 return (NX_NOT_SUCCESSFUL);
@@ -260,22 +291,20 @@ UINT nx_azure_iot_pnp_helper_twin_data_parse(NX_AZURE_IOT_JSON_READER* json_read
             }
 
             if ((len == sizeof(sample_iot_hub_twin_desired_version) - 1) &&
-                (memcmp((VOID*)sample_iot_hub_twin_desired_version, (VOID*)scratch_buf, len) == 0))
+                (memcmp((VOID*)sample_iot_hub_twin_desired_version, (VOID*)name_ptr, len) == 0))
             {
                 continue;
             }
 
             if (nx_azure_iot_json_reader_token_type(json_reader_ptr) == NX_AZURE_IOT_READER_TOKEN_BEGIN_OBJECT &&
                 sample_components_ptr != NX_NULL &&
-                (is_component_in_model(scratch_buf, len, sample_components_ptr, sample_components_num, &index) ==
+                (is_component_in_model(name_ptr, len, sample_components_ptr, sample_components_num, &index) ==
                     NX_AZURE_IOT_SUCCESS))
             {
                 if (visit_component_properties((UCHAR*)sample_components_ptr[index],
                         strlen(sample_components_ptr[index]),
                         json_reader_ptr,
                         version,
-                        scratch_buf,
-                        scratch_buf_len,
                         sample_desired_property_callback,
                         context_ptr))
                 {
@@ -285,7 +314,7 @@ UINT nx_azure_iot_pnp_helper_twin_data_parse(NX_AZURE_IOT_JSON_READER* json_read
             }
             else
             {
-                sample_desired_property_callback(NX_NULL, 0, scratch_buf, len, *json_reader_ptr, version, context_ptr);
+                sample_desired_property_callback(NX_NULL, 0, name_ptr, len, *json_reader_ptr, version, context_ptr);
 
                 if (nx_azure_iot_json_reader_token_type(json_reader_ptr) == NX_AZURE_IOT_READER_TOKEN_BEGIN_OBJECT)
                 {
@@ -22,6 +22,12 @@ extern "C"
 #include "nx_azure_iot_json_reader.h"
 #include "nx_azure_iot_json_writer.h"
 
+/* Longest property name that can straddle two packets of a twin document. Names that fit in one packet are
+   read in place whatever their length.  */
+#ifndef NX_AZURE_IOT_PNP_PROPERTY_NAME_SIZE
+#define NX_AZURE_IOT_PNP_PROPERTY_NAME_SIZE 64
+#endif
+
     /**
      * @brief Parse PnP command name
      *
@@ -42,14 +48,15 @@ extern "C"
         UINT* pnp_command_name_length_ptr);
 
     /**
-     * @brief Parse twin data and call callback on each desired property
+     * @brief Parse twin data and call callback on each desired property as it is reached
+     *
+     * The document may span a chain of packets. Property names are handed to the callback where they lie
+     * in the packet, so they are only valid until the callback returns.
      *
      * @param[in] json_reader_ptr `NX_AZURE_IOT_JSON_READER` pointer containing the twin data
      * @param[in] is_partial 1 if twin data is patch else 0 if full twin document
      * @param[in] sample_components_ptr Pointer to list of all components name pointers
      * @param[in] sample_components_num Size of component list
-     * @param[in] scratch_buf Temporary buffer used for staging property names out of the JSON document
-     * @param[in] scratch_buf_len Temporary buffer length size
      * @param[in] sample_desired_property_callback Callback called with each desired property
      * @param[in] context_ptr Context passed to the callback
      * @return A `UINT` with the result of the API.
@@ -59,8 +66,6 @@ extern "C"
         UINT is_partial,
         CHAR** sample_components_ptr,
         UINT sample_components_num,
-        UCHAR* scratch_buf,
-        UINT scratch_buf_len,
         VOID (*sample_desired_property_callback)(UCHAR* component_name_ptr,
             UINT component_name_len,
             UCHAR* property_name_ptr,
@@ -0,0 +1,227 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "base64.h"
+
+#include <stdint.h>
+
+#define BASE64_INVALID 64
+
+static const char base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char hex[]             = "0123456789abcdef";
+
+// Values for '+' through 'z', everything else is invalid
+static const unsigned char base64_values[80] = {
+    62, 64, 64, 64, 63, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 64, 64, 64, 64, 64,
+    64, 64, 0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, 15, 16, 17,
+    18, 19, 20, 21, 22, 23, 24, 25, 64, 64, 64, 64, 64, 64, 26, 27, 28, 29, 30, 31,
+    32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51};
+
+static uint32_t base64_value(char c)
+{
+    uint32_t index = (uint32_t)(unsigned char)c - '+';
+
+    return index < sizeof(base64_values) ? base64_values[index] : BASE64_INVALID;
+}
+
+static bool url_safe(char c)
+{
+    return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || ('0' <= c && c <= '9');
+}
+
+// Writes one character, escaping it when needed. out_end leaves room for the terminator.
+static bool url_put(char c, char** out, char* out_end)
+{
+    if (url_safe(c))
+    {
+        if (*out >= out_end)
+        {
+            return false;
+        }
+
+        *(*out)++ = c;
+        return true;
+    }
+
+    if (out_end - *out < 3)
+    {
+        return false;
+    }
+
+    *(*out)++ = '%';
+    *(*out)++ = hex[(unsigned char)c >> 4];
+    *(*out)++ = hex[c & 15];
+    return true;
+}
+
+// Splits src into groups of four alphabet characters, the tail group holds 0, 2 or 3 characters
+static void base64_group(const unsigned char* src, size_t length, char group[4])
+{
+    uint32_t bits = (uint32_t)src[0] << 16;
+
+    if (length > 1)
+    {
+        bits |= (uint32_t)src[1] << 8;
+    }
+
+    if (length > 2)
+    {
+        bits |= src[2];
+    }
+
+    group[0] = base64_alphabet[(bits >> 18) & 0x3F];
+    group[1] = base64_alphabet[(bits >> 12) & 0x3F];
+    group[2] = length > 1 ? base64_alphabet[(bits >> 6) & 0x3F] : '=';
+    group[3] = length > 2 ? base64_alphabet[bits & 0x3F] : '=';
+}
+
+size_t base64_encode(const unsigned char* src, size_t src_length, char* out, size_t out_size)
+{
+    size_t length = BASE64_ENCODED_LENGTH(src_length);
+    char* o       = out;
+
+    if (out_size < length + 1)
+    {
+        if (out_size > 0)
+        {
+            out[0] = 0;
+        }
+        return 0;
+    }
+
+    for (; src_length > 0; src += 3, src_length -= src_length < 3 ? src_length : 3, o += 4)
+    {
+        base64_group(src, src_length, o);
+    }
+
+    *o = 0;
+
+    return length;
+}
+
+size_t url_encode(const char* src, size_t src_length, char* out, size_t out_size)
+{
+    char* o       = out;
+    char* out_end = out + out_size - 1;
+
+    if (out_size == 0)
+    {
+        return 0;
+    }
+
+    for (size_t i = 0; i < src_length; i++)
+    {
+        if (!url_put(src[i], &o, out_end))
+        {
+            out[0] = 0;
+            return 0;
+        }
+    }
+
+    *o = 0;
+
+    return o - out;
+}
+
+size_t base64_url_encode(const unsigned char* src, size_t src_length, char* out, size_t out_size)
+{
+    char* o       = out;
+    char* out_end = out + out_size - 1;
+    char group[4];
+
+    if (out_size == 0)
+    {
+        return 0;
+    }
+
+    for (; src_length > 0; src += 3, src_length -= src_length < 3 ? src_length : 3)
+    {
+        base64_group(src, src_length, group);
+
+        for (int i = 0; i < 4; i++)
+        {
+            if (!url_put(group[i], &o, out_end))
+            {
+                out[0] = 0;
+                return 0;
+            }
+        }
+    }
+
+    *o = 0;
+
+    return o - out;
+}
+
+bool base64_decode(const char* src, size_t src_length, unsigned char* out, size_t out_size, size_t* out_length)
+{
+    unsigned char* o = out;
+    size_t tail;
+    uint32_t a, b, c, d;
+    uint32_t bits;
+
+    // Padding only ever appears at the end of a complete group
+    if (src_length % 4 == 0)
+    {
+        for (int i = 0; i < 2 && src_length > 0 && src[src_length - 1] == '='; i++)
+        {
+            src_length--;
+        }
+    }
+
+    tail = src_length % 4;
+    if (tail == 1)
+    {
+        return false;
+    }
+
+    if ((src_length / 4) * 3 + (tail ? tail - 1 : 0) > out_size)
+    {
+        return false;
+    }
+
+    // Four characters make three bytes, an invalid character sets the sentinel bit in the group
+    for (; src_length >= 4; src += 4, src_length -= 4)
+    {
+        a = base64_value(src[0]);
+        b = base64_value(src[1]);
+        c = base64_value(src[2]);
+        d = base64_value(src[3]);
+        if ((a | b | c | d) & BASE64_INVALID)
+        {
+            return false;
+        }
+
+        bits = (a << 18) | (b << 12) | (c << 6) | d;
+
+        *o++ = (unsigned char)(bits >> 16);
+        *o++ = (unsigned char)(bits >> 8);
+        *o++ = (unsigned char)bits;
+    }
+
+    if (tail > 0)
+    {
+        a = base64_value(src[0]);
+        b = base64_value(src[1]);
+        c = tail == 3 ? base64_value(src[2]) : 0;
+        if ((a | b | c) & BASE64_INVALID)
+        {
+            return false;
+        }
+
+        bits = (a << 18) | (b << 12) | (c << 6);
+
+        *o++ = (unsigned char)(bits >> 16);
+        if (tail == 3)
+        {
+            *o++ = (unsigned char)(bits >> 8);
+        }
+    }
+
+    if (out_length != NULL)
+    {
+        *out_length = o - out;
+    }
+
+    return true;
+}
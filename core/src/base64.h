@@ -0,0 +1,28 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _BASE64_H
+#define _BASE64_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Characters needed to encode length bytes, excluding the terminator
+#define BASE64_ENCODED_LENGTH(length) ((((length) + 2) / 3) * 4)
+
+// Largest number of bytes length characters can decode to
+#define BASE64_DECODED_MAX_LENGTH(length) (((length) / 4) * 3 + 2)
+
+// All writers null terminate and return the number of characters written, or 0 if the output does not fit
+size_t base64_encode(const unsigned char* src, size_t src_length, char* out, size_t out_size);
+
+// Percent-encodes everything except letters and digits
+size_t url_encode(const char* src, size_t src_length, char* out, size_t out_size);
+
+// base64 followed by url_encode in one pass, e.g. for SAS signatures, with no intermediate buffer
+size_t base64_url_encode(const unsigned char* src, size_t src_length, char* out, size_t out_size);
+
+// Accepts padded or unpadded input, fails on any character outside the base64 alphabet
+bool base64_decode(const char* src, size_t src_length, unsigned char* out, size_t out_size, size_t* out_length);
+
+#endif // _BASE64_H
@@ -0,0 +1,453 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "connection_supervisor.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "logging.h"
+
+#define MAX_EXPONENTIAL_BACKOFF_JITTER_PERCENT 60
+#define MAX_EXPONENTIAL_BACKOFF_IN_SEC         (10 * 60)
+#define INITIAL_EXPONENTIAL_BACKOFF_IN_SEC     3
+
+#define SUPERVISOR_ALL_EVENTS       0x0F
+#define SUPERVISOR_DISCONNECT_EVENT 0x01
+#define SUPERVISOR_RETRY_EVENT      0x02
+#define SUPERVISOR_RECONNECT_EVENT  0x04
+#define SUPERVISOR_WORK_EVENT       0x08
+
+UINT exponential_backoff_with_jitter(UINT* exponential_retry_count)
+{
+    float jitter_percent = (MAX_EXPONENTIAL_BACKOFF_JITTER_PERCENT / 100.0f) * (rand() / ((float)RAND_MAX));
+    UINT base_delay      = MAX_EXPONENTIAL_BACKOFF_IN_SEC;
+
+    base_delay = (1 << *exponential_retry_count) * INITIAL_EXPONENTIAL_BACKOFF_IN_SEC;
+
+    if (base_delay > MAX_EXPONENTIAL_BACKOFF_IN_SEC)
+    {
+        base_delay = MAX_EXPONENTIAL_BACKOFF_IN_SEC;
+    }
+    else
+    {
+        (*exponential_retry_count)++;
+    }
+
+    return (base_delay * (1 + jitter_percent)) * TX_TIMER_TICKS_PER_SECOND;
+}
+
+static VOID retry_timer_expired(ULONG parameter)
+{
+    CONNECTION_SUPERVISOR* supervisor = (CONNECTION_SUPERVISOR*)parameter;
+
+    tx_event_flags_set(&supervisor->events, SUPERVISOR_RETRY_EVENT, TX_OR);
+}
+
+static VOID attempt_failed(CONNECTION_SUPERVISOR* supervisor)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    TX_DISABLE
+    supervisor->metrics.failed_attempts++;
+    TX_RESTORE
+
+    connection_supervisor_state_set(supervisor, CONNECTION_STATE_DISCONNECTED);
+}
+
+static VOID supervisor_attempt(CONNECTION_SUPERVISOR* supervisor)
+{
+    TX_INTERRUPT_SAVE_AREA
+    UINT status;
+    ULONG delay;
+    ULONG elapsed;
+
+    LOG_INFO(LOG_MODULE_APP, "Reconnecting...");
+
+    if ((status = supervisor->attempt(supervisor->context)))
+    {
+        attempt_failed(supervisor);
+
+        // Wait out the backoff on the timer, the thread stays free to be stopped
+        delay = exponential_backoff_with_jitter(&supervisor->retry_count);
+        LOG_WARN(LOG_MODULE_APP,
+            "Failed to reconnect (0x%08x), retrying in %lu seconds",
+            status,
+            delay / TX_TIMER_TICKS_PER_SECOND);
+
+        tx_timer_deactivate(&supervisor->retry_timer);
+        tx_timer_change(&supervisor->retry_timer, delay, 0);
+        tx_timer_activate(&supervisor->retry_timer);
+        return;
+    }
+
+    elapsed = tx_time_get() - supervisor->disconnect_time;
+
+    supervisor->retry_count = 0;
+
+    TX_DISABLE
+    supervisor->metrics.reconnects++;
+    supervisor->metrics.last_reconnect_ticks = elapsed;
+    supervisor->metrics.total_reconnect_ticks += elapsed;
+    if (elapsed > supervisor->metrics.max_reconnect_ticks)
+    {
+        supervisor->metrics.max_reconnect_ticks = elapsed;
+    }
+    TX_RESTORE
+
+    connection_supervisor_state_set(supervisor, CONNECTION_STATE_READY);
+
+    LOG_INFO(LOG_MODULE_APP, "Reconnected in %lu ms", elapsed * 1000 / TX_TIMER_TICKS_PER_SECOND);
+}
+
+// A drop only counts against the connection it was reported on, not one made since
+static bool disconnect_current(CONNECTION_SUPERVISOR* supervisor)
+{
+    TX_INTERRUPT_SAVE_AREA
+    bool current;
+
+    TX_DISABLE
+    current = supervisor->disconnect_generation == supervisor->generation;
+    TX_RESTORE
+
+    return current;
+}
+
+static VOID supervisor_thread(ULONG parameter)
+{
+    CONNECTION_SUPERVISOR* supervisor = (CONNECTION_SUPERVISOR*)parameter;
+    ULONG events;
+
+    while (true)
+    {
+        tx_event_flags_get(&supervisor->events, SUPERVISOR_ALL_EVENTS, TX_OR_CLEAR, &events, TX_WAIT_FOREVER);
+
+        if (!supervisor->enabled)
+        {
+            continue;
+        }
+
+        if ((events & SUPERVISOR_DISCONNECT_EVENT) && !disconnect_current(supervisor))
+        {
+            events &= ~SUPERVISOR_DISCONNECT_EVENT;
+        }
+
+        // Drops reported while an attempt is in progress are covered by that attempt
+        if ((events & (SUPERVISOR_DISCONNECT_EVENT | SUPERVISOR_RECONNECT_EVENT)) &&
+            connection_supervisor_state_get(supervisor) == CONNECTION_STATE_READY)
+        {
+            if (events & SUPERVISOR_DISCONNECT_EVENT)
+            {
+                LOG_ERROR(LOG_MODULE_APP, "Connection lost");
+            }
+            else
+            {
+                LOG_INFO(LOG_MODULE_APP, "Reconnect requested");
+            }
+
+            supervisor->disconnect_time = tx_time_get();
+            supervisor->retry_count     = 0;
+            connection_supervisor_state_set(supervisor, CONNECTION_STATE_DISCONNECTED);
+
+            events |= SUPERVISOR_RETRY_EVENT;
+        }
+
+        if ((events & SUPERVISOR_RETRY_EVENT) && connection_supervisor_state_get(supervisor) != CONNECTION_STATE_READY)
+        {
+            supervisor_attempt(supervisor);
+
+            // Catch up on work that was skipped while disconnected
+            events |= SUPERVISOR_WORK_EVENT;
+        }
+
+        if ((events & SUPERVISOR_WORK_EVENT) && connection_supervisor_state_get(supervisor) == CONNECTION_STATE_READY &&
+            supervisor->work != NX_NULL)
+        {
+            supervisor->work(supervisor->context);
+        }
+    }
+}
+
+UINT connection_supervisor_create(CONNECTION_SUPERVISOR* supervisor,
+    CHAR* name,
+    UINT priority,
+    func_ptr_connection_attempt attempt,
+    VOID* context)
+{
+    UINT status;
+
+    if (supervisor == NX_NULL || attempt == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    memset(supervisor, 0, sizeof(CONNECTION_SUPERVISOR));
+
+    supervisor->state   = CONNECTION_STATE_DISCONNECTED;
+    supervisor->attempt = attempt;
+    supervisor->context = context;
+
+    if ((status = tx_event_flags_create(&supervisor->events, name)))
+    {
+        LOG_ERROR(LOG_MODULE_APP, "Failed to create supervisor event flags (0x%08x)", status);
+        return status;
+    }
+
+    if ((status = tx_timer_create(
+             &supervisor->retry_timer, name, retry_timer_expired, (ULONG)supervisor, 1, 0, TX_NO_ACTIVATE)))
+    {
+        LOG_ERROR(LOG_MODULE_APP, "Failed to create supervisor timer (0x%08x)", status);
+        tx_event_flags_delete(&supervisor->events);
+        return status;
+    }
+
+    if ((status = tx_thread_create(&supervisor->thread,
+             name,
+             supervisor_thread,
+             (ULONG)supervisor,
+             supervisor->stack,
+             CONNECTION_SUPERVISOR_STACK_SIZE,
+             priority,
+             priority,
+             TX_NO_TIME_SLICE,
+             TX_AUTO_START)))
+    {
+        LOG_ERROR(LOG_MODULE_APP, "Failed to create supervisor thread (0x%08x)", status);
+        tx_timer_delete(&supervisor->retry_timer);
+        tx_event_flags_delete(&supervisor->events);
+        return status;
+    }
+
+    return NX_SUCCESS;
+}
+
+UINT connection_supervisor_delete(CONNECTION_SUPERVISOR* supervisor)
+{
+    if (supervisor == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    connection_supervisor_stop(supervisor);
+
+    tx_thread_terminate(&supervisor->thread);
+    tx_thread_delete(&supervisor->thread);
+    tx_timer_delete(&supervisor->retry_timer);
+    tx_event_flags_delete(&supervisor->events);
+
+    return NX_SUCCESS;
+}
+
+UINT connection_supervisor_connect(CONNECTION_SUPERVISOR* supervisor)
+{
+    UINT status;
+
+    if (supervisor == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    supervisor->disconnect_time = tx_time_get();
+
+    if ((status = supervisor->attempt(supervisor->context)))
+    {
+        attempt_failed(supervisor);
+        return status;
+    }
+
+    supervisor->retry_count = 0;
+    supervisor->enabled     = true;
+    connection_supervisor_state_set(supervisor, CONNECTION_STATE_READY);
+
+    return NX_SUCCESS;
+}
+
+UINT connection_supervisor_stop(CONNECTION_SUPERVISOR* supervisor)
+{
+    if (supervisor == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    supervisor->enabled = false;
+    tx_timer_deactivate(&supervisor->retry_timer);
+
+    connection_supervisor_state_set(supervisor, CONNECTION_STATE_DISCONNECTED);
+
+    return NX_SUCCESS;
+}
+
+UINT connection_supervisor_disconnected(CONNECTION_SUPERVISOR* supervisor)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    if (supervisor == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    TX_DISABLE
+    supervisor->disconnect_generation = supervisor->generation;
+    TX_RESTORE
+
+    return tx_event_flags_set(&supervisor->events, SUPERVISOR_DISCONNECT_EVENT, TX_OR);
+}
+
+UINT connection_supervisor_reconnect(CONNECTION_SUPERVISOR* supervisor)
+{
+    if (supervisor == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    return tx_event_flags_set(&supervisor->events, SUPERVISOR_RECONNECT_EVENT, TX_OR);
+}
+
+UINT connection_supervisor_work_set(CONNECTION_SUPERVISOR* supervisor, func_ptr_connection_work work)
+{
+    if (supervisor == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    supervisor->work = work;
+
+    return NX_SUCCESS;
+}
+
+UINT connection_supervisor_work_notify(CONNECTION_SUPERVISOR* supervisor)
+{
+    if (supervisor == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    return tx_event_flags_set(&supervisor->events, SUPERVISOR_WORK_EVENT, TX_OR);
+}
+
+static VOID handshake_record(CONNECTION_SUPERVISOR* supervisor, ULONG elapsed)
+{
+    supervisor->metrics.handshakes++;
+    supervisor->metrics.last_handshake_ticks = elapsed;
+    supervisor->metrics.total_handshake_ticks += elapsed;
+    if (elapsed > supervisor->metrics.max_handshake_ticks)
+    {
+        supervisor->metrics.max_handshake_ticks = elapsed;
+    }
+}
+
+UINT connection_supervisor_state_set(CONNECTION_SUPERVISOR* supervisor, UINT state)
+{
+    TX_INTERRUPT_SAVE_AREA
+    ULONG now             = tx_time_get();
+    ULONG handshake_ticks = 0;
+    ULONG handshake_bytes = 0;
+    bool handshake        = false;
+
+    if (supervisor == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    TX_DISABLE
+
+    if (supervisor->state == state)
+    {
+        TX_RESTORE
+        return NX_SUCCESS;
+    }
+
+    if (state == CONNECTION_STATE_CONNECTING)
+    {
+        // Drops reported from here on belong to the new connection
+        supervisor->generation++;
+        supervisor->connecting_time = now;
+    }
+    else if (supervisor->state == CONNECTION_STATE_CONNECTING && state != CONNECTION_STATE_DISCONNECTED)
+    {
+        handshake_ticks = now - supervisor->connecting_time;
+        handshake_bytes = supervisor->metrics.last_handshake_bytes;
+        handshake       = true;
+        handshake_record(supervisor, handshake_ticks);
+    }
+
+    supervisor->state = state;
+
+    TX_RESTORE
+
+    // One line per connection, enough to compare TLS profiles on the device itself
+    if (handshake && handshake_bytes > 0)
+    {
+        LOG_INFO(LOG_MODULE_APP,
+            "Handshake took %lu ms, %lu bytes",
+            handshake_ticks * 1000 / TX_TIMER_TICKS_PER_SECOND,
+            handshake_bytes);
+    }
+    else if (handshake)
+    {
+        LOG_INFO(LOG_MODULE_APP, "Handshake took %lu ms", handshake_ticks * 1000 / TX_TIMER_TICKS_PER_SECOND);
+    }
+
+    if (supervisor->state_changed != NX_NULL)
+    {
+        supervisor->state_changed(supervisor->context, state);
+    }
+
+    return NX_SUCCESS;
+}
+
+UINT connection_supervisor_state_get(CONNECTION_SUPERVISOR* supervisor)
+{
+    TX_INTERRUPT_SAVE_AREA
+    UINT state;
+
+    TX_DISABLE
+    state = supervisor->state;
+    TX_RESTORE
+
+    return state;
+}
+
+UINT connection_supervisor_notify_set(CONNECTION_SUPERVISOR* supervisor, func_ptr_connection_state callback)
+{
+    if (supervisor == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    supervisor->state_changed = callback;
+
+    return NX_SUCCESS;
+}
+
+UINT connection_supervisor_handshake_bytes_set(CONNECTION_SUPERVISOR* supervisor, ULONG bytes)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    if (supervisor == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    TX_DISABLE
+    supervisor->metrics.last_handshake_bytes = bytes;
+    TX_RESTORE
+
+    return NX_SUCCESS;
+}
+
+UINT connection_supervisor_metrics_get(CONNECTION_SUPERVISOR* supervisor, CONNECTION_SUPERVISOR_METRICS* metrics)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    if (supervisor == NX_NULL || metrics == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    TX_DISABLE
+    *metrics = supervisor->metrics;
+    TX_RESTORE
+
+    return NX_SUCCESS;
+}
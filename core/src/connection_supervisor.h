@@ -0,0 +1,104 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _CONNECTION_SUPERVISOR_H
+#define _CONNECTION_SUPERVISOR_H
+
+#include <stdbool.h>
+
+#include "tx_api.h"
+
+#include "nx_api.h"
+
+#ifndef CONNECTION_SUPERVISOR_STACK_SIZE
+#define CONNECTION_SUPERVISOR_STACK_SIZE 4096
+#endif
+
+// Connection life cycle, a failure at any stage drops back to disconnected and waits out the backoff
+#define CONNECTION_STATE_DISCONNECTED 0
+#define CONNECTION_STATE_RESOLVING    1
+#define CONNECTION_STATE_CONNECTING   2 // TLS handshake and MQTT CONNECT
+#define CONNECTION_STATE_SUBSCRIBING  3
+#define CONNECTION_STATE_READY        4
+
+typedef VOID (*func_ptr_connection_state)(VOID* context, UINT state);
+
+// Makes one attempt at bringing the connection up, reporting progress with connection_supervisor_state_set
+typedef UINT (*func_ptr_connection_attempt)(VOID* context);
+
+// Deferred client work run on the supervisor thread while connected, e.g. flushing batched updates
+typedef VOID (*func_ptr_connection_work)(VOID* context);
+
+typedef struct CONNECTION_SUPERVISOR_METRICS_STRUCT
+{
+    ULONG reconnects;            // Connections restored after a drop
+    ULONG failed_attempts;       // Attempts that did not reach ready
+    ULONG last_reconnect_ticks;  // Time from losing the connection to ready again
+    ULONG max_reconnect_ticks;
+    ULONG total_reconnect_ticks;
+    ULONG handshakes;            // Attempts that got through the connecting stage
+    ULONG last_handshake_ticks;  // Time spent connecting, i.e. TLS handshake and MQTT CONNECT
+    ULONG max_handshake_ticks;
+    ULONG total_handshake_ticks;
+    ULONG last_handshake_bytes;  // Sent and received while connecting, if the client reports it
+} CONNECTION_SUPERVISOR_METRICS;
+
+typedef struct CONNECTION_SUPERVISOR_STRUCT
+{
+    TX_THREAD thread;
+    TX_EVENT_FLAGS_GROUP events;
+    TX_TIMER retry_timer;
+
+    UINT state;                  // Shared with the network callbacks, use connection_supervisor_state_get
+    ULONG generation;            // Bumped each time a new connection starts
+    ULONG disconnect_generation; // Connection the last reported drop belongs to
+    bool enabled;                // Only reconnect once the first connect has succeeded
+    UINT retry_count;            // Backoff exponent
+    ULONG disconnect_time;
+    ULONG connecting_time;
+
+    func_ptr_connection_attempt attempt;
+    func_ptr_connection_state state_changed;
+    func_ptr_connection_work work;
+    VOID* context;
+
+    CONNECTION_SUPERVISOR_METRICS metrics;
+
+    ULONG stack[CONNECTION_SUPERVISOR_STACK_SIZE / sizeof(ULONG)];
+} CONNECTION_SUPERVISOR;
+
+UINT exponential_backoff_with_jitter(UINT* exponential_retry_count);
+
+UINT connection_supervisor_create(CONNECTION_SUPERVISOR* supervisor,
+    CHAR* name,
+    UINT priority,
+    func_ptr_connection_attempt attempt,
+    VOID* context);
+UINT connection_supervisor_delete(CONNECTION_SUPERVISOR* supervisor);
+
+// Runs the first attempt in the calling thread, the supervisor takes over from then on
+UINT connection_supervisor_connect(CONNECTION_SUPERVISOR* supervisor);
+
+// Stops supervising, e.g. before an intentional disconnect
+UINT connection_supervisor_stop(CONNECTION_SUPERVISOR* supervisor);
+
+// Safe to call from the network callbacks, the reconnect happens on the supervisor thread
+UINT connection_supervisor_disconnected(CONNECTION_SUPERVISOR* supervisor);
+
+// Tear down a working connection and make a fresh attempt, e.g. to present new credentials
+UINT connection_supervisor_reconnect(CONNECTION_SUPERVISOR* supervisor);
+
+UINT connection_supervisor_state_set(CONNECTION_SUPERVISOR* supervisor, UINT state);
+UINT connection_supervisor_state_get(CONNECTION_SUPERVISOR* supervisor);
+UINT connection_supervisor_notify_set(CONNECTION_SUPERVISOR* supervisor, func_ptr_connection_state callback);
+
+// The work also runs after every reconnect, to pick up whatever could not be done while the link was down
+UINT connection_supervisor_work_set(CONNECTION_SUPERVISOR* supervisor, func_ptr_connection_work work);
+
+// Safe to call from timers and the network callbacks
+UINT connection_supervisor_work_notify(CONNECTION_SUPERVISOR* supervisor);
+// Called by the attempt once it knows what the handshake cost on the wire
+UINT connection_supervisor_handshake_bytes_set(CONNECTION_SUPERVISOR* supervisor, ULONG bytes);
+UINT connection_supervisor_metrics_get(CONNECTION_SUPERVISOR* supervisor, CONNECTION_SUPERVISOR_METRICS* metrics);
+
+#endif // _CONNECTION_SUPERVISOR_H
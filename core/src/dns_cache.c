@@ -0,0 +1,451 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "dns_cache.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "logging.h"
+
+#define DNS_CACHE_THREAD_STACK_SIZE 2048
+#define DNS_CACHE_THREAD_PRIORITY   10
+
+#define DNS_CACHE_REFRESH_EVENT 1
+
+#define DNS_CACHE_REFRESH_WAIT (5 * NX_IP_PERIODIC_RATE)
+
+// Backing store for the NetX record cache, which is where each answer's TTL comes from
+#ifndef DNS_CACHE_RECORD_AREA_SIZE
+#define DNS_CACHE_RECORD_AREA_SIZE 2048
+#endif
+
+typedef struct DNS_CACHE_ENTRY_STRUCT
+{
+    CHAR hostname[DNS_CACHE_HOSTNAME_SIZE];
+    NXD_ADDRESS address;
+    ULONG resolved_time;
+    ULONG ttl; // Ticks the answer stays fresh for
+    ULONG last_used;
+    bool valid;
+    bool refresh; // Queued for the refresh thread
+} DNS_CACHE_ENTRY;
+
+static ULONG dns_cache_thread_stack[DNS_CACHE_THREAD_STACK_SIZE / sizeof(ULONG)];
+static TX_THREAD dns_cache_thread;
+
+static TX_MUTEX dns_cache_mutex;
+static TX_EVENT_FLAGS_GROUP dns_cache_flags;
+
+#ifdef NX_DNS_CACHE_ENABLE
+static ULONG dns_cache_record_area[DNS_CACHE_RECORD_AREA_SIZE / sizeof(ULONG)];
+#endif
+
+static NX_DNS* dns_cache_dns;
+static bool dns_cache_started = false;
+
+static DNS_CACHE_ENTRY dns_cache_entries[DNS_CACHE_SIZE];
+static DNS_CACHE_METRICS dns_cache_metrics;
+
+// Must be called with the cache mutex held
+static DNS_CACHE_ENTRY* entry_find(CHAR* hostname)
+{
+    for (UINT i = 0; i < DNS_CACHE_SIZE; i++)
+    {
+        DNS_CACHE_ENTRY* entry = &dns_cache_entries[i];
+
+        if ((entry->valid || entry->refresh) && strcmp(entry->hostname, hostname) == 0)
+        {
+            return entry;
+        }
+    }
+
+    return NX_NULL;
+}
+
+// Must be called with the cache mutex held, evicts the least recently used entry when full
+static DNS_CACHE_ENTRY* entry_claim(CHAR* hostname)
+{
+    DNS_CACHE_ENTRY* entry = entry_find(hostname);
+    ULONG now              = tx_time_get();
+
+    if (entry != NX_NULL)
+    {
+        return entry;
+    }
+
+    for (UINT i = 0; i < DNS_CACHE_SIZE; i++)
+    {
+        DNS_CACHE_ENTRY* candidate = &dns_cache_entries[i];
+
+        if (!candidate->valid && !candidate->refresh)
+        {
+            entry = candidate;
+            break;
+        }
+
+        if (entry == NX_NULL || now - candidate->last_used > now - entry->last_used)
+        {
+            entry = candidate;
+        }
+    }
+
+    memset(entry, 0, sizeof(*entry));
+    strcpy(entry->hostname, hostname);
+    entry->last_used = now;
+
+    return entry;
+}
+
+// Must be called with the cache mutex held
+static VOID entry_store(CHAR* hostname, NXD_ADDRESS* address, ULONG ttl)
+{
+    DNS_CACHE_ENTRY* entry = entry_claim(hostname);
+
+    entry->address       = *address;
+    entry->resolved_time = tx_time_get();
+    entry->ttl           = ttl;
+    entry->valid         = true;
+}
+
+static bool entry_fresh(DNS_CACHE_ENTRY* entry, ULONG now)
+{
+    return entry->valid && now - entry->resolved_time < entry->ttl;
+}
+
+static bool entry_usable(DNS_CACHE_ENTRY* entry, ULONG now)
+{
+    return entry->valid && now - entry->resolved_time < entry->ttl + DNS_CACHE_STALE_LIMIT;
+}
+
+#ifdef NX_DNS_CACHE_ENABLE
+// Seconds left on the cached A record NetX answered with, 0 if there is none. Matching on the address
+// rather than the name also finds the record at the end of a CNAME chain.
+static ULONG record_ttl_get(NX_DNS* dns, ULONG address)
+{
+    UCHAR* cache = (UCHAR*)dns->nx_dns_cache;
+    ULONG now    = tx_time_get();
+    ULONG ttl    = 0;
+    ALIGN_TYPE* head;
+    NX_DNS_RR* record;
+    ULONG elapsed;
+
+    if (cache == NX_NULL)
+    {
+        return 0;
+    }
+
+    tx_mutex_get(&dns->nx_dns_mutex, TX_WAIT_FOREVER);
+
+    // The cache starts with a pointer past the last record, the names are kept at the far end
+    head = (ALIGN_TYPE*)*(ALIGN_TYPE*)cache;
+    for (record = (NX_DNS_RR*)(cache + sizeof(ALIGN_TYPE)); (ALIGN_TYPE*)record < head; record++)
+    {
+        if (record->nx_dns_rr_name == NX_NULL || record->nx_dns_rr_type != NX_DNS_RR_TYPE_A ||
+            record->nx_dns_rr_rdata.nx_dns_rr_rdata_a.nx_dns_rr_a_address != address)
+        {
+            continue;
+        }
+
+        // Several names can share an address, go with the record that runs out first
+        elapsed = (now - record->nx_dns_rr_last_used_time) / NX_IP_PERIODIC_RATE;
+        if (elapsed < record->nx_dns_rr_ttl && (ttl == 0 || record->nx_dns_rr_ttl - elapsed < ttl))
+        {
+            ttl = record->nx_dns_rr_ttl - elapsed;
+        }
+    }
+
+    tx_mutex_put(&dns->nx_dns_mutex);
+
+    return ttl;
+}
+#endif
+
+// nxd_dns_host_by_name_get that also reports how long the answer can be used for
+static UINT resolver_lookup(NX_DNS* dns, CHAR* hostname, NXD_ADDRESS* address, ULONG* ttl, ULONG wait_option)
+{
+    ULONG seconds = 0;
+    UINT status;
+
+    status = nxd_dns_host_by_name_get(dns, (UCHAR*)hostname, address, wait_option, NX_IP_VERSION_V4);
+    if (status != NX_SUCCESS)
+    {
+        return status;
+    }
+
+#ifdef NX_DNS_CACHE_ENABLE
+    seconds = record_ttl_get(dns, address->nxd_ip_address.v4);
+#endif
+
+    if (seconds == 0)
+    {
+        *ttl = DNS_CACHE_TTL_DEFAULT;
+    }
+    else if (seconds > DNS_CACHE_TTL_MAX / TX_TIMER_TICKS_PER_SECOND)
+    {
+        *ttl = DNS_CACHE_TTL_MAX;
+    }
+    else if (seconds * TX_TIMER_TICKS_PER_SECOND < DNS_CACHE_TTL_MIN)
+    {
+        *ttl = DNS_CACHE_TTL_MIN;
+    }
+    else
+    {
+        *ttl = seconds * TX_TIMER_TICKS_PER_SECOND;
+    }
+
+    return NX_SUCCESS;
+}
+
+// Pops the next queued hostname, skipping any that a caller has resolved in the meantime
+static bool refresh_next(CHAR* hostname)
+{
+    bool found = false;
+    ULONG now  = tx_time_get();
+
+    tx_mutex_get(&dns_cache_mutex, TX_WAIT_FOREVER);
+
+    for (UINT i = 0; i < DNS_CACHE_SIZE && !found; i++)
+    {
+        DNS_CACHE_ENTRY* entry = &dns_cache_entries[i];
+
+        if (entry->refresh)
+        {
+            entry->refresh = false;
+
+            if (!entry_fresh(entry, now))
+            {
+                strcpy(hostname, entry->hostname);
+                found = true;
+            }
+        }
+    }
+
+    tx_mutex_put(&dns_cache_mutex);
+
+    return found;
+}
+
+static VOID dns_cache_thread_entry(ULONG parameter)
+{
+    CHAR hostname[DNS_CACHE_HOSTNAME_SIZE];
+    NXD_ADDRESS address;
+    ULONG events;
+    ULONG ttl;
+    UINT status;
+
+    while (true)
+    {
+        tx_event_flags_get(&dns_cache_flags, DNS_CACHE_REFRESH_EVENT, TX_OR_CLEAR, &events, TX_WAIT_FOREVER);
+
+        while (refresh_next(hostname))
+        {
+            // The lookup runs without the mutex so callers can keep using the stale answer
+            status = resolver_lookup(dns_cache_dns, hostname, &address, &ttl, DNS_CACHE_REFRESH_WAIT);
+
+            tx_mutex_get(&dns_cache_mutex, TX_WAIT_FOREVER);
+
+            dns_cache_metrics.refreshes++;
+
+            if (status == NX_SUCCESS)
+            {
+                entry_store(hostname, &address, ttl);
+            }
+            else
+            {
+                dns_cache_metrics.failures++;
+            }
+
+            tx_mutex_put(&dns_cache_mutex);
+
+            if (status != NX_SUCCESS)
+            {
+                LOG_WARN(LOG_MODULE_APP, "Unable to refresh DNS for %s (0x%04x)", hostname, status);
+            }
+        }
+    }
+}
+
+UINT dns_cache_start(NX_DNS* dns)
+{
+    UINT status;
+
+    if (dns == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    dns_cache_dns = dns;
+
+#ifdef NX_DNS_CACHE_ENABLE
+    // Keeps each record with its TTL, which decides how long the answers here stay fresh
+    status = nx_dns_cache_initialize(dns, dns_cache_record_area, sizeof(dns_cache_record_area));
+    if (status != NX_SUCCESS)
+    {
+        LOG_WARN(LOG_MODULE_APP, "Unable to initialize the DNS record cache (0x%04x)", status);
+    }
+#endif
+
+    status = tx_mutex_create(&dns_cache_mutex, "DNS cache mutex", TX_NO_INHERIT);
+    if (status != TX_SUCCESS)
+    {
+        LOG_ERROR(LOG_MODULE_APP, "Unable to create DNS cache mutex (0x%04x)", status);
+        return status;
+    }
+
+    status = tx_event_flags_create(&dns_cache_flags, "DNS cache event flags");
+    if (status != TX_SUCCESS)
+    {
+        LOG_ERROR(LOG_MODULE_APP, "Unable to create DNS cache event flags (0x%04x)", status);
+        tx_mutex_delete(&dns_cache_mutex);
+        return status;
+    }
+
+    status = tx_thread_create(&dns_cache_thread,
+        "DNS cache thread",
+        dns_cache_thread_entry,
+        (ULONG)NULL,
+        &dns_cache_thread_stack,
+        DNS_CACHE_THREAD_STACK_SIZE,
+        DNS_CACHE_THREAD_PRIORITY,
+        DNS_CACHE_THREAD_PRIORITY,
+        TX_NO_TIME_SLICE,
+        TX_AUTO_START);
+    if (status != TX_SUCCESS)
+    {
+        LOG_ERROR(LOG_MODULE_APP, "Unable to create DNS cache thread (0x%04x)", status);
+        tx_event_flags_delete(&dns_cache_flags);
+        tx_mutex_delete(&dns_cache_mutex);
+        return status;
+    }
+
+    dns_cache_started = true;
+
+    return NX_SUCCESS;
+}
+
+UINT dns_cache_resolve(NX_DNS* dns, CHAR* hostname, NXD_ADDRESS* address, ULONG wait_option)
+{
+    DNS_CACHE_ENTRY* entry;
+    ULONG now    = tx_time_get();
+    bool refresh = false;
+    ULONG ttl;
+    UINT status;
+
+    if (!dns_cache_started || strlen(hostname) >= DNS_CACHE_HOSTNAME_SIZE)
+    {
+        return nxd_dns_host_by_name_get(dns, (UCHAR*)hostname, address, wait_option, NX_IP_VERSION_V4);
+    }
+
+    tx_mutex_get(&dns_cache_mutex, TX_WAIT_FOREVER);
+
+    entry = entry_find(hostname);
+    if (entry != NX_NULL && entry_usable(entry, now))
+    {
+        *address         = entry->address;
+        entry->last_used = now;
+
+        if (entry_fresh(entry, now))
+        {
+            dns_cache_metrics.hits++;
+        }
+        else
+        {
+            dns_cache_metrics.stale_hits++;
+            entry->refresh = true;
+            refresh        = true;
+        }
+
+        tx_mutex_put(&dns_cache_mutex);
+
+        if (refresh)
+        {
+            tx_event_flags_set(&dns_cache_flags, DNS_CACHE_REFRESH_EVENT, TX_OR);
+        }
+
+        return NX_SUCCESS;
+    }
+
+    dns_cache_metrics.misses++;
+
+    tx_mutex_put(&dns_cache_mutex);
+
+    status = resolver_lookup(dns, hostname, address, &ttl, wait_option);
+
+    tx_mutex_get(&dns_cache_mutex, TX_WAIT_FOREVER);
+
+    if (status == NX_SUCCESS)
+    {
+        entry_store(hostname, address, ttl);
+    }
+    else
+    {
+        dns_cache_metrics.failures++;
+    }
+
+    tx_mutex_put(&dns_cache_mutex);
+
+    return status;
+}
+
+UINT dns_cache_prefetch(CHAR* hostname)
+{
+    DNS_CACHE_ENTRY* entry;
+
+    if (!dns_cache_started)
+    {
+        return NX_NOT_ENABLED;
+    }
+
+    if (strlen(hostname) >= DNS_CACHE_HOSTNAME_SIZE)
+    {
+        return NX_SIZE_ERROR;
+    }
+
+    tx_mutex_get(&dns_cache_mutex, TX_WAIT_FOREVER);
+
+    entry = entry_claim(hostname);
+    if (!entry_fresh(entry, tx_time_get()))
+    {
+        entry->refresh = true;
+    }
+
+    tx_mutex_put(&dns_cache_mutex);
+
+    tx_event_flags_set(&dns_cache_flags, DNS_CACHE_REFRESH_EVENT, TX_OR);
+
+    return NX_SUCCESS;
+}
+
+VOID dns_cache_invalidate(CHAR* hostname)
+{
+    DNS_CACHE_ENTRY* entry;
+
+    if (!dns_cache_started)
+    {
+        return;
+    }
+
+    tx_mutex_get(&dns_cache_mutex, TX_WAIT_FOREVER);
+
+    if ((entry = entry_find(hostname)) != NX_NULL)
+    {
+        entry->valid   = false;
+        entry->refresh = false;
+    }
+
+    tx_mutex_put(&dns_cache_mutex);
+}
+
+VOID dns_cache_metrics_get(DNS_CACHE_METRICS* metrics)
+{
+    if (!dns_cache_started)
+    {
+        memset(metrics, 0, sizeof(*metrics));
+        return;
+    }
+
+    tx_mutex_get(&dns_cache_mutex, TX_WAIT_FOREVER);
+    *metrics = dns_cache_metrics;
+    tx_mutex_put(&dns_cache_mutex);
+}
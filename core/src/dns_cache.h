@@ -0,0 +1,62 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _DNS_CACHE_H
+#define _DNS_CACHE_H
+
+#include "tx_api.h"
+
+#include "nx_api.h"
+#include "nxd_dns.h"
+
+// Hostnames remembered at once, enough for the hub, DPS, the NTP pool rotation and a blob host
+#ifndef DNS_CACHE_SIZE
+#define DNS_CACHE_SIZE 8
+#endif
+
+// An answer is used for its record's TTL, kept within these bounds so a zero TTL does not turn every
+// resolve into a lookup and a long one does not pin an address for days
+#ifndef DNS_CACHE_TTL_MIN
+#define DNS_CACHE_TTL_MIN (10 * TX_TIMER_TICKS_PER_SECOND)
+#endif
+
+#ifndef DNS_CACHE_TTL_MAX
+#define DNS_CACHE_TTL_MAX (60 * 60 * TX_TIMER_TICKS_PER_SECOND)
+#endif
+
+// Used when the record TTL is not known, i.e. NetX is built without NX_DNS_CACHE_ENABLE
+#ifndef DNS_CACHE_TTL_DEFAULT
+#define DNS_CACHE_TTL_DEFAULT (60 * TX_TIMER_TICKS_PER_SECOND)
+#endif
+
+// Past its TTL an answer is still handed out while a refresh runs in the background, for this long at most
+#ifndef DNS_CACHE_STALE_LIMIT
+#define DNS_CACHE_STALE_LIMIT (5 * 60 * TX_TIMER_TICKS_PER_SECOND)
+#endif
+
+#define DNS_CACHE_HOSTNAME_SIZE 128
+
+typedef struct DNS_CACHE_METRICS_STRUCT
+{
+    ULONG hits;
+    ULONG stale_hits; // Served past the TTL while a refresh was queued
+    ULONG misses;     // The caller waited on a DNS round trip
+    ULONG refreshes;  // Background lookups, including prefetches
+    ULONG failures;
+} DNS_CACHE_METRICS;
+
+// Starts the refresh thread, until then dns_cache_resolve goes straight to the DNS client
+UINT dns_cache_start(NX_DNS* dns);
+
+// Drop-in for nxd_dns_host_by_name_get with IPv4, wait_option only applies on a miss
+UINT dns_cache_resolve(NX_DNS* dns, CHAR* hostname, NXD_ADDRESS* address, ULONG wait_option);
+
+// Resolves a hostname in the background so the first connect does not have to wait for it
+UINT dns_cache_prefetch(CHAR* hostname);
+
+// Forgets an answer that did not work, e.g. the server behind it refused the connection
+VOID dns_cache_invalidate(CHAR* hostname);
+
+VOID dns_cache_metrics_get(DNS_CACHE_METRICS* metrics);
+
+#endif // _DNS_CACHE_H
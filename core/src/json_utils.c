@@ -7,6 +7,8 @@
 
 #include "json_utils.h"
 
+#include "number_format.h"
+
 bool findJsonInt(const char* json, jsmntok_t* tokens, int tokens_count, const char* s, int* value)
 {
     for (int i = 0; i < tokens_count - 1; i++)
@@ -48,3 +50,105 @@ bool findJsonString(const char* json, jsmntok_t* tokens, int tokens_count, const
 
     return false;
 }
+
+bool findJsonStringN(
+    const char* json, jsmntok_t* tokens, int tokens_count, const char* s, char* value, int value_size)
+{
+    int key_len;
+    int value_len;
+    for (int i = 0; i < tokens_count - 1; i++)
+    {
+        if (tokens[i].type == JSMN_STRING && tokens[i + 1].type == JSMN_STRING)
+        {
+            key_len = tokens[i].end - tokens[i].start;
+            if (((int)strlen(s) == key_len) && (strncmp(json + tokens[i].start, s, key_len) == 0))
+            {
+                value_len = tokens[i + 1].end - tokens[i + 1].start;
+                if (value_len >= value_size)
+                {
+                    return false;
+                }
+
+                memcpy(value, json + tokens[i + 1].start, value_len);
+                value[value_len] = 0;
+
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void json_builder_init(JSON_BUILDER* builder, char* buffer, size_t size)
+{
+    builder->buffer   = buffer;
+    builder->size     = size;
+    builder->length   = 0;
+    builder->overflow = size == 0;
+
+    if (size > 0)
+    {
+        buffer[0] = 0;
+    }
+}
+
+void json_builder_append(JSON_BUILDER* builder, const char* text)
+{
+    size_t length = strlen(text);
+
+    if (builder->overflow || builder->length + length + 1 > builder->size)
+    {
+        builder->overflow = true;
+        return;
+    }
+
+    memcpy(builder->buffer + builder->length, text, length + 1);
+    builder->length += length;
+}
+
+// The number writers null terminate in place and return 0 when they run out of room
+static void json_builder_advance(JSON_BUILDER* builder, size_t written)
+{
+    if (written == 0)
+    {
+        builder->overflow = true;
+        builder->buffer[builder->length] = 0;
+        return;
+    }
+
+    builder->length += written;
+}
+
+void json_builder_append_int(JSON_BUILDER* builder, int64_t value)
+{
+    if (!builder->overflow)
+    {
+        json_builder_advance(builder,
+            number_format_int64(value, builder->buffer + builder->length, builder->size - builder->length));
+    }
+}
+
+void json_builder_append_double(JSON_BUILDER* builder, double value, int decimals)
+{
+    if (!builder->overflow)
+    {
+        json_builder_advance(builder,
+            number_format_double(
+                value, decimals, builder->buffer + builder->length, builder->size - builder->length));
+    }
+}
+
+void json_builder_append_float(JSON_BUILDER* builder, float value, int decimals)
+{
+    if (!builder->overflow)
+    {
+        json_builder_advance(builder,
+            number_format_float(value, decimals, builder->buffer + builder->length, builder->size - builder->length));
+    }
+}
+
+size_t json_builder_finish(JSON_BUILDER* builder)
+{
+    return builder->overflow ? 0 : builder->length;
+}
@@ -5,10 +5,38 @@
 #define _JSON_UTILS_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #include "jsmn.h"
 
+// Bounded writer for small JSON documents, appends are dropped once anything has not fit
+typedef struct JSON_BUILDER_STRUCT
+{
+    char* buffer;
+    size_t size;
+    size_t length;
+    bool overflow;
+} JSON_BUILDER;
+
 bool findJsonInt(const char* json, jsmntok_t* tokens, int tokens_count, const char* s, int* value);
 bool findJsonString(const char* json, jsmntok_t* tokens, int tokens_count, const char* s, char* value);
 
+// Fails rather than truncates if the value does not fit, including the terminator
+bool findJsonStringN(
+    const char* json, jsmntok_t* tokens, int tokens_count, const char* s, char* value, int value_size);
+
+void json_builder_init(JSON_BUILDER* builder, char* buffer, size_t size);
+
+// Appends verbatim, the caller supplies any quotes and separators
+void json_builder_append(JSON_BUILDER* builder, const char* text);
+void json_builder_append_int(JSON_BUILDER* builder, int64_t value);
+
+// decimals as for number_format_double, e.g. NUMBER_FORMAT_SHORTEST
+void json_builder_append_double(JSON_BUILDER* builder, double value, int decimals);
+void json_builder_append_float(JSON_BUILDER* builder, float value, int decimals);
+
+// Length of the null terminated document, or 0 if it did not fit
+size_t json_builder_finish(JSON_BUILDER* builder);
+
 #endif
\ No newline at end of file
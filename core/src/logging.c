@@ -0,0 +1,657 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "logging.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "json_utils.h"
+
+#define LOG_THREAD_STACK_SIZE 2048
+
+#define LOG_WRITE_EVENT 1
+
+#define LOG_LINE_SIZE 160
+#define LOG_SPEC_SIZE 24
+
+#define LOG_ARG_INT     1 // Also long, and char and short, which are promoted
+#define LOG_ARG_LLONG   2
+#define LOG_ARG_SIZE    3
+#define LOG_ARG_DOUBLE  4
+#define LOG_ARG_STRING  5
+#define LOG_ARG_POINTER 6
+
+#define LOG_LENGTH_INT   0 // Also char and short, which are promoted
+#define LOG_LENGTH_LONG  1
+#define LOG_LENGTH_LLONG 2
+#define LOG_LENGTH_SIZE  3
+
+typedef struct LOG_ARG_STRUCT
+{
+    UCHAR type;
+    union
+    {
+        long integer;
+        long long long_integer; // Only for ll and j, newlib-nano cannot print these
+        size_t size;
+        double number;
+        USHORT string; // Offset into the record strings
+        VOID* pointer;
+    } value;
+} LOG_ARG;
+
+typedef struct LOG_RECORD_STRUCT
+{
+    const CHAR* format; // Identifies the message, the text is only read by the drain
+    UCHAR module;
+    UCHAR level;
+    UCHAR argc;
+    volatile UCHAR ready; // Claimed slots are filled outside the critical section
+    LOG_ARG args[LOG_ARGS_MAX];
+    CHAR strings[LOG_STRING_SIZE];
+} LOG_RECORD;
+
+// One printf conversion, from the '%' up to and including the conversion character
+typedef struct LOG_SPEC_STRUCT
+{
+    const CHAR* start;
+    const CHAR* end;
+    UCHAR stars;          // Width and precision taken from the arguments
+    bool star_precision;  // The last star is the precision
+    INT precision;        // -1 if none was given
+    UCHAR length;
+    CHAR conversion;      // 0 if the format ended early
+} LOG_SPEC;
+
+static ULONG logging_thread_stack[LOG_THREAD_STACK_SIZE / sizeof(ULONG)];
+static TX_THREAD logging_thread;
+static TX_EVENT_FLAGS_GROUP logging_flags;
+
+static LOG_RECORD logging_records[LOG_QUEUE_DEPTH];
+static ULONG logging_head; // Next slot to claim, only moved with interrupts disabled
+static ULONG logging_tail; // Next slot to drain, only moved by the drain thread
+
+static bool logging_started = false;
+static LOG_METRICS logging_metrics;
+
+// The drain thread owns this, it is too large for the stack of every caller
+static CHAR logging_line[LOG_LINE_SIZE];
+
+volatile UCHAR logging_levels[LOG_MODULE_COUNT] = {LOG_LEVEL_DEFAULT, LOG_LEVEL_DEFAULT, LOG_LEVEL_DEFAULT};
+
+static const CHAR* const logging_module_names[LOG_MODULE_COUNT] = {"app", "nx", "mqtt"};
+static const CHAR* const logging_level_names[]                  = {"none", "error", "warn", "info", "debug"};
+static const CHAR* const logging_level_prefixes[]               = {"", "ERROR: ", "WARN: ", "", ""};
+
+static const CHAR* spec_parse(const CHAR* p, LOG_SPEC* spec)
+{
+    memset(spec, 0, sizeof(*spec));
+    spec->start     = p++;
+    spec->precision = -1;
+
+    if (*p == '%')
+    {
+        spec->conversion = '%';
+        spec->end        = p + 1;
+        return spec->end;
+    }
+
+    while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0')
+    {
+        p++;
+    }
+
+    if (*p == '*')
+    {
+        spec->stars++;
+        p++;
+    }
+    while (*p >= '0' && *p <= '9')
+    {
+        p++;
+    }
+
+    if (*p == '.')
+    {
+        p++;
+        spec->precision = 0;
+
+        if (*p == '*')
+        {
+            spec->stars++;
+            spec->star_precision = true;
+            p++;
+        }
+        while (*p >= '0' && *p <= '9')
+        {
+            spec->precision = spec->precision * 10 + (*p++ - '0');
+        }
+    }
+
+    while (*p == 'h' || *p == 'l' || *p == 'j' || *p == 'z' || *p == 't' || *p == 'L')
+    {
+        if (*p == 'l')
+        {
+            spec->length = spec->length == LOG_LENGTH_LONG ? LOG_LENGTH_LLONG : LOG_LENGTH_LONG;
+        }
+        else if (*p == 'j')
+        {
+            spec->length = LOG_LENGTH_LLONG;
+        }
+        else if (*p == 'z' || *p == 't')
+        {
+            spec->length = LOG_LENGTH_SIZE;
+        }
+        p++;
+    }
+
+    spec->conversion = *p;
+    spec->end        = *p ? p + 1 : p;
+
+    return spec->end;
+}
+
+// strchr also finds the terminator, which is what a format ending in '%' leaves as the conversion
+static bool conversion_is_integer(CHAR conversion)
+{
+    return conversion != 0 && strchr("diuxXoc", conversion) != NX_NULL;
+}
+
+static bool conversion_is_double(CHAR conversion)
+{
+    return conversion != 0 && strchr("fFeEgGaA", conversion) != NX_NULL;
+}
+
+static UINT conversion_args(const LOG_SPEC* spec)
+{
+    if (conversion_is_integer(spec->conversion) || conversion_is_double(spec->conversion) ||
+        spec->conversion == 's' || spec->conversion == 'p')
+    {
+        return spec->stars + 1;
+    }
+
+    return 0;
+}
+
+// Copies what the format refers to into the record, so the caller's buffers can go away
+static VOID record_capture(LOG_RECORD* record, va_list args)
+{
+    const CHAR* p = record->format;
+    const CHAR* string;
+    LOG_SPEC spec;
+    LOG_ARG* arg;
+    UINT used = 0;
+    UINT length;
+    INT precision;
+    INT star;
+
+    record->argc = 0;
+
+    while (*p)
+    {
+        if (*p != '%')
+        {
+            p++;
+            continue;
+        }
+
+        p = spec_parse(p, &spec);
+        if (conversion_args(&spec) == 0)
+        {
+            continue;
+        }
+
+        if (record->argc + conversion_args(&spec) > LOG_ARGS_MAX)
+        {
+            // The drain stops at the first conversion without its arguments
+            logging_metrics.truncated++;
+            return;
+        }
+
+        precision = spec.precision;
+        for (UINT i = 0; i < spec.stars; i++)
+        {
+            star = va_arg(args, INT);
+            if (spec.star_precision && i == spec.stars - 1U)
+            {
+                precision = star;
+            }
+
+            arg                = &record->args[record->argc++];
+            arg->type          = LOG_ARG_INT;
+            arg->value.integer = star;
+        }
+
+        arg = &record->args[record->argc++];
+
+        // Integers are kept at the width the format gives them, so they print back the same way
+        if (conversion_is_integer(spec.conversion))
+        {
+            switch (spec.length)
+            {
+                case LOG_LENGTH_LONG:
+                    arg->type          = LOG_ARG_INT;
+                    arg->value.integer = va_arg(args, long);
+                    break;
+
+                case LOG_LENGTH_LLONG:
+                    arg->type               = LOG_ARG_LLONG;
+                    arg->value.long_integer = va_arg(args, long long);
+                    break;
+
+                case LOG_LENGTH_SIZE:
+                    arg->type       = LOG_ARG_SIZE;
+                    arg->value.size = va_arg(args, size_t);
+                    break;
+
+                default:
+                    arg->type          = LOG_ARG_INT;
+                    arg->value.integer = va_arg(args, INT);
+                    break;
+            }
+        }
+        else if (conversion_is_double(spec.conversion))
+        {
+            arg->type         = LOG_ARG_DOUBLE;
+            arg->value.number = va_arg(args, double);
+        }
+        else if (spec.conversion == 'p')
+        {
+            arg->type          = LOG_ARG_POINTER;
+            arg->value.pointer = va_arg(args, VOID*);
+        }
+        else
+        {
+            string = va_arg(args, const CHAR*);
+            if (string == NX_NULL)
+            {
+                string = "(null)";
+            }
+
+            if (precision >= 0)
+            {
+                const CHAR* nul = memchr(string, 0, precision);
+                length          = nul ? (UINT)(nul - string) : (UINT)precision;
+            }
+            else
+            {
+                length = strlen(string);
+            }
+
+            arg->type = LOG_ARG_STRING;
+
+            if (used >= LOG_STRING_SIZE)
+            {
+                // Full, point at the last terminator
+                arg->value.string = LOG_STRING_SIZE - 1;
+                logging_metrics.truncated++;
+                continue;
+            }
+
+            if (length > LOG_STRING_SIZE - used - 1)
+            {
+                length = LOG_STRING_SIZE - used - 1;
+                logging_metrics.truncated++;
+            }
+
+            memcpy(&record->strings[used], string, length);
+            record->strings[used + length] = 0;
+            arg->value.string              = used;
+            used += length + 1;
+        }
+    }
+}
+
+// Rebuilds one conversion with its stars resolved. The length modifier stays as the caller wrote it,
+// the value was stored at that width. Only L goes, doubles are captured as double.
+static bool spec_rebuild(const LOG_SPEC* spec, const LOG_ARG* stars, CHAR* buffer, UINT size)
+{
+    UINT length = 0;
+    INT written;
+
+    for (const CHAR* p = spec->start; p < spec->end; p++)
+    {
+        if (*p == '*')
+        {
+            written = snprintf(&buffer[length], size - length, "%d", (INT)(stars++)->value.integer);
+        }
+        else if (*p == 'L')
+        {
+            continue;
+        }
+        else
+        {
+            written = snprintf(&buffer[length], size - length, "%c", *p);
+        }
+
+        if (written < 0 || (UINT)written >= size - length)
+        {
+            return false;
+        }
+        length += written;
+    }
+
+    return true;
+}
+
+static INT integer_print(const LOG_SPEC* spec, const LOG_ARG* arg, const CHAR* conversion, CHAR* line, UINT size)
+{
+    switch (arg->type)
+    {
+        case LOG_ARG_LLONG:
+            return snprintf(line, size, conversion, arg->value.long_integer);
+
+        case LOG_ARG_SIZE:
+            return snprintf(line, size, conversion, arg->value.size);
+
+        default:
+            return spec->length == LOG_LENGTH_LONG ? snprintf(line, size, conversion, arg->value.integer)
+                                                   : snprintf(line, size, conversion, (INT)arg->value.integer);
+    }
+}
+
+static VOID record_print(const LOG_RECORD* record, CHAR* line, UINT size)
+{
+    const CHAR* p = record->format;
+    const LOG_ARG* arg;
+    CHAR conversion[LOG_SPEC_SIZE];
+    LOG_SPEC spec;
+    UINT length = 0;
+    UINT next   = 0;
+    INT written;
+
+    while (*p && length < size - 1)
+    {
+        if (*p != '%')
+        {
+            line[length++] = *p++;
+            continue;
+        }
+
+        p = spec_parse(p, &spec);
+
+        if (spec.conversion == '%')
+        {
+            line[length++] = '%';
+            continue;
+        }
+
+        if (conversion_args(&spec) == 0)
+        {
+            // Not something that was captured, show it as written
+            written = snprintf(&line[length], size - length, "%.*s", (INT)(spec.end - spec.start), spec.start);
+        }
+        else if (next + conversion_args(&spec) > record->argc)
+        {
+            written = snprintf(&line[length], size - length, "...");
+            p       = "";
+        }
+        else if (!spec_rebuild(&spec, &record->args[next], conversion, sizeof(conversion)))
+        {
+            written = snprintf(&line[length], size - length, "%.*s", (INT)(spec.end - spec.start), spec.start);
+            next += conversion_args(&spec);
+        }
+        else
+        {
+            next += spec.stars;
+            arg = &record->args[next++];
+
+            switch (arg->type)
+            {
+                case LOG_ARG_INT:
+                case LOG_ARG_LLONG:
+                case LOG_ARG_SIZE:
+                    written = integer_print(&spec, arg, conversion, &line[length], size - length);
+                    break;
+
+                case LOG_ARG_DOUBLE:
+                    written = snprintf(&line[length], size - length, conversion, arg->value.number);
+                    break;
+
+                case LOG_ARG_STRING:
+                    written = snprintf(&line[length], size - length, conversion, &record->strings[arg->value.string]);
+                    break;
+
+                default:
+                    written = snprintf(&line[length], size - length, conversion, arg->value.pointer);
+                    break;
+            }
+        }
+
+        if (written > 0)
+        {
+            length += (UINT)written < size - length ? (UINT)written : size - length - 1;
+        }
+    }
+
+    line[length] = 0;
+
+    printf("%s%s\r\n", logging_level_prefixes[record->level], line);
+}
+
+static VOID logging_thread_entry(ULONG parameter)
+{
+    LOG_RECORD* record;
+    ULONG events;
+
+    while (true)
+    {
+        tx_event_flags_get(&logging_flags, LOG_WRITE_EVENT, TX_OR_CLEAR, &events, TX_WAIT_FOREVER);
+
+        while (logging_tail != logging_head)
+        {
+            record = &logging_records[logging_tail % LOG_QUEUE_DEPTH];
+
+            // The writer that claimed it was preempted before it finished
+            while (!record->ready)
+            {
+                tx_thread_sleep(1);
+            }
+
+            record_print(record, logging_line, sizeof(logging_line));
+
+            record->ready = 0;
+            logging_tail++;
+        }
+    }
+}
+
+UINT logging_start(VOID)
+{
+    UINT status;
+
+    if (logging_started)
+    {
+        return NX_SUCCESS;
+    }
+
+    status = tx_event_flags_create(&logging_flags, "Logging event flags");
+    if (status != TX_SUCCESS)
+    {
+        LOG_ERROR(LOG_MODULE_APP, "Unable to create logging event flags (0x%04x)", status);
+        return status;
+    }
+
+    status = tx_thread_create(&logging_thread,
+        "Logging thread",
+        logging_thread_entry,
+        (ULONG)NULL,
+        &logging_thread_stack,
+        LOG_THREAD_STACK_SIZE,
+        LOG_THREAD_PRIORITY,
+        LOG_THREAD_PRIORITY,
+        TX_NO_TIME_SLICE,
+        TX_AUTO_START);
+    if (status != TX_SUCCESS)
+    {
+        LOG_ERROR(LOG_MODULE_APP, "Unable to create logging thread (0x%04x)", status);
+        tx_event_flags_delete(&logging_flags);
+        return status;
+    }
+
+    logging_started = true;
+
+    return NX_SUCCESS;
+}
+
+VOID logging_write(UINT module, UINT level, const CHAR* format, ...)
+{
+    TX_INTERRUPT_SAVE_AREA
+    LOG_RECORD* record;
+    ULONG queued;
+    ULONG slot;
+    va_list args;
+
+    if (!logging_started)
+    {
+        // Nothing drains the queue yet, print in place
+        LOG_RECORD local;
+        CHAR line[LOG_LINE_SIZE];
+
+        local.format = format;
+        local.module = module;
+        local.level  = level;
+
+        va_start(args, format);
+        record_capture(&local, args);
+        va_end(args);
+
+        record_print(&local, line, sizeof(line));
+        return;
+    }
+
+    TX_DISABLE
+    queued = logging_head - logging_tail;
+    if (queued >= LOG_QUEUE_DEPTH)
+    {
+        logging_metrics.dropped++;
+        TX_RESTORE
+        return;
+    }
+
+    slot = logging_head++;
+
+    logging_metrics.written++;
+    if (queued + 1 > logging_metrics.high_water)
+    {
+        logging_metrics.high_water = queued + 1;
+    }
+    TX_RESTORE
+
+    record         = &logging_records[slot % LOG_QUEUE_DEPTH];
+    record->format = format;
+    record->module = module;
+    record->level  = level;
+
+    va_start(args, format);
+    record_capture(record, args);
+    va_end(args);
+
+    record->ready = 1;
+
+    // The drain only sleeps once the queue is empty, so only the first record of a burst has to wake it
+    if (queued == 0)
+    {
+        tx_event_flags_set(&logging_flags, LOG_WRITE_EVENT, TX_OR);
+    }
+}
+
+UINT logging_level_set(UINT module, UINT level)
+{
+    if (module >= LOG_MODULE_COUNT || level > LOG_LEVEL_DEBUG)
+    {
+        return NX_INVALID_PARAMETERS;
+    }
+
+    if (level > LOG_LEVEL_COMPILE)
+    {
+        LOG_WARN(LOG_MODULE_APP,
+            "Log level %s is compiled out, raise LOG_LEVEL_COMPILE to see it",
+            logging_level_names[level]);
+    }
+
+    logging_levels[module] = level;
+
+    return NX_SUCCESS;
+}
+
+UINT logging_method_invoke(const CHAR* payload, UINT length)
+{
+    jsmn_parser parser;
+    jsmntok_t tokens[8];
+    INT token_count;
+    CHAR module_name[8];
+    CHAR level_name[8];
+    INT level = -1;
+    INT module;
+
+    jsmn_init(&parser);
+    token_count = jsmn_parse(&parser, payload, length, tokens, 8);
+    if (token_count < 1 || tokens[0].type != JSMN_OBJECT ||
+        !findJsonStringN(payload, tokens, token_count, "module", module_name, sizeof(module_name)))
+    {
+        return 400;
+    }
+
+    if (findJsonStringN(payload, tokens, token_count, "level", level_name, sizeof(level_name)))
+    {
+        for (INT i = LOG_LEVEL_NONE; i <= LOG_LEVEL_DEBUG; i++)
+        {
+            if (strcmp(level_name, logging_level_names[i]) == 0)
+            {
+                level = i;
+            }
+        }
+    }
+    else if (!findJsonInt(payload, tokens, token_count, "level", &level))
+    {
+        return 400;
+    }
+
+    if (level < LOG_LEVEL_NONE || level > LOG_LEVEL_DEBUG)
+    {
+        return 400;
+    }
+
+    if (strcmp(module_name, "all") == 0)
+    {
+        for (module = 0; module < LOG_MODULE_COUNT; module++)
+        {
+            logging_level_set(module, level);
+        }
+    }
+    else
+    {
+        for (module = 0; module < LOG_MODULE_COUNT; module++)
+        {
+            if (strcmp(module_name, logging_module_names[module]) == 0)
+            {
+                break;
+            }
+        }
+
+        if (module == LOG_MODULE_COUNT)
+        {
+            return 404;
+        }
+
+        logging_level_set(module, level);
+    }
+
+    LOG_INFO(LOG_MODULE_APP, "Log level of %s set to %s", module_name, logging_level_names[level]);
+
+    return 200;
+}
+
+VOID logging_metrics_get(LOG_METRICS* metrics)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    TX_DISABLE
+    *metrics = logging_metrics;
+    TX_RESTORE
+}
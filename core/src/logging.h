@@ -0,0 +1,91 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _LOGGING_H
+#define _LOGGING_H
+
+#include "tx_api.h"
+
+#include "nx_api.h"
+
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+// Calls above this level are compiled out, arguments and all
+#ifndef LOG_LEVEL_COMPILE
+#define LOG_LEVEL_COMPILE LOG_LEVEL_INFO
+#endif
+
+// Level every module starts at, it can be changed at runtime up to LOG_LEVEL_COMPILE
+#ifndef LOG_LEVEL_DEFAULT
+#define LOG_LEVEL_DEFAULT LOG_LEVEL_INFO
+#endif
+
+#define LOG_MODULE_APP   0
+#define LOG_MODULE_NX    1 // azure_iot_nx client
+#define LOG_MODULE_MQTT  2 // Legacy MQTT client
+#define LOG_MODULE_COUNT 3
+
+// Records waiting for the drain thread, further records are dropped and counted while it is full
+#ifndef LOG_QUEUE_DEPTH
+#define LOG_QUEUE_DEPTH 16
+#endif
+
+#ifndef LOG_THREAD_PRIORITY
+#define LOG_THREAD_PRIORITY 20
+#endif
+
+#define LOG_ARGS_MAX    6
+#define LOG_STRING_SIZE 64 // Bytes for all %s arguments of one record, longer strings are cut short
+
+// Direct method handled by the clients themselves, e.g. {"module":"nx","level":"debug"}.
+// module may be "all", level may also be given as a number.
+#define LOG_METHOD_NAME "setLogLevel"
+
+// Longest LOG_METHOD_NAME payload accepted, including the null terminator
+#define LOG_METHOD_PAYLOAD_SIZE 64
+
+typedef struct LOG_METRICS_STRUCT
+{
+    ULONG written;
+    ULONG dropped;    // The queue was full
+    ULONG truncated;  // Arguments that did not fit the record
+    ULONG high_water; // Most records queued at once
+} LOG_METRICS;
+
+// Runtime level per module, read without a lock by the LOG_ macros
+extern volatile UCHAR logging_levels[LOG_MODULE_COUNT];
+
+// Starts the drain thread, until then records are formatted and printed by the caller
+UINT logging_start(VOID);
+
+// Captures the arguments into a record, the format itself must stay valid, i.e. be a literal.
+// Supports the integer, floating point, %c, %s and %p conversions, with * width and precision.
+VOID logging_write(UINT module, UINT level, const CHAR* format, ...);
+
+UINT logging_level_set(UINT module, UINT level);
+
+// Applies a LOG_METHOD_NAME payload, returns the HTTP status to answer with
+UINT logging_method_invoke(const CHAR* payload, UINT length);
+
+VOID logging_metrics_get(LOG_METRICS* metrics);
+
+#define LOG_AT(module, level, ...)                                                                                     \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if ((level) <= LOG_LEVEL_COMPILE && (level) <= logging_levels[(module)])                                      \
+        {                                                                                                              \
+            logging_write((module), (level), __VA_ARGS__);                                                             \
+        }                                                                                                              \
+    } while (0)
+
+// Formats take no "ERROR: " prefix or line ending, the drain adds both
+#define LOG_ERROR(module, ...) LOG_AT(module, LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARN(module, ...)  LOG_AT(module, LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_INFO(module, ...)  LOG_AT(module, LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(module, ...) LOG_AT(module, LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+#endif // _LOGGING_H
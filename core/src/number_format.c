@@ -0,0 +1,589 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// Shortest mode is Grisu2 (Loitsch, "Printing Floating-Point Numbers Quickly and Accurately with
+// Integers"). The output always reads back exactly, and is the shortest such string in all but a
+// handful of cases where it is one digit longer.
+
+#include "number_format.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#define GRISU_ALPHA -60
+#define GRISU_GAMMA -32
+
+#define CACHED_POWERS_MIN_DEC_EXP -300
+#define CACHED_POWERS_DEC_STEP    8
+
+// Plain notation is used for decimal exponents in (min, max], scientific outside of that
+#define PLAIN_MIN_EXP        -4
+#define PLAIN_MAX_EXP_DOUBLE 15
+#define PLAIN_MAX_EXP_FLOAT  6
+
+typedef struct DIYFP_STRUCT
+{
+    uint64_t f;
+    int e;
+} DIYFP;
+
+typedef struct CACHED_POWER_STRUCT
+{
+    uint64_t f;
+    int e;
+    int k;
+} CACHED_POWER;
+
+// Normalized 10^k for k = -300, -292, ..., 324
+static const CACHED_POWER cached_powers[] = {
+    {0xAB70FE17C79AC6CA, -1060, -300},
+    {0xFF77B1FCBEBCDC4F, -1034, -292},
+    {0xBE5691EF416BD60C, -1007, -284},
+    {0x8DD01FAD907FFC3C, -980, -276},
+    {0xD3515C2831559A83, -954, -268},
+    {0x9D71AC8FADA6C9B5, -927, -260},
+    {0xEA9C227723EE8BCB, -901, -252},
+    {0xAECC49914078536D, -874, -244},
+    {0x823C12795DB6CE57, -847, -236},
+    {0xC21094364DFB5637, -821, -228},
+    {0x9096EA6F3848984F, -794, -220},
+    {0xD77485CB25823AC7, -768, -212},
+    {0xA086CFCD97BF97F4, -741, -204},
+    {0xEF340A98172AACE5, -715, -196},
+    {0xB23867FB2A35B28E, -688, -188},
+    {0x84C8D4DFD2C63F3B, -661, -180},
+    {0xC5DD44271AD3CDBA, -635, -172},
+    {0x936B9FCEBB25C996, -608, -164},
+    {0xDBAC6C247D62A584, -582, -156},
+    {0xA3AB66580D5FDAF6, -555, -148},
+    {0xF3E2F893DEC3F126, -529, -140},
+    {0xB5B5ADA8AAFF80B8, -502, -132},
+    {0x87625F056C7C4A8B, -475, -124},
+    {0xC9BCFF6034C13053, -449, -116},
+    {0x964E858C91BA2655, -422, -108},
+    {0xDFF9772470297EBD, -396, -100},
+    {0xA6DFBD9FB8E5B88F, -369, -92},
+    {0xF8A95FCF88747D94, -343, -84},
+    {0xB94470938FA89BCF, -316, -76},
+    {0x8A08F0F8BF0F156B, -289, -68},
+    {0xCDB02555653131B6, -263, -60},
+    {0x993FE2C6D07B7FAC, -236, -52},
+    {0xE45C10C42A2B3B06, -210, -44},
+    {0xAA242499697392D3, -183, -36},
+    {0xFD87B5F28300CA0E, -157, -28},
+    {0xBCE5086492111AEB, -130, -20},
+    {0x8CBCCC096F5088CC, -103, -12},
+    {0xD1B71758E219652C, -77, -4},
+    {0x9C40000000000000, -50, 4},
+    {0xE8D4A51000000000, -24, 12},
+    {0xAD78EBC5AC620000, 3, 20},
+    {0x813F3978F8940984, 30, 28},
+    {0xC097CE7BC90715B3, 56, 36},
+    {0x8F7E32CE7BEA5C70, 83, 44},
+    {0xD5D238A4ABE98068, 109, 52},
+    {0x9F4F2726179A2245, 136, 60},
+    {0xED63A231D4C4FB27, 162, 68},
+    {0xB0DE65388CC8ADA8, 189, 76},
+    {0x83C7088E1AAB65DB, 216, 84},
+    {0xC45D1DF942711D9A, 242, 92},
+    {0x924D692CA61BE758, 269, 100},
+    {0xDA01EE641A708DEA, 295, 108},
+    {0xA26DA3999AEF774A, 322, 116},
+    {0xF209787BB47D6B85, 348, 124},
+    {0xB454E4A179DD1877, 375, 132},
+    {0x865B86925B9BC5C2, 402, 140},
+    {0xC83553C5C8965D3D, 428, 148},
+    {0x952AB45CFA97A0B3, 455, 156},
+    {0xDE469FBD99A05FE3, 481, 164},
+    {0xA59BC234DB398C25, 508, 172},
+    {0xF6C69A72A3989F5C, 534, 180},
+    {0xB7DCBF5354E9BECE, 561, 188},
+    {0x88FCF317F22241E2, 588, 196},
+    {0xCC20CE9BD35C78A5, 614, 204},
+    {0x98165AF37B2153DF, 641, 212},
+    {0xE2A0B5DC971F303A, 667, 220},
+    {0xA8D9D1535CE3B396, 694, 228},
+    {0xFB9B7CD9A4A7443C, 720, 236},
+    {0xBB764C4CA7A44410, 747, 244},
+    {0x8BAB8EEFB6409C1A, 774, 252},
+    {0xD01FEF10A657842C, 800, 260},
+    {0x9B10A4E5E9913129, 827, 268},
+    {0xE7109BFBA19C0C9D, 853, 276},
+    {0xAC2820D9623BF429, 880, 284},
+    {0x80444B5E7AA7CF85, 907, 292},
+    {0xBF21E44003ACDD2D, 933, 300},
+    {0x8E679C2F5E44FF8F, 960, 308},
+    {0xD433179D9C8CB841, 986, 316},
+    {0x9E19DB92B4E31BA9, 1013, 324},
+};
+
+static DIYFP diyfp_make(uint64_t f, int e)
+{
+    DIYFP x = {f, e};
+    return x;
+}
+
+// Upper 64 bits of the 128 bit product, rounded
+static DIYFP diyfp_mul(DIYFP x, DIYFP y)
+{
+    const uint64_t u_lo = x.f & 0xFFFFFFFFu;
+    const uint64_t u_hi = x.f >> 32;
+    const uint64_t v_lo = y.f & 0xFFFFFFFFu;
+    const uint64_t v_hi = y.f >> 32;
+
+    const uint64_t p0 = u_lo * v_lo;
+    const uint64_t p1 = u_lo * v_hi;
+    const uint64_t p2 = u_hi * v_lo;
+    const uint64_t p3 = u_hi * v_hi;
+
+    uint64_t q = (p0 >> 32) + (p1 & 0xFFFFFFFFu) + (p2 & 0xFFFFFFFFu);
+    q += 1u << 31;
+
+    return diyfp_make(p3 + (p2 >> 32) + (p1 >> 32) + (q >> 32), x.e + y.e + 64);
+}
+
+static DIYFP diyfp_normalize(DIYFP x)
+{
+    while ((x.f >> 63) == 0)
+    {
+        x.f <<= 1;
+        x.e--;
+    }
+
+    return x;
+}
+
+// The value v and the boundaries m- and m+ halfway to its neighbours, m- and m+ share an exponent
+static void boundaries_compute(
+    uint64_t significand, int exponent, bool lower_closer, DIYFP* minus, DIYFP* v, DIYFP* plus)
+{
+    DIYFP m_plus  = diyfp_make(2 * significand + 1, exponent - 1);
+    DIYFP m_minus = lower_closer ? diyfp_make(4 * significand - 1, exponent - 2)
+                                 : diyfp_make(2 * significand - 1, exponent - 1);
+
+    *plus = diyfp_normalize(m_plus);
+
+    minus->f = m_minus.f << (m_minus.e - plus->e);
+    minus->e = plus->e;
+
+    *v = diyfp_normalize(diyfp_make(significand, exponent));
+}
+
+static void boundaries_double(double value, DIYFP* minus, DIYFP* v, DIYFP* plus)
+{
+    const uint64_t hidden_bit = (uint64_t)1 << 52;
+    const int bias            = 1023 + 52;
+    uint64_t bits;
+    uint64_t fraction;
+    int biased_exponent;
+
+    memcpy(&bits, &value, sizeof(bits));
+    fraction        = bits & (hidden_bit - 1);
+    biased_exponent = (int)(bits >> 52) & 0x7FF;
+
+    if (biased_exponent == 0)
+    {
+        boundaries_compute(fraction, 1 - bias, false, minus, v, plus);
+    }
+    else
+    {
+        boundaries_compute(
+            fraction + hidden_bit, biased_exponent - bias, fraction == 0 && biased_exponent > 1, minus, v, plus);
+    }
+}
+
+static void boundaries_float(float value, DIYFP* minus, DIYFP* v, DIYFP* plus)
+{
+    const uint32_t hidden_bit = (uint32_t)1 << 23;
+    const int bias            = 127 + 23;
+    uint32_t bits;
+    uint32_t fraction;
+    int biased_exponent;
+
+    memcpy(&bits, &value, sizeof(bits));
+    fraction        = bits & (hidden_bit - 1);
+    biased_exponent = (int)(bits >> 23) & 0xFF;
+
+    if (biased_exponent == 0)
+    {
+        boundaries_compute(fraction, 1 - bias, false, minus, v, plus);
+    }
+    else
+    {
+        boundaries_compute(
+            fraction + hidden_bit, biased_exponent - bias, fraction == 0 && biased_exponent > 1, minus, v, plus);
+    }
+}
+
+// A power of ten that scales a number with binary exponent e into [2^alpha, 2^gamma]
+static CACHED_POWER cached_power_for(int e)
+{
+    const int f     = GRISU_ALPHA - e - 1;
+    const int k     = (f * 78913) / (1 << 18) + (f > 0);
+    const int index = (-CACHED_POWERS_MIN_DEC_EXP + k + (CACHED_POWERS_DEC_STEP - 1)) / CACHED_POWERS_DEC_STEP;
+
+    return cached_powers[index];
+}
+
+// Number of decimal digits in n, and the power of ten of the leading one
+static int largest_pow10(uint32_t n, uint32_t* pow10)
+{
+    uint32_t p = 1000000000;
+    int digits = 10;
+
+    while (p > n && digits > 1)
+    {
+        p /= 10;
+        digits--;
+    }
+
+    *pow10 = p;
+    return digits;
+}
+
+// Moves the last digit towards w while the result stays inside the boundaries
+static void grisu2_round(char* buffer, int length, uint64_t dist, uint64_t delta, uint64_t rest, uint64_t ten_k)
+{
+    while (rest < dist && delta - rest >= ten_k && (rest + ten_k < dist || dist - rest > rest + ten_k - dist))
+    {
+        buffer[length - 1]--;
+        rest += ten_k;
+    }
+}
+
+static void grisu2_digit_gen(
+    char* buffer, int* length, int* decimal_exponent, DIYFP m_minus, DIYFP w, DIYFP m_plus)
+{
+    uint64_t delta = m_plus.f - m_minus.f;
+    uint64_t dist  = m_plus.f - w.f;
+
+    const int shift    = -m_plus.e;
+    const uint64_t one = (uint64_t)1 << shift;
+
+    uint32_t p1 = (uint32_t)(m_plus.f >> shift);
+    uint64_t p2 = m_plus.f & (one - 1);
+    uint32_t pow10;
+    uint64_t rest;
+    int n = largest_pow10(p1, &pow10);
+    int m = 0;
+
+    // Integral digits
+    while (n > 0)
+    {
+        buffer[(*length)++] = (char)('0' + p1 / pow10);
+        p1 %= pow10;
+        n--;
+
+        rest = ((uint64_t)p1 << shift) + p2;
+        if (rest <= delta)
+        {
+            *decimal_exponent += n;
+            grisu2_round(buffer, *length, dist, delta, rest, (uint64_t)pow10 << shift);
+            return;
+        }
+
+        pow10 /= 10;
+    }
+
+    // Fractional digits, until the remainder is inside the boundaries
+    do
+    {
+        p2 *= 10;
+        buffer[(*length)++] = (char)('0' + (p2 >> shift));
+        p2 &= one - 1;
+        m++;
+
+        delta *= 10;
+        dist *= 10;
+    } while (p2 > delta);
+
+    *decimal_exponent -= m;
+    grisu2_round(buffer, *length, dist, delta, p2, one);
+}
+
+// Digits of v, with v = digits * 10^decimal_exponent
+static int grisu2(char* buffer, int* decimal_exponent, DIYFP m_minus, DIYFP v, DIYFP m_plus)
+{
+    const CACHED_POWER cached = cached_power_for(m_plus.e);
+    const DIYFP c_minus_k     = diyfp_make(cached.f, cached.e);
+
+    DIYFP w       = diyfp_mul(v, c_minus_k);
+    DIYFP w_minus = diyfp_mul(m_minus, c_minus_k);
+    DIYFP w_plus  = diyfp_mul(m_plus, c_minus_k);
+    int length    = 0;
+
+    // Shrink the interval by one unit on each side to stay clear of the rounding in the products
+    w_minus.f++;
+    w_plus.f--;
+
+    *decimal_exponent = -cached.k;
+    grisu2_digit_gen(buffer, &length, decimal_exponent, w_minus, w, w_plus);
+
+    return length;
+}
+
+static char* exponent_append(char* p, int e)
+{
+    if (e < 0)
+    {
+        *p++ = '-';
+        e    = -e;
+    }
+
+    if (e >= 100)
+    {
+        *p++ = (char)('0' + e / 100);
+        e %= 100;
+        *p++ = (char)('0' + e / 10);
+    }
+    else if (e >= 10)
+    {
+        *p++ = (char)('0' + e / 10);
+    }
+
+    *p++ = (char)('0' + e % 10);
+
+    return p;
+}
+
+// Lays out length digits with value digits * 10^decimal_exponent, buffer needs room for the padding
+static char* digits_layout(char* buffer, int length, int decimal_exponent, int max_exp)
+{
+    const int n = length + decimal_exponent;
+
+    if (length <= n && n <= max_exp)
+    {
+        // digits[000]
+        memset(buffer + length, '0', n - length);
+        return buffer + n;
+    }
+
+    if (0 < n && n <= max_exp)
+    {
+        // dig.its
+        memmove(buffer + n + 1, buffer + n, length - n);
+        buffer[n] = '.';
+        return buffer + length + 1;
+    }
+
+    if (PLAIN_MIN_EXP < n && n <= 0)
+    {
+        // 0.[000]digits
+        memmove(buffer + 2 - n, buffer, length);
+        buffer[0] = '0';
+        buffer[1] = '.';
+        memset(buffer + 2, '0', -n);
+        return buffer + 2 - n + length;
+    }
+
+    // d.igitsE-123
+    if (length > 1)
+    {
+        memmove(buffer + 2, buffer + 1, length - 1);
+        buffer[1] = '.';
+        buffer += length + 1;
+    }
+    else
+    {
+        buffer += 1;
+    }
+
+    *buffer++ = 'e';
+
+    return exponent_append(buffer, n - 1);
+}
+
+static size_t output_copy(const char* text, size_t length, char* out, size_t out_size)
+{
+    if (length + 1 > out_size)
+    {
+        return 0;
+    }
+
+    memcpy(out, text, length);
+    out[length] = 0;
+
+    return length;
+}
+
+static size_t unsigned_format(bool negative, uint64_t value, char* out, size_t out_size)
+{
+    char buffer[NUMBER_FORMAT_BUFFER_SIZE];
+    char* p = buffer + sizeof(buffer);
+
+    do
+    {
+        *--p = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    if (negative)
+    {
+        *--p = '-';
+    }
+
+    return output_copy(p, buffer + sizeof(buffer) - p, out, out_size);
+}
+
+static const uint32_t pow10_table[NUMBER_FORMAT_MAX_DECIMALS + 1] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+
+static size_t fixed_format(double value, int decimals, char* out, size_t out_size)
+{
+    char buffer[NUMBER_FORMAT_BUFFER_SIZE];
+    char* p          = buffer + sizeof(buffer);
+    bool negative    = value < 0;
+    double magnitude = negative ? -value : value;
+    uint64_t integral;
+    uint64_t fraction;
+
+    // Scale only the fraction, it is exact in a double and keeps the product well inside 2^53
+    integral = (uint64_t)magnitude;
+    fraction = (uint64_t)((magnitude - (double)integral) * pow10_table[decimals] + 0.5);
+    if (fraction >= pow10_table[decimals])
+    {
+        fraction -= pow10_table[decimals];
+        integral++;
+    }
+
+    for (int i = 0; i < decimals; i++)
+    {
+        *--p = (char)('0' + fraction % 10);
+        fraction /= 10;
+    }
+
+    if (decimals > 0)
+    {
+        *--p = '.';
+    }
+
+    do
+    {
+        *--p = (char)('0' + integral % 10);
+        integral /= 10;
+    } while (integral != 0);
+
+    // Don't write -0.00 for values that round to zero
+    if (negative)
+    {
+        for (char* c = p; c < buffer + sizeof(buffer); c++)
+        {
+            if (*c >= '1' && *c <= '9')
+            {
+                *--p = '-';
+                break;
+            }
+        }
+    }
+
+    return output_copy(p, buffer + sizeof(buffer) - p, out, out_size);
+}
+
+static size_t special_format(double value, char* out, size_t out_size, bool* handled)
+{
+    *handled = true;
+
+    if (value != value || value - value != 0)
+    {
+        // NaN and infinity have no JSON representation
+        return output_copy("null", 4, out, out_size);
+    }
+
+    if (value == 0)
+    {
+        return output_copy("0", 1, out, out_size);
+    }
+
+    *handled = false;
+    return 0;
+}
+
+size_t number_format_int32(int32_t value, char* out, size_t out_size)
+{
+    return number_format_int64(value, out, out_size);
+}
+
+size_t number_format_int64(int64_t value, char* out, size_t out_size)
+{
+    // Negate in unsigned arithmetic so INT64_MIN works
+    return unsigned_format(value < 0, value < 0 ? 0 - (uint64_t)value : (uint64_t)value, out, out_size);
+}
+
+size_t number_format_double(double value, int decimals, char* out, size_t out_size)
+{
+    char buffer[NUMBER_FORMAT_BUFFER_SIZE];
+    char* p = buffer;
+    DIYFP minus;
+    DIYFP v;
+    DIYFP plus;
+    int length;
+    int decimal_exponent;
+    bool handled;
+    size_t written;
+
+    written = special_format(value, out, out_size, &handled);
+    if (handled)
+    {
+        return written;
+    }
+
+    if (decimals > NUMBER_FORMAT_MAX_DECIMALS)
+    {
+        decimals = NUMBER_FORMAT_MAX_DECIMALS;
+    }
+
+    if (decimals >= 0 && value > -1e18 && value < 1e18)
+    {
+        return fixed_format(value, decimals, out, out_size);
+    }
+
+    if (value < 0)
+    {
+        *p++  = '-';
+        value = -value;
+    }
+
+    boundaries_double(value, &minus, &v, &plus);
+    length = grisu2(p, &decimal_exponent, minus, v, plus);
+    p      = digits_layout(p, length, decimal_exponent, PLAIN_MAX_EXP_DOUBLE);
+
+    return output_copy(buffer, p - buffer, out, out_size);
+}
+
+size_t number_format_float(float value, int decimals, char* out, size_t out_size)
+{
+    char buffer[NUMBER_FORMAT_BUFFER_SIZE];
+    char* p = buffer;
+    DIYFP minus;
+    DIYFP v;
+    DIYFP plus;
+    int length;
+    int decimal_exponent;
+    bool handled;
+    size_t written;
+
+    // Fixed mode works the same on the widened value
+    if (decimals >= 0)
+    {
+        return number_format_double(value, decimals, out, out_size);
+    }
+
+    written = special_format(value, out, out_size, &handled);
+    if (handled)
+    {
+        return written;
+    }
+
+    if (value < 0)
+    {
+        *p++  = '-';
+        value = -value;
+    }
+
+    // Boundaries from the float neighbours give the digits a float needs, not the double it widens to
+    boundaries_float(value, &minus, &v, &plus);
+    length = grisu2(p, &decimal_exponent, minus, v, plus);
+    p      = digits_layout(p, length, decimal_exponent, PLAIN_MAX_EXP_FLOAT);
+
+    return output_copy(buffer, p - buffer, out, out_size);
+}
@@ -0,0 +1,27 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _NUMBER_FORMAT_H
+#define _NUMBER_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Pass as decimals for the shortest digits that read back as the same value
+#define NUMBER_FORMAT_SHORTEST -1
+
+#define NUMBER_FORMAT_MAX_DECIMALS 9
+
+// Large enough for any value in any mode, including the terminator
+#define NUMBER_FORMAT_BUFFER_SIZE 32
+
+// All writers produce JSON numbers, null terminate and return the number of characters written,
+// or 0 if the output does not fit. NaN and infinity are written as null.
+size_t number_format_int32(int32_t value, char* out, size_t out_size);
+size_t number_format_int64(int64_t value, char* out, size_t out_size);
+
+// Fixed mode rounds half away from zero and falls back to shortest for magnitudes of 1e18 and up
+size_t number_format_double(double value, int decimals, char* out, size_t out_size);
+size_t number_format_float(float value, int decimals, char* out, size_t out_size);
+
+#endif // _NUMBER_FORMAT_H
@@ -0,0 +1,128 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "provisioning_store.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PROVISIONING_RECORD_MAGIC 0x44505331 // "DPS1"
+
+// FNV-1a, enough to catch a torn write or a record left behind by another identity
+static ULONG fnv_add(ULONG hash, const VOID* data, UINT length)
+{
+    const UCHAR* bytes = (const UCHAR*)data;
+
+    for (UINT i = 0; i < length; i++)
+    {
+        hash = (hash ^ bytes[i]) * 16777619UL;
+    }
+
+    return hash & 0xFFFFFFFFUL;
+}
+
+static ULONG identity_fingerprint(CHAR* id_scope, CHAR* registration_id)
+{
+    ULONG hash = 2166136261UL;
+
+    hash = fnv_add(hash, id_scope, strlen(id_scope) + 1);
+    hash = fnv_add(hash, registration_id, strlen(registration_id) + 1);
+
+    return hash;
+}
+
+static ULONG record_checksum(const PROVISIONING_RECORD* record)
+{
+    return fnv_add(2166136261UL, record, offsetof(PROVISIONING_RECORD, checksum));
+}
+
+UINT provisioning_store_load(PROVISIONING_STORE* store,
+    CHAR* id_scope,
+    CHAR* registration_id,
+    CHAR* hub_hostname,
+    UINT hub_hostname_size,
+    CHAR* device_id,
+    UINT device_id_size)
+{
+    PROVISIONING_RECORD record;
+    UINT status;
+
+    if (store == NX_NULL || store->load == NX_NULL || hub_hostname == NX_NULL || device_id == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    if ((status = store->load(store->context, &record)))
+    {
+        return status;
+    }
+
+    if (record.magic != PROVISIONING_RECORD_MAGIC || record.checksum != record_checksum(&record))
+    {
+        printf("WARN: Stored DPS assignment is corrupt, ignoring it\r\n");
+        return NX_NOT_FOUND;
+    }
+
+    if (record.fingerprint != identity_fingerprint(id_scope, registration_id))
+    {
+        printf("Stored DPS assignment belongs to a different registration, ignoring it\r\n");
+        return NX_NOT_FOUND;
+    }
+
+    // Guard against records written with larger limits
+    if (memchr(record.hub_hostname, 0, sizeof(record.hub_hostname)) == NX_NULL ||
+        memchr(record.device_id, 0, sizeof(record.device_id)) == NX_NULL ||
+        strlen(record.hub_hostname) >= hub_hostname_size || strlen(record.device_id) >= device_id_size ||
+        record.hub_hostname[0] == 0 || record.device_id[0] == 0)
+    {
+        return NX_SIZE_ERROR;
+    }
+
+    strcpy(hub_hostname, record.hub_hostname);
+    strcpy(device_id, record.device_id);
+
+    return NX_SUCCESS;
+}
+
+UINT provisioning_store_save(
+    PROVISIONING_STORE* store, CHAR* id_scope, CHAR* registration_id, CHAR* hub_hostname, CHAR* device_id)
+{
+    PROVISIONING_RECORD record;
+    UINT status;
+
+    if (store == NX_NULL || store->save == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    if (strlen(hub_hostname) >= sizeof(record.hub_hostname) || strlen(device_id) >= sizeof(record.device_id))
+    {
+        return NX_SIZE_ERROR;
+    }
+
+    // Zero the padding too, it is part of the checksum
+    memset(&record, 0, sizeof(record));
+    record.magic       = PROVISIONING_RECORD_MAGIC;
+    record.fingerprint = identity_fingerprint(id_scope, registration_id);
+    strcpy(record.hub_hostname, hub_hostname);
+    strcpy(record.device_id, device_id);
+    record.checksum = record_checksum(&record);
+
+    if ((status = store->save(store->context, &record)))
+    {
+        printf("ERROR: Failed to persist the DPS assignment (0x%02x)\r\n", status);
+    }
+
+    return status;
+}
+
+UINT provisioning_store_erase(PROVISIONING_STORE* store)
+{
+    if (store == NX_NULL || store->erase == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    return store->erase(store->context);
+}
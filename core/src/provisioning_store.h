@@ -0,0 +1,51 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _PROVISIONING_STORE_H
+#define _PROVISIONING_STORE_H
+
+#include <stdbool.h>
+
+#include "tx_api.h"
+
+#include "nx_api.h"
+
+#define PROVISIONING_HOSTNAME_SIZE  128
+#define PROVISIONING_DEVICE_ID_SIZE 64
+
+// What DPS assigned, tagged with the identity it was assigned to
+typedef struct PROVISIONING_RECORD_STRUCT
+{
+    ULONG magic;
+    ULONG fingerprint; // Hash of the id scope and registration id
+    CHAR hub_hostname[PROVISIONING_HOSTNAME_SIZE];
+    CHAR device_id[PROVISIONING_DEVICE_ID_SIZE];
+    ULONG checksum;
+} PROVISIONING_RECORD;
+
+// Persistent storage for a single record, e.g. a flash registry or a file.
+// load returns NX_NOT_FOUND when nothing has been saved.
+typedef struct PROVISIONING_STORE_STRUCT
+{
+    UINT (*load)(VOID* context, PROVISIONING_RECORD* record);
+    UINT (*save)(VOID* context, const PROVISIONING_RECORD* record);
+    UINT (*erase)(VOID* context);
+    VOID* context;
+} PROVISIONING_STORE;
+
+// Succeeds only if the stored assignment is intact and was made for this id scope and registration id
+UINT provisioning_store_load(PROVISIONING_STORE* store,
+    CHAR* id_scope,
+    CHAR* registration_id,
+    CHAR* hub_hostname,
+    UINT hub_hostname_size,
+    CHAR* device_id,
+    UINT device_id_size);
+
+UINT provisioning_store_save(
+    PROVISIONING_STORE* store, CHAR* id_scope, CHAR* registration_id, CHAR* hub_hostname, CHAR* device_id);
+
+// Forces DPS registration on the next connect, e.g. when the device should be re-provisioned
+UINT provisioning_store_erase(PROVISIONING_STORE* store);
+
+#endif // _PROVISIONING_STORE_H
@@ -0,0 +1,480 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "reported_properties.h"
+
+#include <string.h>
+
+#include "json_utils.h"
+#include "logging.h"
+
+// Marks an object as a component in a reported property patch
+#define COMPONENT_MARKER "\"__t\":\"c\""
+
+static VOID window_timer_expired(ULONG parameter)
+{
+    REPORTED_PROPERTIES* properties = (REPORTED_PROPERTIES*)parameter;
+
+    properties->window_open = false;
+    properties->due(properties->context);
+}
+
+// Names and strings are written without escaping, refuse anything that would need it
+static bool json_safe(const CHAR* text, UINT size)
+{
+    UINT length = strlen(text);
+
+    if (length == 0 || length >= size)
+    {
+        return false;
+    }
+
+    for (UINT i = 0; i < length; i++)
+    {
+        if (text[i] == '"' || text[i] == '\\' || (UCHAR)text[i] < 0x20)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Takes the mutex and returns the slot for component/name, reusing a pending one if there is one
+static REPORTED_PROPERTY* property_claim(REPORTED_PROPERTIES* properties, const CHAR* component, const CHAR* name)
+{
+    REPORTED_PROPERTY* property = NX_NULL;
+
+    if (component == NX_NULL)
+    {
+        component = "";
+    }
+
+    if ((component[0] != 0 && !json_safe(component, REPORTED_PROPERTIES_NAME_SIZE)) ||
+        !json_safe(name, REPORTED_PROPERTIES_NAME_SIZE))
+    {
+        LOG_ERROR(LOG_MODULE_APP, "Reported property name is too long or needs escaping");
+        return NX_NULL;
+    }
+
+    tx_mutex_get(&properties->mutex, TX_WAIT_FOREVER);
+
+    properties->metrics.updates++;
+
+    for (UINT i = 0; i < REPORTED_PROPERTIES_MAX; i++)
+    {
+        if (properties->properties[i].type != 0 && strcmp(properties->properties[i].component, component) == 0 &&
+            strcmp(properties->properties[i].name, name) == 0)
+        {
+            properties->metrics.coalesced++;
+            property = &properties->properties[i];
+            break;
+        }
+
+        if (property == NX_NULL && properties->properties[i].type == 0)
+        {
+            property = &properties->properties[i];
+        }
+    }
+
+    if (property == NX_NULL)
+    {
+        properties->metrics.rejected++;
+        tx_mutex_put(&properties->mutex);
+        LOG_ERROR(LOG_MODULE_APP, "No room to stage reported property %s", name);
+        return NX_NULL;
+    }
+
+    if (property->type == 0)
+    {
+        strcpy(property->component, component);
+        strcpy(property->name, name);
+        properties->count++;
+    }
+
+    property->sequence = ++properties->sequence;
+
+    return property;
+}
+
+// Releases the mutex taken by property_claim and starts the window if this is the first change
+static UINT property_commit(REPORTED_PROPERTIES* properties, REPORTED_PROPERTY* property, UCHAR type)
+{
+    bool open_window = !properties->window_open;
+
+    property->type          = type;
+    properties->window_open = true;
+
+    tx_mutex_put(&properties->mutex);
+
+    if (open_window)
+    {
+        if (properties->window == 0)
+        {
+            properties->window_open = false;
+            properties->due(properties->context);
+        }
+        else
+        {
+            tx_timer_deactivate(&properties->window_timer);
+            tx_timer_change(&properties->window_timer, properties->window, 0);
+            tx_timer_activate(&properties->window_timer);
+        }
+    }
+
+    return NX_SUCCESS;
+}
+
+static VOID append_member(JSON_BUILDER* builder, REPORTED_PROPERTY* property)
+{
+    json_builder_append(builder, "\"");
+    json_builder_append(builder, property->name);
+    json_builder_append(builder, "\":");
+
+    switch (property->type)
+    {
+        case REPORTED_PROPERTY_BOOL:
+            json_builder_append(builder, property->value.boolean ? "true" : "false");
+            break;
+
+        case REPORTED_PROPERTY_INT:
+            json_builder_append_int(builder, property->value.integer);
+            break;
+
+        case REPORTED_PROPERTY_DOUBLE:
+            json_builder_append_double(builder, property->value.number.value, property->value.number.decimals);
+            break;
+
+        case REPORTED_PROPERTY_STRING:
+            json_builder_append(builder, "\"");
+            json_builder_append(builder, property->value.string);
+            json_builder_append(builder, "\"");
+            break;
+
+        case REPORTED_PROPERTY_WRITEABLE:
+            json_builder_append(builder, "{\"value\":");
+            json_builder_append_int(builder, property->value.writeable.value);
+            json_builder_append(builder, ",\"ac\":");
+            json_builder_append_int(builder, property->value.writeable.ac);
+            json_builder_append(builder, ",\"av\":");
+            json_builder_append_int(builder, property->value.writeable.av);
+            json_builder_append(builder, "}");
+            break;
+    }
+}
+
+// Must be called with the mutex held. Default component members first, then one object per component.
+static UINT patch_build(REPORTED_PROPERTIES* properties, CHAR* buffer, UINT buffer_size)
+{
+    REPORTED_PROPERTY* property;
+    JSON_BUILDER builder;
+    bool first = true;
+    bool seen;
+
+    json_builder_init(&builder, buffer, buffer_size);
+    json_builder_append(&builder, "{");
+
+    for (UINT i = 0; i < REPORTED_PROPERTIES_MAX; i++)
+    {
+        property = &properties->properties[i];
+        if (property->type != 0 && property->component[0] == 0)
+        {
+            json_builder_append(&builder, first ? "" : ",");
+            append_member(&builder, property);
+            first = false;
+        }
+    }
+
+    for (UINT i = 0; i < REPORTED_PROPERTIES_MAX; i++)
+    {
+        property = &properties->properties[i];
+        if (property->type == 0 || property->component[0] == 0)
+        {
+            continue;
+        }
+
+        // Each component is written once, at its first member
+        seen = false;
+        for (UINT j = 0; j < i && !seen; j++)
+        {
+            seen = properties->properties[j].type != 0 &&
+                   strcmp(properties->properties[j].component, property->component) == 0;
+        }
+
+        if (seen)
+        {
+            continue;
+        }
+
+        json_builder_append(&builder, first ? "\"" : ",\"");
+        json_builder_append(&builder, property->component);
+        json_builder_append(&builder, "\":{" COMPONENT_MARKER);
+
+        for (UINT j = i; j < REPORTED_PROPERTIES_MAX; j++)
+        {
+            if (properties->properties[j].type != 0 &&
+                strcmp(properties->properties[j].component, property->component) == 0)
+            {
+                json_builder_append(&builder, ",");
+                append_member(&builder, &properties->properties[j]);
+            }
+        }
+
+        json_builder_append(&builder, "}");
+        first = false;
+    }
+
+    json_builder_append(&builder, "}");
+
+    return json_builder_finish(&builder);
+}
+
+UINT reported_properties_create(
+    REPORTED_PROPERTIES* properties, CHAR* name, ULONG window, func_ptr_reported_properties_due due, VOID* context)
+{
+    UINT status;
+
+    if (properties == NX_NULL || due == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    memset(properties, 0, sizeof(*properties));
+
+    properties->window  = window;
+    properties->due     = due;
+    properties->context = context;
+
+    if ((status = tx_mutex_create(&properties->mutex, name, TX_INHERIT)))
+    {
+        LOG_ERROR(LOG_MODULE_APP, "Failed to create reported properties mutex (0x%02x)", status);
+        return status;
+    }
+
+    if ((status = tx_timer_create(
+             &properties->window_timer, name, window_timer_expired, (ULONG)properties, 1, 0, TX_NO_ACTIVATE)))
+    {
+        LOG_ERROR(LOG_MODULE_APP, "Failed to create reported properties timer (0x%02x)", status);
+        tx_mutex_delete(&properties->mutex);
+        return status;
+    }
+
+    return NX_SUCCESS;
+}
+
+UINT reported_properties_delete(REPORTED_PROPERTIES* properties)
+{
+    if (properties == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    tx_timer_delete(&properties->window_timer);
+    tx_mutex_delete(&properties->mutex);
+
+    return NX_SUCCESS;
+}
+
+UINT reported_properties_set_bool(REPORTED_PROPERTIES* properties, const CHAR* component, const CHAR* name, bool value)
+{
+    REPORTED_PROPERTY* property;
+
+    if (properties == NX_NULL || name == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    if ((property = property_claim(properties, component, name)) == NX_NULL)
+    {
+        return NX_NO_MORE_ENTRIES;
+    }
+
+    property->value.boolean = value;
+
+    return property_commit(properties, property, REPORTED_PROPERTY_BOOL);
+}
+
+UINT reported_properties_set_int(
+    REPORTED_PROPERTIES* properties, const CHAR* component, const CHAR* name, int64_t value)
+{
+    REPORTED_PROPERTY* property;
+
+    if (properties == NX_NULL || name == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    if ((property = property_claim(properties, component, name)) == NX_NULL)
+    {
+        return NX_NO_MORE_ENTRIES;
+    }
+
+    property->value.integer = value;
+
+    return property_commit(properties, property, REPORTED_PROPERTY_INT);
+}
+
+UINT reported_properties_set_double(
+    REPORTED_PROPERTIES* properties, const CHAR* component, const CHAR* name, double value, INT decimals)
+{
+    REPORTED_PROPERTY* property;
+
+    if (properties == NX_NULL || name == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    if ((property = property_claim(properties, component, name)) == NX_NULL)
+    {
+        return NX_NO_MORE_ENTRIES;
+    }
+
+    property->value.number.value    = value;
+    property->value.number.decimals = decimals;
+
+    return property_commit(properties, property, REPORTED_PROPERTY_DOUBLE);
+}
+
+UINT reported_properties_set_string(
+    REPORTED_PROPERTIES* properties, const CHAR* component, const CHAR* name, const CHAR* value)
+{
+    REPORTED_PROPERTY* property;
+
+    if (properties == NX_NULL || name == NX_NULL || value == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    if (value[0] != 0 && !json_safe(value, REPORTED_PROPERTIES_STRING_SIZE))
+    {
+        LOG_ERROR(LOG_MODULE_APP, "Value of reported property %s is too long or needs escaping", name);
+        return NX_SIZE_ERROR;
+    }
+
+    if ((property = property_claim(properties, component, name)) == NX_NULL)
+    {
+        return NX_NO_MORE_ENTRIES;
+    }
+
+    strcpy(property->value.string, value);
+
+    return property_commit(properties, property, REPORTED_PROPERTY_STRING);
+}
+
+UINT reported_properties_set_writeable(REPORTED_PROPERTIES* properties,
+    const CHAR* component,
+    const CHAR* name,
+    int64_t value,
+    INT ac,
+    UINT av)
+{
+    REPORTED_PROPERTY* property;
+
+    if (properties == NX_NULL || name == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    if ((property = property_claim(properties, component, name)) == NX_NULL)
+    {
+        return NX_NO_MORE_ENTRIES;
+    }
+
+    property->value.writeable.value = value;
+    property->value.writeable.ac    = ac;
+    property->value.writeable.av    = av;
+
+    return property_commit(properties, property, REPORTED_PROPERTY_WRITEABLE);
+}
+
+UINT reported_properties_build(
+    REPORTED_PROPERTIES* properties, CHAR* buffer, UINT buffer_size, UINT* length, ULONG* sequence)
+{
+    if (properties == NX_NULL || buffer == NX_NULL || length == NX_NULL || sequence == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    tx_mutex_get(&properties->mutex, TX_WAIT_FOREVER);
+
+    if (properties->count == 0)
+    {
+        tx_mutex_put(&properties->mutex);
+        return NX_NOT_FOUND;
+    }
+
+    *length   = patch_build(properties, buffer, buffer_size);
+    *sequence = properties->sequence;
+
+    tx_mutex_put(&properties->mutex);
+
+    if (*length == 0)
+    {
+        LOG_ERROR(LOG_MODULE_APP, "Pending reported properties do not fit in a %d byte patch", buffer_size);
+        return NX_SIZE_ERROR;
+    }
+
+    return NX_SUCCESS;
+}
+
+VOID reported_properties_sent(REPORTED_PROPERTIES* properties, ULONG sequence)
+{
+    tx_mutex_get(&properties->mutex, TX_WAIT_FOREVER);
+
+    // Anything set again since the build goes out with the next patch
+    for (UINT i = 0; i < REPORTED_PROPERTIES_MAX; i++)
+    {
+        if (properties->properties[i].type != 0 && properties->properties[i].sequence <= sequence)
+        {
+            properties->properties[i].type = 0;
+            properties->count--;
+        }
+    }
+
+    properties->metrics.patches++;
+
+    tx_mutex_put(&properties->mutex);
+}
+
+UINT reported_properties_flush(REPORTED_PROPERTIES* properties,
+    CHAR* buffer,
+    UINT buffer_size,
+    func_ptr_reported_properties_send send,
+    VOID* context)
+{
+    ULONG sequence;
+    UINT length;
+    UINT status;
+
+    if (send == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    if ((status = reported_properties_build(properties, buffer, buffer_size, &length, &sequence)))
+    {
+        return status;
+    }
+
+    // Don't hold the mutex over the round trip, setters keep working meanwhile
+    if ((status = send(context, buffer, length)))
+    {
+        return status;
+    }
+
+    reported_properties_sent(properties, sequence);
+
+    return NX_SUCCESS;
+}
+
+bool reported_properties_is_empty(REPORTED_PROPERTIES* properties)
+{
+    return properties->count == 0;
+}
+
+VOID reported_properties_metrics_get(REPORTED_PROPERTIES* properties, REPORTED_PROPERTIES_METRICS* metrics)
+{
+    tx_mutex_get(&properties->mutex, TX_WAIT_FOREVER);
+    *metrics = properties->metrics;
+    tx_mutex_put(&properties->mutex);
+}
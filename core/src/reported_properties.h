@@ -0,0 +1,126 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _REPORTED_PROPERTIES_H
+#define _REPORTED_PROPERTIES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tx_api.h"
+
+#include "nx_api.h"
+
+// Distinct properties that can wait for the next patch, setting one again replaces the pending value
+#ifndef REPORTED_PROPERTIES_MAX
+#define REPORTED_PROPERTIES_MAX 12
+#endif
+
+#define REPORTED_PROPERTIES_NAME_SIZE   32
+#define REPORTED_PROPERTIES_STRING_SIZE 32
+
+// How long the first change waits for others to join it
+#define REPORTED_PROPERTIES_WINDOW_DEFAULT (TX_TIMER_TICKS_PER_SECOND / 2)
+
+#define REPORTED_PROPERTY_BOOL      1
+#define REPORTED_PROPERTY_INT       2
+#define REPORTED_PROPERTY_DOUBLE    3
+#define REPORTED_PROPERTY_STRING    4
+#define REPORTED_PROPERTY_WRITEABLE 5 // {"value":<int>,"ac":<status>,"av":<version>}
+
+typedef struct REPORTED_PROPERTY_STRUCT
+{
+    UCHAR type; // 0 when the slot is free
+    ULONG sequence;
+    CHAR component[REPORTED_PROPERTIES_NAME_SIZE]; // Empty for the default component
+    CHAR name[REPORTED_PROPERTIES_NAME_SIZE];
+
+    union
+    {
+        bool boolean;
+        int64_t integer;
+        CHAR string[REPORTED_PROPERTIES_STRING_SIZE];
+        struct
+        {
+            double value;
+            INT decimals;
+        } number;
+        struct
+        {
+            int64_t value;
+            INT ac;
+            UINT av;
+        } writeable;
+    } value;
+} REPORTED_PROPERTY;
+
+// Called from the timer once the window closes, must not block. The flush itself belongs on a thread.
+typedef VOID (*func_ptr_reported_properties_due)(VOID* context);
+
+// Sends one merged patch, anything other than NX_SUCCESS leaves the properties pending
+typedef UINT (*func_ptr_reported_properties_send)(VOID* context, CHAR* patch, UINT length);
+
+typedef struct REPORTED_PROPERTIES_METRICS_STRUCT
+{
+    ULONG updates;    // Values set
+    ULONG coalesced;  // Values that replaced one still waiting to be sent
+    ULONG patches;    // Patches sent
+    ULONG rejected;   // Refused because every slot was taken by another property
+} REPORTED_PROPERTIES_METRICS;
+
+typedef struct REPORTED_PROPERTIES_STRUCT
+{
+    TX_MUTEX mutex;
+    TX_TIMER window_timer;
+
+    REPORTED_PROPERTY properties[REPORTED_PROPERTIES_MAX];
+    UINT count;
+    ULONG sequence;
+
+    ULONG window;     // Ticks, 0 reports every change as due straight away
+    bool window_open; // Timer is running for the current batch
+
+    func_ptr_reported_properties_due due;
+    VOID* context;
+
+    REPORTED_PROPERTIES_METRICS metrics;
+} REPORTED_PROPERTIES;
+
+UINT reported_properties_create(
+    REPORTED_PROPERTIES* properties, CHAR* name, ULONG window, func_ptr_reported_properties_due due, VOID* context);
+UINT reported_properties_delete(REPORTED_PROPERTIES* properties);
+
+// Component may be NX_NULL for the default component
+UINT reported_properties_set_bool(REPORTED_PROPERTIES* properties, const CHAR* component, const CHAR* name, bool value);
+UINT reported_properties_set_int(
+    REPORTED_PROPERTIES* properties, const CHAR* component, const CHAR* name, int64_t value);
+UINT reported_properties_set_double(
+    REPORTED_PROPERTIES* properties, const CHAR* component, const CHAR* name, double value, INT decimals);
+UINT reported_properties_set_string(
+    REPORTED_PROPERTIES* properties, const CHAR* component, const CHAR* name, const CHAR* value);
+UINT reported_properties_set_writeable(REPORTED_PROPERTIES* properties,
+    const CHAR* component,
+    const CHAR* name,
+    int64_t value,
+    INT ac,
+    UINT av);
+
+// Builds everything pending into one patch without sending it, for callers that send it themselves.
+// Returns NX_NOT_FOUND when there is nothing pending. Pass sequence to reported_properties_sent once
+// the hub has accepted the patch, until then the properties stay pending.
+UINT reported_properties_build(
+    REPORTED_PROPERTIES* properties, CHAR* buffer, UINT buffer_size, UINT* length, ULONG* sequence);
+VOID reported_properties_sent(REPORTED_PROPERTIES* properties, ULONG sequence);
+
+// Builds everything pending into one patch in buffer and sends it. Values set while the send is in
+// progress stay pending for the next flush. Returns NX_NOT_FOUND when there was nothing to send.
+UINT reported_properties_flush(REPORTED_PROPERTIES* properties,
+    CHAR* buffer,
+    UINT buffer_size,
+    func_ptr_reported_properties_send send,
+    VOID* context);
+
+bool reported_properties_is_empty(REPORTED_PROPERTIES* properties);
+VOID reported_properties_metrics_get(REPORTED_PROPERTIES* properties, REPORTED_PROPERTIES_METRICS* metrics);
+
+#endif // _REPORTED_PROPERTIES_H
@@ -9,6 +9,7 @@
 #include "nxd_dns.h"
 #include "nxd_sntp_client.h"
 
+#include "dns_cache.h"
 #include "networking.h"
 
 #define SNTP_THREAD_STACK_SIZE 2048
@@ -118,11 +119,8 @@ static UINT sntp_client_run()
 
     printf("\tSNTP server %s\r\n", SNTP_SERVER[sntp_server_count]);
 
-    status = nxd_dns_host_by_name_get(&nx_dns_client,
-        (UCHAR*)SNTP_SERVER[sntp_server_count],
-        &sntp_address,
-        5 * NX_IP_PERIODIC_RATE,
-        NX_IP_VERSION_V4);
+    status = dns_cache_resolve(
+        &nx_dns_client, (CHAR*)SNTP_SERVER[sntp_server_count], &sntp_address, 5 * NX_IP_PERIODIC_RATE);
     if (status != NX_SUCCESS)
     {
         printf("\tFAIL: Unable to resolve DNS for SNTP Server %s (0x%04x)\r\n", SNTP_SERVER[sntp_server_count], status);
@@ -269,6 +267,12 @@ UINT sntp_start()
 {
     UINT status;
 
+    // Rotating through the pool should not cost a lookup each time
+    for (UINT i = 0; i < sizeof(SNTP_SERVER) / sizeof(&SNTP_SERVER); i++)
+    {
+        dns_cache_prefetch((CHAR*)SNTP_SERVER[i]);
+    }
+
     status = tx_event_flags_create(&sntp_flags, "SNTP event flags");
     if (status != TX_SUCCESS)
     {
@@ -0,0 +1,385 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "store_forward.h"
+
+#include <string.h>
+
+#include "logging.h"
+
+// True if a goes out before b in the configured replay order
+static bool replay_before(STORE_FORWARD_QUEUE* queue, const STORE_FORWARD_RECORD* a, const STORE_FORWARD_RECORD* b)
+{
+    switch (queue->config.replay_order)
+    {
+        case STORE_FORWARD_REPLAY_LIFO:
+            return a->sequence > b->sequence;
+
+        case STORE_FORWARD_REPLAY_PRIORITY:
+            return a->priority > b->priority || (a->priority == b->priority && a->sequence < b->sequence);
+
+        case STORE_FORWARD_REPLAY_FIFO:
+        default:
+            return a->sequence < b->sequence;
+    }
+}
+
+// True if a is discarded, or spilled, before b under the configured drop policy
+static bool drop_before(STORE_FORWARD_QUEUE* queue, const STORE_FORWARD_RECORD* a, const STORE_FORWARD_RECORD* b)
+{
+    switch (queue->config.drop_policy)
+    {
+        case STORE_FORWARD_DROP_NEWEST:
+            return a->sequence > b->sequence;
+
+        case STORE_FORWARD_DROP_LOWEST_PRIORITY:
+            return a->priority < b->priority || (a->priority == b->priority && a->sequence < b->sequence);
+
+        case STORE_FORWARD_DROP_OLDEST:
+        default:
+            return a->sequence < b->sequence;
+    }
+}
+
+// Index of the used slot that is not in flight and comes first by the given order, record_count if none
+static UINT find_first(STORE_FORWARD_QUEUE* queue,
+    bool (*before)(STORE_FORWARD_QUEUE*, const STORE_FORWARD_RECORD*, const STORE_FORWARD_RECORD*))
+{
+    UINT found = queue->record_count;
+    STORE_FORWARD_RECORD* record;
+
+    for (UINT i = 0; i < queue->record_count; i++)
+    {
+        record = &queue->records[i];
+        if (record->length == 0 || record->in_flight)
+        {
+            continue;
+        }
+
+        if (found == queue->record_count || before(queue, record, &queue->records[found]))
+        {
+            found = i;
+        }
+    }
+
+    return found;
+}
+
+static VOID slot_free(STORE_FORWARD_QUEUE* queue, UINT index)
+{
+    queue->records[index].length    = 0;
+    queue->records[index].in_flight = false;
+    queue->used--;
+}
+
+// Gives up a record the drop policy picked, to the backend if there is one that takes it.
+// Returns NX_SUCCESS if it was spilled, NX_NO_MORE_ENTRIES if it is lost.
+static UINT record_discard(STORE_FORWARD_QUEUE* queue, const STORE_FORWARD_RECORD* record)
+{
+    if (queue->backend != NX_NULL && queue->backend->write(queue->backend->context, record) == NX_SUCCESS)
+    {
+        queue->backend_pending = true;
+        queue->stats.spilled++;
+        return NX_SUCCESS;
+    }
+
+    queue->stats.dropped++;
+
+    return NX_NO_MORE_ENTRIES;
+}
+
+UINT store_forward_create(
+    STORE_FORWARD_QUEUE* queue, STORE_FORWARD_RECORD* records, UINT record_count, STORE_FORWARD_CONFIG* config)
+{
+    UINT status;
+
+    if (queue == NX_NULL || records == NX_NULL || record_count == 0 || config == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    memset(queue, 0, sizeof(*queue));
+    memset(records, 0, record_count * sizeof(STORE_FORWARD_RECORD));
+
+    queue->records      = records;
+    queue->record_count = record_count;
+    queue->config       = *config;
+
+    if (queue->config.batch_size == 0)
+    {
+        queue->config.batch_size = 1;
+    }
+
+    if ((status = tx_mutex_create(&queue->mutex, "store forward", TX_INHERIT)))
+    {
+        LOG_ERROR(LOG_MODULE_APP, "Failed to create store and forward mutex (0x%02x)", status);
+        return status;
+    }
+
+    return NX_SUCCESS;
+}
+
+UINT store_forward_delete(STORE_FORWARD_QUEUE* queue)
+{
+    if (queue == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    tx_mutex_delete(&queue->mutex);
+
+    return NX_SUCCESS;
+}
+
+UINT store_forward_backend_set(STORE_FORWARD_QUEUE* queue, STORE_FORWARD_BACKEND* backend)
+{
+    if (queue == NX_NULL ||
+        (backend != NX_NULL && (backend->write == NX_NULL || backend->peek == NX_NULL || backend->pop == NX_NULL)))
+    {
+        return NX_PTR_ERROR;
+    }
+
+    tx_mutex_get(&queue->mutex, TX_WAIT_FOREVER);
+
+    // The backend may still hold records from before a reset
+    queue->backend         = backend;
+    queue->backend_pending = backend != NX_NULL;
+
+    tx_mutex_put(&queue->mutex);
+
+    return NX_SUCCESS;
+}
+
+UINT store_forward_enqueue(STORE_FORWARD_QUEUE* queue, const UCHAR* data, UINT length, UINT priority)
+{
+    STORE_FORWARD_RECORD incoming;
+    STORE_FORWARD_RECORD* record = NX_NULL;
+    UINT index;
+    UINT status;
+
+    if (queue == NX_NULL || data == NX_NULL || length == 0)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    if (length > STORE_FORWARD_PAYLOAD_SIZE)
+    {
+        LOG_ERROR(LOG_MODULE_APP, "Record of %d bytes is too large to store", length);
+        return NX_SIZE_ERROR;
+    }
+
+    tx_mutex_get(&queue->mutex, TX_WAIT_FOREVER);
+
+    incoming.sequence   = queue->next_sequence++;
+    incoming.send_order = 0;
+    incoming.length     = length;
+    incoming.priority   = priority;
+    incoming.in_flight  = false;
+
+    if (queue->used == queue->record_count)
+    {
+        // The drop policy weighs the new record against the stored ones, records in flight are held
+        // until they are settled and can't be given up
+        index = find_first(queue, drop_before);
+        if (index == queue->record_count || drop_before(queue, &incoming, &queue->records[index]))
+        {
+            memcpy(incoming.data, data, length);
+            if ((status = record_discard(queue, &incoming)) == NX_SUCCESS)
+            {
+                queue->stats.enqueued++;
+            }
+
+            tx_mutex_put(&queue->mutex);
+            return status;
+        }
+
+        record_discard(queue, &queue->records[index]);
+        slot_free(queue, index);
+    }
+
+    for (UINT i = 0; i < queue->record_count; i++)
+    {
+        if (queue->records[i].length == 0)
+        {
+            record = &queue->records[i];
+            break;
+        }
+    }
+
+    record->sequence   = incoming.sequence;
+    record->send_order = 0;
+    record->length     = length;
+    record->priority   = priority;
+    record->in_flight  = false;
+    memcpy(record->data, data, length);
+
+    queue->used++;
+    queue->stats.enqueued++;
+    if (queue->used > queue->stats.high_water_mark)
+    {
+        queue->stats.high_water_mark = queue->used;
+    }
+
+    tx_mutex_put(&queue->mutex);
+
+    return NX_SUCCESS;
+}
+
+UINT store_forward_drain(STORE_FORWARD_QUEUE* queue, func_ptr_store_forward_send send, VOID* context)
+{
+    STORE_FORWARD_RECORD backend_record;
+    STORE_FORWARD_RECORD* record;
+    ULONG now   = tx_time_get();
+    UINT index  = 0;
+    UINT status = NX_SUCCESS;
+
+    if (queue == NX_NULL || send == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    // The mutex is held while sending so records cannot be evicted from under us
+    tx_mutex_get(&queue->mutex, TX_WAIT_FOREVER);
+
+    // Pace the replay so a backlog does not swamp the link straight after reconnecting
+    if (queue->stats.sent != 0 && now - queue->last_drain < queue->config.drain_interval)
+    {
+        tx_mutex_put(&queue->mutex);
+        return NX_SUCCESS;
+    }
+
+    queue->last_drain = now;
+
+    for (UINT count = 0; count < queue->config.batch_size; count++)
+    {
+        // The backend only shows its head, so nothing can go past it until it is acknowledged
+        if (queue->backend_in_flight)
+        {
+            break;
+        }
+
+        record = NX_NULL;
+        index  = find_first(queue, replay_before);
+        if (index != queue->record_count)
+        {
+            record = &queue->records[index];
+        }
+
+        // Spilled records compete with RAM in the same replay order
+        if (queue->backend_pending)
+        {
+            if (queue->backend->peek(queue->backend->context, &backend_record) != NX_SUCCESS)
+            {
+                queue->backend_pending = false;
+            }
+            else if (record == NX_NULL || replay_before(queue, &backend_record, record))
+            {
+                record = &backend_record;
+            }
+        }
+
+        if (record == NX_NULL)
+        {
+            break;
+        }
+
+        // Mark it first, the send may settle earlier records on its way through
+        record->in_flight  = true;
+        record->send_order = queue->next_send_order++;
+        if (record == &backend_record)
+        {
+            queue->backend_in_flight  = true;
+            queue->backend_send_order = record->send_order;
+        }
+
+        if ((status = send(context, record->data, record->length)))
+        {
+            record->in_flight        = false;
+            queue->backend_in_flight = false;
+            queue->next_send_order--;
+            break;
+        }
+    }
+
+    tx_mutex_put(&queue->mutex);
+
+    return status;
+}
+
+UINT store_forward_complete(STORE_FORWARD_QUEUE* queue, UINT status)
+{
+    ULONG oldest = 0;
+    UINT index   = 0;
+    bool found   = false;
+
+    if (queue == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    tx_mutex_get(&queue->mutex, TX_WAIT_FOREVER);
+
+    // Oldest send still in flight, counted relative to the next one so the order survives wrapping
+    if (queue->backend_in_flight)
+    {
+        oldest = queue->backend_send_order;
+        found  = true;
+    }
+
+    for (UINT i = 0; i < queue->record_count; i++)
+    {
+        if (queue->records[i].length != 0 && queue->records[i].in_flight &&
+            (!found ||
+                queue->next_send_order - queue->records[i].send_order > queue->next_send_order - oldest))
+        {
+            oldest = queue->records[i].send_order;
+            index  = i;
+            found  = true;
+        }
+    }
+
+    if (!found)
+    {
+        tx_mutex_put(&queue->mutex);
+        return NX_NOT_FOUND;
+    }
+
+    if (queue->backend_in_flight && oldest == queue->backend_send_order)
+    {
+        queue->backend_in_flight = false;
+        if (status == NX_SUCCESS)
+        {
+            queue->backend->pop(queue->backend->context);
+        }
+    }
+    else if (status == NX_SUCCESS)
+    {
+        slot_free(queue, index);
+    }
+    else
+    {
+        // Not acknowledged, it goes out again on a later drain
+        queue->records[index].in_flight = false;
+    }
+
+    if (status == NX_SUCCESS)
+    {
+        queue->stats.sent++;
+    }
+
+    tx_mutex_put(&queue->mutex);
+
+    return NX_SUCCESS;
+}
+
+bool store_forward_is_empty(STORE_FORWARD_QUEUE* queue)
+{
+    return queue->used == 0 && !queue->backend_pending;
+}
+
+VOID store_forward_stats_get(STORE_FORWARD_QUEUE* queue, STORE_FORWARD_STATS* stats)
+{
+    tx_mutex_get(&queue->mutex, TX_WAIT_FOREVER);
+    *stats = queue->stats;
+    tx_mutex_put(&queue->mutex);
+}
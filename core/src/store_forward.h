@@ -0,0 +1,110 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _STORE_FORWARD_H
+#define _STORE_FORWARD_H
+
+#include <stdbool.h>
+
+#include "tx_api.h"
+
+#include "nx_api.h"
+
+// Largest payload a single record can hold
+#ifndef STORE_FORWARD_PAYLOAD_SIZE
+#define STORE_FORWARD_PAYLOAD_SIZE 256
+#endif
+
+// What to discard when RAM is full and there is no backend to spill to
+#define STORE_FORWARD_DROP_OLDEST          0
+#define STORE_FORWARD_DROP_NEWEST          1
+#define STORE_FORWARD_DROP_LOWEST_PRIORITY 2
+
+// Order records are replayed in once the connection is back
+#define STORE_FORWARD_REPLAY_FIFO     0
+#define STORE_FORWARD_REPLAY_LIFO     1
+#define STORE_FORWARD_REPLAY_PRIORITY 2
+
+#define STORE_FORWARD_PRIORITY_LOW    0
+#define STORE_FORWARD_PRIORITY_NORMAL 1
+#define STORE_FORWARD_PRIORITY_HIGH   2
+
+typedef struct STORE_FORWARD_RECORD_STRUCT
+{
+    ULONG sequence;
+    ULONG send_order; // Position among the records in flight
+    USHORT length;    // 0 if the slot is free
+    UCHAR priority;
+    UCHAR in_flight; // Sent, held until store_forward_complete settles it
+    UCHAR data[STORE_FORWARD_PAYLOAD_SIZE];
+} STORE_FORWARD_RECORD;
+
+// Secondary storage, e.g. flash, that takes the records the drop policy would discard when RAM fills up.
+// peek returns the oldest stored record without removing it, or NX_NOT_FOUND when empty.
+typedef struct STORE_FORWARD_BACKEND_STRUCT
+{
+    UINT (*write)(VOID* context, const STORE_FORWARD_RECORD* record);
+    UINT (*peek)(VOID* context, STORE_FORWARD_RECORD* record);
+    UINT (*pop)(VOID* context);
+    VOID* context;
+} STORE_FORWARD_BACKEND;
+
+typedef struct STORE_FORWARD_CONFIG_STRUCT
+{
+    UINT drop_policy;
+    UINT replay_order;
+    UINT batch_size;      // Records sent per drain
+    ULONG drain_interval; // Minimum ticks between drains
+} STORE_FORWARD_CONFIG;
+
+typedef struct STORE_FORWARD_STATS_STRUCT
+{
+    ULONG enqueued;
+    ULONG sent; // Acknowledged by the broker, not just handed to NetX
+    ULONG dropped;
+    ULONG spilled;
+    UINT high_water_mark; // Most records held in RAM at once
+} STORE_FORWARD_STATS;
+
+typedef struct STORE_FORWARD_QUEUE_STRUCT
+{
+    TX_MUTEX mutex;
+
+    STORE_FORWARD_RECORD* records;
+    UINT record_count;
+    UINT used;
+
+    ULONG next_sequence;
+    ULONG last_drain;
+
+    STORE_FORWARD_CONFIG config;
+    STORE_FORWARD_BACKEND* backend;
+    bool backend_pending;   // Backend may hold records, cleared once it reports empty
+    bool backend_in_flight; // The backend head has been sent and is not popped yet
+    ULONG backend_send_order;
+
+    ULONG next_send_order;
+
+    STORE_FORWARD_STATS stats;
+} STORE_FORWARD_QUEUE;
+
+// Sends one record, anything other than NX_SUCCESS leaves it queued and stops the drain. A record that
+// was sent stays in the queue until store_forward_complete reports the broker acknowledged it.
+typedef UINT (*func_ptr_store_forward_send)(VOID* context, UCHAR* data, UINT length);
+
+UINT store_forward_create(
+    STORE_FORWARD_QUEUE* queue, STORE_FORWARD_RECORD* records, UINT record_count, STORE_FORWARD_CONFIG* config);
+UINT store_forward_delete(STORE_FORWARD_QUEUE* queue);
+UINT store_forward_backend_set(STORE_FORWARD_QUEUE* queue, STORE_FORWARD_BACKEND* backend);
+
+UINT store_forward_enqueue(STORE_FORWARD_QUEUE* queue, const UCHAR* data, UINT length, UINT priority);
+UINT store_forward_drain(STORE_FORWARD_QUEUE* queue, func_ptr_store_forward_send send, VOID* context);
+
+// Settles the oldest record in flight, completions must arrive in the order the records were sent, as
+// QoS 1 PUBACKs do. NX_SUCCESS releases it, anything else puts it back to be sent again.
+UINT store_forward_complete(STORE_FORWARD_QUEUE* queue, UINT status);
+
+bool store_forward_is_empty(STORE_FORWARD_QUEUE* queue);
+VOID store_forward_stats_get(STORE_FORWARD_QUEUE* queue, STORE_FORWARD_STATS* stats);
+
+#endif // _STORE_FORWARD_H
@@ -0,0 +1,237 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "work_queue.h"
+
+#include <string.h>
+
+#define WAKE_EVENT 0x01
+
+// Tick comparisons that survive the counter wrapping
+#define TICKS_BEFORE(a, b) ((LONG)((a) - (b)) < 0)
+
+static UINT post(WORK_QUEUE* queue, func_ptr_work handler, VOID* context, UINT priority, ULONG ready, ULONG deadline)
+{
+    TX_INTERRUPT_SAVE_AREA
+    WORK_ITEM* item = NX_NULL;
+
+    if (queue == NX_NULL || handler == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    if (priority >= WORK_PRIORITY_COUNT)
+    {
+        return NX_OPTION_ERROR;
+    }
+
+    TX_DISABLE
+
+    queue->metrics.posted++;
+
+    for (UINT i = 0; i < WORK_QUEUE_DEPTH; i++)
+    {
+        if (queue->items[i].handler == handler && queue->items[i].context == context)
+        {
+            // One pending run covers both posts, handlers post themselves again while there is more
+            item = &queue->items[i];
+            queue->metrics.coalesced++;
+
+            if (priority < item->priority)
+            {
+                item->priority = priority;
+            }
+
+            if (TICKS_BEFORE(ready, item->ready))
+            {
+                item->ready = ready;
+            }
+
+            if (TICKS_BEFORE(deadline, item->deadline))
+            {
+                item->deadline = deadline;
+            }
+
+            break;
+        }
+
+        if (item == NX_NULL && queue->items[i].handler == NX_NULL)
+        {
+            item = &queue->items[i];
+        }
+    }
+
+    if (item == NX_NULL)
+    {
+        queue->metrics.dropped++;
+        TX_RESTORE
+        return NX_NO_MORE_ENTRIES;
+    }
+
+    if (item->handler == NX_NULL)
+    {
+        item->handler  = handler;
+        item->context  = context;
+        item->priority = priority;
+        item->ready    = ready;
+        item->deadline = deadline;
+
+        if (++queue->depth > queue->metrics.max_depth)
+        {
+            queue->metrics.max_depth = queue->depth;
+        }
+    }
+
+    TX_RESTORE
+
+    tx_event_flags_set(&queue->wake, WAKE_EVENT, TX_OR);
+
+    return NX_SUCCESS;
+}
+
+// Late items go first by deadline, the rest by priority and then deadline
+static bool runs_before(WORK_ITEM* item, bool item_late, WORK_ITEM* other, bool other_late)
+{
+    if (item_late != other_late)
+    {
+        return item_late;
+    }
+
+    if (!item_late && item->priority != other->priority)
+    {
+        return item->priority < other->priority;
+    }
+
+    return TICKS_BEFORE(item->deadline, other->deadline);
+}
+
+// Takes the item to run next out of the queue, or returns false with the ticks until one is due
+static bool take(WORK_QUEUE* queue, WORK_ITEM* next, ULONG* wait_option)
+{
+    TX_INTERRUPT_SAVE_AREA
+    WORK_ITEM* best = NX_NULL;
+    WORK_ITEM* item;
+    ULONG now = tx_time_get();
+    ULONG latency;
+    bool late;
+    bool best_late = false;
+
+    *wait_option = TX_WAIT_FOREVER;
+
+    TX_DISABLE
+
+    for (UINT i = 0; i < WORK_QUEUE_DEPTH; i++)
+    {
+        item = &queue->items[i];
+        if (item->handler == NX_NULL)
+        {
+            continue;
+        }
+
+        if (TICKS_BEFORE(now, item->ready))
+        {
+            if (item->ready - now < *wait_option)
+            {
+                *wait_option = item->ready - now;
+            }
+            continue;
+        }
+
+        late = !TICKS_BEFORE(now, item->deadline);
+        if (best == NX_NULL || runs_before(item, late, best, best_late))
+        {
+            best      = item;
+            best_late = late;
+        }
+    }
+
+    if (best != NX_NULL)
+    {
+        *next         = *best;
+        best->handler = NX_NULL;
+        queue->depth--;
+
+        latency = now - next->ready;
+        if (latency > queue->metrics.max_latency)
+        {
+            queue->metrics.max_latency = latency;
+        }
+
+        if (best_late)
+        {
+            queue->metrics.late++;
+        }
+
+        queue->metrics.run++;
+    }
+
+    TX_RESTORE
+
+    return best != NX_NULL;
+}
+
+UINT work_queue_create(WORK_QUEUE* queue, CHAR* name)
+{
+    if (queue == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    memset(queue, 0, sizeof(*queue));
+
+    return tx_event_flags_create(&queue->wake, name);
+}
+
+UINT work_queue_delete(WORK_QUEUE* queue)
+{
+    if (queue == NX_NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    return tx_event_flags_delete(&queue->wake);
+}
+
+UINT work_queue_post(WORK_QUEUE* queue, func_ptr_work handler, VOID* context, UINT priority, ULONG deadline)
+{
+    ULONG now = tx_time_get();
+
+    return post(queue, handler, context, priority, now, now + deadline);
+}
+
+UINT work_queue_schedule(
+    WORK_QUEUE* queue, func_ptr_work handler, VOID* context, UINT priority, ULONG delay, ULONG deadline)
+{
+    ULONG ready = tx_time_get() + delay;
+
+    return post(queue, handler, context, priority, ready, ready + deadline);
+}
+
+VOID work_queue_run(WORK_QUEUE* queue)
+{
+    WORK_ITEM item;
+    ULONG wait_option;
+    ULONG events;
+
+    while (true)
+    {
+        if (take(queue, &item, &wait_option))
+        {
+            item.handler(item.context);
+            continue;
+        }
+
+        // A post between take and here leaves the flag set, so nothing is missed
+        tx_event_flags_get(&queue->wake, WAKE_EVENT, TX_OR_CLEAR, &events, wait_option);
+        queue->metrics.wakeups++;
+    }
+}
+
+VOID work_queue_metrics_get(WORK_QUEUE* queue, WORK_QUEUE_METRICS* metrics)
+{
+    TX_INTERRUPT_SAVE_AREA
+
+    TX_DISABLE
+    *metrics = queue->metrics;
+    TX_RESTORE
+}
@@ -0,0 +1,71 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _WORK_QUEUE_H
+#define _WORK_QUEUE_H
+
+#include <stdbool.h>
+
+#include "tx_api.h"
+
+#include "nx_api.h"
+
+// Distinct items that can be pending at once, posting an item that is already pending merges the two
+#ifndef WORK_QUEUE_DEPTH
+#define WORK_QUEUE_DEPTH 8
+#endif
+
+#define WORK_PRIORITY_URGENT 0 // Answers the hub is waiting for, e.g. method responses and twin acks
+#define WORK_PRIORITY_NORMAL 1
+#define WORK_PRIORITY_BULK   2 // Batched sends that can wait, e.g. telemetry replay
+#define WORK_PRIORITY_COUNT  3
+
+// Should do one bounded piece of work and post itself again if more remains, so that
+// more urgent items get in between
+typedef VOID (*func_ptr_work)(VOID* context);
+
+typedef struct WORK_ITEM_STRUCT
+{
+    func_ptr_work handler; // NX_NULL when the slot is free
+    VOID* context;
+    UCHAR priority;
+    ULONG ready;    // Not run before this tick
+    ULONG deadline; // Once past it the item goes ahead of every priority
+} WORK_ITEM;
+
+typedef struct WORK_QUEUE_METRICS_STRUCT
+{
+    ULONG posted;
+    ULONG coalesced;   // Merged into an item already pending
+    ULONG dropped;     // Queue was full
+    ULONG run;
+    ULONG late;        // Started after their deadline
+    ULONG max_latency; // Most ticks from due to start
+    UINT max_depth;    // Most items pending at once
+    ULONG wakeups;
+} WORK_QUEUE_METRICS;
+
+typedef struct WORK_QUEUE_STRUCT
+{
+    TX_EVENT_FLAGS_GROUP wake;
+
+    WORK_ITEM items[WORK_QUEUE_DEPTH];
+    UINT depth;
+
+    WORK_QUEUE_METRICS metrics;
+} WORK_QUEUE;
+
+UINT work_queue_create(WORK_QUEUE* queue, CHAR* name);
+UINT work_queue_delete(WORK_QUEUE* queue);
+
+// Both are safe from threads, timers and ISRs. Deadline is in ticks from when the item is due.
+UINT work_queue_post(WORK_QUEUE* queue, func_ptr_work handler, VOID* context, UINT priority, ULONG deadline);
+UINT work_queue_schedule(
+    WORK_QUEUE* queue, func_ptr_work handler, VOID* context, UINT priority, ULONG delay, ULONG deadline);
+
+// Runs items on the calling thread forever. The thread only wakes when an item is posted or due.
+VOID work_queue_run(WORK_QUEUE* queue);
+
+VOID work_queue_metrics_get(WORK_QUEUE* queue, WORK_QUEUE_METRICS* metrics);
+
+#endif // _WORK_QUEUE_H
@@ -0,0 +1,157 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// JSON number formatting against the snprintf calls it replaced, for telemetry sized values. The
+// host printf is glibc rather than the newlib-nano the boards link, so the ratios are indicative.
+// Before timing, fixed mode must match printf and shortest mode must read back exactly.
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "number_format.h"
+
+#include "test_common.h"
+
+#define VALUE_COUNT 1024
+
+static double values[VALUE_COUNT];
+static int32_t integers[VALUE_COUNT];
+
+static uint64_t random_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t random_next(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+
+    return random_state;
+}
+
+// Any finite double, to exercise every exponent in shortest mode
+static double random_bits_double(void)
+{
+    double value;
+
+    do
+    {
+        uint64_t bits = random_next();
+        memcpy(&value, &bits, sizeof(value));
+    } while (!isfinite(value));
+
+    return value;
+}
+
+static void check(unsigned long count)
+{
+    char out[NUMBER_FORMAT_BUFFER_SIZE];
+    char expected[64];
+
+    for (unsigned long i = 0; i < count; i++)
+    {
+        double telemetry = values[i % VALUE_COUNT] + (double)(random_next() % 1000) / 7.0;
+        double any       = random_bits_double();
+        float any_float  = (float)any;
+
+        // printf rounds exact ties to even where fixed mode rounds them away from zero, and keeps the
+        // sign of a negative value that rounds to zero
+        TEST_ASSERT(number_format_double(telemetry, 2, out, sizeof(out)) > 0);
+        snprintf(expected, sizeof(expected), "%.2f", telemetry);
+        TEST_ASSERT(strcmp(out, expected) == 0 || fabs(telemetry * 100 - trunc(telemetry * 100)) == 0.5 ||
+                    (strcmp(expected, "-0.00") == 0 && strcmp(out, "0.00") == 0));
+
+        TEST_ASSERT(number_format_double(any, NUMBER_FORMAT_SHORTEST, out, sizeof(out)) > 0);
+        TEST_ASSERT(strtod(out, NULL) == any);
+
+        if (isfinite(any_float))
+        {
+            TEST_ASSERT(number_format_float(any_float, NUMBER_FORMAT_SHORTEST, out, sizeof(out)) > 0);
+            TEST_ASSERT(strtof(out, NULL) == any_float);
+        }
+
+        TEST_ASSERT(number_format_int32(integers[i % VALUE_COUNT], out, sizeof(out)) > 0);
+        snprintf(expected, sizeof(expected), "%ld", (long)integers[i % VALUE_COUNT]);
+        TEST_ASSERT(strcmp(out, expected) == 0);
+    }
+}
+
+typedef size_t (*func_ptr_format)(double value, char* out, size_t out_size);
+
+static size_t format_fixed(double value, char* out, size_t out_size)
+{
+    return number_format_double(value, 2, out, out_size);
+}
+
+static size_t format_shortest(double value, char* out, size_t out_size)
+{
+    return number_format_double(value, NUMBER_FORMAT_SHORTEST, out, out_size);
+}
+
+static size_t printf_fixed(double value, char* out, size_t out_size)
+{
+    return snprintf(out, out_size, "%.2f", value);
+}
+
+static size_t printf_shortest(double value, char* out, size_t out_size)
+{
+    return snprintf(out, out_size, "%.17g", value);
+}
+
+static size_t format_int32(double value, char* out, size_t out_size)
+{
+    return number_format_int32((int32_t)value, out, out_size);
+}
+
+static size_t printf_int32(double value, char* out, size_t out_size)
+{
+    return snprintf(out, out_size, "%ld", (long)(int32_t)value);
+}
+
+static double measure(func_ptr_format format, const double* inputs, unsigned long iterations, unsigned long* checksum)
+{
+    char out[64];
+    double start = test_seconds();
+
+    for (unsigned long i = 0; i < iterations; i++)
+    {
+        *checksum += format(inputs[i % VALUE_COUNT], out, sizeof(out));
+    }
+
+    return (test_seconds() - start) * 1e9 / iterations;
+}
+
+int main(int argc, char** argv)
+{
+    static double integer_values[VALUE_COUNT];
+    unsigned long iterations = test_iterations(argc, argv, 1000000);
+    unsigned long checksum   = 0;
+    double ours;
+    double theirs;
+
+    // Sensor readings, e.g. temperature, pressure and humidity, with a few digits after the point
+    for (int i = 0; i < VALUE_COUNT; i++)
+    {
+        values[i]         = ((double)(random_next() % 2000000) - 1000000.0) / 1000.0;
+        integers[i]       = (int32_t)random_next();
+        integer_values[i] = integers[i];
+    }
+
+    check(iterations < 100000 ? iterations : 100000);
+
+    ours   = measure(format_fixed, values, iterations, &checksum);
+    theirs = measure(printf_fixed, values, iterations, &checksum);
+    printf("fixed 2 decimals  %6.1f ns, snprintf %%.2f  %6.1f ns\n", ours, theirs);
+
+    ours   = measure(format_shortest, values, iterations, &checksum);
+    theirs = measure(printf_shortest, values, iterations, &checksum);
+    printf("shortest          %6.1f ns, snprintf %%.17g %6.1f ns\n", ours, theirs);
+
+    ours   = measure(format_int32, integer_values, iterations, &checksum);
+    theirs = measure(printf_int32, integer_values, iterations, &checksum);
+    printf("int32             %6.1f ns, snprintf %%ld   %6.1f ns\n", ours, theirs);
+
+    printf("checksum %lu\n", checksum);
+
+    return 0;
+}
@@ -0,0 +1,190 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// Inbound topic dispatch, the prefix trie against the strstr chain it replaced. Both sides pick the
+// handler and pull out the fields the handlers read, over a mix of the four Hub topic families.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "azure_iot_mqtt_router.h"
+
+#include "test_common.h"
+
+#define C2D_BASE          "devices/bench-device-0001/messages/devicebound/"
+#define METHOD_BASE       "$iothub/methods/POST/"
+#define TWIN_RES_BASE     "$iothub/twin/res/"
+#define TWIN_DESIRED_BASE "$iothub/twin/PATCH/properties/desired/"
+
+static const CHAR* topics[] = {
+    METHOD_BASE "setLedState/?$rid=1",
+    C2D_BASE "%24.to=%2Fdevices%2Fbench-device-0001%2Fmessages%2FdeviceBound&color=red",
+    TWIN_RES_BASE "200/?$rid=42",
+    TWIN_DESIRED_BASE "?$version=17",
+    TWIN_RES_BASE "204/?$rid=43&$version=18",
+    METHOD_BASE "reboot/?$rid=2",
+};
+
+#define TOPIC_COUNT (sizeof(topics) / sizeof(topics[0]))
+
+typedef struct RESULT_STRUCT
+{
+    UINT route;
+    UINT value; // rid, status or version, depending on the route
+} RESULT;
+
+static RESULT trie_result;
+
+static VOID on_c2d(VOID* context, AZURE_IOT_MQTT_TOPIC_FIELDS* fields, AZURE_IOT_MQTT_MESSAGE* message)
+{
+    trie_result.route = 1;
+    trie_result.value = fields->properties.length;
+}
+
+static VOID on_method(VOID* context, AZURE_IOT_MQTT_TOPIC_FIELDS* fields, AZURE_IOT_MQTT_MESSAGE* message)
+{
+    trie_result.route = 2;
+    trie_result.value = azure_iot_mqtt_span_to_uint(fields->request_id);
+}
+
+static VOID on_twin_res(VOID* context, AZURE_IOT_MQTT_TOPIC_FIELDS* fields, AZURE_IOT_MQTT_MESSAGE* message)
+{
+    trie_result.route = 3;
+    trie_result.value = azure_iot_mqtt_span_to_uint(fields->name);
+}
+
+static VOID on_twin_desired(VOID* context, AZURE_IOT_MQTT_TOPIC_FIELDS* fields, AZURE_IOT_MQTT_MESSAGE* message)
+{
+    trie_result.route = 4;
+    trie_result.value = azure_iot_mqtt_span_to_uint(fields->version);
+}
+
+typedef CHAR* (*func_ptr_strstr)(const CHAR*, const CHAR*);
+
+// Byte at a time search, the way newlib-nano implements strstr on the boards. The host libc one is
+// vectorised, which flatters the old path.
+static CHAR* bytewise_strstr(const CHAR* haystack, const CHAR* needle)
+{
+    size_t needle_length = strlen(needle);
+
+    for (; *haystack != 0; haystack++)
+    {
+        if (strncmp(haystack, needle, needle_length) == 0)
+        {
+            return (CHAR*)haystack;
+        }
+    }
+
+    return NULL;
+}
+
+// The receive path before the trie: copy into a terminated buffer, then strstr for each family
+static RESULT strstr_dispatch(const CHAR* topic, UINT topic_length, func_ptr_strstr find_str)
+{
+    CHAR buffer[256];
+    RESULT result = {0};
+    CHAR* find;
+
+    memcpy(buffer, topic, topic_length);
+    buffer[topic_length] = 0;
+
+    if (find_str(buffer, METHOD_BASE))
+    {
+        result.route = 2;
+        if ((find = find_str(buffer + sizeof(METHOD_BASE) - 1, "$rid=")))
+        {
+            result.value = atoi(find + 5);
+        }
+    }
+    else if (find_str(buffer, "messages/devicebound/"))
+    {
+        result.route = 1;
+        if ((find = find_str(find_str(buffer, ".to"), "&")))
+        {
+            result.value = strlen(find + 1);
+        }
+    }
+    else if (find_str(buffer, TWIN_RES_BASE))
+    {
+        result.route = 3;
+        result.value = atoi(buffer + sizeof(TWIN_RES_BASE) - 1);
+    }
+    else if (find_str(buffer, TWIN_DESIRED_BASE))
+    {
+        result.route = 4;
+        if ((find = find_str(buffer + sizeof(TWIN_DESIRED_BASE) - 1, "$version=")))
+        {
+            result.value = atoi(find + 9);
+        }
+    }
+
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    AZURE_IOT_MQTT_ROUTER router;
+    UINT lengths[TOPIC_COUNT];
+    unsigned long iterations = test_iterations(argc, argv, 1000000);
+    unsigned long checksum   = 0;
+    double start;
+    double trie_seconds;
+    double libc_seconds;
+    double bytewise_seconds;
+    RESULT expected;
+
+    TEST_ASSERT(azure_iot_mqtt_router_init(&router) == NX_SUCCESS);
+    TEST_ASSERT(azure_iot_mqtt_router_add(&router, C2D_BASE, sizeof(C2D_BASE) - 1, on_c2d) == NX_SUCCESS);
+    TEST_ASSERT(azure_iot_mqtt_router_add(&router, METHOD_BASE, sizeof(METHOD_BASE) - 1, on_method) == NX_SUCCESS);
+    TEST_ASSERT(
+        azure_iot_mqtt_router_add(&router, TWIN_RES_BASE, sizeof(TWIN_RES_BASE) - 1, on_twin_res) == NX_SUCCESS);
+    TEST_ASSERT(azure_iot_mqtt_router_add(
+                    &router, TWIN_DESIRED_BASE, sizeof(TWIN_DESIRED_BASE) - 1, on_twin_desired) == NX_SUCCESS);
+
+    // Both paths must agree before their times mean anything
+    for (UINT i = 0; i < TOPIC_COUNT; i++)
+    {
+        lengths[i] = strlen(topics[i]);
+        expected   = strstr_dispatch(topics[i], lengths[i], bytewise_strstr);
+
+        TEST_ASSERT(azure_iot_mqtt_router_dispatch(&router, topics[i], lengths[i], NX_NULL, NX_NULL) == NX_SUCCESS);
+        TEST_ASSERT(trie_result.route == expected.route);
+        TEST_ASSERT(trie_result.value == expected.value);
+        TEST_ASSERT(strstr_dispatch(topics[i], lengths[i], (func_ptr_strstr)strstr).value == expected.value);
+    }
+
+    TEST_ASSERT(azure_iot_mqtt_router_dispatch(&router, "$iothub/unknown", 15, NX_NULL, NX_NULL) == NX_NOT_FOUND);
+
+    start = test_seconds();
+    for (unsigned long i = 0; i < iterations; i++)
+    {
+        azure_iot_mqtt_router_dispatch(
+            &router, topics[i % TOPIC_COUNT], lengths[i % TOPIC_COUNT], NX_NULL, NX_NULL);
+        checksum += trie_result.value;
+    }
+    trie_seconds = test_seconds() - start;
+
+    start = test_seconds();
+    for (unsigned long i = 0; i < iterations; i++)
+    {
+        checksum += strstr_dispatch(topics[i % TOPIC_COUNT], lengths[i % TOPIC_COUNT], (func_ptr_strstr)strstr).value;
+    }
+    libc_seconds = test_seconds() - start;
+
+    start = test_seconds();
+    for (unsigned long i = 0; i < iterations; i++)
+    {
+        checksum += strstr_dispatch(topics[i % TOPIC_COUNT], lengths[i % TOPIC_COUNT], bytewise_strstr).value;
+    }
+    bytewise_seconds = test_seconds() - start;
+
+    printf("router: %lu topics, trie %.1f ns/topic, strstr chain %.1f ns/topic with libc strstr, "
+           "%.1f ns/topic with byte-wise strstr (checksum %lu)\n",
+        iterations,
+        trie_seconds * 1e9 / iterations,
+        libc_seconds * 1e9 / iterations,
+        bytewise_seconds * 1e9 / iterations,
+        checksum);
+
+    return 0;
+}
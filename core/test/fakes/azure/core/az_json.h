@@ -0,0 +1,112 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// The az_span and az_json_token parts of the Azure SDK for C that core code touches directly. As in the
+// SDK, a token that straddles buffers has only its part in the last buffer as slice, and
+// az_json_token_copy_into_span puts the whole token together.
+
+#ifndef _AZ_JSON_H
+#define _AZ_JSON_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef struct
+{
+    struct
+    {
+        uint8_t* ptr;
+        int32_t size;
+    } _internal;
+} az_span;
+
+#define AZ_SPAN_LITERAL_FROM_STR(STRING_LITERAL)                                                                       \
+    {                                                                                                                  \
+        ._internal = {.ptr = (uint8_t*)(STRING_LITERAL), .size = sizeof(STRING_LITERAL) - 1 }                          \
+    }
+
+static inline az_span az_span_create(uint8_t* ptr, int32_t size)
+{
+    az_span span = {._internal = {.ptr = ptr, .size = size}};
+
+    return span;
+}
+
+static inline uint8_t* az_span_ptr(az_span span)
+{
+    return span._internal.ptr;
+}
+
+static inline int32_t az_span_size(az_span span)
+{
+    return span._internal.size;
+}
+
+// Index of the first occurrence of target, -1 if there is none
+static inline int32_t az_span_find(az_span source, az_span target)
+{
+    for (int32_t i = 0; i + target._internal.size <= source._internal.size; i++)
+    {
+        if (memcmp(source._internal.ptr + i, target._internal.ptr, (size_t)target._internal.size) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+typedef enum
+{
+    AZ_JSON_TOKEN_NONE,
+    AZ_JSON_TOKEN_BEGIN_OBJECT,
+    AZ_JSON_TOKEN_END_OBJECT,
+    AZ_JSON_TOKEN_BEGIN_ARRAY,
+    AZ_JSON_TOKEN_END_ARRAY,
+    AZ_JSON_TOKEN_PROPERTY_NAME,
+    AZ_JSON_TOKEN_STRING,
+    AZ_JSON_TOKEN_NUMBER,
+    AZ_JSON_TOKEN_TRUE,
+    AZ_JSON_TOKEN_FALSE,
+    AZ_JSON_TOKEN_NULL,
+} az_json_token_kind;
+
+typedef struct
+{
+    az_span slice; // The part of the token in its last buffer
+    az_json_token_kind kind;
+    int32_t size; // The whole token, without the quotes of a string
+
+    struct
+    {
+        bool is_multisegment;
+        bool string_has_escaped_chars;
+        az_span* pointer_to_first_buffer;
+        int32_t start_buffer_index;
+        int32_t start_buffer_offset;
+        int32_t end_buffer_index;
+        int32_t end_buffer_offset; // One past the last byte
+    } _internal;
+} az_json_token;
+
+typedef struct
+{
+    az_json_token token;
+    int32_t current_depth;
+
+    struct
+    {
+        az_span* json_buffers;
+        int32_t number_of_buffers;
+        int32_t buffer_index;
+        int32_t buffer_offset;
+        uint64_t object_stack; // Bit per nesting level, set for an object and clear for an array
+        bool expect_property_name;
+    } _internal;
+} az_json_reader;
+
+// Copies the whole token into destination and returns what is left of it, destination must be large enough
+az_span az_json_token_copy_into_span(az_json_token const* json_token, az_span destination);
+
+#endif // _AZ_JSON_H
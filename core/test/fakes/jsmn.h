@@ -0,0 +1,39 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// The declarations of jsmn that core headers use, the submodule is not needed to build the tests.
+// A test that links code calling the parser supplies its own jsmn_init and jsmn_parse.
+
+#ifndef _JSMN_H
+#define _JSMN_H
+
+#include <stddef.h>
+
+typedef enum
+{
+    JSMN_UNDEFINED = 0,
+    JSMN_OBJECT    = 1,
+    JSMN_ARRAY     = 2,
+    JSMN_STRING    = 3,
+    JSMN_PRIMITIVE = 4
+} jsmntype_t;
+
+typedef struct jsmntok
+{
+    jsmntype_t type;
+    int start;
+    int end;
+    int size;
+} jsmntok_t;
+
+typedef struct jsmn_parser
+{
+    unsigned int pos;
+    unsigned int toknext;
+    int toksuper;
+} jsmn_parser;
+
+void jsmn_init(jsmn_parser* parser);
+int jsmn_parse(jsmn_parser* parser, const char* js, const size_t len, jsmntok_t* tokens, const unsigned int num_tokens);
+
+#endif // _JSMN_H
@@ -0,0 +1,77 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// Host stand-in for the NetX Duo packet API, packets are heap allocated from a pool of fixed payload size
+
+#ifndef _NX_API_H
+#define _NX_API_H
+
+#include "tx_api.h"
+
+#define NX_NULL  0
+#define NX_TRUE  1
+#define NX_FALSE 0
+
+#define NX_NO_WAIT      TX_NO_WAIT
+#define NX_WAIT_FOREVER TX_WAIT_FOREVER
+
+#define NX_IP_PERIODIC_RATE TX_TIMER_TICKS_PER_SECOND
+
+#define NX_SUCCESS            0x00
+#define NX_NO_PACKET          0x01
+#define NX_PTR_ERROR          0x07
+#define NX_SIZE_ERROR         0x09
+#define NX_OPTION_ERROR       0x0A
+#define NX_NO_MORE_ENTRIES    0x17
+#define NX_IN_PROGRESS        0x37
+#define NX_NOT_CONNECTED      0x38
+#define NX_NOT_SUCCESSFUL     0x43
+#define NX_INVALID_PARAMETERS 0x4D
+#define NX_NOT_FOUND          0x4E
+
+#define NX_RECEIVE_PACKET 0
+
+typedef struct NX_PACKET_POOL_STRUCT
+{
+    ULONG nx_packet_pool_payload_size;
+    ULONG nx_packet_pool_available;
+    ULONG nx_packet_pool_total;
+} NX_PACKET_POOL;
+
+typedef struct NX_PACKET_STRUCT
+{
+    NX_PACKET_POOL* nx_packet_pool_owner;
+    struct NX_PACKET_STRUCT* nx_packet_next;       // Next packet of the same chain
+    struct NX_PACKET_STRUCT* nx_packet_queue_next; // Next chain in whatever queue holds this one
+    ULONG nx_packet_length;                        // Total over the chain, only kept in the head
+    UCHAR* nx_packet_data_start;
+    UCHAR* nx_packet_data_end;
+    UCHAR* nx_packet_prepend_ptr;
+    UCHAR* nx_packet_append_ptr;
+} NX_PACKET;
+
+typedef struct NX_IP_STRUCT
+{
+    ULONG nx_fake_unused;
+} NX_IP;
+
+typedef struct NXD_ADDRESS_STRUCT
+{
+    ULONG nxd_ip_version;
+    union
+    {
+        ULONG v4;
+        ULONG v6[4];
+    } nxd_ip_address;
+} NXD_ADDRESS;
+
+UINT nx_packet_pool_create(
+    NX_PACKET_POOL* pool_ptr, CHAR* name, ULONG payload_size, VOID* memory_ptr, ULONG memory_size);
+UINT nx_packet_allocate(NX_PACKET_POOL* pool_ptr, NX_PACKET** packet_ptr, ULONG packet_type, ULONG wait_option);
+UINT nx_packet_release(NX_PACKET* packet_ptr);
+UINT nx_packet_data_append(
+    NX_PACKET* packet_ptr, VOID* data_start, ULONG data_size, NX_PACKET_POOL* pool_ptr, ULONG wait_option);
+UINT nx_packet_data_extract_offset(
+    NX_PACKET* packet_ptr, ULONG offset, VOID* buffer_start, ULONG buffer_length, ULONG* bytes_copied);
+
+#endif // _NX_API_H
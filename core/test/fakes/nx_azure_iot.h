@@ -0,0 +1,14 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// Status codes shared by the Azure IoT middleware fakes
+
+#ifndef _NX_AZURE_IOT_H
+#define _NX_AZURE_IOT_H
+
+#define NX_AZURE_IOT_SUCCESS                   0x00
+#define NX_AZURE_IOT_SDK_CORE_ERROR            0x20002
+#define NX_AZURE_IOT_NOT_FOUND                 0x20016
+#define NX_AZURE_IOT_INSUFFICIENT_BUFFER_SPACE 0x20018
+
+#endif // _NX_AZURE_IOT_H
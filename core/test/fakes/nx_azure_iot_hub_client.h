@@ -0,0 +1,47 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// The parts of the Azure IoT middleware hub client that core code calls. There is no fake behind the
+// declarations, a test that links such code answers the calls itself.
+
+#ifndef _NX_AZURE_IOT_HUB_CLIENT_H
+#define _NX_AZURE_IOT_HUB_CLIENT_H
+
+#include "tx_api.h"
+
+#include "nx_api.h"
+
+#include "nx_azure_iot.h"
+
+typedef struct NX_AZURE_IOT_HUB_CLIENT_STRUCT
+{
+    VOID* nx_azure_iot_fake_context;
+} NX_AZURE_IOT_HUB_CLIENT;
+
+UINT nx_azure_iot_hub_client_device_twin_reported_properties_send(NX_AZURE_IOT_HUB_CLIENT* hub_client_ptr,
+    const UCHAR* message_buffer,
+    UINT message_length,
+    UINT* request_id_ptr,
+    UINT* response_status_ptr,
+    ULONG* version_ptr,
+    UINT wait_option);
+
+UINT nx_azure_iot_hub_client_direct_method_message_response(NX_AZURE_IOT_HUB_CLIENT* hub_client_ptr,
+    UINT status_code,
+    VOID* context_ptr,
+    USHORT context_length,
+    const UCHAR* payload,
+    UINT payload_length,
+    UINT wait_option);
+
+UINT nx_azure_iot_hub_client_telemetry_message_create(
+    NX_AZURE_IOT_HUB_CLIENT* hub_client_ptr, NX_PACKET** packet_pptr, UINT wait_option);
+UINT nx_azure_iot_hub_client_telemetry_message_delete(NX_PACKET* packet_ptr);
+UINT nx_azure_iot_hub_client_telemetry_property_add(NX_PACKET* packet_ptr,
+    const UCHAR* property_name,
+    USHORT property_name_length,
+    const UCHAR* property_value,
+    USHORT property_value_length,
+    UINT wait_option);
+
+#endif // _NX_AZURE_IOT_HUB_CLIENT_H
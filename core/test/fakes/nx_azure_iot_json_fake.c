@@ -0,0 +1,496 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// A small JSON tokenizer over a list of buffers, lenient about separators since only well formed
+// documents are fed to it, and a writer into a single buffer.
+
+#include "nx_azure_iot_json_reader.h"
+#include "nx_azure_iot_json_writer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_DEPTH 64
+
+// The next byte, -1 at the end of the document
+static INT reader_peek(az_json_reader* reader)
+{
+    while (reader->_internal.buffer_index < reader->_internal.number_of_buffers)
+    {
+        az_span buffer = reader->_internal.json_buffers[reader->_internal.buffer_index];
+
+        if (reader->_internal.buffer_offset < az_span_size(buffer))
+        {
+            return az_span_ptr(buffer)[reader->_internal.buffer_offset];
+        }
+
+        reader->_internal.buffer_index++;
+        reader->_internal.buffer_offset = 0;
+    }
+
+    return -1;
+}
+
+static VOID reader_advance(az_json_reader* reader)
+{
+    reader->_internal.buffer_offset++;
+}
+
+static VOID token_start(az_json_reader* reader, az_json_token_kind kind)
+{
+    az_json_token* token = &reader->token;
+
+    // Past the end of a buffer the token starts in the next one
+    reader_peek(reader);
+
+    memset(token, 0, sizeof(*token));
+    token->kind                              = kind;
+    token->_internal.pointer_to_first_buffer = reader->_internal.json_buffers;
+    token->_internal.start_buffer_index      = reader->_internal.buffer_index;
+    token->_internal.start_buffer_offset     = reader->_internal.buffer_offset;
+    token->_internal.end_buffer_index        = reader->_internal.buffer_index;
+    token->_internal.end_buffer_offset       = reader->_internal.buffer_offset;
+}
+
+// Takes the byte under the cursor into the token
+static VOID token_extend(az_json_reader* reader)
+{
+    az_json_token* token = &reader->token;
+
+    token->_internal.end_buffer_index  = reader->_internal.buffer_index;
+    token->_internal.end_buffer_offset = reader->_internal.buffer_offset + 1;
+    token->size++;
+
+    reader_advance(reader);
+}
+
+static VOID token_finish(az_json_reader* reader)
+{
+    az_json_token* token = &reader->token;
+    az_span last         = token->_internal.pointer_to_first_buffer[token->_internal.end_buffer_index];
+    int32_t start        = 0;
+
+    if (token->size == 0 || token->_internal.start_buffer_index == token->_internal.end_buffer_index)
+    {
+        start = token->_internal.start_buffer_offset;
+    }
+
+    token->_internal.is_multisegment = token->_internal.start_buffer_index != token->_internal.end_buffer_index;
+    token->slice = az_span_create(az_span_ptr(last) + start, token->_internal.end_buffer_offset - start);
+}
+
+static bool reader_in_object(az_json_reader* reader)
+{
+    return reader->current_depth > 0 && (reader->_internal.object_stack >> (reader->current_depth - 1)) & 1;
+}
+
+az_span az_json_token_copy_into_span(az_json_token const* json_token, az_span destination)
+{
+    int32_t index  = json_token->_internal.start_buffer_index;
+    int32_t offset = json_token->_internal.start_buffer_offset;
+    int32_t copied = 0;
+
+    while (copied < json_token->size)
+    {
+        az_span buffer = json_token->_internal.pointer_to_first_buffer[index];
+
+        if (offset >= az_span_size(buffer))
+        {
+            index++;
+            offset = 0;
+            continue;
+        }
+
+        az_span_ptr(destination)[copied++] = az_span_ptr(buffer)[offset++];
+    }
+
+    return az_span_create(az_span_ptr(destination) + copied, az_span_size(destination) - copied);
+}
+
+// The token as one string, for the getters
+static UINT token_copy(NX_AZURE_IOT_JSON_READER* reader_ptr, UCHAR* buffer, UINT buffer_size, UINT* length)
+{
+    az_json_token* token = &reader_ptr->json_reader.token;
+
+    if ((UINT)token->size >= buffer_size)
+    {
+        return NX_AZURE_IOT_INSUFFICIENT_BUFFER_SPACE;
+    }
+
+    az_json_token_copy_into_span(token, az_span_create(buffer, (int32_t)buffer_size));
+    buffer[token->size] = 0;
+    *length             = (UINT)token->size;
+
+    return NX_AZURE_IOT_SUCCESS;
+}
+
+UINT nx_azure_iot_json_reader_with_buffer_init(
+    NX_AZURE_IOT_JSON_READER* reader_ptr, const UCHAR* buffer_ptr, UINT buffer_len)
+{
+    memset(reader_ptr, 0, sizeof(*reader_ptr));
+
+    reader_ptr->span_buffer[0]                          = az_span_create((UCHAR*)buffer_ptr, (int32_t)buffer_len);
+    reader_ptr->json_reader._internal.json_buffers      = reader_ptr->span_buffer;
+    reader_ptr->json_reader._internal.number_of_buffers = 1;
+
+    return NX_AZURE_IOT_SUCCESS;
+}
+
+UINT nx_azure_iot_json_reader_init(NX_AZURE_IOT_JSON_READER* reader_ptr, NX_PACKET* packet_ptr)
+{
+    int32_t count = 0;
+
+    memset(reader_ptr, 0, sizeof(*reader_ptr));
+
+    for (NX_PACKET* packet = packet_ptr; packet != NX_NULL; packet = packet->nx_packet_next)
+    {
+        if (count == NX_AZURE_IOT_READER_MAX_LIST)
+        {
+            return NX_AZURE_IOT_INSUFFICIENT_BUFFER_SPACE;
+        }
+
+        reader_ptr->span_buffer[count++] = az_span_create(
+            packet->nx_packet_prepend_ptr, (int32_t)(packet->nx_packet_append_ptr - packet->nx_packet_prepend_ptr));
+    }
+
+    reader_ptr->json_reader._internal.json_buffers      = reader_ptr->span_buffer;
+    reader_ptr->json_reader._internal.number_of_buffers = count;
+    reader_ptr->packet_ptr                              = packet_ptr;
+
+    return NX_AZURE_IOT_SUCCESS;
+}
+
+UINT nx_azure_iot_json_reader_deinit(NX_AZURE_IOT_JSON_READER* reader_ptr)
+{
+    if (reader_ptr->packet_ptr != NX_NULL)
+    {
+        nx_packet_release(reader_ptr->packet_ptr);
+        reader_ptr->packet_ptr = NX_NULL;
+    }
+
+    return NX_AZURE_IOT_SUCCESS;
+}
+
+UINT nx_azure_iot_json_reader_next_token(NX_AZURE_IOT_JSON_READER* reader_ptr)
+{
+    az_json_reader* reader = &reader_ptr->json_reader;
+    INT c;
+
+    while ((c = reader_peek(reader)) == ' ' || c == '\t' || c == '\r' || c == '\n' || c == ',' || c == ':')
+    {
+        reader_advance(reader);
+    }
+
+    if (c == -1)
+    {
+        return NX_AZURE_IOT_NOT_FOUND;
+    }
+
+    if (c == '{' || c == '[')
+    {
+        if (reader->current_depth == MAX_DEPTH)
+        {
+            return NX_AZURE_IOT_SDK_CORE_ERROR;
+        }
+
+        token_start(reader, c == '{' ? AZ_JSON_TOKEN_BEGIN_OBJECT : AZ_JSON_TOKEN_BEGIN_ARRAY);
+        token_extend(reader);
+
+        if (c == '{')
+        {
+            reader->_internal.object_stack |= 1ULL << reader->current_depth;
+        }
+        else
+        {
+            reader->_internal.object_stack &= ~(1ULL << reader->current_depth);
+        }
+        reader->current_depth++;
+        reader->_internal.expect_property_name = c == '{';
+    }
+    else if (c == '}' || c == ']')
+    {
+        if (reader->current_depth == 0 || reader_in_object(reader) != (c == '}'))
+        {
+            return NX_AZURE_IOT_SDK_CORE_ERROR;
+        }
+
+        token_start(reader, c == '}' ? AZ_JSON_TOKEN_END_OBJECT : AZ_JSON_TOKEN_END_ARRAY);
+        token_extend(reader);
+
+        reader->current_depth--;
+        reader->_internal.expect_property_name = reader_in_object(reader);
+    }
+    else if (c == '"')
+    {
+        bool name = reader_in_object(reader) && reader->_internal.expect_property_name;
+
+        reader_advance(reader);
+        token_start(reader, name ? AZ_JSON_TOKEN_PROPERTY_NAME : AZ_JSON_TOKEN_STRING);
+
+        while ((c = reader_peek(reader)) != '"')
+        {
+            if (c == -1)
+            {
+                return NX_AZURE_IOT_SDK_CORE_ERROR;
+            }
+
+            if (c == '\\')
+            {
+                reader->token._internal.string_has_escaped_chars = true;
+                token_extend(reader);
+                if (reader_peek(reader) == -1)
+                {
+                    return NX_AZURE_IOT_SDK_CORE_ERROR;
+                }
+            }
+
+            token_extend(reader);
+        }
+        reader_advance(reader);
+
+        reader->_internal.expect_property_name = !name && reader_in_object(reader);
+    }
+    else
+    {
+        az_json_token_kind kind = c == 't' ? AZ_JSON_TOKEN_TRUE
+                                  : c == 'f' ? AZ_JSON_TOKEN_FALSE
+                                  : c == 'n' ? AZ_JSON_TOKEN_NULL
+                                             : AZ_JSON_TOKEN_NUMBER;
+
+        token_start(reader, kind);
+        while ((c = reader_peek(reader)) != -1 && strchr(",:}] \t\r\n", c) == NX_NULL)
+        {
+            token_extend(reader);
+        }
+
+        reader->_internal.expect_property_name = reader_in_object(reader);
+    }
+
+    token_finish(reader);
+
+    return NX_AZURE_IOT_SUCCESS;
+}
+
+UINT nx_azure_iot_json_reader_skip_children(NX_AZURE_IOT_JSON_READER* reader_ptr)
+{
+    az_json_reader* reader = &reader_ptr->json_reader;
+    int32_t depth;
+    UINT status;
+
+    if (reader->token.kind == AZ_JSON_TOKEN_PROPERTY_NAME &&
+        (status = nx_azure_iot_json_reader_next_token(reader_ptr)))
+    {
+        return status;
+    }
+
+    if (reader->token.kind != AZ_JSON_TOKEN_BEGIN_OBJECT && reader->token.kind != AZ_JSON_TOKEN_BEGIN_ARRAY)
+    {
+        return NX_AZURE_IOT_SUCCESS;
+    }
+
+    depth = reader->current_depth;
+    while (reader->current_depth >= depth)
+    {
+        if ((status = nx_azure_iot_json_reader_next_token(reader_ptr)))
+        {
+            return status;
+        }
+    }
+
+    return NX_AZURE_IOT_SUCCESS;
+}
+
+UINT nx_azure_iot_json_reader_token_type(NX_AZURE_IOT_JSON_READER* reader_ptr)
+{
+    return (UINT)reader_ptr->json_reader.token.kind;
+}
+
+UINT nx_azure_iot_json_reader_token_is_text_equal(
+    NX_AZURE_IOT_JSON_READER* reader_ptr, UCHAR* expected_text_ptr, UINT expected_text_len)
+{
+    az_json_token* token = &reader_ptr->json_reader.token;
+    UCHAR* text;
+    UINT equal;
+
+    if ((token->kind != AZ_JSON_TOKEN_PROPERTY_NAME && token->kind != AZ_JSON_TOKEN_STRING) ||
+        (UINT)token->size != expected_text_len)
+    {
+        return NX_FALSE;
+    }
+
+    text = malloc(expected_text_len + 1);
+    az_json_token_copy_into_span(token, az_span_create(text, (int32_t)expected_text_len + 1));
+    equal = memcmp(text, expected_text_ptr, expected_text_len) == 0;
+    free(text);
+
+    return equal;
+}
+
+UINT nx_azure_iot_json_reader_token_int32_get(NX_AZURE_IOT_JSON_READER* reader_ptr, int32_t* value_ptr)
+{
+    UCHAR text[16];
+    CHAR* end;
+    UINT length;
+    long value;
+
+    if (reader_ptr->json_reader.token.kind != AZ_JSON_TOKEN_NUMBER ||
+        token_copy(reader_ptr, text, sizeof(text), &length))
+    {
+        return NX_AZURE_IOT_SDK_CORE_ERROR;
+    }
+
+    value = strtol((CHAR*)text, &end, 10);
+    if (length == 0 || *end != 0 || value < INT32_MIN || value > INT32_MAX)
+    {
+        return NX_AZURE_IOT_SDK_CORE_ERROR;
+    }
+
+    *value_ptr = (int32_t)value;
+
+    return NX_AZURE_IOT_SUCCESS;
+}
+
+UINT nx_azure_iot_json_reader_token_string_get(
+    NX_AZURE_IOT_JSON_READER* reader_ptr, UCHAR* buffer_ptr, UINT buffer_size, UINT* bytes_copied)
+{
+    if (reader_ptr->json_reader.token.kind != AZ_JSON_TOKEN_STRING)
+    {
+        return NX_AZURE_IOT_SDK_CORE_ERROR;
+    }
+
+    return token_copy(reader_ptr, buffer_ptr, buffer_size, bytes_copied);
+}
+
+static UINT writer_append(NX_AZURE_IOT_JSON_WRITER* json_writer_ptr, const CHAR* text, UINT length)
+{
+    if (json_writer_ptr->length + length >= json_writer_ptr->buffer_size)
+    {
+        return NX_AZURE_IOT_INSUFFICIENT_BUFFER_SPACE;
+    }
+
+    memcpy(&json_writer_ptr->buffer[json_writer_ptr->length], text, length);
+    json_writer_ptr->length += length;
+    json_writer_ptr->buffer[json_writer_ptr->length] = 0;
+
+    return NX_AZURE_IOT_SUCCESS;
+}
+
+// A separator first unless this starts the object or follows a property name
+static UINT writer_element(NX_AZURE_IOT_JSON_WRITER* json_writer_ptr, const CHAR* text, UINT length)
+{
+    UINT status;
+
+    if (json_writer_ptr->need_comma && (status = writer_append(json_writer_ptr, ",", 1)))
+    {
+        return status;
+    }
+
+    return writer_append(json_writer_ptr, text, length);
+}
+
+static UINT writer_string(NX_AZURE_IOT_JSON_WRITER* json_writer_ptr, const UCHAR* text, UINT length)
+{
+    UINT status;
+
+    if ((status = writer_element(json_writer_ptr, "\"", 1)) ||
+        (status = writer_append(json_writer_ptr, (const CHAR*)text, length)) ||
+        (status = writer_append(json_writer_ptr, "\"", 1)))
+    {
+        return status;
+    }
+
+    return NX_AZURE_IOT_SUCCESS;
+}
+
+UINT nx_azure_iot_json_writer_with_buffer_init(
+    NX_AZURE_IOT_JSON_WRITER* json_writer_ptr, UCHAR* buffer_ptr, UINT buffer_len)
+{
+    memset(json_writer_ptr, 0, sizeof(*json_writer_ptr));
+    json_writer_ptr->buffer      = buffer_ptr;
+    json_writer_ptr->buffer_size = buffer_len;
+
+    return NX_AZURE_IOT_SUCCESS;
+}
+
+UINT nx_azure_iot_json_writer_deinit(NX_AZURE_IOT_JSON_WRITER* json_writer_ptr)
+{
+    (VOID) json_writer_ptr;
+
+    return NX_AZURE_IOT_SUCCESS;
+}
+
+UINT nx_azure_iot_json_writer_get_bytes_used(NX_AZURE_IOT_JSON_WRITER* json_writer_ptr)
+{
+    return json_writer_ptr->length;
+}
+
+UINT nx_azure_iot_json_writer_append_begin_object(NX_AZURE_IOT_JSON_WRITER* json_writer_ptr)
+{
+    UINT status = writer_element(json_writer_ptr, "{", 1);
+
+    json_writer_ptr->need_comma = false;
+
+    return status;
+}
+
+UINT nx_azure_iot_json_writer_append_end_object(NX_AZURE_IOT_JSON_WRITER* json_writer_ptr)
+{
+    UINT status = writer_append(json_writer_ptr, "}", 1);
+
+    json_writer_ptr->need_comma = true;
+
+    return status;
+}
+
+UINT nx_azure_iot_json_writer_append_property_name(
+    NX_AZURE_IOT_JSON_WRITER* json_writer_ptr, const UCHAR* property_name, UINT property_name_len)
+{
+    UINT status;
+
+    if ((status = writer_string(json_writer_ptr, property_name, property_name_len)) ||
+        (status = writer_append(json_writer_ptr, ":", 1)))
+    {
+        return status;
+    }
+
+    json_writer_ptr->need_comma = false;
+
+    return NX_AZURE_IOT_SUCCESS;
+}
+
+UINT nx_azure_iot_json_writer_append_property_with_int32_value(
+    NX_AZURE_IOT_JSON_WRITER* json_writer_ptr, const UCHAR* property_name, UINT property_name_len, int32_t value)
+{
+    CHAR text[12];
+    UINT status;
+
+    if ((status = nx_azure_iot_json_writer_append_property_name(json_writer_ptr, property_name, property_name_len)) ||
+        (status = writer_append(json_writer_ptr, text, (UINT)snprintf(text, sizeof(text), "%d", (INT)value))))
+    {
+        return status;
+    }
+
+    json_writer_ptr->need_comma = true;
+
+    return NX_AZURE_IOT_SUCCESS;
+}
+
+UINT nx_azure_iot_json_writer_append_property_with_string_value(NX_AZURE_IOT_JSON_WRITER* json_writer_ptr,
+    const UCHAR* property_name,
+    UINT property_name_len,
+    const UCHAR* str,
+    UINT str_len)
+{
+    UINT status;
+
+    if ((status = nx_azure_iot_json_writer_append_property_name(json_writer_ptr, property_name, property_name_len)) ||
+        (status = writer_string(json_writer_ptr, str, str_len)))
+    {
+        return status;
+    }
+
+    json_writer_ptr->need_comma = true;
+
+    return NX_AZURE_IOT_SUCCESS;
+}
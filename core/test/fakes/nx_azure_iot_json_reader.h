@@ -0,0 +1,59 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// Host stand-in for the middleware JSON reader. Like the real one it reads a chained packet as a list of
+// segments without copying it, takes the packet over at init and releases it at deinit.
+
+#ifndef _NX_AZURE_IOT_JSON_READER_H
+#define _NX_AZURE_IOT_JSON_READER_H
+
+#include "tx_api.h"
+
+#include "nx_api.h"
+
+#include "azure/core/az_json.h"
+#include "nx_azure_iot.h"
+
+// Most packets a document may span
+#define NX_AZURE_IOT_READER_MAX_LIST 15
+
+#define NX_AZURE_IOT_READER_TOKEN_NONE          AZ_JSON_TOKEN_NONE
+#define NX_AZURE_IOT_READER_TOKEN_BEGIN_OBJECT  AZ_JSON_TOKEN_BEGIN_OBJECT
+#define NX_AZURE_IOT_READER_TOKEN_END_OBJECT    AZ_JSON_TOKEN_END_OBJECT
+#define NX_AZURE_IOT_READER_TOKEN_BEGIN_ARRAY   AZ_JSON_TOKEN_BEGIN_ARRAY
+#define NX_AZURE_IOT_READER_TOKEN_END_ARRAY     AZ_JSON_TOKEN_END_ARRAY
+#define NX_AZURE_IOT_READER_TOKEN_PROPERTY_NAME AZ_JSON_TOKEN_PROPERTY_NAME
+#define NX_AZURE_IOT_READER_TOKEN_STRING        AZ_JSON_TOKEN_STRING
+#define NX_AZURE_IOT_READER_TOKEN_NUMBER        AZ_JSON_TOKEN_NUMBER
+#define NX_AZURE_IOT_READER_TOKEN_TRUE          AZ_JSON_TOKEN_TRUE
+#define NX_AZURE_IOT_READER_TOKEN_FALSE         AZ_JSON_TOKEN_FALSE
+#define NX_AZURE_IOT_READER_TOKEN_NULL          AZ_JSON_TOKEN_NULL
+
+typedef struct NX_AZURE_IOT_JSON_READER_STRUCT
+{
+    az_json_reader json_reader;
+    az_span span_buffer[NX_AZURE_IOT_READER_MAX_LIST];
+    NX_PACKET* packet_ptr;
+} NX_AZURE_IOT_JSON_READER;
+
+UINT nx_azure_iot_json_reader_init(NX_AZURE_IOT_JSON_READER* reader_ptr, NX_PACKET* packet_ptr);
+UINT nx_azure_iot_json_reader_with_buffer_init(
+    NX_AZURE_IOT_JSON_READER* reader_ptr, const UCHAR* buffer_ptr, UINT buffer_len);
+UINT nx_azure_iot_json_reader_deinit(NX_AZURE_IOT_JSON_READER* reader_ptr);
+
+// NX_AZURE_IOT_NOT_FOUND once the document has been read
+UINT nx_azure_iot_json_reader_next_token(NX_AZURE_IOT_JSON_READER* reader_ptr);
+
+// From a property name or the start of an object or array, moves to the token that ends its value
+UINT nx_azure_iot_json_reader_skip_children(NX_AZURE_IOT_JSON_READER* reader_ptr);
+
+UINT nx_azure_iot_json_reader_token_type(NX_AZURE_IOT_JSON_READER* reader_ptr);
+UINT nx_azure_iot_json_reader_token_is_text_equal(
+    NX_AZURE_IOT_JSON_READER* reader_ptr, UCHAR* expected_text_ptr, UINT expected_text_len);
+UINT nx_azure_iot_json_reader_token_int32_get(NX_AZURE_IOT_JSON_READER* reader_ptr, int32_t* value_ptr);
+
+// Copies the string as it appears in the document, escapes are not undone
+UINT nx_azure_iot_json_reader_token_string_get(
+    NX_AZURE_IOT_JSON_READER* reader_ptr, UCHAR* buffer_ptr, UINT buffer_size, UINT* bytes_copied);
+
+#endif // _NX_AZURE_IOT_JSON_READER_H
@@ -0,0 +1,44 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// Host stand-in for the middleware JSON writer, into a caller's buffer only. Strings are written as
+// given, without escaping.
+
+#ifndef _NX_AZURE_IOT_JSON_WRITER_H
+#define _NX_AZURE_IOT_JSON_WRITER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tx_api.h"
+
+#include "nx_api.h"
+
+#include "nx_azure_iot.h"
+
+typedef struct NX_AZURE_IOT_JSON_WRITER_STRUCT
+{
+    UCHAR* buffer;
+    UINT buffer_size;
+    UINT length;
+    bool need_comma; // A value was written at this level, the next one is separated from it
+} NX_AZURE_IOT_JSON_WRITER;
+
+UINT nx_azure_iot_json_writer_with_buffer_init(
+    NX_AZURE_IOT_JSON_WRITER* json_writer_ptr, UCHAR* buffer_ptr, UINT buffer_len);
+UINT nx_azure_iot_json_writer_deinit(NX_AZURE_IOT_JSON_WRITER* json_writer_ptr);
+UINT nx_azure_iot_json_writer_get_bytes_used(NX_AZURE_IOT_JSON_WRITER* json_writer_ptr);
+
+UINT nx_azure_iot_json_writer_append_begin_object(NX_AZURE_IOT_JSON_WRITER* json_writer_ptr);
+UINT nx_azure_iot_json_writer_append_end_object(NX_AZURE_IOT_JSON_WRITER* json_writer_ptr);
+UINT nx_azure_iot_json_writer_append_property_name(
+    NX_AZURE_IOT_JSON_WRITER* json_writer_ptr, const UCHAR* property_name, UINT property_name_len);
+UINT nx_azure_iot_json_writer_append_property_with_int32_value(
+    NX_AZURE_IOT_JSON_WRITER* json_writer_ptr, const UCHAR* property_name, UINT property_name_len, int32_t value);
+UINT nx_azure_iot_json_writer_append_property_with_string_value(NX_AZURE_IOT_JSON_WRITER* json_writer_ptr,
+    const UCHAR* property_name,
+    UINT property_name_len,
+    const UCHAR* str,
+    UINT str_len);
+
+#endif // _NX_AZURE_IOT_JSON_WRITER_H
@@ -0,0 +1,144 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "nx_api.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+UINT nx_packet_pool_create(
+    NX_PACKET_POOL* pool_ptr, CHAR* name, ULONG payload_size, VOID* memory_ptr, ULONG memory_size)
+{
+    (VOID) name;
+    (VOID) memory_ptr;
+
+    pool_ptr->nx_packet_pool_payload_size = payload_size;
+    pool_ptr->nx_packet_pool_total        = memory_size / (payload_size + sizeof(NX_PACKET));
+    pool_ptr->nx_packet_pool_available    = pool_ptr->nx_packet_pool_total;
+
+    return NX_SUCCESS;
+}
+
+UINT nx_packet_allocate(NX_PACKET_POOL* pool_ptr, NX_PACKET** packet_ptr, ULONG packet_type, ULONG wait_option)
+{
+    TX_INTERRUPT_SAVE_AREA
+    NX_PACKET* packet;
+
+    (VOID) packet_type;
+    (VOID) wait_option;
+
+    TX_DISABLE
+    if (pool_ptr->nx_packet_pool_available == 0)
+    {
+        TX_RESTORE
+        return NX_NO_PACKET;
+    }
+    pool_ptr->nx_packet_pool_available--;
+    TX_RESTORE
+
+    packet = calloc(1, sizeof(NX_PACKET) + pool_ptr->nx_packet_pool_payload_size);
+
+    packet->nx_packet_pool_owner  = pool_ptr;
+    packet->nx_packet_data_start  = (UCHAR*)(packet + 1);
+    packet->nx_packet_data_end    = packet->nx_packet_data_start + pool_ptr->nx_packet_pool_payload_size;
+    packet->nx_packet_prepend_ptr = packet->nx_packet_data_start;
+    packet->nx_packet_append_ptr  = packet->nx_packet_data_start;
+
+    *packet_ptr = packet;
+
+    return NX_SUCCESS;
+}
+
+UINT nx_packet_release(NX_PACKET* packet_ptr)
+{
+    TX_INTERRUPT_SAVE_AREA
+    NX_PACKET* next;
+
+    while (packet_ptr != NX_NULL)
+    {
+        next = packet_ptr->nx_packet_next;
+
+        TX_DISABLE
+        packet_ptr->nx_packet_pool_owner->nx_packet_pool_available++;
+        TX_RESTORE
+
+        free(packet_ptr);
+        packet_ptr = next;
+    }
+
+    return NX_SUCCESS;
+}
+
+UINT nx_packet_data_append(
+    NX_PACKET* packet_ptr, VOID* data_start, ULONG data_size, NX_PACKET_POOL* pool_ptr, ULONG wait_option)
+{
+    const UCHAR* data = (const UCHAR*)data_start;
+    NX_PACKET* last   = packet_ptr;
+    ULONG room;
+    UINT status;
+
+    while (last->nx_packet_next != NX_NULL)
+    {
+        last = last->nx_packet_next;
+    }
+
+    packet_ptr->nx_packet_length += data_size;
+
+    // Fill the last packet, then chain new ones from the pool
+    while (data_size > 0)
+    {
+        room = (ULONG)(last->nx_packet_data_end - last->nx_packet_append_ptr);
+        if (room == 0)
+        {
+            if ((status = nx_packet_allocate(pool_ptr, &last->nx_packet_next, NX_RECEIVE_PACKET, wait_option)))
+            {
+                return status;
+            }
+
+            last = last->nx_packet_next;
+            continue;
+        }
+
+        if (room > data_size)
+        {
+            room = data_size;
+        }
+
+        memcpy(last->nx_packet_append_ptr, data, room);
+        last->nx_packet_append_ptr += room;
+        data += room;
+        data_size -= room;
+    }
+
+    return NX_SUCCESS;
+}
+
+UINT nx_packet_data_extract_offset(
+    NX_PACKET* packet_ptr, ULONG offset, VOID* buffer_start, ULONG buffer_length, ULONG* bytes_copied)
+{
+    UCHAR* buffer = (UCHAR*)buffer_start;
+    ULONG available;
+    ULONG copy;
+
+    *bytes_copied = 0;
+
+    for (; packet_ptr != NX_NULL && buffer_length > 0; packet_ptr = packet_ptr->nx_packet_next)
+    {
+        available = (ULONG)(packet_ptr->nx_packet_append_ptr - packet_ptr->nx_packet_prepend_ptr);
+        if (offset >= available)
+        {
+            offset -= available;
+            continue;
+        }
+
+        copy = available - offset < buffer_length ? available - offset : buffer_length;
+        memcpy(buffer, packet_ptr->nx_packet_prepend_ptr + offset, copy);
+
+        buffer += copy;
+        buffer_length -= copy;
+        *bytes_copied += copy;
+        offset = 0;
+    }
+
+    return *bytes_copied > 0 ? NX_SUCCESS : NX_NOT_SUCCESSFUL;
+}
@@ -0,0 +1,54 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// Host stand-in for the NetX Duo MQTT client with a broker attached. QoS 1 PUBLISH packets wait in
+// the transmit queue until the broker acknowledges them, in order, a fixed delay after they were sent.
+
+#ifndef _NXD_MQTT_CLIENT_H
+#define _NXD_MQTT_CLIENT_H
+
+#include "tx_api.h"
+
+#include "nx_api.h"
+
+#define NXD_MQTT_SUCCESS             0x00
+#define NXD_MQTT_NOT_CONNECTED       0x10003
+#define NXD_MQTT_PACKET_POOL_FAILURE 0x10009
+
+#define MQTT_QOS_0 0
+#define MQTT_QOS_1 1
+
+typedef struct NXD_MQTT_CLIENT_STRUCT
+{
+    TX_MUTEX* nxd_mqtt_client_mutex_ptr;
+    NX_PACKET_POOL* nxd_mqtt_client_packet_pool_ptr;
+
+    NX_PACKET* message_transmit_queue_head; // QoS 1 messages waiting for their PUBACK, oldest first
+    NX_PACKET* message_transmit_queue_tail;
+
+    TX_MUTEX nxd_mqtt_fake_mutex;
+    TX_THREAD nxd_mqtt_fake_broker;
+    ULONG nxd_mqtt_fake_ack_delay;    // Ticks from PUBLISH to PUBACK, i.e. the round trip
+    UINT nxd_mqtt_fake_paused;        // Broker stops acknowledging, e.g. to force timeouts
+    ULONG nxd_mqtt_fake_published;    // PUBLISH packets sent at either QoS
+    ULONG nxd_mqtt_fake_acknowledged; // PUBACKs delivered
+} NXD_MQTT_CLIENT;
+
+UINT nxd_mqtt_client_publish(NXD_MQTT_CLIENT* client_ptr,
+    CHAR* topic_name,
+    UINT topic_name_length,
+    CHAR* message,
+    UINT message_length,
+    UINT retain,
+    UINT QoS,
+    ULONG wait_option);
+
+// Connected client with a running broker
+UINT nxd_mqtt_fake_create(NXD_MQTT_CLIENT* client_ptr, NX_PACKET_POOL* pool_ptr, ULONG ack_delay);
+UINT nxd_mqtt_fake_delete(NXD_MQTT_CLIENT* client_ptr);
+VOID nxd_mqtt_fake_pause(NXD_MQTT_CLIENT* client_ptr, UINT paused);
+
+// Drops every unacknowledged message, the way a reconnect with a clean session does
+VOID nxd_mqtt_fake_reconnect(NXD_MQTT_CLIENT* client_ptr);
+
+#endif // _NXD_MQTT_CLIENT_H
@@ -0,0 +1,151 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "nxd_mqtt_client.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+// Each queued PUBLISH packet starts with the tick it was sent at
+static ULONG packet_sent_time(NX_PACKET* packet)
+{
+    ULONG sent_time;
+
+    memcpy(&sent_time, packet->nx_packet_prepend_ptr, sizeof(sent_time));
+
+    return sent_time;
+}
+
+static VOID broker_entry(ULONG parameter)
+{
+    NXD_MQTT_CLIENT* client_ptr = (NXD_MQTT_CLIENT*)parameter;
+    NX_PACKET* packet;
+
+    while (true)
+    {
+        tx_thread_sleep(1);
+
+        tx_mutex_get(client_ptr->nxd_mqtt_client_mutex_ptr, TX_WAIT_FOREVER);
+
+        // PUBACKs come back in the order the PUBLISH packets went out
+        while (!client_ptr->nxd_mqtt_fake_paused && (packet = client_ptr->message_transmit_queue_head) != NX_NULL &&
+               tx_time_get() - packet_sent_time(packet) >= client_ptr->nxd_mqtt_fake_ack_delay)
+        {
+            client_ptr->message_transmit_queue_head = packet->nx_packet_queue_next;
+            if (client_ptr->message_transmit_queue_head == NX_NULL)
+            {
+                client_ptr->message_transmit_queue_tail = NX_NULL;
+            }
+
+            nx_packet_release(packet);
+            client_ptr->nxd_mqtt_fake_acknowledged++;
+        }
+
+        tx_mutex_put(client_ptr->nxd_mqtt_client_mutex_ptr);
+    }
+}
+
+UINT nxd_mqtt_client_publish(NXD_MQTT_CLIENT* client_ptr,
+    CHAR* topic_name,
+    UINT topic_name_length,
+    CHAR* message,
+    UINT message_length,
+    UINT retain,
+    UINT QoS,
+    ULONG wait_option)
+{
+    NX_PACKET* packet;
+    ULONG now = tx_time_get();
+    UINT status;
+
+    (VOID) topic_name;
+    (VOID) topic_name_length;
+    (VOID) message;
+    (VOID) message_length;
+    (VOID) retain;
+
+    tx_mutex_get(client_ptr->nxd_mqtt_client_mutex_ptr, TX_WAIT_FOREVER);
+
+    client_ptr->nxd_mqtt_fake_published++;
+
+    if (QoS == MQTT_QOS_1)
+    {
+        status = nx_packet_allocate(client_ptr->nxd_mqtt_client_packet_pool_ptr, &packet, 0, wait_option);
+        if (status != NX_SUCCESS)
+        {
+            tx_mutex_put(client_ptr->nxd_mqtt_client_mutex_ptr);
+            return NXD_MQTT_PACKET_POOL_FAILURE;
+        }
+
+        nx_packet_data_append(packet, &now, sizeof(now), client_ptr->nxd_mqtt_client_packet_pool_ptr, wait_option);
+
+        if (client_ptr->message_transmit_queue_tail == NX_NULL)
+        {
+            client_ptr->message_transmit_queue_head = packet;
+        }
+        else
+        {
+            client_ptr->message_transmit_queue_tail->nx_packet_queue_next = packet;
+        }
+        client_ptr->message_transmit_queue_tail = packet;
+    }
+
+    tx_mutex_put(client_ptr->nxd_mqtt_client_mutex_ptr);
+
+    return NXD_MQTT_SUCCESS;
+}
+
+UINT nxd_mqtt_fake_create(NXD_MQTT_CLIENT* client_ptr, NX_PACKET_POOL* pool_ptr, ULONG ack_delay)
+{
+    memset(client_ptr, 0, sizeof(*client_ptr));
+
+    tx_mutex_create(&client_ptr->nxd_mqtt_fake_mutex, "MQTT client", TX_NO_INHERIT);
+
+    client_ptr->nxd_mqtt_client_mutex_ptr       = &client_ptr->nxd_mqtt_fake_mutex;
+    client_ptr->nxd_mqtt_client_packet_pool_ptr = pool_ptr;
+    client_ptr->nxd_mqtt_fake_ack_delay         = ack_delay;
+
+    return tx_thread_create(&client_ptr->nxd_mqtt_fake_broker,
+        "MQTT broker",
+        broker_entry,
+        (ULONG)client_ptr,
+        NX_NULL,
+        0,
+        1,
+        1,
+        TX_NO_TIME_SLICE,
+        TX_AUTO_START);
+}
+
+UINT nxd_mqtt_fake_delete(NXD_MQTT_CLIENT* client_ptr)
+{
+    tx_thread_terminate(&client_ptr->nxd_mqtt_fake_broker);
+    tx_thread_delete(&client_ptr->nxd_mqtt_fake_broker);
+
+    nxd_mqtt_fake_reconnect(client_ptr);
+
+    return tx_mutex_delete(&client_ptr->nxd_mqtt_fake_mutex);
+}
+
+VOID nxd_mqtt_fake_pause(NXD_MQTT_CLIENT* client_ptr, UINT paused)
+{
+    tx_mutex_get(client_ptr->nxd_mqtt_client_mutex_ptr, TX_WAIT_FOREVER);
+    client_ptr->nxd_mqtt_fake_paused = paused;
+    tx_mutex_put(client_ptr->nxd_mqtt_client_mutex_ptr);
+}
+
+VOID nxd_mqtt_fake_reconnect(NXD_MQTT_CLIENT* client_ptr)
+{
+    NX_PACKET* packet;
+
+    tx_mutex_get(client_ptr->nxd_mqtt_client_mutex_ptr, TX_WAIT_FOREVER);
+
+    while ((packet = client_ptr->message_transmit_queue_head) != NX_NULL)
+    {
+        client_ptr->message_transmit_queue_head = packet->nx_packet_queue_next;
+        nx_packet_release(packet);
+    }
+    client_ptr->message_transmit_queue_tail = NX_NULL;
+
+    tx_mutex_put(client_ptr->nxd_mqtt_client_mutex_ptr);
+}
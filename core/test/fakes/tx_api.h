@@ -0,0 +1,174 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// Host stand-in for the parts of the ThreadX API used by core, built on pthreads.
+// Timers fire from one thread, the way they fire from the ThreadX timer thread.
+
+#ifndef _TX_API_H
+#define _TX_API_H
+
+#include <pthread.h>
+
+#define VOID void
+typedef char CHAR;
+typedef unsigned char UCHAR;
+typedef int INT;
+typedef unsigned int UINT;
+typedef long LONG;
+typedef unsigned long ULONG;
+typedef short SHORT;
+typedef unsigned short USHORT;
+typedef unsigned long long ULONG64;
+
+#define TX_TIMER_TICKS_PER_SECOND 100
+
+#define TX_NO_WAIT      0UL
+#define TX_WAIT_FOREVER 0xFFFFFFFFUL
+
+#define TX_SUCCESS        0x00
+#define TX_DELETED        0x01
+#define TX_PTR_ERROR      0x03
+#define TX_NO_EVENTS      0x07
+#define TX_OPTION_ERROR   0x08
+#define TX_QUEUE_EMPTY    0x0A
+#define TX_QUEUE_FULL     0x0B
+#define TX_NO_INSTANCE    0x0D
+#define TX_THREAD_ERROR   0x0E
+#define TX_NOT_AVAILABLE  0x1D
+#define TX_NOT_OWNED      0x1E
+
+#define TX_OR        0
+#define TX_OR_CLEAR  1
+#define TX_AND       2
+#define TX_AND_CLEAR 3
+
+#define TX_NO_INHERIT 0
+#define TX_INHERIT    1
+
+#define TX_AUTO_START    1
+#define TX_DONT_START    0
+#define TX_AUTO_ACTIVATE 1
+#define TX_NO_ACTIVATE   0
+#define TX_NO_TIME_SLICE 0
+
+#define TX_1_ULONG  1
+#define TX_2_ULONG  2
+#define TX_4_ULONG  4
+#define TX_8_ULONG  8
+#define TX_16_ULONG 16
+
+// Interrupt masking becomes one process wide lock
+#define TX_INTERRUPT_SAVE_AREA UINT interrupt_save;
+#define TX_DISABLE             interrupt_save = _tx_fake_disable();
+#define TX_RESTORE             _tx_fake_restore(interrupt_save);
+
+typedef struct TX_THREAD_STRUCT
+{
+    pthread_t tx_fake_thread;
+    VOID (*tx_fake_entry)(ULONG);
+    ULONG tx_fake_input;
+    CHAR* tx_thread_name;
+    UINT tx_fake_created;
+} TX_THREAD;
+
+typedef struct TX_MUTEX_STRUCT
+{
+    pthread_mutex_t tx_fake_mutex;
+} TX_MUTEX;
+
+typedef struct TX_SEMAPHORE_STRUCT
+{
+    pthread_mutex_t tx_fake_lock;
+    pthread_cond_t tx_fake_cond;
+    ULONG tx_semaphore_count;
+} TX_SEMAPHORE;
+
+typedef struct TX_EVENT_FLAGS_GROUP_STRUCT
+{
+    pthread_mutex_t tx_fake_lock;
+    pthread_cond_t tx_fake_cond;
+    ULONG tx_event_flags_group_current;
+    UINT tx_fake_deleted;
+} TX_EVENT_FLAGS_GROUP;
+
+typedef struct TX_QUEUE_STRUCT
+{
+    pthread_mutex_t tx_fake_lock;
+    pthread_cond_t tx_fake_cond;
+    UINT tx_fake_message_size; // In ULONGs
+    ULONG* tx_fake_start;
+    ULONG tx_fake_capacity;
+    ULONG tx_fake_read;
+    ULONG tx_queue_enqueued;
+} TX_QUEUE;
+
+typedef struct TX_TIMER_STRUCT
+{
+    VOID (*tx_fake_expiry)(ULONG);
+    ULONG tx_fake_input;
+    ULONG tx_fake_initial;
+    ULONG tx_fake_reschedule;
+    ULONG tx_fake_expires;
+    UINT tx_fake_active;
+    struct TX_TIMER_STRUCT* tx_fake_next;
+} TX_TIMER;
+
+UINT _tx_fake_disable(VOID);
+VOID _tx_fake_restore(UINT previous);
+
+UINT tx_thread_create(TX_THREAD* thread_ptr,
+    CHAR* name_ptr,
+    VOID (*entry_function)(ULONG),
+    ULONG entry_input,
+    VOID* stack_start,
+    ULONG stack_size,
+    UINT priority,
+    UINT preempt_threshold,
+    ULONG time_slice,
+    UINT auto_start);
+UINT tx_thread_terminate(TX_THREAD* thread_ptr);
+UINT tx_thread_delete(TX_THREAD* thread_ptr);
+UINT tx_thread_sleep(ULONG timer_ticks);
+VOID tx_thread_relinquish(VOID);
+TX_THREAD* tx_thread_identify(VOID);
+
+UINT tx_mutex_create(TX_MUTEX* mutex_ptr, CHAR* name_ptr, UINT inherit);
+UINT tx_mutex_delete(TX_MUTEX* mutex_ptr);
+UINT tx_mutex_get(TX_MUTEX* mutex_ptr, ULONG wait_option);
+UINT tx_mutex_put(TX_MUTEX* mutex_ptr);
+
+UINT tx_semaphore_create(TX_SEMAPHORE* semaphore_ptr, CHAR* name_ptr, ULONG initial_count);
+UINT tx_semaphore_delete(TX_SEMAPHORE* semaphore_ptr);
+UINT tx_semaphore_get(TX_SEMAPHORE* semaphore_ptr, ULONG wait_option);
+UINT tx_semaphore_put(TX_SEMAPHORE* semaphore_ptr);
+
+UINT tx_event_flags_create(TX_EVENT_FLAGS_GROUP* group_ptr, CHAR* name_ptr);
+UINT tx_event_flags_delete(TX_EVENT_FLAGS_GROUP* group_ptr);
+UINT tx_event_flags_get(TX_EVENT_FLAGS_GROUP* group_ptr,
+    ULONG requested_flags,
+    UINT get_option,
+    ULONG* actual_flags_ptr,
+    ULONG wait_option);
+UINT tx_event_flags_set(TX_EVENT_FLAGS_GROUP* group_ptr, ULONG flags_to_set, UINT set_option);
+
+UINT tx_queue_create(
+    TX_QUEUE* queue_ptr, CHAR* name_ptr, UINT message_size, VOID* queue_start, ULONG queue_size);
+UINT tx_queue_delete(TX_QUEUE* queue_ptr);
+UINT tx_queue_send(TX_QUEUE* queue_ptr, VOID* source_ptr, ULONG wait_option);
+UINT tx_queue_receive(TX_QUEUE* queue_ptr, VOID* destination_ptr, ULONG wait_option);
+
+UINT tx_timer_create(TX_TIMER* timer_ptr,
+    CHAR* name_ptr,
+    VOID (*expiration_function)(ULONG),
+    ULONG expiration_input,
+    ULONG initial_ticks,
+    ULONG reschedule_ticks,
+    UINT auto_activate);
+UINT tx_timer_delete(TX_TIMER* timer_ptr);
+UINT tx_timer_activate(TX_TIMER* timer_ptr);
+UINT tx_timer_deactivate(TX_TIMER* timer_ptr);
+UINT tx_timer_change(TX_TIMER* timer_ptr, ULONG initial_ticks, ULONG reschedule_ticks);
+
+ULONG tx_time_get(VOID);
+
+#endif // _TX_API_H
@@ -0,0 +1,585 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#define _GNU_SOURCE
+
+#include "tx_api.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+
+#define NANOSECONDS_PER_TICK (1000000000L / TX_TIMER_TICKS_PER_SECOND)
+
+static pthread_mutex_t interrupt_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+static pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static TX_TIMER* timer_list;
+static pthread_once_t timer_once = PTHREAD_ONCE_INIT;
+
+static __thread TX_THREAD* current_thread;
+
+static struct timespec start_time;
+static pthread_once_t start_once = PTHREAD_ONCE_INIT;
+
+static VOID start_time_init(VOID)
+{
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+}
+
+ULONG tx_time_get(VOID)
+{
+    struct timespec now;
+
+    pthread_once(&start_once, start_time_init);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (ULONG)((now.tv_sec - start_time.tv_sec) * TX_TIMER_TICKS_PER_SECOND +
+                   (now.tv_nsec - start_time.tv_nsec) / NANOSECONDS_PER_TICK);
+}
+
+// Absolute CLOCK_REALTIME deadline for a wait option, as the pthread timed waits expect
+static struct timespec deadline_get(ULONG wait_option)
+{
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += wait_option / TX_TIMER_TICKS_PER_SECOND;
+    deadline.tv_nsec += (wait_option % TX_TIMER_TICKS_PER_SECOND) * NANOSECONDS_PER_TICK;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    return deadline;
+}
+
+// Waits on cond, false once wait_option has passed. Unlocks on cancellation so terminate is safe.
+static UINT cond_wait(pthread_cond_t* cond, pthread_mutex_t* lock, const struct timespec* deadline)
+{
+    INT result;
+
+    pthread_cleanup_push((VOID(*)(VOID*))pthread_mutex_unlock, lock);
+    result = deadline == NULL ? pthread_cond_wait(cond, lock) : pthread_cond_timedwait(cond, lock, deadline);
+    pthread_cleanup_pop(0);
+
+    return result != ETIMEDOUT;
+}
+
+UINT _tx_fake_disable(VOID)
+{
+    INT previous;
+
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &previous);
+    pthread_mutex_lock(&interrupt_lock);
+
+    return (UINT)previous;
+}
+
+VOID _tx_fake_restore(UINT previous)
+{
+    pthread_mutex_unlock(&interrupt_lock);
+    pthread_setcancelstate((INT)previous, NULL);
+}
+
+static VOID* thread_trampoline(VOID* parameter)
+{
+    TX_THREAD* thread_ptr = (TX_THREAD*)parameter;
+
+    current_thread = thread_ptr;
+    thread_ptr->tx_fake_entry(thread_ptr->tx_fake_input);
+
+    return NULL;
+}
+
+UINT tx_thread_create(TX_THREAD* thread_ptr,
+    CHAR* name_ptr,
+    VOID (*entry_function)(ULONG),
+    ULONG entry_input,
+    VOID* stack_start,
+    ULONG stack_size,
+    UINT priority,
+    UINT preempt_threshold,
+    ULONG time_slice,
+    UINT auto_start)
+{
+    (VOID) stack_start;
+    (VOID) stack_size;
+    (VOID) priority;
+    (VOID) preempt_threshold;
+    (VOID) time_slice;
+    (VOID) auto_start;
+
+    thread_ptr->tx_thread_name  = name_ptr;
+    thread_ptr->tx_fake_entry   = entry_function;
+    thread_ptr->tx_fake_input   = entry_input;
+    thread_ptr->tx_fake_created = 1;
+
+    if (pthread_create(&thread_ptr->tx_fake_thread, NULL, thread_trampoline, thread_ptr) != 0)
+    {
+        thread_ptr->tx_fake_created = 0;
+        return TX_THREAD_ERROR;
+    }
+
+    return TX_SUCCESS;
+}
+
+UINT tx_thread_terminate(TX_THREAD* thread_ptr)
+{
+    if (!thread_ptr->tx_fake_created)
+    {
+        return TX_SUCCESS;
+    }
+
+    if (pthread_equal(thread_ptr->tx_fake_thread, pthread_self()))
+    {
+        pthread_exit(NULL);
+    }
+
+    pthread_cancel(thread_ptr->tx_fake_thread);
+    pthread_join(thread_ptr->tx_fake_thread, NULL);
+    thread_ptr->tx_fake_created = 0;
+
+    return TX_SUCCESS;
+}
+
+UINT tx_thread_delete(TX_THREAD* thread_ptr)
+{
+    // Only terminated threads may be deleted
+    return thread_ptr->tx_fake_created ? TX_THREAD_ERROR : TX_SUCCESS;
+}
+
+UINT tx_thread_sleep(ULONG timer_ticks)
+{
+    struct timespec delay;
+
+    delay.tv_sec  = timer_ticks / TX_TIMER_TICKS_PER_SECOND;
+    delay.tv_nsec = (timer_ticks % TX_TIMER_TICKS_PER_SECOND) * NANOSECONDS_PER_TICK;
+    nanosleep(&delay, NULL);
+
+    return TX_SUCCESS;
+}
+
+VOID tx_thread_relinquish(VOID)
+{
+    sched_yield();
+}
+
+TX_THREAD* tx_thread_identify(VOID)
+{
+    return current_thread;
+}
+
+UINT tx_mutex_create(TX_MUTEX* mutex_ptr, CHAR* name_ptr, UINT inherit)
+{
+    pthread_mutexattr_t attributes;
+
+    (VOID) name_ptr;
+    (VOID) inherit;
+
+    // ThreadX mutexes can be taken again by their owner
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&mutex_ptr->tx_fake_mutex, &attributes);
+    pthread_mutexattr_destroy(&attributes);
+
+    return TX_SUCCESS;
+}
+
+UINT tx_mutex_delete(TX_MUTEX* mutex_ptr)
+{
+    pthread_mutex_destroy(&mutex_ptr->tx_fake_mutex);
+
+    return TX_SUCCESS;
+}
+
+UINT tx_mutex_get(TX_MUTEX* mutex_ptr, ULONG wait_option)
+{
+    struct timespec deadline;
+
+    if (wait_option == TX_WAIT_FOREVER)
+    {
+        pthread_mutex_lock(&mutex_ptr->tx_fake_mutex);
+        return TX_SUCCESS;
+    }
+
+    if (wait_option == TX_NO_WAIT)
+    {
+        return pthread_mutex_trylock(&mutex_ptr->tx_fake_mutex) == 0 ? TX_SUCCESS : TX_NOT_AVAILABLE;
+    }
+
+    deadline = deadline_get(wait_option);
+
+    return pthread_mutex_timedlock(&mutex_ptr->tx_fake_mutex, &deadline) == 0 ? TX_SUCCESS : TX_NOT_AVAILABLE;
+}
+
+UINT tx_mutex_put(TX_MUTEX* mutex_ptr)
+{
+    return pthread_mutex_unlock(&mutex_ptr->tx_fake_mutex) == 0 ? TX_SUCCESS : TX_NOT_OWNED;
+}
+
+UINT tx_semaphore_create(TX_SEMAPHORE* semaphore_ptr, CHAR* name_ptr, ULONG initial_count)
+{
+    (VOID) name_ptr;
+
+    pthread_mutex_init(&semaphore_ptr->tx_fake_lock, NULL);
+    pthread_cond_init(&semaphore_ptr->tx_fake_cond, NULL);
+    semaphore_ptr->tx_semaphore_count = initial_count;
+
+    return TX_SUCCESS;
+}
+
+UINT tx_semaphore_delete(TX_SEMAPHORE* semaphore_ptr)
+{
+    pthread_cond_destroy(&semaphore_ptr->tx_fake_cond);
+    pthread_mutex_destroy(&semaphore_ptr->tx_fake_lock);
+
+    return TX_SUCCESS;
+}
+
+UINT tx_semaphore_get(TX_SEMAPHORE* semaphore_ptr, ULONG wait_option)
+{
+    struct timespec deadline = deadline_get(wait_option);
+    UINT status              = TX_SUCCESS;
+
+    pthread_mutex_lock(&semaphore_ptr->tx_fake_lock);
+
+    while (semaphore_ptr->tx_semaphore_count == 0)
+    {
+        if (wait_option == TX_NO_WAIT ||
+            !cond_wait(&semaphore_ptr->tx_fake_cond,
+                &semaphore_ptr->tx_fake_lock,
+                wait_option == TX_WAIT_FOREVER ? NULL : &deadline))
+        {
+            status = TX_NO_INSTANCE;
+            break;
+        }
+    }
+
+    if (status == TX_SUCCESS)
+    {
+        semaphore_ptr->tx_semaphore_count--;
+    }
+
+    pthread_mutex_unlock(&semaphore_ptr->tx_fake_lock);
+
+    return status;
+}
+
+UINT tx_semaphore_put(TX_SEMAPHORE* semaphore_ptr)
+{
+    pthread_mutex_lock(&semaphore_ptr->tx_fake_lock);
+    semaphore_ptr->tx_semaphore_count++;
+    pthread_cond_signal(&semaphore_ptr->tx_fake_cond);
+    pthread_mutex_unlock(&semaphore_ptr->tx_fake_lock);
+
+    return TX_SUCCESS;
+}
+
+UINT tx_event_flags_create(TX_EVENT_FLAGS_GROUP* group_ptr, CHAR* name_ptr)
+{
+    (VOID) name_ptr;
+
+    pthread_mutex_init(&group_ptr->tx_fake_lock, NULL);
+    pthread_cond_init(&group_ptr->tx_fake_cond, NULL);
+    group_ptr->tx_event_flags_group_current = 0;
+    group_ptr->tx_fake_deleted              = 0;
+
+    return TX_SUCCESS;
+}
+
+UINT tx_event_flags_delete(TX_EVENT_FLAGS_GROUP* group_ptr)
+{
+    // Waiters are released with TX_DELETED, the way ThreadX resumes them
+    pthread_mutex_lock(&group_ptr->tx_fake_lock);
+    group_ptr->tx_fake_deleted = 1;
+    pthread_cond_broadcast(&group_ptr->tx_fake_cond);
+    pthread_mutex_unlock(&group_ptr->tx_fake_lock);
+
+    return TX_SUCCESS;
+}
+
+UINT tx_event_flags_get(TX_EVENT_FLAGS_GROUP* group_ptr,
+    ULONG requested_flags,
+    UINT get_option,
+    ULONG* actual_flags_ptr,
+    ULONG wait_option)
+{
+    struct timespec deadline = deadline_get(wait_option);
+    UINT status              = TX_SUCCESS;
+    ULONG current;
+    UINT satisfied;
+
+    pthread_mutex_lock(&group_ptr->tx_fake_lock);
+
+    while (true)
+    {
+        if (group_ptr->tx_fake_deleted)
+        {
+            status = TX_DELETED;
+            break;
+        }
+
+        current   = group_ptr->tx_event_flags_group_current;
+        satisfied = (get_option & TX_AND) ? (current & requested_flags) == requested_flags
+                                          : (current & requested_flags) != 0;
+        if (satisfied)
+        {
+            *actual_flags_ptr = current;
+            if (get_option & TX_OR_CLEAR)
+            {
+                group_ptr->tx_event_flags_group_current &= ~requested_flags;
+            }
+            break;
+        }
+
+        if (wait_option == TX_NO_WAIT ||
+            !cond_wait(
+                &group_ptr->tx_fake_cond, &group_ptr->tx_fake_lock, wait_option == TX_WAIT_FOREVER ? NULL : &deadline))
+        {
+            status = TX_NO_EVENTS;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&group_ptr->tx_fake_lock);
+
+    return status;
+}
+
+UINT tx_event_flags_set(TX_EVENT_FLAGS_GROUP* group_ptr, ULONG flags_to_set, UINT set_option)
+{
+    pthread_mutex_lock(&group_ptr->tx_fake_lock);
+
+    if (group_ptr->tx_fake_deleted)
+    {
+        pthread_mutex_unlock(&group_ptr->tx_fake_lock);
+        return TX_DELETED;
+    }
+
+    if (set_option == TX_AND)
+    {
+        group_ptr->tx_event_flags_group_current &= flags_to_set;
+    }
+    else
+    {
+        group_ptr->tx_event_flags_group_current |= flags_to_set;
+    }
+
+    pthread_cond_broadcast(&group_ptr->tx_fake_cond);
+    pthread_mutex_unlock(&group_ptr->tx_fake_lock);
+
+    return TX_SUCCESS;
+}
+
+UINT tx_queue_create(TX_QUEUE* queue_ptr, CHAR* name_ptr, UINT message_size, VOID* queue_start, ULONG queue_size)
+{
+    (VOID) name_ptr;
+
+    pthread_mutex_init(&queue_ptr->tx_fake_lock, NULL);
+    pthread_cond_init(&queue_ptr->tx_fake_cond, NULL);
+    queue_ptr->tx_fake_message_size = message_size;
+    queue_ptr->tx_fake_start        = (ULONG*)queue_start;
+    queue_ptr->tx_fake_capacity     = queue_size / (message_size * sizeof(ULONG));
+    queue_ptr->tx_fake_read         = 0;
+    queue_ptr->tx_queue_enqueued    = 0;
+
+    return TX_SUCCESS;
+}
+
+UINT tx_queue_delete(TX_QUEUE* queue_ptr)
+{
+    pthread_cond_destroy(&queue_ptr->tx_fake_cond);
+    pthread_mutex_destroy(&queue_ptr->tx_fake_lock);
+
+    return TX_SUCCESS;
+}
+
+UINT tx_queue_send(TX_QUEUE* queue_ptr, VOID* source_ptr, ULONG wait_option)
+{
+    struct timespec deadline = deadline_get(wait_option);
+    ULONG write;
+
+    pthread_mutex_lock(&queue_ptr->tx_fake_lock);
+
+    while (queue_ptr->tx_queue_enqueued == queue_ptr->tx_fake_capacity)
+    {
+        if (wait_option == TX_NO_WAIT ||
+            !cond_wait(
+                &queue_ptr->tx_fake_cond, &queue_ptr->tx_fake_lock, wait_option == TX_WAIT_FOREVER ? NULL : &deadline))
+        {
+            pthread_mutex_unlock(&queue_ptr->tx_fake_lock);
+            return TX_QUEUE_FULL;
+        }
+    }
+
+    write = (queue_ptr->tx_fake_read + queue_ptr->tx_queue_enqueued) % queue_ptr->tx_fake_capacity;
+    memcpy(&queue_ptr->tx_fake_start[write * queue_ptr->tx_fake_message_size],
+        source_ptr,
+        queue_ptr->tx_fake_message_size * sizeof(ULONG));
+    queue_ptr->tx_queue_enqueued++;
+
+    pthread_cond_broadcast(&queue_ptr->tx_fake_cond);
+    pthread_mutex_unlock(&queue_ptr->tx_fake_lock);
+
+    return TX_SUCCESS;
+}
+
+UINT tx_queue_receive(TX_QUEUE* queue_ptr, VOID* destination_ptr, ULONG wait_option)
+{
+    struct timespec deadline = deadline_get(wait_option);
+
+    pthread_mutex_lock(&queue_ptr->tx_fake_lock);
+
+    while (queue_ptr->tx_queue_enqueued == 0)
+    {
+        if (wait_option == TX_NO_WAIT ||
+            !cond_wait(
+                &queue_ptr->tx_fake_cond, &queue_ptr->tx_fake_lock, wait_option == TX_WAIT_FOREVER ? NULL : &deadline))
+        {
+            pthread_mutex_unlock(&queue_ptr->tx_fake_lock);
+            return TX_QUEUE_EMPTY;
+        }
+    }
+
+    memcpy(destination_ptr,
+        &queue_ptr->tx_fake_start[queue_ptr->tx_fake_read * queue_ptr->tx_fake_message_size],
+        queue_ptr->tx_fake_message_size * sizeof(ULONG));
+    queue_ptr->tx_fake_read = (queue_ptr->tx_fake_read + 1) % queue_ptr->tx_fake_capacity;
+    queue_ptr->tx_queue_enqueued--;
+
+    pthread_cond_broadcast(&queue_ptr->tx_fake_cond);
+    pthread_mutex_unlock(&queue_ptr->tx_fake_lock);
+
+    return TX_SUCCESS;
+}
+
+static VOID* timer_thread(VOID* parameter)
+{
+    VOID (*expiry)(ULONG);
+    ULONG input;
+    TX_TIMER* timer;
+
+    (VOID) parameter;
+
+    while (true)
+    {
+        pthread_mutex_lock(&timer_lock);
+        for (timer = timer_list; timer != NULL; timer = timer->tx_fake_next)
+        {
+            if (timer->tx_fake_active && (LONG)(tx_time_get() - timer->tx_fake_expires) >= 0)
+            {
+                break;
+            }
+        }
+
+        if (timer == NULL)
+        {
+            pthread_mutex_unlock(&timer_lock);
+            tx_thread_sleep(1);
+            continue;
+        }
+
+        if (timer->tx_fake_reschedule != 0)
+        {
+            timer->tx_fake_expires += timer->tx_fake_reschedule;
+        }
+        else
+        {
+            timer->tx_fake_active = 0;
+        }
+
+        expiry = timer->tx_fake_expiry;
+        input  = timer->tx_fake_input;
+        pthread_mutex_unlock(&timer_lock);
+
+        // Runs unlocked, expiry functions may change timers
+        expiry(input);
+    }
+
+    return NULL;
+}
+
+static VOID timer_thread_start(VOID)
+{
+    pthread_t thread;
+
+    pthread_create(&thread, NULL, timer_thread, NULL);
+    pthread_detach(thread);
+}
+
+UINT tx_timer_create(TX_TIMER* timer_ptr,
+    CHAR* name_ptr,
+    VOID (*expiration_function)(ULONG),
+    ULONG expiration_input,
+    ULONG initial_ticks,
+    ULONG reschedule_ticks,
+    UINT auto_activate)
+{
+    (VOID) name_ptr;
+
+    pthread_once(&timer_once, timer_thread_start);
+
+    pthread_mutex_lock(&timer_lock);
+    timer_ptr->tx_fake_expiry     = expiration_function;
+    timer_ptr->tx_fake_input      = expiration_input;
+    timer_ptr->tx_fake_initial    = initial_ticks;
+    timer_ptr->tx_fake_reschedule = reschedule_ticks;
+    timer_ptr->tx_fake_expires    = tx_time_get() + initial_ticks;
+    timer_ptr->tx_fake_active     = auto_activate;
+    timer_ptr->tx_fake_next       = timer_list;
+    timer_list                    = timer_ptr;
+    pthread_mutex_unlock(&timer_lock);
+
+    return TX_SUCCESS;
+}
+
+UINT tx_timer_delete(TX_TIMER* timer_ptr)
+{
+    TX_TIMER** link;
+
+    pthread_mutex_lock(&timer_lock);
+    for (link = &timer_list; *link != NULL; link = &(*link)->tx_fake_next)
+    {
+        if (*link == timer_ptr)
+        {
+            *link = timer_ptr->tx_fake_next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&timer_lock);
+
+    return TX_SUCCESS;
+}
+
+UINT tx_timer_activate(TX_TIMER* timer_ptr)
+{
+    pthread_mutex_lock(&timer_lock);
+    timer_ptr->tx_fake_expires = tx_time_get() + timer_ptr->tx_fake_initial;
+    timer_ptr->tx_fake_active  = 1;
+    pthread_mutex_unlock(&timer_lock);
+
+    return TX_SUCCESS;
+}
+
+UINT tx_timer_deactivate(TX_TIMER* timer_ptr)
+{
+    pthread_mutex_lock(&timer_lock);
+    timer_ptr->tx_fake_active = 0;
+    pthread_mutex_unlock(&timer_lock);
+
+    return TX_SUCCESS;
+}
+
+UINT tx_timer_change(TX_TIMER* timer_ptr, ULONG initial_ticks, ULONG reschedule_ticks)
+{
+    pthread_mutex_lock(&timer_lock);
+    timer_ptr->tx_fake_initial    = initial_ticks;
+    timer_ptr->tx_fake_reschedule = reschedule_ticks;
+    pthread_mutex_unlock(&timer_lock);
+
+    return TX_SUCCESS;
+}
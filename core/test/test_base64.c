@@ -0,0 +1,212 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// base64 and URL encoding: RFC 4648 vectors, round trips over every tail length, exact output
+// bounds, then random input thrown at the decoder. Pass an iteration count for a longer fuzz run.
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "base64.h"
+
+#include "test_common.h"
+
+#define GUARD      0xA5
+#define GUARD_SIZE 8
+
+static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static const char* rfc4648[][2] = {
+    {"", ""},
+    {"f", "Zg=="},
+    {"fo", "Zm8="},
+    {"foo", "Zm9v"},
+    {"foob", "Zm9vYg=="},
+    {"fooba", "Zm9vYmE="},
+    {"foobar", "Zm9vYmFy"},
+};
+
+static bool alphabet_char(char c)
+{
+    return ('A' <= c && c <= 'Z') || ('a' <= c && c <= 'z') || ('0' <= c && c <= '9') || c == '+' || c == '/';
+}
+
+// What the decoder should accept: alphabet characters, padding only to complete the last group
+static bool reference_valid(const char* src, size_t length)
+{
+    if (length % 4 == 0)
+    {
+        for (int i = 0; i < 2 && length > 0 && src[length - 1] == '='; i++)
+        {
+            length--;
+        }
+    }
+
+    if (length % 4 == 1)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < length; i++)
+    {
+        if (!alphabet_char(src[i]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void random_bytes(unsigned char* data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        data[i] = (unsigned char)rand();
+    }
+}
+
+static void test_vectors(void)
+{
+    char encoded[16];
+    char url[20];
+    unsigned char decoded[16];
+    size_t length;
+
+    for (size_t i = 0; i < sizeof(rfc4648) / sizeof(rfc4648[0]); i++)
+    {
+        const char* plain  = rfc4648[i][0];
+        const char* base64 = rfc4648[i][1];
+
+        TEST_ASSERT(base64_encode((const unsigned char*)plain, strlen(plain), encoded, sizeof(encoded)) ==
+                    strlen(base64));
+        TEST_ASSERT(strcmp(encoded, base64) == 0);
+
+        // Padded and unpadded both decode
+        TEST_ASSERT(base64_decode(base64, strlen(base64), decoded, sizeof(decoded), &length));
+        TEST_ASSERT(length == strlen(plain) && memcmp(decoded, plain, length) == 0);
+        TEST_ASSERT(base64_decode(base64, strcspn(base64, "="), decoded, sizeof(decoded), &length));
+        TEST_ASSERT(length == strlen(plain) && memcmp(decoded, plain, length) == 0);
+    }
+
+    TEST_ASSERT(url_encode("a b/c+d=", 8, url, sizeof(url)) == 16);
+    TEST_ASSERT(strcmp(url, "a%20b%2fc%2bd%3d") == 0);
+
+    TEST_ASSERT(!base64_decode("Zm9v!", 5, decoded, sizeof(decoded), &length));
+    TEST_ASSERT(!base64_decode("Zm9vY", 5, decoded, sizeof(decoded), &length));
+    TEST_ASSERT(!base64_decode("Zm=v", 4, decoded, sizeof(decoded), &length));
+}
+
+static void test_round_trip(void)
+{
+    unsigned char data[300];
+    unsigned char decoded[300 + GUARD_SIZE];
+    char encoded[BASE64_ENCODED_LENGTH(300) + 1 + GUARD_SIZE];
+    char url[BASE64_ENCODED_LENGTH(300) * 3 + 1];
+    char url_direct[BASE64_ENCODED_LENGTH(300) * 3 + 1];
+    size_t encoded_length;
+    size_t length;
+
+    for (size_t size = 0; size <= sizeof(data); size++)
+    {
+        random_bytes(data, size);
+        encoded_length = BASE64_ENCODED_LENGTH(size);
+
+        // Exactly enough room succeeds, one byte less fails and writes nothing past the buffer
+        memset(encoded, GUARD, sizeof(encoded));
+        TEST_ASSERT(base64_encode(data, size, encoded, encoded_length) == 0);
+        TEST_ASSERT((unsigned char)encoded[encoded_length] == GUARD);
+        TEST_ASSERT(base64_encode(data, size, encoded, encoded_length + 1) == encoded_length);
+        TEST_ASSERT(encoded[encoded_length] == 0);
+        TEST_ASSERT((unsigned char)encoded[encoded_length + 1] == GUARD);
+
+        memset(decoded, GUARD, sizeof(decoded));
+        if (size > 0)
+        {
+            TEST_ASSERT(!base64_decode(encoded, encoded_length, decoded, size - 1, &length));
+        }
+        TEST_ASSERT(base64_decode(encoded, encoded_length, decoded, size, &length));
+        TEST_ASSERT(length == size);
+        TEST_ASSERT(memcmp(decoded, data, size) == 0);
+        TEST_ASSERT(decoded[size] == GUARD);
+        TEST_ASSERT(size <= BASE64_DECODED_MAX_LENGTH(encoded_length));
+
+        // The one pass encoder matches the two step one
+        TEST_ASSERT(url_encode(encoded, encoded_length, url, sizeof(url)) > 0 || size == 0);
+        TEST_ASSERT(base64_url_encode(data, size, url_direct, sizeof(url_direct)) == strlen(url));
+        TEST_ASSERT(strcmp(url, url_direct) == 0);
+        TEST_ASSERT(base64_url_encode(data, size, url_direct, strlen(url)) == 0);
+    }
+}
+
+// Random mixes of alphabet, padding and stray characters, accepted exactly when the reference says
+// so and never written past the output size
+static void test_fuzz(unsigned long iterations)
+{
+    static const char pool[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/====-_ \n.\x80\xff";
+    char src[64];
+    unsigned char decoded[64 + GUARD_SIZE];
+    char encoded[BASE64_ENCODED_LENGTH(64) + 1];
+    unsigned char again[64];
+    size_t src_length;
+    size_t out_size;
+    size_t length;
+    size_t again_length;
+    bool valid;
+    bool fits;
+
+    for (unsigned long i = 0; i < iterations; i++)
+    {
+        src_length = rand() % sizeof(src);
+        for (size_t j = 0; j < src_length; j++)
+        {
+            // Mostly alphabet so that valid input turns up often
+            src[j] = rand() % 8 ? alphabet[rand() % 64] : pool[rand() % (sizeof(pool) - 1)];
+        }
+
+        out_size = rand() % 64;
+        valid    = reference_valid(src, src_length);
+
+        memset(decoded, GUARD, sizeof(decoded));
+        length = 0;
+        fits   = base64_decode(src, src_length, decoded, out_size, &length);
+
+        for (size_t j = out_size; j < sizeof(decoded); j++)
+        {
+            TEST_ASSERT(decoded[j] == GUARD);
+        }
+
+        if (!valid)
+        {
+            TEST_ASSERT(!fits);
+            continue;
+        }
+
+        if (fits)
+        {
+            TEST_ASSERT(length <= out_size);
+            TEST_ASSERT(length <= BASE64_DECODED_MAX_LENGTH(src_length));
+
+            // Whatever decodes encodes back to something that decodes the same
+            TEST_ASSERT(base64_encode(decoded, length, encoded, sizeof(encoded)) == BASE64_ENCODED_LENGTH(length));
+            TEST_ASSERT(base64_decode(encoded, strlen(encoded), again, sizeof(again), &again_length));
+            TEST_ASSERT(again_length == length && memcmp(again, decoded, length) == 0);
+        }
+        else
+        {
+            TEST_ASSERT(base64_decode(src, src_length, decoded, sizeof(decoded) - GUARD_SIZE, &length));
+            TEST_ASSERT(length > out_size);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    srand(4648);
+
+    test_vectors();
+    test_round_trip();
+    test_fuzz(test_iterations(argc, argv, 200000));
+
+    return 0;
+}
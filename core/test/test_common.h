@@ -0,0 +1,37 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _TEST_COMMON_H
+#define _TEST_COMMON_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Stops the test at the first failure, ctest reports the non zero exit
+#define TEST_ASSERT(condition)                                                                                         \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(condition))                                                                                              \
+        {                                                                                                              \
+            printf("%s:%d: assertion failed: %s\n", __FILE__, __LINE__, #condition);                                  \
+            exit(1);                                                                                                   \
+        }                                                                                                              \
+    } while (0)
+
+static inline double test_seconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Iteration count from the command line, ctest passes a small one
+static inline unsigned long test_iterations(int argc, char** argv, unsigned long fallback)
+{
+    return argc > 1 ? strtoul(argv[1], NULL, 10) : fallback;
+}
+
+#endif // _TEST_COMMON_H
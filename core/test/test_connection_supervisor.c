@@ -0,0 +1,90 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// Drops reported while a reconnect is in progress: a late report about the old connection is ignored,
+// a drop of the new connection before it reaches ready still triggers another attempt.
+
+#include "connection_supervisor.h"
+
+#include "test_common.h"
+
+#define DROP_NONE    0
+#define DROP_STALE   1 // Reported before the attempt starts connecting, i.e. about the connection it replaces
+#define DROP_CURRENT 2 // Reported once the attempt is connecting, i.e. about the new connection
+
+static CONNECTION_SUPERVISOR supervisor;
+
+static volatile UINT attempt_count;
+static volatile UINT attempt_drop;
+
+static UINT attempt(VOID* context)
+{
+    (VOID) context;
+
+    connection_supervisor_state_set(&supervisor, CONNECTION_STATE_RESOLVING);
+    if (attempt_drop == DROP_STALE)
+    {
+        connection_supervisor_disconnected(&supervisor);
+    }
+
+    connection_supervisor_state_set(&supervisor, CONNECTION_STATE_CONNECTING);
+    if (attempt_drop == DROP_CURRENT)
+    {
+        connection_supervisor_disconnected(&supervisor);
+    }
+
+    connection_supervisor_state_set(&supervisor, CONNECTION_STATE_SUBSCRIBING);
+
+    attempt_drop = DROP_NONE;
+    attempt_count++;
+
+    return NX_SUCCESS;
+}
+
+static VOID wait_ready(UINT count)
+{
+    ULONG deadline = tx_time_get() + 5 * TX_TIMER_TICKS_PER_SECOND;
+
+    while (attempt_count < count || connection_supervisor_state_get(&supervisor) != CONNECTION_STATE_READY)
+    {
+        TEST_ASSERT(tx_time_get() < deadline);
+
+        tx_thread_sleep(1);
+    }
+}
+
+int main(VOID)
+{
+    CONNECTION_SUPERVISOR_METRICS metrics;
+
+    TEST_ASSERT(connection_supervisor_create(&supervisor, "supervisor", 5, attempt, NX_NULL) == NX_SUCCESS);
+    TEST_ASSERT(connection_supervisor_connect(&supervisor) == NX_SUCCESS);
+    TEST_ASSERT(attempt_count == 1);
+    TEST_ASSERT(connection_supervisor_state_get(&supervisor) == CONNECTION_STATE_READY);
+
+    // The old connection reports its drop twice, the second report lands during the reconnect
+    attempt_drop = DROP_STALE;
+    connection_supervisor_disconnected(&supervisor);
+    wait_ready(2);
+
+    tx_thread_sleep(TX_TIMER_TICKS_PER_SECOND / 5);
+    TEST_ASSERT(attempt_count == 2);
+    TEST_ASSERT(connection_supervisor_state_get(&supervisor) == CONNECTION_STATE_READY);
+
+    // The new connection drops while still subscribing, it must not be mistaken for the old one
+    attempt_drop = DROP_CURRENT;
+    connection_supervisor_disconnected(&supervisor);
+    wait_ready(4);
+
+    tx_thread_sleep(TX_TIMER_TICKS_PER_SECOND / 5);
+    TEST_ASSERT(attempt_count == 4);
+
+    TEST_ASSERT(connection_supervisor_metrics_get(&supervisor, &metrics) == NX_SUCCESS);
+    TEST_ASSERT(metrics.reconnects == 3);
+    TEST_ASSERT(metrics.handshakes == 4);
+    TEST_ASSERT(metrics.failed_attempts == 0);
+
+    TEST_ASSERT(connection_supervisor_delete(&supervisor) == NX_SUCCESS);
+
+    return 0;
+}
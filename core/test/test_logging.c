@@ -0,0 +1,153 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// Deferred log formatting: each conversion is captured at the width its length modifier gives and
+// must print exactly as printf would have printed it in place. The host has a 64 bit long, so a
+// value stored or printed at the wrong width shows up here.
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "logging.h"
+
+#include "json_utils.h"
+#include "test_common.h"
+
+static FILE* capture_file;
+static int saved_stdout;
+
+// The level method is not exercised, these only satisfy the link
+void jsmn_init(jsmn_parser* parser)
+{
+    (void)parser;
+}
+
+int jsmn_parse(jsmn_parser* parser, const char* js, const size_t len, jsmntok_t* tokens, const unsigned int num_tokens)
+{
+    (void)parser;
+    (void)js;
+    (void)len;
+    (void)tokens;
+    (void)num_tokens;
+
+    return -1;
+}
+
+bool findJsonInt(const char* json, jsmntok_t* tokens, int tokens_count, const char* s, int* value)
+{
+    (void)json;
+    (void)tokens;
+    (void)tokens_count;
+    (void)s;
+    (void)value;
+
+    return false;
+}
+
+bool findJsonStringN(
+    const char* json, jsmntok_t* tokens, int tokens_count, const char* s, char* value, int value_size)
+{
+    (void)json;
+    (void)tokens;
+    (void)tokens_count;
+    (void)s;
+    (void)value;
+    (void)value_size;
+
+    return false;
+}
+
+// Logging is not started, so logging_write formats and prints on the calling thread
+static void capture_begin(void)
+{
+    fflush(stdout);
+    capture_file = tmpfile();
+    TEST_ASSERT(capture_file != NULL);
+    saved_stdout = dup(STDOUT_FILENO);
+    dup2(fileno(capture_file), STDOUT_FILENO);
+}
+
+// The captured line without its line ending
+static const char* capture_end(void)
+{
+    static char line[256];
+    size_t length;
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    rewind(capture_file);
+    length       = fread(line, 1, sizeof(line) - 1, capture_file);
+    line[length] = 0;
+    fclose(capture_file);
+
+    TEST_ASSERT(length >= 2 && strcmp(&line[length - 2], "\r\n") == 0);
+    line[length - 2] = 0;
+
+    return line;
+}
+
+#define CHECK_FORMAT(...)                                                                                              \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        char expected[160];                                                                                            \
+        snprintf(expected, sizeof(expected), __VA_ARGS__);                                                             \
+        capture_begin();                                                                                               \
+        logging_write(LOG_MODULE_APP, LOG_LEVEL_INFO, __VA_ARGS__);                                                    \
+        TEST_ASSERT(strcmp(capture_end(), expected) == 0);                                                             \
+    } while (0)
+
+#define CHECK_OUTPUT(expected, ...)                                                                                    \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        capture_begin();                                                                                               \
+        logging_write(LOG_MODULE_APP, LOG_LEVEL_INFO, __VA_ARGS__);                                                    \
+        TEST_ASSERT(strcmp(capture_end(), expected) == 0);                                                             \
+    } while (0)
+
+static void test_integer_widths(void)
+{
+    CHECK_FORMAT("%d %i %u %x %X %o", INT_MIN, -1, UINT_MAX, 0xdeadbeefU, 0xabcU, 8U);
+    CHECK_FORMAT("%ld %lu %lx", LONG_MIN, ULONG_MAX, 0x123456789abcdefUL);
+    CHECK_FORMAT("%lld %llu %jd", LLONG_MIN, ULLONG_MAX, (intmax_t)-42);
+    CHECK_FORMAT("%zu %zx %td", SIZE_MAX, (size_t)0x1000, (ptrdiff_t)-7);
+    CHECK_FORMAT("%hd %hu %hhx %hhd", -2, 0x1ffff, 0x1ff, 200);
+    CHECK_FORMAT("%c%c%c", 'o', 'k', '!');
+
+    // Widths, flags and precision stay with the conversion
+    CHECK_FORMAT("[%08lx] [%-6d] [%+ld] [%#x] [%.3u]", 0xbeefUL, 42, 7L, 255U, 5U);
+    CHECK_FORMAT("[%*d] [%-*lu] [%.*d]", 6, -3, 4, 12UL, 4, 9);
+
+    // Mixed widths do not shift the arguments that follow
+    CHECK_FORMAT("%d %lld %d %zu %ld %u", -1, LLONG_MAX, 2, (size_t)3, -4L, 5U);
+}
+
+static void test_other_conversions(void)
+{
+    int local = 0;
+
+    CHECK_FORMAT("%.2f %e %g %8.3f", 3.14159, -1e-10, 1e20, 2.5);
+    CHECK_FORMAT("%s|%-8s|%.3s|%.*s", "abc", "pad", "truncate", 2, "xyz");
+    CHECK_FORMAT("%p", (void*)&local);
+    CHECK_FORMAT("100%% done, %d%%", 5);
+}
+
+// A format ending in '%' must neither consume an argument nor print one
+static void test_trailing_percent(void)
+{
+    CHECK_OUTPUT("progress 100%", "progress 100%");
+    CHECK_OUTPUT("5 %", "%d %", 5);
+    CHECK_OUTPUT("%", "%");
+}
+
+int main(void)
+{
+    test_integer_widths();
+    test_other_conversions();
+    test_trailing_percent();
+
+    return 0;
+}
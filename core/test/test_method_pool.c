@@ -0,0 +1,140 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// Direct method responses are matched by handle: once a call has timed out and its slot went to a
+// later call, a late response with the old handle is dropped instead of answering the later call.
+
+#include <string.h>
+
+#include "azure_iot_nx_method.h"
+
+#include "test_common.h"
+
+#define SLOW_TIMEOUT 10
+
+static AZURE_IOT_NX_METHOD_POOL pool;
+static NX_AZURE_IOT_HUB_CLIENT hub_client;
+static NX_PACKET_POOL packet_pool;
+
+static volatile UINT invoke_count;
+static AZURE_IOT_NX_METHOD_HANDLE invoked_handle;
+
+static UINT response_count;
+static UINT response_status;
+static CHAR response_context[AZURE_IOT_NX_METHOD_CONTEXT_SIZE + 1];
+
+UINT nx_azure_iot_hub_client_direct_method_message_response(NX_AZURE_IOT_HUB_CLIENT* hub_client_ptr,
+    UINT status_code,
+    VOID* context_ptr,
+    USHORT context_length,
+    const UCHAR* payload,
+    UINT payload_length,
+    UINT wait_option)
+{
+    (VOID) payload;
+    (VOID) payload_length;
+    (VOID) wait_option;
+
+    TEST_ASSERT(hub_client_ptr == &hub_client);
+    TEST_ASSERT(context_length <= AZURE_IOT_NX_METHOD_CONTEXT_SIZE);
+
+    memcpy(response_context, context_ptr, context_length);
+    response_context[context_length] = 0;
+    response_status                  = status_code;
+    response_count++;
+
+    return NX_AZURE_IOT_SUCCESS;
+}
+
+// Keeps the handle and returns without answering, as a method that finishes its work later would
+static VOID invoke(VOID* context,
+    const UCHAR* method,
+    USHORT method_length,
+    UCHAR* payload,
+    USHORT payload_length,
+    AZURE_IOT_NX_METHOD_HANDLE method_handle)
+{
+    (VOID) method;
+    (VOID) method_length;
+    (VOID) payload;
+    (VOID) payload_length;
+
+    TEST_ASSERT(context == &pool);
+
+    invoked_handle = method_handle;
+    invoke_count++;
+}
+
+// The request id stands in for the middleware's method context
+static AZURE_IOT_NX_METHOD_HANDLE dispatch(const CHAR* rid)
+{
+    NX_PACKET* packet;
+    ULONG timeout;
+    ULONG deadline;
+    UINT count = invoke_count;
+
+    TEST_ASSERT(nx_packet_allocate(&packet_pool, &packet, 0, NX_NO_WAIT) == NX_SUCCESS);
+    TEST_ASSERT(nx_packet_data_append(packet, "{}", 2, &packet_pool, NX_NO_WAIT) == NX_SUCCESS);
+
+    TEST_ASSERT(azure_iot_nx_method_dispatch(
+                    &pool, (const UCHAR*)"slow", 4, packet, (VOID*)rid, (USHORT)strlen(rid), &timeout) == NX_SUCCESS);
+    TEST_ASSERT(timeout == SLOW_TIMEOUT);
+
+    deadline = tx_time_get() + 5 * TX_TIMER_TICKS_PER_SECOND;
+    while (invoke_count == count)
+    {
+        TEST_ASSERT(tx_time_get() < deadline);
+
+        tx_thread_sleep(1);
+    }
+
+    return invoked_handle;
+}
+
+int main(VOID)
+{
+    static UCHAR pool_memory[8 * 128];
+    AZURE_IOT_NX_METHOD_METRICS metrics;
+    AZURE_IOT_NX_METHOD_HANDLE expired;
+    AZURE_IOT_NX_METHOD_HANDLE current;
+    AZURE_IOT_NX_METHOD_HANDLE invalid;
+
+    nx_packet_pool_create(&packet_pool, "pool", 64, pool_memory, sizeof(pool_memory));
+    TEST_ASSERT(azure_iot_nx_method_pool_create(&pool, &hub_client, 5, invoke, &pool) == NX_SUCCESS);
+    TEST_ASSERT(azure_iot_nx_method_limit_set(&pool, "slow", 1, SLOW_TIMEOUT) == NX_SUCCESS);
+
+    // The first call times out and the hub is answered on its behalf
+    expired = dispatch("rid-1");
+    tx_thread_sleep(SLOW_TIMEOUT + 1);
+    TEST_ASSERT(azure_iot_nx_method_expire(&pool) == TX_WAIT_FOREVER);
+    TEST_ASSERT(response_count == 1 && response_status == 504 && strcmp(response_context, "rid-1") == 0);
+
+    // The next call lands in the same slot
+    current = dispatch("rid-2");
+    TEST_ASSERT(current.index == expired.index);
+    TEST_ASSERT(current.sequence != expired.sequence);
+
+    // The late answer to the first call must not reach the second
+    TEST_ASSERT(azure_iot_nx_method_respond(&pool, 200, expired, (UCHAR*)"{}", 2) == NX_NOT_FOUND);
+    TEST_ASSERT(response_count == 1);
+
+    TEST_ASSERT(azure_iot_nx_method_respond(&pool, 200, current, (UCHAR*)"{}", 2) == NX_SUCCESS);
+    TEST_ASSERT(response_count == 2 && response_status == 200 && strcmp(response_context, "rid-2") == 0);
+
+    // Answered once only, and handles that never named a call match nothing
+    TEST_ASSERT(azure_iot_nx_method_respond(&pool, 200, current, (UCHAR*)"{}", 2) == NX_NOT_FOUND);
+    memset(&invalid, 0, sizeof(invalid));
+    TEST_ASSERT(azure_iot_nx_method_respond(&pool, 200, invalid, (UCHAR*)"{}", 2) == NX_NOT_FOUND);
+    invalid.index = AZURE_IOT_NX_METHOD_MAX;
+    TEST_ASSERT(azure_iot_nx_method_respond(&pool, 200, invalid, (UCHAR*)"{}", 2) == NX_INVALID_PARAMETERS);
+    TEST_ASSERT(response_count == 2);
+
+    azure_iot_nx_method_metrics_get(&pool, &metrics);
+    TEST_ASSERT(metrics.dispatched == 2);
+    TEST_ASSERT(metrics.timed_out == 1);
+    TEST_ASSERT(metrics.late == 3);
+
+    TEST_ASSERT(azure_iot_nx_method_pool_delete(&pool) == NX_SUCCESS);
+
+    return 0;
+}
@@ -0,0 +1,305 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// Reported property patch pipeline against a hub that holds patches on the wire on demand: senders
+// overlap up to their count, every patch gets exactly one result, refusals and transport failures
+// are told apart, and a wait that gives up leaves the slot to be freed by delivery.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "azure_iot_nx_patch.h"
+
+#include "test_common.h"
+
+#define DOCUMENT_OK      "{\"ok\":1}"
+#define DOCUMENT_REFUSED "{\"refused\":1}"
+#define DOCUMENT_DROPPED "{\"dropped\":1}"
+
+static AZURE_IOT_NX_PATCH_PIPELINE pipeline;
+static NX_AZURE_IOT_HUB_CLIENT hub_client;
+
+static volatile bool hub_hold;
+static volatile UINT hub_on_wire;
+static volatile UINT hub_max_on_wire;
+static volatile ULONG hub_version;
+static volatile UINT done_count;
+
+static ULONG completed_request[16];
+static AZURE_IOT_NX_PATCH_RESULT completed_result[16];
+static UINT completed_count;
+
+// Answers from the document: refused gets a 400, dropped never reaches the hub, anything else a 204
+UINT nx_azure_iot_hub_client_device_twin_reported_properties_send(NX_AZURE_IOT_HUB_CLIENT* hub_client_ptr,
+    const UCHAR* message_buffer,
+    UINT message_length,
+    UINT* request_id_ptr,
+    UINT* response_status_ptr,
+    ULONG* version_ptr,
+    UINT wait_option)
+{
+    TX_INTERRUPT_SAVE_AREA
+    UINT status = NX_AZURE_IOT_SUCCESS;
+
+    (VOID) wait_option;
+
+    TEST_ASSERT(hub_client_ptr == &hub_client);
+
+    TX_DISABLE
+    if (++hub_on_wire > hub_max_on_wire)
+    {
+        hub_max_on_wire = hub_on_wire;
+    }
+    TX_RESTORE
+
+    while (hub_hold)
+    {
+        tx_thread_sleep(1);
+    }
+
+    *request_id_ptr = 0;
+
+    if (message_length == strlen(DOCUMENT_DROPPED) && memcmp(message_buffer, DOCUMENT_DROPPED, message_length) == 0)
+    {
+        status = NX_NOT_CONNECTED;
+    }
+    else if (message_length == strlen(DOCUMENT_REFUSED) &&
+             memcmp(message_buffer, DOCUMENT_REFUSED, message_length) == 0)
+    {
+        *response_status_ptr = 400;
+    }
+    else
+    {
+        TX_DISABLE
+        *version_ptr = ++hub_version;
+        TX_RESTORE
+
+        *response_status_ptr = 204;
+    }
+
+    TX_DISABLE
+    hub_on_wire--;
+    TX_RESTORE
+
+    return status;
+}
+
+static VOID patch_done(VOID* context)
+{
+    TEST_ASSERT(context == &pipeline);
+
+    done_count++;
+}
+
+static VOID patch_complete(ULONG request, AZURE_IOT_NX_PATCH_RESULT* result, VOID* context)
+{
+    TEST_ASSERT(context == &pipeline);
+    TEST_ASSERT(completed_count < sizeof(completed_request) / sizeof(completed_request[0]));
+
+    completed_request[completed_count] = request;
+    completed_result[completed_count]  = *result;
+    completed_count++;
+}
+
+static ULONG submit(const CHAR* document, bool keep)
+{
+    AZURE_IOT_NX_PATCH* patch;
+    ULONG request = 0;
+    UINT length   = (UINT)strlen(document);
+
+    TEST_ASSERT(azure_iot_nx_patch_claim(&pipeline, &patch) == NX_SUCCESS);
+    memcpy(patch->document, document, length);
+    TEST_ASSERT(azure_iot_nx_patch_submit(&pipeline, patch, length, patch_complete, &pipeline, keep, &request) ==
+                NX_SUCCESS);
+    TEST_ASSERT(request != 0);
+
+    return request;
+}
+
+static VOID wait_done(UINT count)
+{
+    ULONG deadline = tx_time_get() + 5 * TX_TIMER_TICKS_PER_SECOND;
+
+    while (done_count < count)
+    {
+        TEST_ASSERT(tx_time_get() < deadline);
+
+        tx_thread_sleep(1);
+    }
+}
+
+static VOID wait_on_wire(UINT count)
+{
+    ULONG deadline = tx_time_get() + 5 * TX_TIMER_TICKS_PER_SECOND;
+
+    while (hub_on_wire < count)
+    {
+        TEST_ASSERT(tx_time_get() < deadline);
+
+        tx_thread_sleep(1);
+    }
+}
+
+// Every slot is free again once all of them can be claimed at once
+static VOID assert_all_free(VOID)
+{
+    AZURE_IOT_NX_PATCH* patches[AZURE_IOT_NX_PATCH_MAX];
+
+    for (UINT i = 0; i < AZURE_IOT_NX_PATCH_MAX; i++)
+    {
+        TEST_ASSERT(azure_iot_nx_patch_claim(&pipeline, &patches[i]) == NX_SUCCESS);
+    }
+
+    for (UINT i = 0; i < AZURE_IOT_NX_PATCH_MAX; i++)
+    {
+        azure_iot_nx_patch_abandon(&pipeline, patches[i]);
+    }
+}
+
+static VOID test_wait(VOID)
+{
+    AZURE_IOT_NX_PATCH_RESULT result;
+    ULONG request;
+
+    request = submit(DOCUMENT_OK, true);
+    TEST_ASSERT(azure_iot_nx_patch_wait(&pipeline, request, &result, 5 * TX_TIMER_TICKS_PER_SECOND) == TX_SUCCESS);
+    TEST_ASSERT(result.status == NX_SUCCESS);
+    TEST_ASSERT(result.response_status == 204);
+    TEST_ASSERT(result.version == hub_version);
+
+    // The result was collected, a second wait finds nothing
+    wait_done(1);
+    azure_iot_nx_patch_deliver(&pipeline);
+    TEST_ASSERT(completed_count == 1 && completed_request[0] == request);
+    TEST_ASSERT(azure_iot_nx_patch_wait(&pipeline, request, &result, TX_NO_WAIT) == NX_NOT_FOUND);
+    TEST_ASSERT(azure_iot_nx_patch_wait(&pipeline, 0, &result, TX_NO_WAIT) == NX_NOT_FOUND);
+
+    assert_all_free();
+}
+
+static VOID test_overlap(VOID)
+{
+    AZURE_IOT_NX_PATCH_METRICS metrics;
+    AZURE_IOT_NX_PATCH* patch;
+    ULONG requests[AZURE_IOT_NX_PATCH_MAX];
+    UINT done_before = done_count;
+
+    completed_count = 0;
+    hub_hold        = true;
+
+    for (UINT i = 0; i < AZURE_IOT_NX_PATCH_MAX; i++)
+    {
+        requests[i] = submit(DOCUMENT_OK, false);
+    }
+
+    // Each sender holds one patch on the wire, the rest wait in the queue and no slot is left
+    wait_on_wire(AZURE_IOT_NX_PATCH_SENDERS);
+    tx_thread_sleep(TX_TIMER_TICKS_PER_SECOND / 10);
+    TEST_ASSERT(hub_on_wire == AZURE_IOT_NX_PATCH_SENDERS);
+    TEST_ASSERT(azure_iot_nx_patch_claim(&pipeline, &patch) == NX_NO_MORE_ENTRIES);
+
+    hub_hold = false;
+    wait_done(done_before + AZURE_IOT_NX_PATCH_MAX);
+
+    azure_iot_nx_patch_deliver(&pipeline);
+    azure_iot_nx_patch_deliver(&pipeline);
+
+    // One completion per request, whatever order the senders finished in
+    TEST_ASSERT(completed_count == AZURE_IOT_NX_PATCH_MAX);
+    for (UINT i = 0; i < AZURE_IOT_NX_PATCH_MAX; i++)
+    {
+        UINT seen = 0;
+
+        for (UINT j = 0; j < completed_count; j++)
+        {
+            if (completed_request[j] == requests[i])
+            {
+                TEST_ASSERT(completed_result[j].status == NX_SUCCESS);
+                TEST_ASSERT(completed_result[j].response_status == 204);
+                seen++;
+            }
+        }
+        TEST_ASSERT(seen == 1);
+    }
+
+    TEST_ASSERT(hub_max_on_wire == AZURE_IOT_NX_PATCH_SENDERS);
+
+    azure_iot_nx_patch_metrics_get(&pipeline, &metrics);
+    TEST_ASSERT(metrics.max_in_flight == AZURE_IOT_NX_PATCH_MAX);
+    TEST_ASSERT(metrics.rejected == 1);
+
+    assert_all_free();
+}
+
+static VOID test_failures(VOID)
+{
+    AZURE_IOT_NX_PATCH_METRICS before;
+    AZURE_IOT_NX_PATCH_METRICS after;
+    AZURE_IOT_NX_PATCH_RESULT result;
+    AZURE_IOT_NX_PATCH* patch;
+    ULONG request;
+    UINT done_before = done_count;
+
+    azure_iot_nx_patch_metrics_get(&pipeline, &before);
+
+    request = submit(DOCUMENT_REFUSED, true);
+    TEST_ASSERT(azure_iot_nx_patch_wait(&pipeline, request, &result, 5 * TX_TIMER_TICKS_PER_SECOND) == TX_SUCCESS);
+    TEST_ASSERT(result.status == NX_NOT_SUCCESSFUL);
+    TEST_ASSERT(result.response_status == 400);
+
+    request = submit(DOCUMENT_DROPPED, true);
+    TEST_ASSERT(azure_iot_nx_patch_wait(&pipeline, request, &result, 5 * TX_TIMER_TICKS_PER_SECOND) == TX_SUCCESS);
+    TEST_ASSERT(result.status == NX_NOT_CONNECTED);
+    TEST_ASSERT(result.response_status == 0);
+
+    // An empty document is refused before it is queued and its slot is handed back
+    TEST_ASSERT(azure_iot_nx_patch_claim(&pipeline, &patch) == NX_SUCCESS);
+    TEST_ASSERT(azure_iot_nx_patch_submit(&pipeline, patch, 0, patch_complete, &pipeline, false, NX_NULL) ==
+                NX_SIZE_ERROR);
+
+    azure_iot_nx_patch_metrics_get(&pipeline, &after);
+    TEST_ASSERT(after.failed == before.failed + 2);
+    TEST_ASSERT(after.submitted == before.submitted + 2);
+
+    // The done callback runs after the waiter is woken
+    wait_done(done_before + 2);
+    azure_iot_nx_patch_deliver(&pipeline);
+    assert_all_free();
+}
+
+// A wait that times out gives up the result, delivery then frees the slot
+static VOID test_wait_timeout(VOID)
+{
+    AZURE_IOT_NX_PATCH_RESULT result;
+    ULONG request;
+    UINT done_before = done_count;
+
+    completed_count = 0;
+    hub_hold        = true;
+
+    request = submit(DOCUMENT_OK, true);
+    TEST_ASSERT(azure_iot_nx_patch_wait(&pipeline, request, &result, TX_TIMER_TICKS_PER_SECOND / 10) == TX_NO_EVENTS);
+
+    hub_hold = false;
+    wait_done(done_before + 1);
+
+    azure_iot_nx_patch_deliver(&pipeline);
+    TEST_ASSERT(completed_count == 1 && completed_request[0] == request);
+    TEST_ASSERT(completed_result[0].status == NX_SUCCESS);
+
+    assert_all_free();
+}
+
+int main(VOID)
+{
+    TEST_ASSERT(azure_iot_nx_patch_pipeline_create(&pipeline, &hub_client, 5, patch_done, &pipeline) == NX_SUCCESS);
+
+    test_wait();
+    test_overlap();
+    test_failures();
+    test_wait_timeout();
+
+    TEST_ASSERT(azure_iot_nx_patch_pipeline_delete(&pipeline) == NX_SUCCESS);
+
+    return 0;
+}
@@ -0,0 +1,155 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// A stored DPS assignment is only used when it is intact, was made for the same id scope and
+// registration id, and fits the caller's buffers. Runs against an in-memory store.
+
+#include <string.h>
+
+#include "provisioning_store.h"
+
+#include "test_common.h"
+
+#define ID_SCOPE        "0ne00000001"
+#define REGISTRATION_ID "device-1"
+#define HUB_HOSTNAME    "hub.azure-devices.net"
+#define DEVICE_ID       "device-1"
+
+typedef struct MEMORY_STORE_STRUCT
+{
+    PROVISIONING_RECORD record;
+    bool saved;
+} MEMORY_STORE;
+
+static MEMORY_STORE memory;
+
+static UINT memory_load(VOID* context, PROVISIONING_RECORD* record)
+{
+    MEMORY_STORE* store = (MEMORY_STORE*)context;
+
+    if (!store->saved)
+    {
+        return NX_NOT_FOUND;
+    }
+
+    *record = store->record;
+
+    return NX_SUCCESS;
+}
+
+static UINT memory_save(VOID* context, const PROVISIONING_RECORD* record)
+{
+    MEMORY_STORE* store = (MEMORY_STORE*)context;
+
+    store->record = *record;
+    store->saved  = true;
+
+    return NX_SUCCESS;
+}
+
+static UINT memory_erase(VOID* context)
+{
+    MEMORY_STORE* store = (MEMORY_STORE*)context;
+
+    store->saved = false;
+
+    return NX_SUCCESS;
+}
+
+static PROVISIONING_STORE store = {memory_load, memory_save, memory_erase, &memory};
+
+static CHAR hub_hostname[PROVISIONING_HOSTNAME_SIZE];
+static CHAR device_id[PROVISIONING_DEVICE_ID_SIZE];
+
+static UINT load(CHAR* id_scope, CHAR* registration_id)
+{
+    hub_hostname[0] = 0;
+    device_id[0]    = 0;
+
+    return provisioning_store_load(
+        &store, id_scope, registration_id, hub_hostname, sizeof(hub_hostname), device_id, sizeof(device_id));
+}
+
+static VOID save(VOID)
+{
+    TEST_ASSERT(provisioning_store_save(&store, ID_SCOPE, REGISTRATION_ID, HUB_HOSTNAME, DEVICE_ID) == NX_SUCCESS);
+}
+
+static VOID test_round_trip(VOID)
+{
+    TEST_ASSERT(load(ID_SCOPE, REGISTRATION_ID) == NX_NOT_FOUND);
+
+    save();
+    TEST_ASSERT(load(ID_SCOPE, REGISTRATION_ID) == NX_SUCCESS);
+    TEST_ASSERT(strcmp(hub_hostname, HUB_HOSTNAME) == 0);
+    TEST_ASSERT(strcmp(device_id, DEVICE_ID) == 0);
+
+    TEST_ASSERT(provisioning_store_erase(&store) == NX_SUCCESS);
+    TEST_ASSERT(load(ID_SCOPE, REGISTRATION_ID) == NX_NOT_FOUND);
+}
+
+static VOID test_corrupt(VOID)
+{
+    // A flipped bit anywhere before the checksum, as a torn write would leave
+    save();
+    memory.record.hub_hostname[3] ^= 0x01;
+    TEST_ASSERT(load(ID_SCOPE, REGISTRATION_ID) == NX_NOT_FOUND);
+
+    save();
+    memory.record.checksum++;
+    TEST_ASSERT(load(ID_SCOPE, REGISTRATION_ID) == NX_NOT_FOUND);
+
+    save();
+    memory.record.magic = 0;
+    TEST_ASSERT(load(ID_SCOPE, REGISTRATION_ID) == NX_NOT_FOUND);
+}
+
+static VOID test_other_identity(VOID)
+{
+    save();
+    TEST_ASSERT(load("0ne00000002", REGISTRATION_ID) == NX_NOT_FOUND);
+    TEST_ASSERT(load(ID_SCOPE, "device-2") == NX_NOT_FOUND);
+
+    // The fields are hashed apart, moving a character from one to the other is a different identity
+    TEST_ASSERT(load("0ne0000000", "1" REGISTRATION_ID) == NX_NOT_FOUND);
+
+    TEST_ASSERT(load(ID_SCOPE, REGISTRATION_ID) == NX_SUCCESS);
+}
+
+static VOID test_sizes(VOID)
+{
+    CHAR long_hostname[PROVISIONING_HOSTNAME_SIZE + 1];
+    CHAR long_device_id[PROVISIONING_DEVICE_ID_SIZE + 1];
+    CHAR small[8];
+
+    memset(long_hostname, 'h', PROVISIONING_HOSTNAME_SIZE);
+    long_hostname[PROVISIONING_HOSTNAME_SIZE] = 0;
+    memset(long_device_id, 'd', PROVISIONING_DEVICE_ID_SIZE);
+    long_device_id[PROVISIONING_DEVICE_ID_SIZE] = 0;
+
+    // Too long for the record, nothing is written
+    TEST_ASSERT(provisioning_store_erase(&store) == NX_SUCCESS);
+    TEST_ASSERT(provisioning_store_save(&store, ID_SCOPE, REGISTRATION_ID, long_hostname, DEVICE_ID) == NX_SIZE_ERROR);
+    TEST_ASSERT(provisioning_store_save(&store, ID_SCOPE, REGISTRATION_ID, HUB_HOSTNAME, long_device_id) ==
+                NX_SIZE_ERROR);
+    TEST_ASSERT(!memory.saved);
+
+    // Too long for the caller's buffers
+    save();
+    TEST_ASSERT(provisioning_store_load(
+                    &store, ID_SCOPE, REGISTRATION_ID, small, sizeof(small), device_id, sizeof(device_id)) ==
+                NX_SIZE_ERROR);
+    TEST_ASSERT(provisioning_store_load(
+                    &store, ID_SCOPE, REGISTRATION_ID, hub_hostname, sizeof(hub_hostname), small, sizeof(small)) ==
+                NX_SIZE_ERROR);
+}
+
+int main(VOID)
+{
+    test_round_trip();
+    test_corrupt();
+    test_other_identity();
+    test_sizes();
+
+    return 0;
+}
@@ -0,0 +1,190 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// QoS 1 publish window against the fake broker: completion order, window limits, timeouts and
+// aborts, then throughput at windows of 1, 4 and 16 over a fixed round trip.
+
+#include <string.h>
+
+#include "azure_iot_mqtt_publish.h"
+
+#include "test_common.h"
+
+#define PACKET_COUNT 64
+#define MAX_COMPLETE 1024
+
+#define ROUND_TRIP_TICKS 2
+
+static NX_PACKET_POOL pool;
+static NXD_MQTT_CLIENT client;
+
+static UINT complete_count;
+static ULONG complete_context[MAX_COMPLETE];
+static UINT complete_status[MAX_COMPLETE];
+
+static VOID publish_complete(VOID* context, UINT status)
+{
+    TEST_ASSERT(complete_count < MAX_COMPLETE);
+
+    complete_context[complete_count] = (ULONG)context;
+    complete_status[complete_count]  = status;
+    complete_count++;
+}
+
+static UINT publish(AZURE_IOT_MQTT_PUBLISH_WINDOW* window, ULONG context)
+{
+    return azure_iot_mqtt_publish_window_send(
+        window, &client, "topic", 5, "{}", 2, publish_complete, (VOID*)context);
+}
+
+static VOID wait_complete(AZURE_IOT_MQTT_PUBLISH_WINDOW* window, UINT count)
+{
+    ULONG deadline = tx_time_get() + 5 * TX_TIMER_TICKS_PER_SECOND;
+
+    while (complete_count < count)
+    {
+        TEST_ASSERT(tx_time_get() < deadline);
+
+        tx_thread_sleep(1);
+        azure_iot_mqtt_publish_window_process(window, &client);
+    }
+}
+
+static VOID test_ordered_completion(VOID)
+{
+    AZURE_IOT_MQTT_PUBLISH_WINDOW window;
+
+    complete_count = 0;
+    TEST_ASSERT(azure_iot_mqtt_publish_window_init(&window, 4, TX_TIMER_TICKS_PER_SECOND) == NX_SUCCESS);
+
+    // The window holds back the fifth message until a PUBACK frees a slot
+    nxd_mqtt_fake_pause(&client, NX_TRUE);
+    for (ULONG i = 0; i < 4; i++)
+    {
+        TEST_ASSERT(publish(&window, i) == NX_SUCCESS);
+    }
+    TEST_ASSERT(publish(&window, 4) == NX_NO_MORE_ENTRIES);
+    TEST_ASSERT(complete_count == 0);
+
+    nxd_mqtt_fake_pause(&client, NX_FALSE);
+    wait_complete(&window, 4);
+
+    for (UINT i = 0; i < 4; i++)
+    {
+        TEST_ASSERT(complete_context[i] == i);
+        TEST_ASSERT(complete_status[i] == NX_SUCCESS);
+    }
+
+    // A QoS 1 message published around the window still holds back the ones after it
+    nxd_mqtt_fake_pause(&client, NX_TRUE);
+    TEST_ASSERT(nxd_mqtt_client_publish(&client, "topic", 5, "{}", 2, NX_FALSE, MQTT_QOS_1, NX_NO_WAIT) ==
+                NXD_MQTT_SUCCESS);
+    azure_iot_mqtt_publish_window_sent(&window, &client);
+    TEST_ASSERT(publish(&window, 5) == NX_SUCCESS);
+
+    tx_thread_sleep(ROUND_TRIP_TICKS * 2);
+    azure_iot_mqtt_publish_window_process(&window, &client);
+    TEST_ASSERT(complete_count == 4);
+
+    nxd_mqtt_fake_pause(&client, NX_FALSE);
+    wait_complete(&window, 5);
+    TEST_ASSERT(complete_context[4] == 5);
+    TEST_ASSERT(complete_status[4] == NX_SUCCESS);
+}
+
+static VOID test_timeout_and_abort(VOID)
+{
+    AZURE_IOT_MQTT_PUBLISH_WINDOW window;
+
+    complete_count = 0;
+    TEST_ASSERT(azure_iot_mqtt_publish_window_init(&window, 4, 5) == NX_SUCCESS);
+
+    // No PUBACK within the timeout
+    nxd_mqtt_fake_pause(&client, NX_TRUE);
+    TEST_ASSERT(publish(&window, 10) == NX_SUCCESS);
+    TEST_ASSERT(publish(&window, 11) == NX_SUCCESS);
+    wait_complete(&window, 2);
+    TEST_ASSERT(complete_status[0] == NX_NOT_SUCCESSFUL);
+    TEST_ASSERT(complete_status[1] == NX_NOT_SUCCESSFUL);
+
+    // A disconnect fails whatever is outstanding with the given status
+    TEST_ASSERT(publish(&window, 12) == NX_SUCCESS);
+    azure_iot_mqtt_publish_window_abort(&window, &client, NX_NOT_CONNECTED);
+    TEST_ASSERT(complete_count == 3);
+    TEST_ASSERT(complete_context[2] == 12);
+    TEST_ASSERT(complete_status[2] == NX_NOT_CONNECTED);
+
+    // The next session starts counting from an empty NetX queue
+    nxd_mqtt_fake_reconnect(&client);
+    nxd_mqtt_fake_pause(&client, NX_FALSE);
+    TEST_ASSERT(publish(&window, 13) == NX_SUCCESS);
+    wait_complete(&window, 4);
+    TEST_ASSERT(complete_context[3] == 13);
+    TEST_ASSERT(complete_status[3] == NX_SUCCESS);
+}
+
+static double throughput_run(UINT size, ULONG messages)
+{
+    AZURE_IOT_MQTT_PUBLISH_WINDOW window;
+    ULONG sent = 0;
+    double start;
+    double rate;
+
+    complete_count = 0;
+    TEST_ASSERT(azure_iot_mqtt_publish_window_init(&window, size, 10 * TX_TIMER_TICKS_PER_SECOND) == NX_SUCCESS);
+
+    start = test_seconds();
+    while (sent < messages)
+    {
+        if (publish(&window, sent) == NX_SUCCESS)
+        {
+            sent++;
+        }
+        else
+        {
+            tx_thread_sleep(1);
+        }
+    }
+    wait_complete(&window, messages);
+    rate = messages / (test_seconds() - start);
+
+    for (UINT i = 0; i < messages; i++)
+    {
+        TEST_ASSERT(complete_status[i] == NX_SUCCESS);
+    }
+
+    printf("publish window %2u: %lu messages, %.0f messages/s over a %d ms round trip\n",
+        size,
+        messages,
+        rate,
+        ROUND_TRIP_TICKS * 1000 / TX_TIMER_TICKS_PER_SECOND);
+
+    return rate;
+}
+
+int main(int argc, char** argv)
+{
+    static UCHAR pool_memory[PACKET_COUNT * 128];
+    ULONG messages = test_iterations(argc, argv, 48);
+    double rate_1;
+    double rate_16;
+
+    TEST_ASSERT(messages <= MAX_COMPLETE);
+
+    nx_packet_pool_create(&pool, "pool", 64, pool_memory, sizeof(pool_memory));
+    TEST_ASSERT(nxd_mqtt_fake_create(&client, &pool, ROUND_TRIP_TICKS) == NX_SUCCESS);
+
+    test_ordered_completion();
+    test_timeout_and_abort();
+
+    rate_1 = throughput_run(1, messages);
+    throughput_run(4, messages);
+    rate_16 = throughput_run(16, messages);
+
+    // A full window keeps 16 messages in flight per round trip rather than one
+    TEST_ASSERT(rate_16 > rate_1 * 4);
+
+    nxd_mqtt_fake_delete(&client);
+
+    return 0;
+}
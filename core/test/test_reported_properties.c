@@ -0,0 +1,174 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// Staging and merging of reported properties: a value set again replaces the pending one, each
+// component goes out as one object, and only what the hub accepted is cleared, so a value set
+// between building a patch and its acceptance goes out with the next one.
+
+#include <string.h>
+
+#include "reported_properties.h"
+
+#include "test_common.h"
+
+static REPORTED_PROPERTIES properties;
+static bool created;
+static UINT due_count;
+
+static VOID due(VOID* context)
+{
+    TEST_ASSERT(context == &properties);
+
+    due_count++;
+}
+
+// The pending patch must be exactly expected
+static ULONG patch_check(const CHAR* expected)
+{
+    CHAR buffer[256];
+    ULONG sequence;
+    UINT length;
+
+    TEST_ASSERT(reported_properties_build(&properties, buffer, sizeof(buffer), &length, &sequence) == NX_SUCCESS);
+    if (strcmp(buffer, expected) != 0)
+    {
+        printf("patch: %s\n", buffer);
+        TEST_ASSERT(0);
+    }
+    TEST_ASSERT(length == strlen(expected));
+
+    return sequence;
+}
+
+static VOID properties_reset(VOID)
+{
+    if (created)
+    {
+        reported_properties_delete(&properties);
+    }
+
+    created   = true;
+    due_count = 0;
+
+    // No window, every change is due straight away
+    TEST_ASSERT(reported_properties_create(&properties, "test", 0, due, &properties) == NX_SUCCESS);
+    TEST_ASSERT(reported_properties_is_empty(&properties));
+}
+
+static VOID test_replace(VOID)
+{
+    REPORTED_PROPERTIES_METRICS metrics;
+
+    properties_reset();
+
+    TEST_ASSERT(reported_properties_set_int(&properties, NX_NULL, "interval", 10) == NX_SUCCESS);
+    TEST_ASSERT(reported_properties_set_int(&properties, NX_NULL, "interval", 20) == NX_SUCCESS);
+    TEST_ASSERT(due_count == 2);
+
+    patch_check("{\"interval\":20}");
+
+    reported_properties_metrics_get(&properties, &metrics);
+    TEST_ASSERT(metrics.updates == 2);
+    TEST_ASSERT(metrics.coalesced == 1);
+}
+
+static VOID test_components(VOID)
+{
+    ULONG sequence;
+
+    properties_reset();
+
+    TEST_ASSERT(reported_properties_set_int(&properties, "thermostat1", "maxTemp", 21) == NX_SUCCESS);
+    TEST_ASSERT(reported_properties_set_bool(&properties, NX_NULL, "led", true) == NX_SUCCESS);
+    TEST_ASSERT(reported_properties_set_int(&properties, "thermostat2", "maxTemp", 3) == NX_SUCCESS);
+    TEST_ASSERT(reported_properties_set_string(&properties, "thermostat1", "mode", "heat") == NX_SUCCESS);
+    TEST_ASSERT(reported_properties_set_writeable(&properties, "", "interval", 5, 200, 7) == NX_SUCCESS);
+
+    sequence = patch_check("{\"led\":true,\"interval\":{\"value\":5,\"ac\":200,\"av\":7},"
+                           "\"thermostat1\":{\"__t\":\"c\",\"maxTemp\":21,\"mode\":\"heat\"},"
+                           "\"thermostat2\":{\"__t\":\"c\",\"maxTemp\":3}}");
+
+    reported_properties_sent(&properties, sequence);
+    TEST_ASSERT(reported_properties_is_empty(&properties));
+}
+
+static VOID test_set_while_sending(VOID)
+{
+    REPORTED_PROPERTIES_METRICS metrics;
+    CHAR buffer[64];
+    ULONG sequence;
+    UINT length;
+
+    properties_reset();
+
+    TEST_ASSERT(reported_properties_set_int(&properties, NX_NULL, "a", 1) == NX_SUCCESS);
+    TEST_ASSERT(reported_properties_set_int(&properties, NX_NULL, "b", 2) == NX_SUCCESS);
+    sequence = patch_check("{\"a\":1,\"b\":2}");
+
+    // Set again while the patch is on its way, the hub never saw this value
+    TEST_ASSERT(reported_properties_set_int(&properties, NX_NULL, "a", 3) == NX_SUCCESS);
+
+    reported_properties_sent(&properties, sequence);
+    TEST_ASSERT(!reported_properties_is_empty(&properties));
+    sequence = patch_check("{\"a\":3}");
+
+    reported_properties_sent(&properties, sequence);
+    TEST_ASSERT(reported_properties_is_empty(&properties));
+    TEST_ASSERT(reported_properties_build(&properties, buffer, sizeof(buffer), &length, &sequence) == NX_NOT_FOUND);
+
+    reported_properties_metrics_get(&properties, &metrics);
+    TEST_ASSERT(metrics.patches == 2);
+}
+
+static VOID test_too_large(VOID)
+{
+    CHAR buffer[16];
+    ULONG sequence;
+    UINT length;
+
+    properties_reset();
+
+    TEST_ASSERT(reported_properties_set_string(&properties, "thermostat1", "mode", "heat") == NX_SUCCESS);
+    TEST_ASSERT(reported_properties_build(&properties, buffer, sizeof(buffer), &length, &sequence) == NX_SIZE_ERROR);
+
+    // Still pending, a larger buffer takes it
+    TEST_ASSERT(!reported_properties_is_empty(&properties));
+    patch_check("{\"thermostat1\":{\"__t\":\"c\",\"mode\":\"heat\"}}");
+}
+
+static VOID test_full(VOID)
+{
+    REPORTED_PROPERTIES_METRICS metrics;
+    CHAR name[REPORTED_PROPERTIES_NAME_SIZE];
+
+    properties_reset();
+
+    for (UINT i = 0; i < REPORTED_PROPERTIES_MAX; i++)
+    {
+        snprintf(name, sizeof(name), "p%u", i);
+        TEST_ASSERT(reported_properties_set_int(&properties, NX_NULL, name, i) == NX_SUCCESS);
+    }
+
+    TEST_ASSERT(reported_properties_set_int(&properties, NX_NULL, "extra", 1) == NX_NO_MORE_ENTRIES);
+    TEST_ASSERT(reported_properties_set_int(&properties, "thermostat1", "p0", 1) == NX_NO_MORE_ENTRIES);
+
+    // A property already waiting can still be updated
+    TEST_ASSERT(reported_properties_set_int(&properties, NX_NULL, "p0", 100) == NX_SUCCESS);
+
+    reported_properties_metrics_get(&properties, &metrics);
+    TEST_ASSERT(metrics.rejected == 2);
+    TEST_ASSERT(metrics.coalesced == 1);
+}
+
+int main(VOID)
+{
+    test_replace();
+    test_components();
+    test_set_while_sending();
+    test_too_large();
+    test_full();
+
+    reported_properties_delete(&properties);
+
+    return 0;
+}
@@ -0,0 +1,143 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// SHA-256 against the FIPS 180-2 example messages, fed whole and in uneven pieces, plus the
+// compressor hook receiving whole blocks in place.
+
+#include <string.h>
+
+#include "sha256.h"
+
+#include "test_common.h"
+
+static const char* vector_448 = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+static const char* vector_896 = "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmno"
+                                "ijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu";
+
+static size_t compress_calls;
+static size_t compress_blocks;
+
+static void digest_hex(const unsigned char digest[SHA256_DIGEST_SIZE], char hex[SHA256_DIGEST_SIZE * 2 + 1])
+{
+    for (int i = 0; i < SHA256_DIGEST_SIZE; i++)
+    {
+        snprintf(hex + i * 2, 3, "%02x", digest[i]);
+    }
+}
+
+// Feeds the message in pieces of chunk bytes, 0 for all at once
+static void hash(const unsigned char* data, size_t size, size_t chunk, char hex[SHA256_DIGEST_SIZE * 2 + 1])
+{
+    sha256_t context;
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    size_t offset = 0;
+
+    sha256_init(&context);
+
+    if (chunk == 0)
+    {
+        chunk = size;
+    }
+
+    while (offset < size)
+    {
+        size_t piece = size - offset < chunk ? size - offset : chunk;
+
+        sha256_update(&context, data + offset, piece);
+        offset += piece;
+    }
+
+    sha256_final(&context, digest);
+    digest_hex(digest, hex);
+}
+
+static void check_vector(const char* message, const char* expected)
+{
+    static const size_t chunks[] = {0, 1, 7, 37, 63, 64, 65};
+    char hex[SHA256_DIGEST_SIZE * 2 + 1];
+
+    for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++)
+    {
+        hash((const unsigned char*)message, strlen(message), chunks[i], hex);
+        TEST_ASSERT(strcmp(hex, expected) == 0);
+    }
+}
+
+static void test_nist_vectors(void)
+{
+    static unsigned char million_a[1000000];
+    char hex[SHA256_DIGEST_SIZE * 2 + 1];
+
+    check_vector("", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    check_vector("abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    check_vector(vector_448, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    check_vector(vector_896, "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1");
+
+    memset(million_a, 'a', sizeof(million_a));
+    hash(million_a, sizeof(million_a), 0, hex);
+    TEST_ASSERT(strcmp(hex, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0") == 0);
+    hash(million_a, sizeof(million_a), 37, hex);
+    TEST_ASSERT(strcmp(hex, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0") == 0);
+}
+
+// Every length around the padding boundaries gives the same digest however it is split
+static void test_split_consistency(void)
+{
+    unsigned char message[200];
+    char whole[SHA256_DIGEST_SIZE * 2 + 1];
+    char split[SHA256_DIGEST_SIZE * 2 + 1];
+
+    for (size_t i = 0; i < sizeof(message); i++)
+    {
+        message[i] = (unsigned char)(i * 31 + 7);
+    }
+
+    for (size_t size = 0; size <= sizeof(message); size++)
+    {
+        hash(message, size, 0, whole);
+
+        for (size_t chunk = 1; chunk <= 70; chunk++)
+        {
+            hash(message, size, chunk, split);
+            TEST_ASSERT(strcmp(whole, split) == 0);
+        }
+    }
+}
+
+static void counting_compress(uint32_t state[8], const unsigned char* blocks, size_t block_count)
+{
+    (void)state;
+    (void)blocks;
+
+    compress_calls++;
+    compress_blocks += block_count;
+}
+
+static void test_compress_hook(void)
+{
+    static unsigned char message[1000];
+    sha256_t context;
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    char hex[SHA256_DIGEST_SIZE * 2 + 1];
+
+    // 15 whole blocks go through in one call straight from the input, the tail and padding in another
+    sha256_set_compress(counting_compress);
+    sha256_init(&context);
+    sha256_update(&context, message, sizeof(message));
+    sha256_final(&context, digest);
+    TEST_ASSERT(compress_calls == 2);
+    TEST_ASSERT(compress_blocks == 16);
+
+    sha256_set_compress(NULL);
+    hash((const unsigned char*)"abc", 3, 0, hex);
+    TEST_ASSERT(strcmp(hex, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad") == 0);
+}
+
+int main(void)
+{
+    test_nist_vectors();
+    test_split_consistency();
+    test_compress_hook();
+
+    return 0;
+}
@@ -0,0 +1,296 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// Store and forward queue: records are held until acknowledged, the drop policy picks what is spilled
+// and spilled records replay in the configured order.
+
+#include <string.h>
+
+#include "azure_iot_mqtt_publish.h"
+#include "store_forward.h"
+
+#include "test_common.h"
+
+#define RECORD_COUNT  3
+#define BACKEND_COUNT 8
+
+typedef struct BACKEND_STRUCT
+{
+    STORE_FORWARD_RECORD records[BACKEND_COUNT];
+    UINT head;
+    UINT count;
+} BACKEND;
+
+static STORE_FORWARD_QUEUE queue;
+static STORE_FORWARD_RECORD records[RECORD_COUNT];
+
+static BACKEND backend_storage;
+static STORE_FORWARD_BACKEND backend;
+
+static CHAR sent_data[32][8];
+static UINT sent_count;
+static UINT send_status;
+
+static UINT backend_write(VOID* context, const STORE_FORWARD_RECORD* record)
+{
+    BACKEND* storage = (BACKEND*)context;
+
+    if (storage->count == BACKEND_COUNT)
+    {
+        return NX_NO_MORE_ENTRIES;
+    }
+
+    storage->records[(storage->head + storage->count++) % BACKEND_COUNT] = *record;
+
+    return NX_SUCCESS;
+}
+
+static UINT backend_peek(VOID* context, STORE_FORWARD_RECORD* record)
+{
+    BACKEND* storage = (BACKEND*)context;
+
+    if (storage->count == 0)
+    {
+        return NX_NOT_FOUND;
+    }
+
+    *record = storage->records[storage->head];
+
+    return NX_SUCCESS;
+}
+
+static UINT backend_pop(VOID* context)
+{
+    BACKEND* storage = (BACKEND*)context;
+
+    storage->head = (storage->head + 1) % BACKEND_COUNT;
+    storage->count--;
+
+    return NX_SUCCESS;
+}
+
+static UINT record_send(VOID* context, UCHAR* data, UINT length)
+{
+    if (send_status != NX_SUCCESS)
+    {
+        return send_status;
+    }
+
+    TEST_ASSERT(length < sizeof(sent_data[0]));
+    memcpy(sent_data[sent_count], data, length);
+    sent_data[sent_count++][length] = 0;
+
+    return NX_SUCCESS;
+}
+
+static VOID queue_create(UINT drop_policy, UINT replay_order, bool with_backend)
+{
+    STORE_FORWARD_CONFIG config = {drop_policy, replay_order, 8, 0};
+
+    memset(&backend_storage, 0, sizeof(backend_storage));
+    backend.write   = backend_write;
+    backend.peek    = backend_peek;
+    backend.pop     = backend_pop;
+    backend.context = &backend_storage;
+
+    TEST_ASSERT(store_forward_create(&queue, records, RECORD_COUNT, &config) == NX_SUCCESS);
+    TEST_ASSERT(store_forward_backend_set(&queue, with_backend ? &backend : NX_NULL) == NX_SUCCESS);
+
+    sent_count  = 0;
+    send_status = NX_SUCCESS;
+}
+
+static VOID enqueue(const CHAR* data, UINT priority, UINT expected)
+{
+    TEST_ASSERT(store_forward_enqueue(&queue, (const UCHAR*)data, strlen(data), priority) == expected);
+}
+
+static VOID test_held_until_acknowledged(VOID)
+{
+    STORE_FORWARD_STATS stats;
+
+    queue_create(STORE_FORWARD_DROP_OLDEST, STORE_FORWARD_REPLAY_FIFO, false);
+    enqueue("a", STORE_FORWARD_PRIORITY_NORMAL, NX_SUCCESS);
+    enqueue("b", STORE_FORWARD_PRIORITY_NORMAL, NX_SUCCESS);
+
+    // Handed over but not acknowledged, both are still stored and not sent twice
+    TEST_ASSERT(store_forward_drain(&queue, record_send, NX_NULL) == NX_SUCCESS);
+    TEST_ASSERT(store_forward_drain(&queue, record_send, NX_NULL) == NX_SUCCESS);
+    TEST_ASSERT(sent_count == 2);
+    TEST_ASSERT(!store_forward_is_empty(&queue));
+
+    // Completions settle the oldest send first, a failed one is sent again
+    TEST_ASSERT(store_forward_complete(&queue, NX_SUCCESS) == NX_SUCCESS);
+    TEST_ASSERT(store_forward_complete(&queue, NX_NOT_SUCCESSFUL) == NX_SUCCESS);
+    TEST_ASSERT(store_forward_complete(&queue, NX_SUCCESS) == NX_NOT_FOUND);
+
+    TEST_ASSERT(store_forward_drain(&queue, record_send, NX_NULL) == NX_SUCCESS);
+    TEST_ASSERT(sent_count == 3);
+    TEST_ASSERT(strcmp(sent_data[2], "b") == 0);
+    TEST_ASSERT(store_forward_complete(&queue, NX_SUCCESS) == NX_SUCCESS);
+    TEST_ASSERT(store_forward_is_empty(&queue));
+
+    store_forward_stats_get(&queue, &stats);
+    TEST_ASSERT(stats.sent == 2);
+
+    // A failed send leaves the record queued
+    enqueue("c", STORE_FORWARD_PRIORITY_NORMAL, NX_SUCCESS);
+    send_status = NX_NOT_CONNECTED;
+    TEST_ASSERT(store_forward_drain(&queue, record_send, NX_NULL) == NX_NOT_CONNECTED);
+    TEST_ASSERT(store_forward_complete(&queue, NX_SUCCESS) == NX_NOT_FOUND);
+
+    store_forward_delete(&queue);
+}
+
+static VOID test_in_flight_not_dropped(VOID)
+{
+    STORE_FORWARD_STATS stats;
+
+    queue_create(STORE_FORWARD_DROP_OLDEST, STORE_FORWARD_REPLAY_FIFO, false);
+    enqueue("a", STORE_FORWARD_PRIORITY_NORMAL, NX_SUCCESS);
+    TEST_ASSERT(store_forward_drain(&queue, record_send, NX_NULL) == NX_SUCCESS);
+
+    enqueue("b", STORE_FORWARD_PRIORITY_NORMAL, NX_SUCCESS);
+    enqueue("c", STORE_FORWARD_PRIORITY_NORMAL, NX_SUCCESS);
+
+    // a is in flight, so b is the oldest record that can go
+    enqueue("d", STORE_FORWARD_PRIORITY_NORMAL, NX_SUCCESS);
+    TEST_ASSERT(store_forward_complete(&queue, NX_SUCCESS) == NX_SUCCESS);
+
+    TEST_ASSERT(store_forward_drain(&queue, record_send, NX_NULL) == NX_SUCCESS);
+    TEST_ASSERT(sent_count == 3);
+    TEST_ASSERT(strcmp(sent_data[1], "c") == 0);
+    TEST_ASSERT(strcmp(sent_data[2], "d") == 0);
+
+    store_forward_stats_get(&queue, &stats);
+    TEST_ASSERT(stats.dropped == 1);
+
+    store_forward_delete(&queue);
+}
+
+static VOID test_spill_lowest_priority(VOID)
+{
+    queue_create(STORE_FORWARD_DROP_LOWEST_PRIORITY, STORE_FORWARD_REPLAY_PRIORITY, true);
+    enqueue("n1", STORE_FORWARD_PRIORITY_NORMAL, NX_SUCCESS);
+    enqueue("l1", STORE_FORWARD_PRIORITY_LOW, NX_SUCCESS);
+    enqueue("h1", STORE_FORWARD_PRIORITY_HIGH, NX_SUCCESS);
+
+    // The low priority record goes to the backend, not the oldest one
+    enqueue("h2", STORE_FORWARD_PRIORITY_HIGH, NX_SUCCESS);
+    TEST_ASSERT(backend_storage.count == 1);
+    TEST_ASSERT(memcmp(backend_storage.records[0].data, "l1", 2) == 0);
+
+    // An incoming record that ranks lowest is spilled itself
+    enqueue("l2", STORE_FORWARD_PRIORITY_LOW, NX_SUCCESS);
+    TEST_ASSERT(backend_storage.count == 2);
+    TEST_ASSERT(memcmp(backend_storage.records[1].data, "l2", 2) == 0);
+
+    TEST_ASSERT(store_forward_drain(&queue, record_send, NX_NULL) == NX_SUCCESS);
+    while (store_forward_complete(&queue, NX_SUCCESS) == NX_SUCCESS)
+    {
+        TEST_ASSERT(store_forward_drain(&queue, record_send, NX_NULL) == NX_SUCCESS);
+    }
+
+    TEST_ASSERT(sent_count == 5);
+    TEST_ASSERT(strcmp(sent_data[0], "h1") == 0);
+    TEST_ASSERT(strcmp(sent_data[1], "h2") == 0);
+    TEST_ASSERT(strcmp(sent_data[2], "n1") == 0);
+    TEST_ASSERT(strcmp(sent_data[3], "l1") == 0);
+    TEST_ASSERT(strcmp(sent_data[4], "l2") == 0);
+    TEST_ASSERT(store_forward_is_empty(&queue));
+
+    store_forward_delete(&queue);
+}
+
+static VOID test_spilled_replay_by_priority(VOID)
+{
+    queue_create(STORE_FORWARD_DROP_OLDEST, STORE_FORWARD_REPLAY_PRIORITY, true);
+    enqueue("h1", STORE_FORWARD_PRIORITY_HIGH, NX_SUCCESS);
+    enqueue("n1", STORE_FORWARD_PRIORITY_NORMAL, NX_SUCCESS);
+    enqueue("n2", STORE_FORWARD_PRIORITY_NORMAL, NX_SUCCESS);
+    enqueue("n3", STORE_FORWARD_PRIORITY_NORMAL, NX_SUCCESS);
+    TEST_ASSERT(backend_storage.count == 1);
+
+    // The spilled high priority record goes first even though RAM is not empty
+    TEST_ASSERT(store_forward_drain(&queue, record_send, NX_NULL) == NX_SUCCESS);
+    TEST_ASSERT(sent_count == 1);
+    TEST_ASSERT(strcmp(sent_data[0], "h1") == 0);
+
+    TEST_ASSERT(store_forward_complete(&queue, NX_SUCCESS) == NX_SUCCESS);
+    TEST_ASSERT(backend_storage.count == 0);
+
+    TEST_ASSERT(store_forward_drain(&queue, record_send, NX_NULL) == NX_SUCCESS);
+    TEST_ASSERT(sent_count == 4);
+    TEST_ASSERT(strcmp(sent_data[1], "n1") == 0);
+
+    store_forward_delete(&queue);
+}
+
+// Records replayed through the QoS 1 window are released by the PUBACK
+static NXD_MQTT_CLIENT client;
+static AZURE_IOT_MQTT_PUBLISH_WINDOW window;
+
+static VOID window_complete(VOID* context, UINT status)
+{
+    store_forward_complete(&queue, status);
+}
+
+static UINT window_send(VOID* context, UCHAR* data, UINT length)
+{
+    return azure_iot_mqtt_publish_window_send(
+        &window, &client, "topic", 5, (CHAR*)data, length, window_complete, NX_NULL);
+}
+
+static VOID test_released_on_puback(VOID)
+{
+    static UCHAR pool_memory[16 * 128];
+    NX_PACKET_POOL pool;
+    STORE_FORWARD_STATS stats;
+    ULONG deadline;
+
+    nx_packet_pool_create(&pool, "pool", 64, pool_memory, sizeof(pool_memory));
+    TEST_ASSERT(nxd_mqtt_fake_create(&client, &pool, 2) == NX_SUCCESS);
+    TEST_ASSERT(azure_iot_mqtt_publish_window_init(&window, 4, TX_TIMER_TICKS_PER_SECOND) == NX_SUCCESS);
+
+    queue_create(STORE_FORWARD_DROP_OLDEST, STORE_FORWARD_REPLAY_FIFO, false);
+    enqueue("a", STORE_FORWARD_PRIORITY_NORMAL, NX_SUCCESS);
+    enqueue("b", STORE_FORWARD_PRIORITY_NORMAL, NX_SUCCESS);
+
+    // Queued in NetX is not delivered, a disconnect puts both back
+    nxd_mqtt_fake_pause(&client, NX_TRUE);
+    TEST_ASSERT(store_forward_drain(&queue, window_send, NX_NULL) == NX_SUCCESS);
+    azure_iot_mqtt_publish_window_abort(&window, &client, NX_NOT_CONNECTED);
+    nxd_mqtt_fake_reconnect(&client);
+    store_forward_stats_get(&queue, &stats);
+    TEST_ASSERT(stats.sent == 0);
+    TEST_ASSERT(queue.used == 2);
+
+    nxd_mqtt_fake_pause(&client, NX_FALSE);
+    TEST_ASSERT(store_forward_drain(&queue, window_send, NX_NULL) == NX_SUCCESS);
+
+    deadline = tx_time_get() + 5 * TX_TIMER_TICKS_PER_SECOND;
+    while (!store_forward_is_empty(&queue))
+    {
+        TEST_ASSERT(tx_time_get() < deadline);
+        tx_thread_sleep(1);
+        azure_iot_mqtt_publish_window_process(&window, &client);
+    }
+
+    store_forward_stats_get(&queue, &stats);
+    TEST_ASSERT(stats.sent == 2);
+    TEST_ASSERT(client.nxd_mqtt_fake_acknowledged == 2);
+
+    store_forward_delete(&queue);
+    nxd_mqtt_fake_delete(&client);
+}
+
+int main(VOID)
+{
+    test_held_until_acknowledged();
+    test_in_flight_not_dropped();
+    test_spill_lowest_priority();
+    test_spilled_replay_by_priority();
+    test_released_on_puback();
+
+    return 0;
+}
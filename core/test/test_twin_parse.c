@@ -0,0 +1,244 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+// A twin document gives the same desired properties however it is split across the packets of a chain.
+// Names are read in place, only a name that straddles two packets is copied, and one longer than the copy
+// buffer fails the parse rather than being cut short.
+
+#include <string.h>
+
+#include "nx_azure_iot_pnp_helpers.h"
+
+#include "test_common.h"
+
+#define PAYLOAD_SIZE 256
+
+static NX_PACKET_POOL packet_pool;
+
+static CHAR parse_log[1024];
+
+// The single packet being parsed, names read in place must lie inside it
+static UCHAR* in_place_start;
+static UCHAR* in_place_end;
+
+static CHAR* components[] = {"thermostat1"};
+
+UINT nx_azure_iot_hub_client_telemetry_message_create(
+    NX_AZURE_IOT_HUB_CLIENT* hub_client_ptr, NX_PACKET** packet_pptr, UINT wait_option)
+{
+    (VOID) hub_client_ptr;
+
+    return nx_packet_allocate(&packet_pool, packet_pptr, 0, wait_option);
+}
+
+UINT nx_azure_iot_hub_client_telemetry_message_delete(NX_PACKET* packet_ptr)
+{
+    return nx_packet_release(packet_ptr);
+}
+
+UINT nx_azure_iot_hub_client_telemetry_property_add(NX_PACKET* packet_ptr,
+    const UCHAR* property_name,
+    USHORT property_name_length,
+    const UCHAR* property_value,
+    USHORT property_value_length,
+    UINT wait_option)
+{
+    (VOID) packet_ptr;
+    (VOID) property_name;
+    (VOID) property_name_length;
+    (VOID) property_value;
+    (VOID) property_value_length;
+    (VOID) wait_option;
+
+    return NX_AZURE_IOT_SUCCESS;
+}
+
+// Records "component/name=value@version;" for each desired property
+static VOID property_record(UCHAR* component_name_ptr,
+    UINT component_name_len,
+    UCHAR* property_name_ptr,
+    UINT property_name_len,
+    NX_AZURE_IOT_JSON_READER property_value_reader,
+    UINT version,
+    VOID* context)
+{
+    CHAR value[64];
+    UINT length;
+    int32_t number;
+    size_t used = strlen(parse_log);
+
+    TEST_ASSERT(context == &packet_pool);
+
+    if (in_place_start != NX_NULL)
+    {
+        TEST_ASSERT(property_name_ptr >= in_place_start && property_name_ptr + property_name_len <= in_place_end);
+    }
+
+    switch (nx_azure_iot_json_reader_token_type(&property_value_reader))
+    {
+        case NX_AZURE_IOT_READER_TOKEN_NUMBER:
+            TEST_ASSERT(nx_azure_iot_json_reader_token_int32_get(&property_value_reader, &number) ==
+                        NX_AZURE_IOT_SUCCESS);
+            snprintf(value, sizeof(value), "%d", (INT)number);
+            break;
+
+        case NX_AZURE_IOT_READER_TOKEN_STRING:
+            TEST_ASSERT(nx_azure_iot_json_reader_token_string_get(
+                            &property_value_reader, (UCHAR*)value, sizeof(value), &length) == NX_AZURE_IOT_SUCCESS);
+            break;
+
+        case NX_AZURE_IOT_READER_TOKEN_BEGIN_OBJECT:
+            strcpy(value, "{}");
+            break;
+
+        default:
+            strcpy(value, "?");
+            break;
+    }
+
+    snprintf(&parse_log[used],
+        sizeof(parse_log) - used,
+        "%.*s/%.*s=%s@%u;",
+        (INT)component_name_len,
+        component_name_ptr != NX_NULL ? (CHAR*)component_name_ptr : "",
+        (INT)property_name_len,
+        (CHAR*)property_name_ptr,
+        value,
+        version);
+}
+
+// The document in a chain whose first packet holds first bytes and the others rest bytes each
+static NX_PACKET* chain_create(const CHAR* document, UINT first, UINT rest)
+{
+    NX_PACKET* head  = NX_NULL;
+    NX_PACKET** link = &head;
+    UINT length      = (UINT)strlen(document);
+    UINT offset      = 0;
+    UINT size        = first;
+
+    while (offset < length)
+    {
+        if (size > length - offset)
+        {
+            size = length - offset;
+        }
+
+        TEST_ASSERT(size <= PAYLOAD_SIZE);
+        TEST_ASSERT(nx_packet_allocate(&packet_pool, link, 0, NX_NO_WAIT) == NX_SUCCESS);
+        memcpy((*link)->nx_packet_append_ptr, &document[offset], size);
+        (*link)->nx_packet_append_ptr += size;
+
+        offset += size;
+        link = &(*link)->nx_packet_next;
+        size = rest;
+    }
+
+    head->nx_packet_length = length;
+
+    return head;
+}
+
+// Parses the chain, which the reader owns from here, and returns the parse status
+static UINT parse(NX_PACKET* packet, UINT is_partial)
+{
+    NX_AZURE_IOT_JSON_READER reader;
+    UINT status;
+
+    parse_log[0]   = 0;
+    in_place_start = NX_NULL;
+    if (packet->nx_packet_next == NX_NULL)
+    {
+        in_place_start = packet->nx_packet_prepend_ptr;
+        in_place_end   = packet->nx_packet_append_ptr;
+    }
+
+    TEST_ASSERT(nx_azure_iot_json_reader_init(&reader, packet) == NX_AZURE_IOT_SUCCESS);
+    status = nx_azure_iot_pnp_helper_twin_data_parse(
+        &reader, is_partial, components, sizeof(components) / sizeof(components[0]), property_record, &packet_pool);
+    nx_azure_iot_json_reader_deinit(&reader);
+
+    TEST_ASSERT(packet_pool.nx_packet_pool_available == packet_pool.nx_packet_pool_total);
+
+    return status;
+}
+
+// Every split of the document, from a one byte first packet on, parses as the whole one does
+static VOID test_splits(const CHAR* document, UINT is_partial, const CHAR* expected)
+{
+    UINT length = (UINT)strlen(document);
+    UINT first;
+    UINT rest;
+
+    TEST_ASSERT(parse(chain_create(document, length, 0), is_partial) == NX_AZURE_IOT_SUCCESS);
+    TEST_ASSERT(strcmp(parse_log, expected) == 0);
+
+    for (first = 1; first < length; first++)
+    {
+        // Short enough packets that most tokens straddle one, few enough for the reader
+        rest = (length - first + NX_AZURE_IOT_READER_MAX_LIST - 2) / (NX_AZURE_IOT_READER_MAX_LIST - 1);
+
+        TEST_ASSERT(parse(chain_create(document, first, rest), is_partial) == NX_AZURE_IOT_SUCCESS);
+        if (strcmp(parse_log, expected) != 0)
+        {
+            printf("split %u/%u: %s\n", first, rest, parse_log);
+            TEST_ASSERT(0);
+        }
+    }
+}
+
+static VOID test_full_twin(VOID)
+{
+    test_splits("{\"reported\":{\"ledLabel\":\"hall\",\"nested\":{\"x\":1},\"$version\":3},"
+                "\"desired\":{\"thermostat1\":{\"__t\":\"c\",\"targetTemperature\":21},\"telemetryInterval\":10,"
+                "\"nested\":{\"a\":{\"b\":1}},\"ledLabel\":\"kitchen\",\"$version\":7}}",
+        0,
+        "thermostat1/targetTemperature=21@7;/telemetryInterval=10@7;/nested={}@7;/ledLabel=kitchen@7;");
+}
+
+static VOID test_partial_patch(VOID)
+{
+    test_splits("{\"thermostat1\":{\"__t\":\"c\",\"targetTemperature\":22},\"telemetryInterval\":5,\"$version\":8}",
+        1,
+        "thermostat1/targetTemperature=22@8;/telemetryInterval=5@8;");
+}
+
+static VOID test_long_names(VOID)
+{
+    CHAR name[NX_AZURE_IOT_PNP_PROPERTY_NAME_SIZE + 2];
+    CHAR document[sizeof(name) + 32];
+    CHAR expected[sizeof(name) + 8];
+
+    // As long as the copy buffer, straddling two packets
+    memset(name, 'n', NX_AZURE_IOT_PNP_PROPERTY_NAME_SIZE);
+    name[NX_AZURE_IOT_PNP_PROPERTY_NAME_SIZE] = 0;
+    snprintf(document, sizeof(document), "{\"%s\":1,\"$version\":2}", name);
+    snprintf(expected, sizeof(expected), "/%s=1@2;", name);
+
+    TEST_ASSERT(parse(chain_create(document, 12, PAYLOAD_SIZE), 1) == NX_AZURE_IOT_SUCCESS);
+    TEST_ASSERT(strcmp(parse_log, expected) == 0);
+
+    // Longer, read in place from a single packet
+    strcat(name, "n");
+    snprintf(document, sizeof(document), "{\"%s\":1,\"$version\":2}", name);
+    snprintf(expected, sizeof(expected), "/%s=1@2;", name);
+
+    TEST_ASSERT(parse(chain_create(document, PAYLOAD_SIZE, 0), 1) == NX_AZURE_IOT_SUCCESS);
+    TEST_ASSERT(strcmp(parse_log, expected) == 0);
+
+    // Longer and straddling, the name cannot be put together so the parse fails
+    TEST_ASSERT(parse(chain_create(document, 12, PAYLOAD_SIZE), 1) == NX_NOT_SUCCESSFUL);
+    TEST_ASSERT(parse_log[0] == 0);
+}
+
+int main(VOID)
+{
+    static UCHAR pool_memory[32 * (PAYLOAD_SIZE + sizeof(NX_PACKET))];
+
+    nx_packet_pool_create(&packet_pool, "pool", PAYLOAD_SIZE, pool_memory, sizeof(pool_memory));
+
+    test_full_twin();
+    test_partial_patch();
+    test_long_names();
+
+    return 0;
+}